@@ -13,10 +13,18 @@ See the file COPYING for details.
 #include "xxmalloc.h"
 #include "path.h"
 #include "hash_table.h"
+#include "buffer.h"
+#include "debug.h"
+#include "macros.h"
 
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
 #include <time.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <dirent.h>
 
 struct hash_table *check_sums = NULL;
@@ -52,6 +60,7 @@ void batch_file_delete(struct batch_file *f)
 
 	free(f->outer_name);
 	free(f->inner_name);
+	free(f->hash);
 
 	free(f);
 }
@@ -98,95 +107,291 @@ int batch_file_outer_compare(struct batch_file *file1, struct batch_file *file2)
 	return strcmp(file1->outer_name, file2->outer_name);
 }
 
+/*
+Checksums are kept by the device, inode, size, and modification time
+of each file, so that a file is hashed again only if it may have changed,
+and so that a file is not hashed twice under different names.  If a
+cache file is given, the checksums are also appended to it and loaded
+by later runs.  The table is shared by threads hashing in parallel.
+*/
+
+static pthread_mutex_t check_sums_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct hash_table *dir_check_sums = NULL;
+static FILE *check_sums_cache = NULL;
+
+#define BATCH_FILE_CHECKSUM_THREADS 8
+
+static char *checksum_key(const struct stat *info)
+{
+#if defined(CCTOOLS_OPSYS_DARWIN)
+	const struct timespec *mtime = &info->st_mtimespec;
+#else
+	const struct timespec *mtime = &info->st_mtim;
+#endif
+	return string_format("%llu:%llu:%lld:%lld.%09ld",
+			(unsigned long long)info->st_dev,
+			(unsigned long long)info->st_ino,
+			(long long)info->st_size,
+			(long long)mtime->tv_sec,
+			(long)mtime->tv_nsec);
+}
+
+void batch_file_set_checksum_cache(const char *filename)
+{
+	pthread_mutex_lock(&check_sums_mutex);
+
+	if (check_sums == NULL) {
+		check_sums = hash_table_create(0, 0);
+	}
+
+	if (check_sums_cache) {
+		fclose(check_sums_cache);
+		check_sums_cache = NULL;
+	}
+
+	FILE *file = fopen(filename, "r");
+	if (file) {
+		char key[256];
+		char value[SHA1_DIGEST_LENGTH * 2 + 1];
+		int count = 0;
+		/* A line cut short by a crash does not match and is skipped. */
+		while (fscanf(file, "%255s %40s\n", key, value) == 2) {
+			if (strlen(value) == SHA1_DIGEST_LENGTH * 2 && !hash_table_lookup(check_sums, key)) {
+				hash_table_insert(check_sums, key, xxstrdup(value));
+				count++;
+			}
+		}
+		fclose(file);
+		debug(D_MAKEFLOW, "loaded %d checksums from %s", count, filename);
+	}
+
+	check_sums_cache = fopen(filename, "a");
+	if (!check_sums_cache) {
+		debug(D_MAKEFLOW, "couldn't open checksum cache %s: %s", filename, strerror(errno));
+	}
+
+	pthread_mutex_unlock(&check_sums_mutex);
+}
+
+/* Return the checksum of the contents of a file, from the cache if unchanged. */
+
+static char *batch_file_checksum(const char *path)
+{
+	struct stat info;
+	if (stat(path, &info) < 0) {
+		debug(D_MAKEFLOW, "Unable to checksum this file: %s", path);
+		return NULL;
+	}
+
+	char *key = checksum_key(&info);
+
+	pthread_mutex_lock(&check_sums_mutex);
+	if (check_sums == NULL) {
+		check_sums = hash_table_create(0, 0);
+	}
+	char *value = hash_table_lookup(check_sums, key);
+	if (value) {
+		value = xxstrdup(value);
+	}
+	pthread_mutex_unlock(&check_sums_mutex);
+
+	if (value) {
+		debug(D_MAKEFLOW, "Checksum already exists in hash table. Cached CHECKSUM hash of %s is: %s", path, value);
+		free(key);
+		return value;
+	}
+
+	unsigned char hash[SHA1_DIGEST_LENGTH];
+	struct timeval start_time;
+	struct timeval end_time;
+
+	gettimeofday(&start_time, NULL);
+	int success = sha1_file(path, hash);
+	gettimeofday(&end_time, NULL);
+	double run_time = ((end_time.tv_sec * 1000000 + end_time.tv_usec) - (start_time.tv_sec * 1000000 + start_time.tv_usec)) / 1000000.0;
+
+	if (success == 0) {
+		debug(D_MAKEFLOW, "Unable to checksum this file: %s", path);
+		free(key);
+		return NULL;
+	}
+
+	value = xxstrdup(sha1_string(hash));
+
+	pthread_mutex_lock(&check_sums_mutex);
+	total_checksum_time += run_time;
+	debug(D_MAKEFLOW_HOOK, " The total checksum time is %lf", total_checksum_time);
+	if (!hash_table_lookup(check_sums, key)) {
+		hash_table_insert(check_sums, key, xxstrdup(value));
+		if (check_sums_cache) {
+			fprintf(check_sums_cache, "%s %s\n", key, value);
+			fflush(check_sums_cache);
+		}
+	}
+	pthread_mutex_unlock(&check_sums_mutex);
+
+	debug(D_MAKEFLOW, "Checksum hash of %s is: %s", path, value);
+	free(key);
+	return value;
+}
+
 /* Return the content based ID for a file.
  * generates the checksum of a file's contents if does not exist */
 char *batch_file_generate_id(struct batch_file *f)
 {
-	if (check_sums == NULL) {
-		check_sums = hash_table_create(0, 0);
+	char *value = batch_file_checksum(f->outer_name);
+	if (!value)
+		return NULL;
+
+	free(f->hash);
+	f->hash = value;
+	return xxstrdup(value);
+}
+
+struct checksum_batch {
+	char **paths;
+	char **values;
+	int count;
+	int next;
+	pthread_mutex_t mutex;
+};
+
+static void *checksum_batch_thread(void *arg)
+{
+	struct checksum_batch *b = arg;
+
+	while (1) {
+		pthread_mutex_lock(&b->mutex);
+		int i = b->next++;
+		pthread_mutex_unlock(&b->mutex);
+
+		if (i >= b->count)
+			break;
+
+		b->values[i] = batch_file_checksum(b->paths[i]);
 	}
-	char *check_sum_value = hash_table_lookup(check_sums, f->outer_name);
-	if (check_sum_value == NULL) {
-		unsigned char hash[SHA1_DIGEST_LENGTH];
-		struct timeval start_time;
-		struct timeval end_time;
-
-		gettimeofday(&start_time, NULL);
-		int success = sha1_file(f->outer_name, hash);
-		gettimeofday(&end_time, NULL);
-		double run_time = ((end_time.tv_sec * 1000000 + end_time.tv_usec) - (start_time.tv_sec * 1000000 + start_time.tv_usec)) / 1000000.0;
-		total_checksum_time += run_time;
-		debug(D_MAKEFLOW_HOOK, " The total checksum time is %lf", total_checksum_time);
-		if (success == 0) {
-			debug(D_MAKEFLOW, "Unable to checksum this file: %s", f->outer_name);
-			return NULL;
+
+	return NULL;
+}
+
+/* Fill in the checksums of several files, hashing them in parallel. */
+
+static void checksum_files_parallel(char **paths, char **values, int count)
+{
+	struct checksum_batch b;
+	b.paths = paths;
+	b.values = values;
+	b.count = count;
+	b.next = 0;
+	pthread_mutex_init(&b.mutex, NULL);
+
+	pthread_t threads[BATCH_FILE_CHECKSUM_THREADS];
+	int nthreads = MIN(count, BATCH_FILE_CHECKSUM_THREADS) - 1;
+	int i;
+
+	/* The calling thread works too, so that a failure to start threads is not an error. */
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_create(&threads[i], NULL, checksum_batch_thread, &b) != 0) {
+			nthreads = i;
+			break;
 		}
-		f->hash = xxstrdup(sha1_string(hash));
-		hash_table_insert(check_sums, f->outer_name, xxstrdup(sha1_string(hash)));
-		debug(D_MAKEFLOW, "Checksum hash of %s is: %s", f->outer_name, f->hash);
-		return xxstrdup(f->hash);
 	}
-	debug(D_MAKEFLOW, "Checksum already exists in hash table. Cached CHECKSUM hash of %s is: %s", f->outer_name, check_sum_value);
-	return xxstrdup(check_sum_value);
+
+	checksum_batch_thread(&b);
+
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	pthread_mutex_destroy(&b.mutex);
 }
 
 /* Return the content based ID for a directory.
- * generates the checksum for the directories contents if does not exist
+ * Generates the checksum for the contents of the directory if it does not exist.
+ * The files at each level are hashed in parallel, but are combined
+ * in the same order as always, so that the ID does not change.
  * 		*NEED TO ACCOUNT FOR SYMLINKS LATER*  */
 char *batch_file_generate_id_dir(char *file_name)
 {
-	if (check_sums == NULL) {
-		check_sums = hash_table_create(0, 0);
+	pthread_mutex_lock(&check_sums_mutex);
+	if (dir_check_sums == NULL) {
+		dir_check_sums = hash_table_create(0, 0);
 	}
-	char *check_sum_value = hash_table_lookup(check_sums, file_name);
-	if (check_sum_value == NULL) {
-		char *hash_sum = "";
-		struct dirent **dp;
-		int num;
-		// Scans directory and sorts in reverse order
-		num = scandir(file_name, &dp, NULL, alphasort);
-		if (num < 0) {
-			debug(D_MAKEFLOW, "Unable to scan %s", file_name);
-			return NULL;
-		} else {
-			int i;
-			for (i = num - 1; i >= 0; i--) {
-				if (strcmp(dp[i]->d_name, ".") != 0 && strcmp(dp[i]->d_name, "..") != 0) {
-					char *file_path = string_format("%s/%s", file_name, dp[i]->d_name);
-					if (path_is_dir(file_path) == 1) {
-						hash_sum = string_format("%s%s", hash_sum, batch_file_generate_id_dir(file_path));
-					} else {
-						unsigned char hash[SHA1_DIGEST_LENGTH];
-						struct timeval start_time;
-						struct timeval end_time;
-
-						gettimeofday(&start_time, NULL);
-						int success = sha1_file(file_path, hash);
-						gettimeofday(&end_time, NULL);
-						double run_time = ((end_time.tv_sec * 1000000 + end_time.tv_usec) - (start_time.tv_sec * 1000000 + start_time.tv_usec)) / 1000000.0;
-						total_checksum_time += run_time;
-						debug(D_MAKEFLOW_HOOK, " The total checksum time is %lf", total_checksum_time);
-						if (success == 0) {
-							debug(D_MAKEFLOW, "Unable to checksum this file: %s", file_path);
-							free(file_path);
-							free(dp[i]);
-							continue;
-						}
-						hash_sum = string_format("%s%s:%s", hash_sum, file_name, sha1_string(hash));
-					}
-					free(file_path);
-				}
-				free(dp[i]);
+	char *check_sum_value = hash_table_lookup(dir_check_sums, file_name);
+	pthread_mutex_unlock(&check_sums_mutex);
+
+	if (check_sum_value) {
+		debug(D_MAKEFLOW, "Checksum already exists in hash table. Cached CHECKSUM hash of %s is: %s", file_name, check_sum_value);
+		return xxstrdup(check_sum_value);
+	}
+
+	struct dirent **dp;
+	int num;
+	// Scans directory and sorts in reverse order
+	num = scandir(file_name, &dp, NULL, alphasort);
+	if (num < 0) {
+		debug(D_MAKEFLOW, "Unable to scan %s", file_name);
+		return NULL;
+	}
+
+	char **paths = xxcalloc(num + 1, sizeof(char *));
+	int *is_dir = xxcalloc(num + 1, sizeof(int));
+	char **file_paths = xxcalloc(num + 1, sizeof(char *));
+	int nfiles = 0;
+	int i;
+
+	for (i = num - 1; i >= 0; i--) {
+		if (strcmp(dp[i]->d_name, ".") != 0 && strcmp(dp[i]->d_name, "..") != 0) {
+			paths[i] = string_format("%s/%s", file_name, dp[i]->d_name);
+			if (path_is_dir(paths[i]) == 1) {
+				is_dir[i] = 1;
+			} else {
+				file_paths[nfiles++] = paths[i];
 			}
-			free(dp);
-			unsigned char hash[SHA1_DIGEST_LENGTH];
-			sha1_buffer(hash_sum, strlen(hash_sum), hash);
-			free(hash_sum);
-			hash_table_insert(check_sums, file_name, xxstrdup(sha1_string(hash)));
-			debug(D_MAKEFLOW, "Checksum hash of %s is: %s", file_name, sha1_string(hash));
-			return xxstrdup(sha1_string(hash));
 		}
 	}
-	debug(D_MAKEFLOW, "Checksum already exists in hash table. Cached CHECKSUM hash of %s is: %s", file_name, check_sum_value);
-	return check_sum_value;
+
+	char **file_values = xxcalloc(nfiles + 1, sizeof(char *));
+	checksum_files_parallel(file_paths, file_values, nfiles);
+
+	buffer_t B;
+	buffer_init(&B);
+
+	int j = 0;
+	for (i = num - 1; i >= 0; i--) {
+		if (!paths[i]) {
+			/* . and .. */
+		} else if (is_dir[i]) {
+			char *value = batch_file_generate_id_dir(paths[i]);
+			if (value)
+				buffer_putstring(&B, value);
+			free(value);
+		} else {
+			char *value = file_values[j++];
+			if (value)
+				buffer_printf(&B, "%s:%s", file_name, value);
+			free(value);
+		}
+		free(paths[i]);
+		free(dp[i]);
+	}
+
+	free(dp);
+	free(paths);
+	free(is_dir);
+	free(file_paths);
+	free(file_values);
+
+	unsigned char hash[SHA1_DIGEST_LENGTH];
+	sha1_buffer(buffer_tostring(&B), buffer_pos(&B), hash);
+	buffer_free(&B);
+
+	pthread_mutex_lock(&check_sums_mutex);
+	if (!hash_table_lookup(dir_check_sums, file_name)) {
+		hash_table_insert(dir_check_sums, file_name, xxstrdup(sha1_string(hash)));
+	}
+	pthread_mutex_unlock(&check_sums_mutex);
+
+	debug(D_MAKEFLOW, "Checksum hash of %s is: %s", file_name, sha1_string(hash));
+	return xxstrdup(sha1_string(hash));
 }
@@ -24,11 +24,17 @@ batch systems execute jobs in a sandbox that permits these two names to be diffe
 Some batch systems do not permit these names to differ.
 */
 
+/** Flags that modify the handling of a batch_file. */
+typedef enum {
+	BATCH_FILE_TEMP = (1 << 0), /**< The file is passed between jobs within the batch system, and is never brought back to the submitter. Honored by batch systems with the temp_files feature. */
+} batch_file_flags_t;
+
 /** Internal description of a single file used by a batch job. */
 struct batch_file {
 	char *outer_name;   /**< The name of the file in the submitters filesystem namespace. */
 	char *inner_name;   /**< The name of the file as it should appear to the running job. */
 	char *hash;         /**< The hierarchical checksum of this file/directory, when content based names are used. */
+	int flags;          /**< Zero or more of @ref batch_file_flags_t. */
 };
 
 /** Create batch_file struct.
@@ -67,7 +73,15 @@ char * batch_file_list_to_string( struct list *file_list );
 */
 int batch_file_outer_compare( struct batch_file *f1, struct batch_file *f2 );
 
+/** Keep the checksums of files in a cache file, so that later runs need not compute them again.
+Checksums found in the file are loaded, and new checksums are appended to it.
+Each checksum is kept by the device, inode, size, and modification time of its file.
+@param filename The name of the cache file.
+*/
+void batch_file_set_checksum_cache(const char *filename);
+
 /** Generate a sha1 hash based on the file contents.
+The checksum is also kept in f->hash.  This may be called from several threads at once.
 @param f The batch_file whose checksum will be generated.
 @return Allocated string of the hash, user should free or NULL on error of checksumming file.
 */
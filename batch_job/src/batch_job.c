@@ -126,6 +126,12 @@ void batch_job_set_envlist(struct batch_job *t, struct jx *envlist)
 	t->envlist = jx_copy(envlist);
 }
 
+/** Sets the priority of batch_job. */
+void batch_job_set_priority(struct batch_job *t, double priority)
+{
+	t->priority = priority;
+}
+
 /** Sets the batch_job_info of batch_job.
  Manually copies data into struct.
  Does not free in current code, but as this become standard
@@ -140,6 +146,8 @@ void batch_job_set_info(struct batch_job *t, struct batch_job_info *info)
 	t->info->exit_code = info->exit_code;
 	t->info->exit_signal = info->exit_signal;
 	t->info->disk_allocation_exhausted = info->disk_allocation_exhausted;
+	t->info->cpu_time = info->cpu_time;
+	t->info->memory = info->memory;
 }
 
 void batch_job_set_command_spec(struct batch_job *t, struct jx *command)
@@ -165,6 +173,12 @@ void batch_job_set_command_spec(struct batch_job *t, struct jx *command)
  *  LATER : environment variables (name:value)
  *  returns a string the caller needs to free
  **/
+/* list_sort gives the comparator pointers to the items, as qsort does. */
+static int batch_job_file_compare(const void *a, const void *b)
+{
+	return batch_file_outer_compare(*(struct batch_file **)a, *(struct batch_file **)b);
+}
+
 char *batch_job_generate_id(struct batch_job *t)
 {
 	if (t->hash)
@@ -181,13 +195,14 @@ char *batch_job_generate_id(struct batch_job *t)
 	sha1_update(&context, "\0", 1);
 
 	/* Sort inputs for consistent hashing */
-	list_sort(t->input_files, (void *)batch_file_outer_compare);
+	list_sort(t->input_files, batch_job_file_compare);
 
 	/* add checksum of the node's input files together */
 	struct list_cursor *cur = list_cursor_create(t->input_files);
 	for (list_seek(cur, 0); list_get(cur, (void **)&f); list_next(cur)) {
 		char *file_id;
 		if (path_is_dir(f->inner_name) == 1) {
+			free(f->hash);
 			f->hash = batch_file_generate_id_dir(f->outer_name);
 			file_id = xxstrdup(f->hash);
 		} else {
@@ -203,7 +218,7 @@ char *batch_job_generate_id(struct batch_job *t)
 	list_cursor_destroy(cur);
 
 	/* Sort outputs for consistent hashing */
-	list_sort(t->output_files, (void *)batch_file_outer_compare);
+	list_sort(t->output_files, batch_job_file_compare);
 
 	/* add checksum of the node's output file names together */
 	cur = list_cursor_create(t->output_files);
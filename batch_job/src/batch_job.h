@@ -35,6 +35,7 @@ struct batch_job {
 	struct jx *envlist;          /**< JSON formatted environment list */ 
 	struct batch_job_info *info; /**< Stores the info struct created by batch_queue. */
 	char *hash;                  /**< Checksum based on CMD, input contents, and output names. */
+	double priority;             /**< Relative priority among tasks in the same queue, higher first. */
 };
 
 /** Create a batch_job struct.
@@ -109,6 +110,13 @@ void batch_job_set_resources(struct batch_job *t, const struct rmsummary *resour
 */
 void batch_job_set_envlist(struct batch_job *t, struct jx *envlist);
 
+/** Set the priority of this task.
+ Queues which schedule their own tasks, such as Work Queue and TaskVine, run tasks of higher priority first.
+@param t The batch_job to prioritize.
+@param priority The priority of the task. The default is zero.
+*/
+void batch_job_set_priority(struct batch_job *t, double priority);
+
 /** Set the batch_job_info of this task.
  Performs simple copy into already allocated memory.
 @param t The batch_job that was completed.
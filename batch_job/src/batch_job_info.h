@@ -7,6 +7,7 @@ See the file COPYING for details.
 #ifndef BATCH_JOB_INFO_H
 #define BATCH_JOB_INFO_H
 
+#include <stdint.h>
 #include <time.h>
 
 /** Describes a batch job when it has completed. */
@@ -20,6 +21,8 @@ struct batch_job_info {
 	int exit_signal;     /**< The signal by which the job was killed, if it exited abnormally. */
 	int disk_allocation_exhausted; /**< Non-zero if the job filled its loop device allocation to capacity, zero otherwise */
 	long log_pos;        /**< Last read position in the log file, for ftell and fseek. (only for batch_queue_cluster) */
+	int64_t cpu_time;    /**< CPU time used by the job in microseconds, or zero if not measured. (only for batch_queue_local) */
+	int64_t memory;      /**< Peak memory used by the job in MB, or zero if not measured. (only for batch_queue_local) */
 };
 
 /** Create a new batch_job_info struct.
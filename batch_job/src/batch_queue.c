@@ -44,6 +44,7 @@ static struct batch_queue_module batch_queue_unknown = {
 		NULL,
 		NULL,
 		NULL,
+		NULL,
 };
 
 #define BATCH_JOB_SYSTEMS "local, vine, wq, condor, uge (sge), pbs, lsf, torque, moab, slurm, amazon, k8s, flux, dryrun"
@@ -244,6 +245,23 @@ batch_queue_id_t batch_queue_wait_timeout(struct batch_queue *q, struct batch_jo
 	return q->module->wait(q, info, stoptime);
 }
 
+int batch_queue_wait_many(struct batch_queue *q, batch_queue_id_t *jobids, struct batch_job_info *infos, int max, time_t stoptime)
+{
+	if (max < 1)
+		return -1;
+
+	if (q->module->wait_many)
+		return q->module->wait_many(q, jobids, infos, max, stoptime);
+
+	/* Other modules may block even when asked not to, so return one job at a time. */
+	batch_queue_id_t jobid = q->module->wait(q, &infos[0], stoptime);
+	if (jobid <= 0)
+		return jobid < 0 ? -1 : 0;
+
+	jobids[0] = jobid;
+	return 1;
+}
+
 int batch_queue_remove(struct batch_queue *q, batch_queue_id_t jobid)
 {
 	return q->module->remove(q, jobid);
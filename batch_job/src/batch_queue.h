@@ -127,6 +127,22 @@ If less than zero, the operation timed out or was interrupted by a system event,
 */
 batch_queue_id_t batch_queue_wait_timeout(struct batch_queue *q, struct batch_job_info *info, time_t stoptime);
 
+/** Wait for one or more batch jobs to complete, with a timeout.
+Blocks like @ref batch_queue_wait_timeout until a batch job completes,
+then returns it along with any other jobs that have already completed,
+without blocking again.  This lets the caller process a burst of
+completions at once, rather than one per call.
+@param q The queue to wait on.
+@param jobids An array of at least max elements, filled in with the jobids of the completed jobs.
+@param infos An array of at least max elements, filled in with the details of the completed jobs.
+@param max The greatest number of jobs to return.
+@param stoptime An absolute time at which to stop waiting, as in @ref batch_queue_wait_timeout.
+@return If greater than zero, the number of completed jobs returned.
+If equal to zero, there were no more jobs to wait for.
+If less than zero, the operation timed out or was interrupted by a system event, but may be tried again.
+*/
+int batch_queue_wait_many(struct batch_queue *q, batch_queue_id_t *jobids, struct batch_job_info *infos, int max, time_t stoptime);
+
 /** Remove a batch job.
 This call will start the removal process.
 You must still call @ref batch_queue_wait to wait for the removal to complete.
@@ -840,4 +840,5 @@ const struct batch_queue_module batch_queue_amazon = {
 		batch_queue_amazon_submit,
 		batch_queue_amazon_wait,
 		batch_queue_amazon_remove,
+		NULL,
 };
@@ -528,6 +528,7 @@ const struct batch_queue_module batch_queue_cluster = {
 		batch_queue_cluster_submit,
 		batch_queue_cluster_wait,
 		batch_queue_cluster_remove,
+		NULL,
 };
 
 const struct batch_queue_module batch_queue_moab = {
@@ -542,6 +543,7 @@ const struct batch_queue_module batch_queue_moab = {
 		batch_queue_cluster_submit,
 		batch_queue_cluster_wait,
 		batch_queue_cluster_remove,
+		NULL,
 };
 
 const struct batch_queue_module batch_queue_uge = {
@@ -556,6 +558,7 @@ const struct batch_queue_module batch_queue_uge = {
 		batch_queue_cluster_submit,
 		batch_queue_cluster_wait,
 		batch_queue_cluster_remove,
+		NULL,
 };
 
 /* retained sge keyword for backwards compatibility after sge->uge name change. */
@@ -571,6 +574,7 @@ const struct batch_queue_module batch_queue_sge = {
 		batch_queue_cluster_submit,
 		batch_queue_cluster_wait,
 		batch_queue_cluster_remove,
+		NULL,
 };
 
 const struct batch_queue_module batch_queue_pbs = {
@@ -585,6 +589,7 @@ const struct batch_queue_module batch_queue_pbs = {
 		batch_queue_cluster_submit,
 		batch_queue_cluster_wait,
 		batch_queue_cluster_remove,
+		NULL,
 };
 
 const struct batch_queue_module batch_queue_lsf = {
@@ -599,6 +604,7 @@ const struct batch_queue_module batch_queue_lsf = {
 		batch_queue_cluster_submit,
 		batch_queue_cluster_wait,
 		batch_queue_cluster_remove,
+		NULL,
 };
 
 const struct batch_queue_module batch_queue_torque = {
@@ -613,6 +619,7 @@ const struct batch_queue_module batch_queue_torque = {
 		batch_queue_cluster_submit,
 		batch_queue_cluster_wait,
 		batch_queue_cluster_remove,
+		NULL,
 };
 
 const struct batch_queue_module batch_queue_slurm = {
@@ -627,6 +634,7 @@ const struct batch_queue_module batch_queue_slurm = {
 		batch_queue_cluster_submit,
 		batch_queue_cluster_wait,
 		batch_queue_cluster_remove,
+		NULL,
 };
 
 /* vim: set noexpandtab tabstop=8: */
@@ -403,6 +403,7 @@ const struct batch_queue_module batch_queue_condor = {
 		batch_queue_condor_submit,
 		batch_queue_condor_wait,
 		batch_queue_condor_remove,
+		NULL,
 };
 
 /* vim: set noexpandtab tabstop=8: */
@@ -115,6 +115,7 @@ const struct batch_queue_module batch_queue_dryrun = {
 		batch_queue_dryrun_submit,
 		batch_queue_dryrun_wait,
 		batch_queue_dryrun_remove,
+		NULL,
 };
 
 /* vim: set noexpandtab tabstop=8: */
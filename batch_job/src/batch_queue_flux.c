@@ -373,6 +373,7 @@ const struct batch_queue_module batch_queue_flux = {
 		batch_queue_flux_submit,
 		batch_queue_flux_wait,
 		batch_queue_flux_remove,
+		NULL,
 };
 
 /* vim: set noexpandtab tabstop=8: */
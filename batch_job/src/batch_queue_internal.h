@@ -33,6 +33,9 @@ struct batch_queue_module {
 	batch_queue_id_t (*submit) (struct batch_queue *Q, struct batch_job *bt );
 	batch_queue_id_t (*wait) (struct batch_queue *Q, struct batch_job_info *info, time_t stoptime);
 	int (*remove) (struct batch_queue *Q, batch_queue_id_t id);
+
+	/* optional: return several completed jobs at once, otherwise wait is used */
+	int (*wait_many) (struct batch_queue *Q, batch_queue_id_t *ids, struct batch_job_info *infos, int max, time_t stoptime);
 };
 
 struct batch_queue {
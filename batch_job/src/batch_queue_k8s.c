@@ -707,6 +707,7 @@ const struct batch_queue_module batch_queue_k8s = {
 		batch_queue_k8s_submit,
 		batch_queue_k8s_wait,
 		batch_queue_k8s_remove,
+		NULL,
 };
 
 /* vim: set noexpandtab tabstop=8: */
@@ -7,15 +7,23 @@ See the file COPYING for details.
 #include "batch_queue.h"
 #include "batch_queue_internal.h"
 #include "debug.h"
+#include "full_io.h"
+#include "itable.h"
+#include "jx.h"
 #include "process.h"
 #include "macros.h"
+#include "rmsummary.h"
 #include "stringtools.h"
+#include "xxmalloc.h"
 
+#include <fcntl.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
 #include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #if defined(CCTOOLS_OPSYS_DARWIN)
 /* no such header */
@@ -25,28 +33,376 @@ See the file COPYING for details.
 #include <sys/prctl.h>
 #endif
 
-static batch_queue_id_t batch_queue_local_submit(struct batch_queue *q, struct batch_job *bt)
+extern char **environ;
+
+/*
+When the option "cgroups" is set, each job is placed in its own leaf of
+a cgroup v2 hierarchy created below the cgroup of this process.  The
+memory and cores requested by the job become its memory.max and cpu.max,
+wherever those controllers are delegated to us, and its cpu time and peak
+memory are read from the leaf when it exits.  Otherwise, or if the leaf
+cannot be read, the usage is taken from the rusage of the job.
+*/
+
+#define CGROUP_REMOVE_TIMEOUT 5
+
+static char *cgroup_base = 0;     /* The cgroup holding the jobs, below our own. */
+static char *cgroup_parent = 0;   /* Our own cgroup, to return to when done. */
+static char *cgroup_leaf = 0;     /* The leaf of cgroup_base holding this process, if it could move there. */
+static char *cgroup_enabled = 0;  /* The controllers we enabled in cgroup_parent, to disable when done. */
+static int cgroup_enforced = 0;   /* Are the cpu and memory controllers enabled for the jobs? */
+static struct itable *cgroup_jobs = 0;
+static int cgroup_count = 0;
+
+static int cgroup_write(const char *dir, const char *name, const char *value)
 {
-	batch_queue_id_t jobid;
+	char *path = string_format("%s/%s", dir, name);
+	int fd = open(path, O_WRONLY);
+	int result = -1;
+	if (fd >= 0) {
+		result = full_write(fd, value, strlen(value)) == (ssize_t)strlen(value) ? 0 : -1;
+		close(fd);
+	}
+	if (result < 0)
+		debug(D_BATCH, "couldn't write %s to %s: %s", value, path, strerror(errno));
+	free(path);
+	return result;
+}
 
-	fflush(NULL);
-	jobid = fork();
-	if (jobid > 0) {
-		debug(D_BATCH, "started process %" PRIbjid ": %s", jobid, bt->command);
-		struct batch_job_info *info = malloc(sizeof(*info));
-		memset(info, 0, sizeof(*info));
-		info->submitted = time(0);
-		info->started = time(0);
-		itable_insert(q->job_table, jobid, info);
-		return jobid;
-	} else if (jobid < 0) {
-		debug(D_BATCH, "couldn't create new process: %s\n", strerror(errno));
+/* Return the value following key in the named file of a cgroup, or -1 if there is none. */
+
+static int64_t cgroup_read(const char *dir, const char *name, const char *key)
+{
+	char *path = string_format("%s/%s", dir, name);
+	FILE *file = fopen(path, "r");
+	free(path);
+	if (!file)
 		return -1;
+
+	char line[256];
+	int64_t value = -1;
+	size_t keylen = key ? strlen(key) : 0;
+	while (fgets(line, sizeof(line), file)) {
+		if (!key) {
+			value = strtoll(line, 0, 10);
+			break;
+		} else if (!strncmp(line, key, keylen) && line[keylen] == ' ') {
+			value = strtoll(line + keylen + 1, 0, 10);
+			break;
+		}
+	}
+
+	fclose(file);
+	return value;
+}
+
+/* Find the directory of our own cgroup, or return null if we are not in a cgroup v2 hierarchy. */
+
+static char *cgroup_self(void)
+{
+	char line[PATH_MAX];
+	char mount[PATH_MAX] = "";
+	char relative[PATH_MAX] = "";
+
+	FILE *file = fopen("/proc/self/mounts", "r");
+	if (!file)
+		return 0;
+	while (fgets(line, sizeof(line), file)) {
+		char device[PATH_MAX], dir[PATH_MAX], type[64];
+		if (sscanf(line, "%s %s %63s", device, dir, type) == 3 && !strcmp(type, "cgroup2")) {
+			strcpy(mount, dir);
+			break;
+		}
+	}
+	fclose(file);
+
+	file = fopen("/proc/self/cgroup", "r");
+	if (!file)
+		return 0;
+	while (fgets(line, sizeof(line), file)) {
+		if (!strncmp(line, "0::", 3)) {
+			strcpy(relative, line + 3);
+			string_chomp(relative);
+			break;
+		}
+	}
+	fclose(file);
+
+	if (!mount[0] || !relative[0])
+		return 0;
+
+	return string_format("%s%s", mount, strcmp(relative, "/") ? relative : "");
+}
+
+/* Return true if the controller is listed in the named file of a cgroup. */
+
+static int cgroup_lists(const char *dir, const char *name, const char *controller)
+{
+	char *path = string_format("%s/%s", dir, name);
+	FILE *file = fopen(path, "r");
+	free(path);
+	if (!file)
+		return 0;
+
+	char word[64];
+	int found = 0;
+	while (!found && fscanf(file, "%63s", word) == 1)
+		found = !strcmp(word, controller);
+
+	fclose(file);
+	return found;
+}
+
+/*
+A cgroup may give controllers to its children only while it holds no
+process of its own.  So this process first moves to a leaf next to the
+jobs, and then enables cpu and memory in its former cgroup and in the new
+one.  If that fails, the jobs are still measured, but not limited.
+*/
+
+static void cgroup_setup(void)
+{
+	if (cgroup_base)
+		return;
+
+	char *self = cgroup_self();
+	if (!self) {
+		debug(D_NOTICE, "cgroup v2 is not available, jobs will not be confined.");
+		return;
+	}
+
+	char *base = string_format("%s/batch_local.%d", self, (int)getpid());
+	if (mkdir(base, 0755) < 0 && errno != EEXIST) {
+		debug(D_NOTICE, "couldn't create cgroup %s: %s", base, strerror(errno));
+		free(self);
+		free(base);
+		return;
+	}
+
+	char *leaf = string_format("%s/makeflow", base);
+	if (mkdir(leaf, 0755) < 0 || cgroup_write(leaf, "cgroup.procs", "0") < 0) {
+		rmdir(leaf);
+		free(leaf);
+		leaf = 0;
+	}
+
+	char *enabled = xxstrdup("");
+	int enforced = leaf != 0;
+	const char *controllers[] = {"cpu", "memory"};
+	int i;
+	for (i = 0; enforced && i < 2; i++) {
+		if (cgroup_lists(self, "cgroup.subtree_control", controllers[i]))
+			continue;
+		char *value = string_format("+%s", controllers[i]);
+		if (cgroup_write(self, "cgroup.subtree_control", value) == 0)
+			enabled = string_combine_multi(enabled, enabled[0] ? " " : "", "-", controllers[i], 0);
+		else
+			enforced = 0;
+		free(value);
+	}
+	if (enforced && cgroup_write(base, "cgroup.subtree_control", "+cpu +memory") < 0)
+		enforced = 0;
+
+	if (!enforced)
+		debug(D_NOTICE, "couldn't enable the cpu and memory controllers for cgroup %s: the cores and memory of local jobs will be measured, but not enforced.", base);
+
+	debug(D_BATCH, "placing local jobs in cgroup %s", base);
+	cgroup_base = base;
+	cgroup_parent = self;
+	cgroup_leaf = leaf;
+	cgroup_enforced = enforced;
+	if (enabled[0]) {
+		cgroup_enabled = enabled;
 	} else {
-		if (bt->envlist) {
-			jx_export(bt->envlist);
+		free(enabled);
+	}
+	cgroup_jobs = itable_create(0);
+}
+
+/*
+Kill anything left in a cgroup, and remove it once it is empty.
+cgroup.kill does not wait for the processes to exit, so until then
+the cgroup is still populated and cannot be removed.
+*/
+
+static void cgroup_remove(const char *dir)
+{
+	cgroup_write(dir, "cgroup.kill", "1");
+
+	time_t stoptime = time(0) + CGROUP_REMOVE_TIMEOUT;
+	while (cgroup_read(dir, "cgroup.events", "populated") > 0 && time(0) < stoptime)
+		usleep(10000);
+
+	if (rmdir(dir) < 0)
+		debug(D_NOTICE, "couldn't remove cgroup %s: %s", dir, strerror(errno));
+}
+
+/* Return to our own cgroup, undo what cgroup_setup did, and remove the hierarchy. */
+
+static void cgroup_cleanup(void)
+{
+	if (cgroup_enforced)
+		cgroup_write(cgroup_base, "cgroup.subtree_control", "-cpu -memory");
+	if (cgroup_enabled)
+		cgroup_write(cgroup_parent, "cgroup.subtree_control", cgroup_enabled);
+	if (cgroup_leaf) {
+		cgroup_write(cgroup_parent, "cgroup.procs", "0");
+		if (rmdir(cgroup_leaf) < 0)
+			debug(D_NOTICE, "couldn't remove cgroup %s: %s", cgroup_leaf, strerror(errno));
+	}
+	if (rmdir(cgroup_base) < 0)
+		debug(D_NOTICE, "couldn't remove cgroup %s: %s", cgroup_base, strerror(errno));
+
+	free(cgroup_base);
+	free(cgroup_parent);
+	free(cgroup_leaf);
+	free(cgroup_enabled);
+	cgroup_base = 0;
+	cgroup_parent = 0;
+	cgroup_leaf = 0;
+	cgroup_enabled = 0;
+	cgroup_enforced = 0;
+	itable_delete(cgroup_jobs);
+	cgroup_jobs = 0;
+}
+
+/* Create the leaf for a new job and return an open descriptor to its cgroup.procs, or -1. */
+
+static int cgroup_create_job(struct batch_job *bt, char **dir)
+{
+	*dir = string_format("%s/job.%d", cgroup_base, cgroup_count++);
+	if (mkdir(*dir, 0755) < 0) {
+		debug(D_BATCH, "couldn't create cgroup %s: %s", *dir, strerror(errno));
+		free(*dir);
+		*dir = 0;
+		return -1;
+	}
+
+	struct rmsummary *r = bt->resources;
+	if (r && r->memory > 0) {
+		char *value = string_format("%" PRId64, (int64_t)r->memory * 1024 * 1024);
+		cgroup_write(*dir, "memory.max", value);
+		free(value);
+	}
+	if (r && r->cores > 0) {
+		char *value = string_format("%" PRId64 " 100000", (int64_t)(r->cores * 100000));
+		cgroup_write(*dir, "cpu.max", value);
+		free(value);
+	}
+
+	char *path = string_format("%s/cgroup.procs", *dir);
+	int fd = open(path, O_WRONLY | O_CLOEXEC);
+	free(path);
+	if (fd < 0) {
+		rmdir(*dir);
+		free(*dir);
+		*dir = 0;
+	}
+	return fd;
+}
+
+/* Remove the leaf of a job, with anything the job left running in the background. */
+
+static void cgroup_remove_job(pid_t pid)
+{
+	char *dir = itable_remove(cgroup_jobs, pid);
+	if (!dir)
+		return;
+
+	cgroup_remove(dir);
+	free(dir);
+}
+
+/* Measure the usage of a job from its leaf, then remove the leaf. */
+
+static void cgroup_complete_job(pid_t pid, struct batch_job_info *info)
+{
+	char *dir = itable_lookup(cgroup_jobs, pid);
+	if (!dir)
+		return;
+
+	int64_t usage = cgroup_read(dir, "cpu.stat", "usage_usec");
+	if (usage >= 0)
+		info->cpu_time = usage;
+
+	int64_t peak = cgroup_read(dir, "memory.peak", 0);
+	if (peak >= 0)
+		info->memory = peak / (1024 * 1024);
+
+	cgroup_remove_job(pid);
+}
+
+/*
+Build the environment of a job in the parent, so that the child
+need do nothing but exec after a vfork.  The caller frees the array
+and the strings listed in owned.
+*/
+
+static char **local_environment(struct jx *envlist, char ***owned)
+{
+	int nenv = 0;
+	while (environ[nenv])
+		nenv++;
+
+	int nvars = 0;
+	struct jx_pair *p;
+	if (jx_istype(envlist, JX_OBJECT))
+		for (p = envlist->u.pairs; p; p = p->next)
+			nvars++;
+
+	char **envp = xxmalloc((nenv + nvars + 1) * sizeof(char *));
+	memcpy(envp, environ, nenv * sizeof(char *));
+	*owned = xxmalloc((nvars + 1) * sizeof(char *));
+	int nowned = 0;
+
+	for (p = nvars ? envlist->u.pairs : 0; p; p = p->next) {
+		if (p->key->type != JX_STRING || p->value->type != JX_STRING)
+			continue;
+
+		const char *name = p->key->u.string_value;
+		size_t length = strlen(name);
+		char *var = string_format("%s=%s", name, p->value->u.string_value);
+		(*owned)[nowned++] = var;
+
+		int i;
+		for (i = 0; i < nenv; i++) {
+			if (!strncmp(envp[i], name, length) && envp[i][length] == '=')
+				break;
 		}
+		envp[i] = var;
+		if (i == nenv)
+			nenv++;
+	}
+
+	envp[nenv] = 0;
+	(*owned)[nowned] = 0;
+	return envp;
+}
 
+/*
+Jobs are started with vfork, so that the cost of starting a job does not
+grow with the memory of the calling process, as it would with fork.
+The child only sets its death signal, joins its cgroup, and execs.
+*/
+
+static batch_queue_id_t batch_queue_local_submit(struct batch_queue *q, struct batch_job *bt)
+{
+	batch_queue_id_t jobid;
+
+	char *argv[] = {"sh", "-c", bt->command, 0};
+	char **owned;
+	char **envp = local_environment(bt->envlist, &owned);
+
+	char *cgroup_dir = 0;
+	int cgroup_fd = -1;
+	if (batch_queue_option_is_yes(q, "cgroups")) {
+		cgroup_setup();
+		if (cgroup_base)
+			cgroup_fd = cgroup_create_job(bt, &cgroup_dir);
+	}
+
+	jobid = vfork();
+	if (jobid == 0) {
 		/* Force the child process to exit if the parent dies. */
 #if defined(CCTOOLS_OPSYS_DARWIN)
 		/* no such syscall */
@@ -57,10 +413,75 @@ static batch_queue_id_t batch_queue_local_submit(struct batch_queue *q, struct b
 		prctl(PR_SET_PDEATHSIG, SIGTERM);
 #endif
 
-		execlp("/bin/sh", "sh", "-c", bt->command, (char *)0);
+		if (cgroup_fd >= 0 && write(cgroup_fd, "0", 1) != 1)
+			_exit(127);
+
+		execve("/bin/sh", argv, envp);
 		_exit(127); // Failed to execute the cmd.
 	}
-	return -1;
+
+	int i;
+	for (i = 0; owned[i]; i++)
+		free(owned[i]);
+	free(owned);
+	free(envp);
+	if (cgroup_fd >= 0)
+		close(cgroup_fd);
+
+	if (jobid < 0) {
+		debug(D_BATCH, "couldn't create new process: %s\n", strerror(errno));
+		if (cgroup_dir) {
+			rmdir(cgroup_dir);
+			free(cgroup_dir);
+		}
+		return -1;
+	}
+
+	debug(D_BATCH, "started process %" PRIbjid ": %s", jobid, bt->command);
+	struct batch_job_info *info = malloc(sizeof(*info));
+	memset(info, 0, sizeof(*info));
+	info->submitted = time(0);
+	info->started = time(0);
+	itable_insert(q->job_table, jobid, info);
+	if (cgroup_dir)
+		itable_insert(cgroup_jobs, jobid, cgroup_dir);
+	return jobid;
+}
+
+/* Fill in the details of a process which has exited, or return -1 if it is not one of ours. */
+
+static batch_queue_id_t batch_queue_local_complete(struct batch_queue *q, struct process_info *p, struct batch_job_info *info_out)
+{
+	struct batch_job_info *info = itable_remove(q->job_table, p->pid);
+	if (!info) {
+		process_putback(p);
+		return -1;
+	}
+
+	info->finished = time(0);
+	if (WIFEXITED(p->status)) {
+		info->exited_normally = 1;
+		info->exit_code = WEXITSTATUS(p->status);
+	} else {
+		info->exited_normally = 0;
+		info->exit_signal = WTERMSIG(p->status);
+	}
+
+	/* The rusage covers the shell and every child it waited for. */
+	struct timeval *u = &p->rusage.ru_utime;
+	struct timeval *s = &p->rusage.ru_stime;
+	info->cpu_time = (u->tv_sec + s->tv_sec) * (int64_t)1000000 + u->tv_usec + s->tv_usec;
+	info->memory = p->rusage.ru_maxrss / 1024;
+
+	if (cgroup_jobs)
+		cgroup_complete_job(p->pid, info);
+
+	memcpy(info_out, info, sizeof(*info));
+
+	int jobid = p->pid;
+	free(p);
+	free(info);
+	return jobid;
 }
 
 static batch_queue_id_t batch_queue_local_wait(struct batch_queue *q, struct batch_job_info *info_out, time_t stoptime)
@@ -76,28 +497,7 @@ static batch_queue_id_t batch_queue_local_wait(struct batch_queue *q, struct bat
 
 		struct process_info *p = process_wait(timeout);
 		if (p) {
-			struct batch_job_info *info = itable_remove(q->job_table, p->pid);
-			if (!info) {
-				process_putback(p);
-				return -1;
-			}
-
-			info->finished = time(0);
-			if (WIFEXITED(p->status)) {
-				info->exited_normally = 1;
-				info->exit_code = WEXITSTATUS(p->status);
-			} else {
-				info->exited_normally = 0;
-				info->exit_signal = WTERMSIG(p->status);
-			}
-
-			memcpy(info_out, info, sizeof(*info));
-
-			int jobid = p->pid;
-			free(p);
-			free(info);
-			return jobid;
-
+			return batch_queue_local_complete(q, p, info_out);
 		} else if (errno == ESRCH || errno == ECHILD) {
 			return 0;
 		}
@@ -107,10 +507,41 @@ static batch_queue_id_t batch_queue_local_wait(struct batch_queue *q, struct bat
 	}
 }
 
+static int batch_queue_local_wait_many(struct batch_queue *q, batch_queue_id_t *ids, struct batch_job_info *infos, int max, time_t stoptime)
+{
+	batch_queue_id_t jobid = batch_queue_local_wait(q, &infos[0], stoptime);
+	if (jobid <= 0)
+		return jobid < 0 ? -1 : 0;
+
+	ids[0] = jobid;
+	int n = 1;
+
+	/* Collect any other processes which have already exited, without blocking. */
+	while (n < max) {
+		struct process_info *p = process_wait(0);
+		if (!p)
+			break;
+
+		jobid = batch_queue_local_complete(q, p, &infos[n]);
+		if (jobid < 0)
+			break;
+
+		ids[n++] = jobid;
+	}
+
+	return n;
+}
+
 static int batch_queue_local_remove(struct batch_queue *q, batch_queue_id_t jobid)
 {
 	int max_wait = 5; // maximum seconds we wish to wait for a given process
 	process_kill_waitpid(jobid, max_wait);
+
+	/* The job will not be returned by wait, so clean up after it here. */
+	free(itable_remove(q->job_table, jobid));
+	if (cgroup_jobs)
+		cgroup_remove_job(jobid);
+
 	return 0;
 }
 
@@ -120,7 +551,15 @@ static int batch_queue_local_create(struct batch_queue *q)
 	return 0;
 }
 
-batch_queue_stub_free(local);
+/* The hierarchy is shared by all local queues, so it is removed only once it is empty. */
+
+static int batch_queue_local_free(struct batch_queue *q)
+{
+	if (cgroup_base && itable_size(cgroup_jobs) == 0)
+		cgroup_cleanup();
+	return 0;
+}
+
 batch_queue_stub_port(local);
 batch_queue_stub_option_update(local);
 
@@ -136,6 +575,7 @@ const struct batch_queue_module batch_queue_local = {
 		batch_queue_local_submit,
 		batch_queue_local_wait,
 		batch_queue_local_remove,
+		batch_queue_local_wait_many,
 };
 
 /* vim: set noexpandtab tabstop=8: */
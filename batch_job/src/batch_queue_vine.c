@@ -34,11 +34,15 @@ static struct vine_file *declare_once(struct batch_queue *q, struct batch_file *
 
 	f = hash_table_lookup(q->tv_file_table, bf->outer_name);
 	if (!f) {
-		// if(bf->flags & BATCH_FILE_TEMP) {
-		//	f = vine_declare_temp(q->tv_manager);
-		// } else {
-		f = vine_declare_file(q->tv_manager, bf->outer_name, cache, 0);
-		//}
+		/*
+		A temp file stays on the workers, and is moved directly from
+		the task that produces it to the tasks that consume it.
+		*/
+		if (bf->flags & BATCH_FILE_TEMP) {
+			f = vine_declare_temp(q->tv_manager);
+		} else {
+			f = vine_declare_file(q->tv_manager, bf->outer_name, cache, 0);
+		}
 		hash_table_insert(q->tv_file_table, bf->outer_name, f);
 	}
 	return f;
@@ -113,12 +117,43 @@ static batch_queue_id_t batch_queue_vine_submit(struct batch_queue *q, struct ba
 		vine_task_set_resources(t, bt->resources);
 	}
 
+	vine_task_set_priority(t, bt->priority);
+
 	return vine_submit(q->tv_manager, t);
 }
 
+/* Fill in the details of a completed task and delete it, returning its id. */
+
+static batch_queue_id_t batch_queue_vine_complete(struct vine_task *t, struct batch_job_info *info)
+{
+	info->submitted = vine_task_get_metric(t, "time_when_submitted") / 1000000;
+	info->started = vine_task_get_metric(t, "time_when_commit_end") / 1000000;
+	info->finished = vine_task_get_metric(t, "time_when_done") / 1000000;
+	info->exited_normally = 1;
+	info->exit_code = vine_task_get_exit_code(t);
+	info->exit_signal = 0;
+	info->disk_allocation_exhausted = 0;
+
+	/*
+	   If the standard output of the job is not empty,
+	   then print it, because this is analogous to a Unix
+	   job, and would otherwise be lost.  Important for
+	   capturing errors from the program.
+	 */
+
+	const char *s = vine_task_get_stdout(t);
+	if (s[1] || s[0] != '\n') {
+		printf("%s\n", s);
+	}
+
+	batch_queue_id_t taskid = vine_task_get_id(t);
+	vine_task_delete(t);
+	return taskid;
+}
+
 static batch_queue_id_t batch_queue_vine_wait(struct batch_queue *q, struct batch_job_info *info, time_t stoptime)
 {
-	int timeout, taskid = -1;
+	int timeout;
 
 	if (stoptime == 0) {
 		timeout = VINE_WAIT_FOREVER;
@@ -128,32 +163,7 @@ static batch_queue_id_t batch_queue_vine_wait(struct batch_queue *q, struct batc
 
 	struct vine_task *t = vine_wait(q->tv_manager, timeout);
 	if (t) {
-		info->submitted = vine_task_get_metric(t, "time_when_submitted") / 1000000;
-		info->started = vine_task_get_metric(t, "time_when_commit_end") / 1000000;
-		info->finished = vine_task_get_metric(t, "time_when_done") / 1000000;
-		info->exited_normally = 1;
-		info->exit_code = vine_task_get_exit_code(t);
-		info->exit_signal = 0;
-		info->disk_allocation_exhausted = 0;
-
-		/*
-		   If the standard output of the job is not empty,
-		   then print it, because this is analogous to a Unix
-		   job, and would otherwise be lost.  Important for
-		   capturing errors from the program.
-		 */
-
-		const char *s = vine_task_get_stdout(t);
-		if (s[1] || s[0] != '\n') {
-			printf("%s\n", s);
-		}
-
-		taskid = vine_task_get_id(t);
-		vine_task_delete(t);
-	}
-
-	if (taskid >= 0) {
-		return taskid;
+		return batch_queue_vine_complete(t, info);
 	}
 
 	if (vine_empty(q->tv_manager)) {
@@ -163,6 +173,27 @@ static batch_queue_id_t batch_queue_vine_wait(struct batch_queue *q, struct batc
 	}
 }
 
+static int batch_queue_vine_wait_many(struct batch_queue *q, batch_queue_id_t *ids, struct batch_job_info *infos, int max, time_t stoptime)
+{
+	batch_queue_id_t taskid = batch_queue_vine_wait(q, &infos[0], stoptime);
+	if (taskid <= 0)
+		return taskid < 0 ? -1 : 0;
+
+	ids[0] = taskid;
+	int n = 1;
+
+	/* With a timeout of zero, vine_wait only returns tasks already retrieved. */
+	while (n < max) {
+		struct vine_task *t = vine_wait(q->tv_manager, 0);
+		if (!t)
+			break;
+		ids[n] = batch_queue_vine_complete(t, &infos[n]);
+		n++;
+	}
+
+	return n;
+}
+
 static int batch_queue_vine_remove(struct batch_queue *q, batch_queue_id_t jobid)
 {
 	return 0;
@@ -192,6 +223,7 @@ static int batch_queue_vine_create(struct batch_queue *q)
 	batch_queue_set_feature(q, "remote_rename", "%s=%s");
 	batch_queue_set_feature(q, "batch_log_name", "%s.vine.log");
 	batch_queue_set_feature(q, "batch_log_transactions", "%s.tr");
+	batch_queue_set_feature(q, "temp_files", "yes");
 	return 0;
 }
 
@@ -281,6 +313,7 @@ const struct batch_queue_module batch_queue_vine = {
 		batch_queue_vine_submit,
 		batch_queue_vine_wait,
 		batch_queue_vine_remove,
+		batch_queue_vine_wait_many,
 };
 
 /* vim: set noexpandtab tabstop=8: */
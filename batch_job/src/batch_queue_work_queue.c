@@ -79,15 +79,48 @@ static batch_queue_id_t batch_queue_wq_submit(struct batch_queue *q, struct batc
 		work_queue_task_specify_resources(t, bt->resources);
 	}
 
+	work_queue_task_specify_priority(t, bt->priority);
+
 	work_queue_submit(q->wq_manager, t);
 
 	return t->taskid;
 }
 
+/* Fill in the details of a completed task and delete it, returning its id. */
+
+static batch_queue_id_t batch_queue_wq_complete(struct work_queue_task *t, struct batch_job_info *info)
+{
+	info->submitted = t->time_when_submitted / 1000000;
+	info->started = t->time_when_commit_end / 1000000;
+	info->finished = t->time_when_done / 1000000;
+	info->exited_normally = 1;
+	info->exit_code = t->return_status;
+	info->exit_signal = 0;
+	info->disk_allocation_exhausted = t->disk_allocation_exhausted;
+
+	/*
+	   If the standard ouput of the job is not empty,
+	   then print it, because this is analogous to a Unix
+	   job, and would otherwise be lost.  Important for
+	   capturing errors from the program.
+	 */
+
+	if (t->output && t->output[0]) {
+		if (t->output[1] || t->output[0] != '\n') {
+			string_chomp(t->output);
+			printf("%s\n", t->output);
+		}
+	}
+
+	batch_queue_id_t taskid = t->taskid;
+	work_queue_task_delete(t);
+	return taskid;
+}
+
 static batch_queue_id_t batch_queue_wq_wait(struct batch_queue *q, struct batch_job_info *info, time_t stoptime)
 {
 	static int try_open_log = 0;
-	int timeout, taskid = -1;
+	int timeout;
 
 	if (!try_open_log) {
 		try_open_log = 1;
@@ -109,34 +142,7 @@ static batch_queue_id_t batch_queue_wq_wait(struct batch_queue *q, struct batch_
 
 	struct work_queue_task *t = work_queue_wait(q->wq_manager, timeout);
 	if (t) {
-		info->submitted = t->time_when_submitted / 1000000;
-		info->started = t->time_when_commit_end / 1000000;
-		info->finished = t->time_when_done / 1000000;
-		info->exited_normally = 1;
-		info->exit_code = t->return_status;
-		info->exit_signal = 0;
-		info->disk_allocation_exhausted = t->disk_allocation_exhausted;
-
-		/*
-		   If the standard ouput of the job is not empty,
-		   then print it, because this is analogous to a Unix
-		   job, and would otherwise be lost.  Important for
-		   capturing errors from the program.
-		 */
-
-		if (t->output && t->output[0]) {
-			if (t->output[1] || t->output[0] != '\n') {
-				string_chomp(t->output);
-				printf("%s\n", t->output);
-			}
-		}
-
-		taskid = t->taskid;
-		work_queue_task_delete(t);
-	}
-
-	if (taskid >= 0) {
-		return taskid;
+		return batch_queue_wq_complete(t, info);
 	}
 
 	if (work_queue_empty(q->wq_manager)) {
@@ -146,6 +152,27 @@ static batch_queue_id_t batch_queue_wq_wait(struct batch_queue *q, struct batch_
 	}
 }
 
+static int batch_queue_wq_wait_many(struct batch_queue *q, batch_queue_id_t *ids, struct batch_job_info *infos, int max, time_t stoptime)
+{
+	batch_queue_id_t taskid = batch_queue_wq_wait(q, &infos[0], stoptime);
+	if (taskid <= 0)
+		return taskid < 0 ? -1 : 0;
+
+	ids[0] = taskid;
+	int n = 1;
+
+	/* Collect any other tasks retrieved during the wait, without talking to the workers again. */
+	while (n < max) {
+		struct work_queue_task *t = work_queue_no_wait(q->wq_manager);
+		if (!t)
+			break;
+		ids[n] = batch_queue_wq_complete(t, &infos[n]);
+		n++;
+	}
+
+	return n;
+}
+
 static int batch_queue_wq_remove(struct batch_queue *q, batch_queue_id_t jobid)
 {
 	return 0;
@@ -268,6 +295,7 @@ const struct batch_queue_module batch_queue_wq = {
 		batch_queue_wq_submit,
 		batch_queue_wq_wait,
 		batch_queue_wq_remove,
+		batch_queue_wq_wait_many,
 };
 
 /* vim: set noexpandtab tabstop=8: */
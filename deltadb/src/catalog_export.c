@@ -74,8 +74,6 @@ void catalog_export_new_classads( struct jx *j, struct link *l, time_t stoptime
 #define COLOR_ONE "#aaaaff"
 #define COLOR_TWO "#bbbbbb"
 
-static int color_counter = 0;
-
 static const char *align_string(struct jx_table *h)
 {
 	if(h->align == JX_TABLE_ALIGN_RIGHT) {
@@ -90,7 +88,8 @@ void catalog_export_html_solo(struct jx *j, struct link *l, time_t stoptime )
 	link_printf(l,stoptime, "<table bgcolor=%s>\n", COLOR_TWO);
 	link_printf(l,stoptime, "<tr bgcolor=%s>\n", COLOR_ONE);
 
-	color_counter = 0;
+	/* Queries are answered by several threads, so the rows are counted here. */
+	int color_counter = 0;
 
 	struct jx_pair *p;
 	for(p=j->u.pairs;p;p=p->next) {
@@ -116,18 +115,16 @@ void catalog_export_html_header( struct link *l, struct jx_table *h, time_t stop
 		link_printf(l,stoptime,"<td align=%s><b>%s</b>\n", align_string(h), h->title);
 		h++;
 	}
-	color_counter = 0;
 }
 
-void catalog_export_html( struct jx *n, struct link *l, struct jx_table *h, time_t stoptime )
+void catalog_export_html( struct jx *n, struct link *l, struct jx_table *h, int row, time_t stoptime )
 {
-	catalog_export_html_with_link(n, l, h, 0, 0, stoptime);
+	catalog_export_html_with_link(n, l, h, 0, 0, row, stoptime);
 }
 
-void catalog_export_html_with_link( struct jx *n, struct link *l, struct jx_table *h, const char *linkname, const char *linktext, time_t stoptime )
+void catalog_export_html_with_link( struct jx *n, struct link *l, struct jx_table *h, const char *linkname, const char *linktext, int row, time_t stoptime )
 {
-	link_printf(l,stoptime,"<tr bgcolor=%s>\n", color_counter % 2 ? COLOR_ONE : COLOR_TWO);
-	color_counter++;
+	link_printf(l,stoptime,"<tr bgcolor=%s>\n", row % 2 ? COLOR_ONE : COLOR_TWO);
 	while(h->name) {
 		struct jx *value = jx_lookup(n,h->name);
 		char *text;
@@ -161,7 +158,8 @@ void catalog_export_html_footer( struct link *l, struct jx_table *h, time_t stop
 }
 
 void catalog_export_html_datetime_picker( struct link *l, time_t stoptime, time_t current) {
-	struct tm *t = localtime(&current);
+	struct tm tm;
+	struct tm *t = localtime_r(&current,&tm);
 	struct tm *tm_yesterday, *tm_tomorrow;
 	time_t yesterday, tomorrow;
 
@@ -18,10 +18,11 @@ void catalog_export_new_classads( struct jx *j, struct link *l, time_t stoptime
 
 void catalog_export_html_solo( struct jx *j, struct link *l, time_t stoptime );
 void catalog_export_html_header( struct link *l, struct jx_table *h, time_t stoptime );
-void catalog_export_html( struct jx *j, struct link *l, struct jx_table *h, time_t stoptime );
+void catalog_export_html( struct jx *j, struct link *l, struct jx_table *h, int row, time_t stoptime );
 void catalog_export_html_footer( struct link *l, struct jx_table *h, time_t stoptime );
 
-void catalog_export_html_with_link(struct jx *j, struct link *l, struct jx_table *h, const char *linkname, const char *linktext, time_t stoptime );
+/* The rows of a table alternate in color, by the row number given, counting from zero after the header. */
+void catalog_export_html_with_link(struct jx *j, struct link *l, struct jx_table *h, const char *linkname, const char *linktext, int row, time_t stoptime );
 
 void catalog_export_html_datetime_picker( struct link *l, time_t stoptime, time_t current);
 
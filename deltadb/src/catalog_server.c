@@ -24,6 +24,8 @@ See the file COPYING for details.
 #include "domain_name_cache.h"
 #include "username.h"
 #include "list.h"
+#include "itable.h"
+#include "hash_table.h"
 #include "xxmalloc.h"
 #include "macros.h"
 #include "daemon.h"
@@ -37,33 +39,67 @@ See the file COPYING for details.
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
 #include <signal.h>
 #include <unistd.h>
 #include <time.h>
-#include <sys/wait.h>
 #include <sys/select.h>
+#include <sys/socket.h>
+#include <pthread.h>
+
+#ifdef CCTOOLS_OPSYS_LINUX
+#include <sys/epoll.h>
+#endif
 
 #ifndef LINE_MAX
 #define LINE_MAX 1024
 #endif
 
-#define MAX_TABLE_SIZE 10000
-
 /* Timeout in communicating with the querying client */
 #define HANDLE_QUERY_TIMEOUT 15
 
+/* Time an idle query connection is kept open for another request. */
+#define KEEPALIVE_TIMEOUT 30
+
+/* Maximum number of query connections open before new ones are closed after one request. */
+#define KEEPALIVE_MAX 1024
+
+/* Minimum time between publications of the table to the query threads. */
+#define SNAPSHOT_INTERVAL 1
+
+/* Default number of threads answering queries, enough that a few slow clients do not stall the rest. */
+#define QUERY_THREADS_DEFAULT 32
+
+/* Fields indexed by default, those most commonly compared in queries. */
+#define INDEX_FIELDS_DEFAULT "type,project"
+
 /* Very short timeout to deal with TCP update, which blocks the server. */
 #define HANDLE_TCP_UPDATE_TIMEOUT 5
 
+/* Maximum number of datagrams received and decoded together. */
+#define UDP_BATCH_MAX 64
+
+/* Maximum number of batches handled before checking other sources. */
+#define UDP_BATCHES_PER_CALL 16
+
+/* Receive buffer requested for the UDP update port, to absorb bursts. */
+#define UDP_RECV_BUFFER (8*1024*1024)
+
+/* Default upper limit of threads decoding updates. */
+#define UPDATE_THREADS_DEFAULT_MAX 4
+
+/* Minimum time between flushes of the history and update logs. */
+#define LOG_FLUSH_INTERVAL 1
+
+/* Interval of the statistics on received updates. */
+#define UPDATE_STATS_INTERVAL 60
+
 /* Maximum size of a JX record arriving via TCP is 1MB. */
 #define TCP_PAYLOAD_MAX 1024*1024
 
 /* The table of record, hashed on address:port */
 static struct deltadb *table = 0;
 
-/* An array of jxs used to sort for display */
-static struct jx *array[MAX_TABLE_SIZE];
-
 /* The time for which updated data lives before automatic deletion */
 static int lifetime = 1800;
 
@@ -103,17 +139,18 @@ static char owner[USERNAME_MAX];
 /* Time when the process was started. */
 static time_t starttime;
 
-/* If true, for for every query */
-static int fork_mode = 1;
+/* Number of threads answering queries. */
+static int query_threads = QUERY_THREADS_DEFAULT;
 
-/* The maximum number of simultaneous children that can be running. */
-static int child_procs_max = 50;
+/* Fields of the records with a secondary index, to speed up queries on them. */
+static char **index_fields = 0;
+static int index_field_count = 0;
 
-/* Number of query processses currently running. */
-static int child_procs_count = 0;
+/* The maximum number of history queries that can be running at once. */
+static int history_threads_max = 50;
 
-/* Maximum time to allow a child process to run. */
-static int child_procs_timeout = 60;
+/* Maximum time to allow a query to run. */
+static int query_timeout = 60;
 
 /* The maximum size of a server that will actually be believed. */
 static INT64_T max_server_size = 0;
@@ -125,6 +162,18 @@ static char *logfilename = 0;
 /* Location of the history file. Default is in the current dir. */
 static const char * history_dir = "catalog.history";
 
+/* Number of threads decoding updates in addition to the main thread, or -1 to choose by cpu count. */
+static int update_threads = -1;
+
+/* Number of updates received by UDP since the last statistics message. */
+static int udp_updates_received = 0;
+
+/* Time of the last statistics message. */
+static time_t last_stats_time = 0;
+
+/* Time when the logs were last flushed. */
+static time_t last_flush_time = 0;
+
 /* Settings for the manager catalog that we will report *to* */
 static int outgoing_alarm = 0;
 static int outgoing_timeout = 300;
@@ -154,20 +203,488 @@ static void install_handler(int sig, void (*handler) (int sig))
 	sigaction(sig, &s, 0);
 }
 
-int compare_jx(const void *a, const void *b)
+/*
+Queries are answered by a pool of threads from an immutable snapshot
+of the table, which the main thread publishes at most every
+SNAPSHOT_INTERVAL seconds. Records are shared between successive
+snapshots, so that only those changed since the last publication
+are copied. A query thread holds a reference to the snapshot it reads,
+so publishing is just a swap of the current pointer, and an old
+snapshot is freed by whichever thread releases it last.
+
+A new snapshot is built from the previous one: the changed records are
+sorted among themselves and merged into the sorted records, and only the
+index lists of values held by a changed record are rebuilt. The others
+are shared with the previous snapshot.
+*/
+
+struct catalog_record {
+	int refcount;
+	char *key;
+	struct jx *j;
+	const char *name;     /* for sorting, within j */
+	const char **values;  /* of each of index_fields, within j, or null */
+	int replaced;         /* set by the main thread once a newer version is published */
+};
+
+struct catalog_snapshot {
+	int refcount;
+	int n;
+	struct catalog_record **records; /* sorted by name for display */
+	struct hash_table **field_indexes; /* for each of index_fields, value -> record_list */
+};
+
+/* Records with the same value of an indexed field, in display order, shared by snapshots. */
+
+struct record_list {
+	int refcount;
+	int n;
+	int size;
+	struct catalog_record **records;
+};
+
+/* The snapshot most recently published. */
+static struct catalog_snapshot *current_snapshot = 0;
+static pthread_mutex_t snapshot_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Records in the current snapshot, and keys changed since, used only by the main thread. */
+static struct hash_table *published_records = 0;
+static struct hash_table *changed_keys = 0;
+
+/* Time when the current snapshot was published. */
+static time_t last_publish_time = 0;
+
+static struct catalog_record *record_create( const char *key, struct jx *j )
+{
+	int f;
+
+	struct catalog_record *r = xxmalloc(sizeof(*r));
+	r->refcount = 1;
+	r->key = xxstrdup(key);
+	r->j = j;
+	r->replaced = 0;
+
+	r->name = jx_lookup_string(j, "name");
+	if(!r->name)
+		r->name = "unknown";
+
+	/* Only string values are indexed, as only those can be equal to a string. */
+	r->values = xxmalloc(sizeof(*r->values)*MAX(index_field_count,1));
+	for(f=0;f<index_field_count;f++) {
+		r->values[f] = jx_lookup_string(j,index_fields[f]);
+	}
+
+	return r;
+}
+
+static void record_release( struct catalog_record *r )
+{
+	if(__atomic_sub_fetch(&r->refcount,1,__ATOMIC_ACQ_REL)>0) return;
+	jx_delete(r->j);
+	free(r->values);
+	free(r->key);
+	free(r);
+}
+
+static int compare_records(const void *a, const void *b)
+{
+	struct catalog_record **pa = (struct catalog_record **) a;
+	struct catalog_record **pb = (struct catalog_record **) b;
+
+	return strcasecmp((*pa)->name, (*pb)->name);
+}
+
+/*
+Merge the sorted records a, leaving out those replaced, with the sorted
+records b, into out, which must have room for na+nb records.
+Returns the number of records in out.
+*/
+
+static int record_merge( struct catalog_record **out, struct catalog_record **a, int na, struct catalog_record **b, int nb )
+{
+	int i = 0, j = 0, n = 0;
+
+	while(i<na || j<nb) {
+		if(i<na && a[i]->replaced) {
+			i++;
+		} else if(j>=nb || (i<na && compare_records(&a[i],&b[j])<=0)) {
+			out[n++] = a[i++];
+		} else {
+			out[n++] = b[j++];
+		}
+	}
+
+	return n;
+}
+
+static struct record_list *record_list_create( int size )
+{
+	struct record_list *l = xxmalloc(sizeof(*l));
+	l->refcount = 1;
+	l->n = 0;
+	l->size = size;
+	l->records = size>0 ? xxmalloc(sizeof(*l->records)*size) : 0;
+	return l;
+}
+
+static void record_list_append( struct record_list *l, struct catalog_record *r )
+{
+	if(l->n==l->size) {
+		l->size = MAX(l->size*2,8);
+		l->records = xxrealloc(l->records,sizeof(*l->records)*l->size);
+	}
+	l->records[l->n++] = r;
+}
+
+static void record_list_release( void *arg )
+{
+	struct record_list *l = arg;
+	if(__atomic_sub_fetch(&l->refcount,1,__ATOMIC_ACQ_REL)>0) return;
+	free(l->records);
+	free(l);
+}
+
+static struct catalog_snapshot *snapshot_create( int size )
+{
+	int f;
+
+	struct catalog_snapshot *s = xxmalloc(sizeof(*s));
+	s->refcount = 1;
+	s->n = 0;
+	s->records = xxmalloc(sizeof(*s->records)*MAX(size,1));
+	s->field_indexes = xxcalloc(MAX(index_field_count,1),sizeof(*s->field_indexes));
+	for(f=0;f<index_field_count;f++) {
+		s->field_indexes[f] = hash_table_create(0,0);
+	}
+	return s;
+}
+
+/* Build the secondary indexes of a snapshot whose records are sorted, so that each list is also in display order. */
+
+static void snapshot_index_build( struct catalog_snapshot *s )
+{
+	int i, f;
+
+	for(i=0;i<s->n;i++) {
+		struct catalog_record *r = s->records[i];
+		for(f=0;f<index_field_count;f++) {
+			const char *value = r->values[f];
+			if(!value) continue;
+
+			struct record_list *l = hash_table_lookup(s->field_indexes[f],value);
+			if(!l) {
+				l = record_list_create(0);
+				hash_table_insert(s->field_indexes[f],value,l);
+			}
+			record_list_append(l,r);
+		}
+	}
+}
+
+/* Sort the records of a new snapshot for display, then build its indexes. */
+
+static void snapshot_finish( struct catalog_snapshot *s )
+{
+	qsort(s->records, s->n, sizeof(*s->records), compare_records);
+	snapshot_index_build(s);
+}
+
+/*
+Build the index of field f of a new snapshot s from that of the previous
+snapshot old. The lists of values that no record in added or removed
+holds are shared, and the others merged from the old list and added.
+*/
+
+static void snapshot_index_update( struct catalog_snapshot *s, struct catalog_snapshot *old, int f, struct catalog_record **added, int nadded, struct catalog_record **removed, int nremoved )
+{
+	int i;
+	char *value;
+	struct record_list *l;
+
+	/* The added records of each value, in display order as added is. */
+	struct hash_table *additions = hash_table_create(0,0);
+	for(i=0;i<nadded;i++) {
+		const char *v = added[i]->values[f];
+		if(!v) continue;
+		l = hash_table_lookup(additions,v);
+		if(!l) {
+			l = record_list_create(0);
+			hash_table_insert(additions,v,l);
+		}
+		record_list_append(l,added[i]);
+	}
+
+	/* Values losing a record, and not gaining any. */
+	struct hash_table *affected = hash_table_create(0,0);
+	for(i=0;i<nremoved;i++) {
+		const char *v = removed[i]->values[f];
+		if(v && !hash_table_lookup(additions,v)) hash_table_insert(affected,v,(void*)1);
+	}
+
+	HASH_TABLE_ITERATE(old->field_indexes[f],value,l) {
+		if(hash_table_lookup(additions,value) || hash_table_lookup(affected,value)) continue;
+		__atomic_add_fetch(&l->refcount,1,__ATOMIC_RELAXED);
+		hash_table_insert(s->field_indexes[f],value,l);
+	}
+
+	struct record_list *a;
+	HASH_TABLE_ITERATE(additions,value,a) {
+		struct record_list *o = hash_table_lookup(old->field_indexes[f],value);
+		l = record_list_create((o ? o->n : 0) + a->n);
+		l->n = record_merge(l->records, o ? o->records : 0, o ? o->n : 0, a->records, a->n);
+		hash_table_insert(s->field_indexes[f],value,l);
+	}
+
+	void *dummy;
+	HASH_TABLE_ITERATE(affected,value,dummy) {
+		struct record_list *o = hash_table_lookup(old->field_indexes[f],value);
+		if(!o) continue;
+		l = record_list_create(o->n);
+		l->n = record_merge(l->records, o->records, o->n, 0, 0);
+		if(l->n>0) {
+			hash_table_insert(s->field_indexes[f],value,l);
+		} else {
+			record_list_release(l);
+		}
+	}
+
+	hash_table_clear(additions,record_list_release);
+	hash_table_delete(additions);
+	hash_table_delete(affected);
+}
+
+/* Add a record to a snapshot being built, which takes over the caller's reference. */
+
+static void snapshot_add( struct catalog_snapshot *s, struct catalog_record *r )
+{
+	s->records[s->n++] = r;
+}
+
+static void snapshot_release( struct catalog_snapshot *s )
+{
+	int i;
+
+	if(!s) return;
+	if(__atomic_sub_fetch(&s->refcount,1,__ATOMIC_ACQ_REL)>0) return;
+
+	for(i=0;i<index_field_count;i++) {
+		hash_table_clear(s->field_indexes[i],record_list_release);
+		hash_table_delete(s->field_indexes[i]);
+	}
+	free(s->field_indexes);
+
+	for(i=0;i<s->n;i++) record_release(s->records[i]);
+	free(s->records);
+	free(s);
+}
+
+/* Get a reference to the current snapshot, to be released with snapshot_release. */
+
+static struct catalog_snapshot *snapshot_acquire()
+{
+	pthread_mutex_lock(&snapshot_mutex);
+	struct catalog_snapshot *s = current_snapshot;
+	__atomic_add_fetch(&s->refcount,1,__ATOMIC_RELAXED);
+	pthread_mutex_unlock(&snapshot_mutex);
+	return s;
+}
+
+/* Find a record of a snapshot by key, for the rare pages about a single record. */
+
+static struct catalog_record *snapshot_lookup( struct catalog_snapshot *s, const char *key )
+{
+	int i;
+	for(i=0;i<s->n;i++) {
+		if(!strcmp(s->records[i]->key,key)) return s->records[i];
+	}
+	return 0;
+}
+
+/* Note that a record was created, changed, or removed in the table. */
+
+static void snapshot_changed( const char *key )
+{
+	if(!hash_table_lookup(changed_keys,key)) {
+		hash_table_insert(changed_keys,key,(void*)1);
+	}
+}
+
+/*
+Publish the current state of the table, if anything changed.
+Unless force is set, this happens at most every SNAPSHOT_INTERVAL
+seconds, so that bursts of updates are published together.
+*/
+
+static void snapshot_publish( int force )
 {
-	struct jx **pa = (struct jx **) a;
-	struct jx **pb = (struct jx **) b;
+	char *key;
+	void *value;
+	int f, i;
+	time_t current = time(0);
 
-	const char *sa = jx_lookup_string(*pa, "name");
-	const char *sb = jx_lookup_string(*pb, "name");
+	if(current_snapshot && hash_table_size(changed_keys)==0) return;
+	if(!force && (current-last_publish_time)<SNAPSHOT_INTERVAL) return;
+
+	struct catalog_snapshot *old = current_snapshot;
+	int nchanged = hash_table_size(changed_keys);
+	struct catalog_record **added = xxmalloc(sizeof(*added)*MAX(nchanged,1));
+	struct catalog_record **removed = xxmalloc(sizeof(*removed)*MAX(nchanged,1));
+	int nadded = 0, nremoved = 0;
+
+	/* The removed records are still held by the old snapshot. */
+	HASH_TABLE_ITERATE(changed_keys,key,value) {
+		struct catalog_record *r = hash_table_remove(published_records,key);
+		if(r) {
+			r->replaced = 1;
+			removed[nremoved++] = r;
+		}
+
+		struct jx *j = deltadb_lookup(table,key);
+		if(j) {
+			r = record_create(key,jx_copy(j));
+			hash_table_insert(published_records,key,r);
+			added[nadded++] = r;
+		}
+	}
+	hash_table_clear(changed_keys,0);
 
-	if(!sa)
-		sa = "unknown";
-	if(!sb)
-		sb = "unknown";
+	qsort(added, nadded, sizeof(*added), compare_records);
 
-	return strcasecmp(sa, sb);
+	struct catalog_snapshot *s = snapshot_create((old ? old->n : 0) + nadded);
+	s->n = record_merge(s->records, old ? old->records : 0, old ? old->n : 0, added, nadded);
+	for(i=0;i<s->n;i++) {
+		__atomic_add_fetch(&s->records[i]->refcount,1,__ATOMIC_RELAXED);
+	}
+
+	if(old) {
+		for(f=0;f<index_field_count;f++) {
+			snapshot_index_update(s,old,f,added,nadded,removed,nremoved);
+		}
+	} else {
+		snapshot_index_build(s);
+	}
+
+	/* The published table keeps its own reference to the added records. */
+	for(i=0;i<nremoved;i++) record_release(removed[i]);
+	free(added);
+	free(removed);
+
+	pthread_mutex_lock(&snapshot_mutex);
+	current_snapshot = s;
+	pthread_mutex_unlock(&snapshot_mutex);
+
+	snapshot_release(old);
+
+	last_publish_time = current;
+}
+
+/*
+Find the records of a snapshot that may match expr. If expr is a
+conjunction with an equality between an indexed field and a string
+among its terms, only the shortest such list of records is returned,
+otherwise all of them. Either way, expr must still be evaluated on
+each record returned. Returns true if an index was used.
+*/
+
+static int snapshot_plan_term( struct catalog_snapshot *s, struct jx *expr, struct record_list **best )
+{
+	static struct record_list empty = {0,0,0,0};
+	int f;
+
+	if(!jx_istype(expr,JX_OPERATOR)) return 0;
+
+	struct jx_operator *o = &expr->u.oper;
+
+	if(o->type==JX_OP_AND) {
+		int left = snapshot_plan_term(s,o->left,best);
+		int right = snapshot_plan_term(s,o->right,best);
+		return left || right;
+	}
+
+	if(o->type!=JX_OP_EQ) return 0;
+
+	struct jx *symbol = o->left;
+	struct jx *value = o->right;
+	if(!jx_istype(symbol,JX_SYMBOL)) {
+		symbol = o->right;
+		value = o->left;
+	}
+	if(!jx_istype(symbol,JX_SYMBOL) || !jx_istype(value,JX_STRING)) return 0;
+
+	for(f=0;f<index_field_count;f++) {
+		if(!strcmp(index_fields[f],symbol->u.symbol_name)) {
+			struct record_list *l = hash_table_lookup(s->field_indexes[f],value->u.string_value);
+			if(!l) l = &empty;
+			if(!*best || l->n<(*best)->n) *best = l;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int snapshot_plan( struct catalog_snapshot *s, struct jx *expr, struct catalog_record ***records, int *n )
+{
+	struct record_list *best = 0;
+
+	if(snapshot_plan_term(s,expr,&best)) {
+		*records = best->records;
+		*n = best->n;
+		return 1;
+	} else {
+		*records = s->records;
+		*n = s->n;
+		return 0;
+	}
+}
+
+/* Publish the table as recovered from the history, before any queries are answered. */
+
+static void snapshot_init()
+{
+	char *key;
+	struct jx *j;
+
+	published_records = hash_table_create(0,0);
+	changed_keys = hash_table_create(0,0);
+
+	deltadb_firstkey(table);
+	while(deltadb_nextkey(table,&key,&j)) {
+		snapshot_changed(key);
+	}
+
+	snapshot_publish(1);
+}
+
+/*
+Build a snapshot of the table as it was at some time in the past,
+by replaying the history. May be called from any thread.
+*/
+
+static struct catalog_snapshot *snapshot_from_history( time_t timestamp )
+{
+	char *key;
+	struct jx *j;
+	int n = 0;
+
+	struct deltadb *db = deltadb_create_snapshot(history_dir, timestamp);
+	if(!db) return 0;
+
+	deltadb_firstkey(db);
+	while(deltadb_nextkey(db,&key,&j)) n++;
+
+	struct catalog_snapshot *s = snapshot_create(n);
+
+	deltadb_firstkey(db);
+	while(deltadb_nextkey(db,&key,&j)) {
+		snapshot_add(s,record_create(key,jx_copy(j)));
+	}
+
+	snapshot_finish(s);
+
+	deltadb_delete(db);
+
+	return s;
 }
 
 static void remove_expired_records()
@@ -196,7 +713,8 @@ static void remove_expired_records()
 		}
 
 		if( (current-lastheardfrom) > this_lifetime ) {
-				j = deltadb_remove(table,key);
+			snapshot_changed(key);
+			j = deltadb_remove(table,key);
 			if(j) jx_delete(j);
 		}
 	}
@@ -204,6 +722,33 @@ static void remove_expired_records()
 	last_clean_time = current;
 }
 
+/*
+Push out the history and update logs, which are written
+to disk together at most every LOG_FLUSH_INTERVAL seconds.
+*/
+
+static void flush_logs( int force )
+{
+	time_t current = time(0);
+	if(!force && (current-last_flush_time)<LOG_FLUSH_INTERVAL) return;
+
+	deltadb_flush(table);
+	if(logfile) fflush(logfile);
+	last_flush_time = current;
+}
+
+static void show_update_stats()
+{
+	time_t current = time(0);
+	if((current-last_stats_time)<UPDATE_STATS_INTERVAL) return;
+
+	if(last_stats_time>0) {
+		debug(D_DEBUG,"received %d udp updates in %d seconds",udp_updates_received,(int)(current-last_stats_time));
+	}
+	udp_updates_received = 0;
+	last_stats_time = current;
+}
+
 static void update_all_catalogs()
 {
 	struct jx *j = jx_object(0);
@@ -252,51 +797,113 @@ static void make_hash_key(struct jx *j, char *key)
 			uuid ? uuid : "");
 }
 
-static void handle_update( const char *addr, int port, const char *raw_data, int raw_data_length, const char *protocol )
+/*
+An update as it arrives from the network, and the result of decoding it.
+Decoding touches no shared state, so that batches of updates can be
+decoded by several threads at once, and then applied to the table in
+order by the main thread.
+*/
+
+struct update_msg {
+	const char *addr;
+	int port;
+	const char *raw;
+	int raw_length;
+	struct jx *j;      /* the decoded JSON object */
+	char *text;        /* the text, if in the legacy nvpair format or invalid */
+	const char *error; /* why the update is being ignored */
+};
+
+/* Uncompress and parse an update, using buf of buf_size bytes as scratch space. */
+
+static void update_decode( struct update_msg *m, char *buf, unsigned long buf_size )
 {
-	char key[LINE_MAX];
 	unsigned long data_length;
-	struct jx *j;
 
-		// If the packet starts with Control-Z (0x1A), it is compressed,
-		// so uncompress it to data[].  Otherwise just copy to data[];.
+	m->j = 0;
+	m->text = 0;
+	m->error = 0;
 
-		if(raw_data[0]==0x1A) {
-			data_length = sizeof(data);
-			int success = uncompress((Bytef*)data,&data_length,(const Bytef*)&raw_data[1],raw_data_length-1);
-			if(success!=Z_OK) {
-				debug(D_DEBUG,"warning: %s:%d sent invalid compressed data (ignoring it)\n",addr,port);
-				return;
-			}
-		} else {
-			memcpy(data,raw_data,raw_data_length);
-			data_length = raw_data_length;
+	if(m->raw_length<=0) {
+		m->error = "empty data";
+		return;
+	}
+
+	// If the packet starts with Control-Z (0x1A), it is compressed,
+	// so uncompress it to buf[].  Otherwise just copy to buf[];.
+
+	if(m->raw[0]==0x1A) {
+		data_length = buf_size-1;
+		int success = uncompress((Bytef*)buf,&data_length,(const Bytef*)&m->raw[1],m->raw_length-1);
+		if(success!=Z_OK) {
+			m->error = "invalid compressed data";
+			return;
 		}
+	} else {
+		data_length = MIN((unsigned long)m->raw_length,buf_size-1);
+		memcpy(buf,m->raw,data_length);
+	}
 
-		// Make sure the string data is null terminated.
-		data[data_length] = 0;
+	// Make sure the string data is null terminated.
+	buf[data_length] = 0;
 
-		// Once uncompressed, if it starts with a bracket,
-		// then it is JX/JSON, otherwise it is the legacy nvpair format.
+	// Once uncompressed, if it starts with a bracket,
+	// then it is JX/JSON, otherwise it is the legacy nvpair format.
 
-		if(data[0]=='{') {
-			j = jx_parse_string(data);
-			if(!j) {
-				debug(D_DEBUG,"warning: %s:%d sent invalid JSON data (ignoring it)\n%s\n",addr,port,data);
-				return;
-			}
-			if(!jx_is_constant(j)) {
-				debug(D_DEBUG,"warning: %s:%d sent non-constant JX data (ignoring it)\n%s\n",addr,port,data);
-				jx_delete(j);
-				return;
-			}
+	if(buf[0]=='{') {
+		struct jx_parser *p = jx_parser_create(false);
+		jx_parser_read_string_and_length(p,buf,data_length);
+		struct jx *j = jx_parse(p);
+		if(jx_parser_errors(p)) {
+			jx_delete(j);
+			j = 0;
+		}
+		jx_parser_delete(p);
+
+		if(!j) {
+			m->error = "invalid JSON data";
+			m->text = strdup(buf);
+		} else if(!jx_is_constant(j)) {
+			m->error = "non-constant JX data";
+			m->text = strdup(buf);
+			jx_delete(j);
 		} else {
-			struct nvpair *nv = nvpair_create();
-			if(!nv) return;
-			nvpair_parse(nv, data);
+			m->j = j;
+		}
+	} else {
+		m->text = strdup(buf);
+	}
+}
+
+/* Apply a decoded update to the table. Must be called from the main thread. */
+
+static void update_apply( struct update_msg *m, const char *protocol )
+{
+	char key[LINE_MAX];
+	const char *addr = m->addr;
+	int port = m->port;
+	struct jx *j = m->j;
+
+	m->j = 0;
+
+	if(m->error) {
+		debug(D_DEBUG,"warning: %s:%d sent %s (ignoring it)\n%s\n",addr,port,m->error,m->text ? m->text : "");
+		free(m->text);
+		m->text = 0;
+		return;
+	}
+
+	if(!j) {
+		struct nvpair *nv = nvpair_create();
+		if(nv) {
+			nvpair_parse(nv, m->text);
 			j = nvpair_to_jx(nv);
 			nvpair_delete(nv);
 		}
+		free(m->text);
+		m->text = 0;
+		if(!j) return;
+	}
 
 		jx_insert_string(j, "address", addr);
 		jx_insert_integer(j, "lastheardfrom", time(0));
@@ -344,35 +951,163 @@ static void handle_update( const char *addr, int port, const char *raw_data, int
 
 		if(logfile) {
 			if(!deltadb_lookup(table,key)) {
+				/* Flushed together with the history, see flush_logs. */
 				jx_print_stream(j,logfile);
 				fprintf(logfile,"\n");
-				fflush(logfile);
 			}
 		}
 
 		deltadb_insert(table, key, j);
+		snapshot_changed(key);
 
 		debug(D_DEBUG, "received %s update from %s",protocol,key);
 }
 
+static void handle_update( const char *addr, int port, const char *raw_data, int raw_data_length, const char *protocol )
+{
+	struct update_msg m;
+	m.addr = addr;
+	m.port = port;
+	m.raw = raw_data;
+	m.raw_length = raw_data_length;
+
+	update_decode(&m,data,sizeof(data));
+	update_apply(&m,protocol);
+}
+
+/*
+A small pool of threads that decodes a batch of updates alongside
+the main thread. Workers sleep on pool_start until a new batch is
+posted, take messages by index, and signal pool_done when idle.
+*/
+
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+static struct update_msg *pool_msgs = 0;
+static int pool_count = 0;
+static int pool_next = 0;
+static int pool_busy = 0;
+static unsigned pool_batch = 0;
+
+static void *update_worker( void *arg )
+{
+	unsigned long buf_size = sizeof(data);
+	char *buf = xxmalloc(buf_size);
+	unsigned seen = 0;
+
+	pthread_mutex_lock(&pool_mutex);
+	while(1) {
+		while(pool_batch==seen) {
+			pthread_cond_wait(&pool_start,&pool_mutex);
+		}
+		seen = pool_batch;
+
+		pool_busy++;
+		while(pool_next<pool_count) {
+			struct update_msg *m = &pool_msgs[pool_next++];
+			pthread_mutex_unlock(&pool_mutex);
+			update_decode(m,buf,buf_size);
+			pthread_mutex_lock(&pool_mutex);
+		}
+		pool_busy--;
+
+		if(pool_busy==0) pthread_cond_signal(&pool_done);
+	}
+
+	return 0;
+}
+
+static void update_pool_start()
+{
+	int i;
+
+	if(update_threads<0) {
+		long n = sysconf(_SC_NPROCESSORS_ONLN);
+		update_threads = MAX(0,MIN(n-1,UPDATE_THREADS_DEFAULT_MAX));
+	}
+
+	for(i=0;i<update_threads;i++) {
+		pthread_t t;
+		if(pthread_create(&t,0,update_worker,0)!=0) {
+			fatal("couldn't create update thread: %s",strerror(errno));
+		}
+		pthread_detach(t);
+	}
+
+	debug(D_DEBUG,"decoding updates with %d additional threads",update_threads);
+}
+
+static void update_pool_decode( struct update_msg *msgs, int count )
+{
+	int i;
+
+	if(update_threads<=0) {
+		for(i=0;i<count;i++) update_decode(&msgs[i],data,sizeof(data));
+		return;
+	}
+
+	pthread_mutex_lock(&pool_mutex);
+	pool_msgs = msgs;
+	pool_count = count;
+	pool_next = 0;
+	pool_batch++;
+	pthread_cond_broadcast(&pool_start);
+
+	while(pool_next<pool_count) {
+		struct update_msg *m = &pool_msgs[pool_next++];
+		pthread_mutex_unlock(&pool_mutex);
+		update_decode(m,data,sizeof(data));
+		pthread_mutex_lock(&pool_mutex);
+	}
+
+	while(pool_busy>0) {
+		pthread_cond_wait(&pool_done,&pool_mutex);
+	}
+	pthread_mutex_unlock(&pool_mutex);
+}
+
 /*
 Where possible, we prefer to accept short updates via UDP,
 because these can be accepted quickly in a non-blocking manner.
+Datagrams are drained in batches: decoded together, then applied in order.
+The number of batches per call is limited, so that queries are not starved.
 */
 
 static void handle_udp_updates(struct datagram *update_port)
 {
-	char data[DATAGRAM_PAYLOAD_MAX];
-	char addr[DATAGRAM_ADDRESS_MAX];
-	int port;
+	static char buffers[UDP_BATCH_MAX][DATAGRAM_PAYLOAD_MAX];
+	struct datagram_message dmsgs[UDP_BATCH_MAX];
+	struct update_msg umsgs[UDP_BATCH_MAX];
+	int i, n, batches;
+
+	for(batches=0;batches<UDP_BATCHES_PER_CALL;batches++) {
+		for(i=0;i<UDP_BATCH_MAX;i++) {
+			dmsgs[i].data = buffers[i];
+			dmsgs[i].length = DATAGRAM_PAYLOAD_MAX;
+		}
 
-	while(1) {
-		int result = datagram_recv(update_port, data, DATAGRAM_PAYLOAD_MAX, addr, &port, 0);
-		if(result <= 0)
+		n = datagram_recv_batch(update_port,dmsgs,UDP_BATCH_MAX);
+		if(n<=0)
 			return;
 
-		data[result] = 0;
-		handle_update(addr,port,data,result,"udp");
+		for(i=0;i<n;i++) {
+			umsgs[i].addr = dmsgs[i].addr;
+			umsgs[i].port = dmsgs[i].port;
+			umsgs[i].raw = dmsgs[i].data;
+			umsgs[i].raw_length = dmsgs[i].length;
+		}
+
+		update_pool_decode(umsgs,n);
+
+		for(i=0;i<n;i++) {
+			update_apply(&umsgs[i],"udp");
+		}
+
+		udp_updates_received += n;
+
+		if(n<UDP_BATCH_MAX)
+			return;
 	}
 }
 
@@ -431,9 +1166,10 @@ int jx_eval_is_true( struct jx *expr, struct jx *context )
 
 void send_http_response( struct link *l, int code, const char *message, const char *content_type, time_t stoptime )
 {
+	char date[32];
 	time_t current = time(0);
 	link_printf(l,stoptime, "HTTP/1.1 %d %s\n",code,message);
-	link_printf(l,stoptime, "Date: %s", ctime(&current));
+	link_printf(l,stoptime, "Date: %s", ctime_r(&current,date));
 	link_printf(l,stoptime, "Server: catalog_server\n");
 	link_printf(l,stoptime, "Connection: close\n");
 	link_printf(l,stoptime, "Access-Control-Allow-Origin: *\n");
@@ -441,6 +1177,25 @@ void send_http_response( struct link *l, int code, const char *message, const ch
 	link_flush_output(l);
 }
 
+/*
+Send a response header for a body of known length, which allows the
+client to send another request on the same connection.
+*/
+
+void send_http_response_length( struct link *l, int code, const char *message, const char *content_type, size_t length, int keepalive, time_t stoptime )
+{
+	char date[32];
+	time_t current = time(0);
+	link_printf(l,stoptime, "HTTP/1.1 %d %s\n",code,message);
+	link_printf(l,stoptime, "Date: %s", ctime_r(&current,date));
+	link_printf(l,stoptime, "Server: catalog_server\n");
+	link_printf(l,stoptime, "Connection: %s\n", keepalive ? "keep-alive" : "close");
+	link_printf(l,stoptime, "Access-Control-Allow-Origin: *\n");
+	link_printf(l,stoptime, "Content-Length: %zu\n",length);
+	link_printf(l,stoptime, "Content-type: %s; charset=utf-8\n\n",content_type);
+	link_flush_output(l);
+}
+
 void send_html_header( struct link *l, time_t stoptime )
 {
 	link_printf(l,stoptime, "<!DOCTYPE HTML PUBLIC \"-//W3C//DTD HTML 4.01//EN\" \"http://www.w3.org/TR/html4/strict.dtd\">\n");
@@ -449,131 +1204,179 @@ void send_html_header( struct link *l, time_t stoptime )
 	link_printf(l,stoptime, "</head>\n");
 }
 
-static void handle_query( struct link *ql, time_t st )
+static struct jx *decode_jx( const char *b64 )
 {
-	char line[LINE_MAX];
-	char url[LINE_MAX];
-	char full_path[LINE_MAX];
-	char path[LINE_MAX];
-	char action[LINE_MAX];
-	char version[LINE_MAX];
-	char hostport[LINE_MAX];
-	char addr[LINK_ADDRESS_MAX];
-	char key[LINE_MAX];
-	char strexpr[LINE_MAX];
-	int port;
-	long time_start, time_stop;
-	long timestamp = 0;
-
-	char *hkey;
-	struct jx *j;
-	int i, n;
-
-	link_address_remote(ql, addr, &port);
-	debug(D_DEBUG, "%s query from %s:%d", link_using_ssl(ql) ? "https" : "http", addr, port);
+	struct jx *j = 0;
+	struct buffer buf;
+	buffer_init(&buf);
+	if(b64_decode(b64,&buf)==0) {
+		j = jx_parse_string(buffer_tostring(&buf));
+	}
+	buffer_free(&buf);
+	return j;
+}
 
-	if(link_readline(ql, line, LINE_MAX, time(0) + HANDLE_QUERY_TIMEOUT)) {
-		string_chomp(line);
-		if(sscanf(line, "%s %s %s", action, url, version) != 3) {
-			return;
-		}
+/*
+Respond to /select/<since>/<expr>/<fields>, where expr is a base-64 encoded
+filter expression and fields is a base-64 encoded array of field names,
+or null for all fields. The response lists the keys of all matching
+records, in display order, but the contents of only those matching records
+updated at or after since. A client that kept the result of a previous
+query then only needs to receive the changes.
+Returns true if the connection may be kept open for another request.
+*/
 
-		// Consume the rest of the query
-		while(1) {
-			/* If we read to end-of-stream on the request, that's ok. */
-			if(!link_readline(ql, line, LINE_MAX, time(0) + HANDLE_QUERY_TIMEOUT)) {
-				break;
-			}
+static int handle_select( struct link *ql, struct catalog_snapshot *s, time_t since, const char *strexpr, const char *strfields, int keepalive, time_t st )
+{
+	time_t now = time(0);
+	int i, count = 0, updated = 0;
+
+	struct jx *expr = decode_jx(strexpr);
+	struct jx *fields = decode_jx(strfields);
+
+	if(!expr || !fields || !(jx_istype(fields,JX_ARRAY) || jx_istype(fields,JX_NULL))) {
+		send_http_response(ql,400,"Bad Request","text/plain",st);
+		link_printf(ql,st,"Invalid query text.\n");
+		jx_delete(expr);
+		jx_delete(fields);
+		return 0;
+	}
 
-			/* If we get a blank line separator, proceed to respond. */
-			if(line[0] == 0) {
-				break;
+	buffer_t keys, body;
+	buffer_init(&keys);
+	buffer_init(&body);
+	buffer_abortonfailure(&keys, 1);
+	buffer_abortonfailure(&body, 1);
+
+	buffer_printf(&body,"{\"time\":%ld,\"updated\":{",(long)now);
+
+	struct catalog_record **records;
+	int n;
+	int indexed = snapshot_plan(s,expr,&records,&n);
+
+	for(i = 0; i < n; i++) {
+		struct catalog_record *r = records[i];
+		struct jx *j = r->j;
+		if(!jx_eval_is_true(expr,j)) continue;
+
+		if(count>0) buffer_putliteral(&keys,",");
+		jx_escape_string(r->key,&keys);
+		count++;
+
+		if(jx_lookup_integer(j,"lastheardfrom") < since) continue;
+
+		if(updated>0) buffer_putliteral(&body,",\n");
+		jx_escape_string(r->key,&body);
+		buffer_putliteral(&body,":");
+		if(jx_istype(fields,JX_ARRAY)) {
+			struct jx *p = jx_object(0);
+			struct jx *field;
+			void *iter = NULL;
+			while((field = jx_iterate_array(fields,&iter))) {
+				if(!jx_istype(field,JX_STRING)) continue;
+				struct jx *value = jx_lookup(j,field->u.string_value);
+				if(value) jx_insert(p,jx_copy(field),jx_copy(value));
 			}
+			jx_print_buffer(p,&body);
+			jx_delete(p);
+		} else {
+			jx_print_buffer(j,&body);
 		}
-	} else {
-		return;
+		updated++;
 	}
 
-	if(sscanf(url, "http://%[^/]%s", hostport, full_path) == 2) {
-		// continue on
-	} else {
-		strcpy(full_path, url);
-	}
+	buffer_printf(&body,"},\n\"keys\":[%s]}\n",buffer_tostring(&keys));
 
-	if(3==sscanf(full_path, "/updates/%ld/%ld/%[^/]",&time_start,&time_stop,strexpr)) {
-		// check for updates request first, before processing deltadb state
-		struct buffer buf;
-		buffer_init(&buf);
-		if(b64_decode(strexpr,&buf)==0) {
-			struct jx *expr = jx_parse_string(buffer_tostring(&buf));
-			if(expr) {
-				if(link_using_ssl(ql)) {
-					send_http_response(ql,501,"Server Error","text/plain",st);
-					link_printf(ql,st,"Sorry, unable to serve queries over HTTPS.");
-				} else {
-					send_http_response(ql,200,"OK","text/plain",st);
-
-					struct deltadb_query *query = deltadb_query_create();
-					deltadb_query_set_filter(query,expr);
-					// Note this leaks a stdio stream, but it will be shortly recovered on process exit.
-					deltadb_query_set_output(query,fdopen(link_fd(ql),"w"));
+	size_t length;
+	const char *text = buffer_tolstring(&body,&length);
+	send_http_response_length(ql,200,"OK","application/json",length,keepalive,st);
+	link_putlstring(ql,text,length,st);
+
+	debug(D_DEBUG,"select since %ld matched %d of %d records%s, %d updated",(long)since,count,n,indexed ? " by index" : "",updated);
+
+	buffer_free(&keys);
+	buffer_free(&body);
+	jx_delete(expr);
+	jx_delete(fields);
+
+	return keepalive;
+}
+
+/* Outcomes of handling a request on a query connection. */
+
+enum {
+	QUERY_CLOSE,    /* the connection should be closed */
+	QUERY_KEEP,     /* the connection may carry another request */
+	QUERY_DETACHED, /* the connection was handed over to a history thread */
+};
+
+/* Stream the updates between time_start and time_stop that match the base-64 encoded expression. */
+
+static void handle_updates( struct link *ql, time_t time_start, time_t time_stop, const char *strexpr, time_t st )
+{
+	struct buffer buf;
+	buffer_init(&buf);
+	if(b64_decode(strexpr,&buf)==0) {
+		struct jx *expr = jx_parse_string(buffer_tostring(&buf));
+		if(expr) {
+			if(link_using_ssl(ql)) {
+				send_http_response(ql,501,"Server Error","text/plain",st);
+				link_printf(ql,st,"Sorry, unable to serve queries over HTTPS.");
+				jx_delete(expr);
+			} else {
+				send_http_response(ql,200,"OK","text/plain",st);
+
+				struct deltadb_query *query = deltadb_query_create();
+				deltadb_query_set_filter(query,expr);
+				FILE *stream = fdopen(dup(link_fd(ql)),"w");
+				if(stream) {
+					deltadb_query_set_output(query,stream);
 					deltadb_query_set_display(query,DELTADB_DISPLAY_STREAM);
 					deltadb_query_execute_dir(query,history_dir,time_start,time_stop);
-					deltadb_query_delete(query);
-					jx_delete(expr);
+					fclose(stream);
 				}
-			} else {
-				send_http_response(ql,400,"Bad Request","text/plain",st);
-				link_printf(ql,st,"Invalid query text.\n");
+				deltadb_query_delete(query);
 			}
 		} else {
 			send_http_response(ql,400,"Bad Request","text/plain",st);
-			link_printf(ql,st,"Invalid base-64 encoding.\n");
+			link_printf(ql,st,"Invalid query text.\n");
 		}
-		buffer_free(&buf);
-		return;
-	}
-
-	// check for historical timestamp prefix
-	int matches = sscanf(full_path, "/history/%ld%s", &timestamp, path);
-	if (matches == 2) {
-		// continue on
-	} else if (matches == 1) {
-		strncpy(path, "/", sizeof(path));
 	} else {
-		strcpy(path, full_path);
+		send_http_response(ql,400,"Bad Request","text/plain",st);
+		link_printf(ql,st,"Invalid base-64 encoding.\n");
 	}
+	buffer_free(&buf);
+}
 
-	// reset catalog to timestamp
-	if (timestamp > 0) {
-		//deltadb_delete(table);
-		printf("timestamp: %ld\n", timestamp);
-		table = deltadb_create_snapshot(history_dir, timestamp);
-	}
-	
-	/* load the hash table entries into one big array */
-	n = 0;
-	deltadb_firstkey(table);
-	while(deltadb_nextkey(table, &hkey, &j)) {
-		array[n] = j;
-		n++;
-	}
+/*
+Answer a request for path from the records in snapshot s.
+A timestamp greater than zero indicates a historical snapshot.
+*/
 
-	// sort the array by name before displaying
-	qsort(array, n, sizeof(struct jx *), compare_jx);
+static int handle_path( struct link *ql, struct catalog_snapshot *s, const char *path, time_t timestamp, int keepalive, time_t st )
+{
+	char url[LINE_MAX];
+	char key[LINE_MAX];
+	char strexpr[LINE_MAX];
+	char strfields[LINE_MAX];
+	long since;
+	struct jx *j;
+	int i;
 
 	if(!strcmp(path, "/query.text")) {
 		send_http_response(ql,200,"OK","text/plain",st);
-		for(i = 0; i < n; i++)
-			catalog_export_nvpair(array[i], ql,st);
+		for(i = 0; i < s->n; i++)
+			catalog_export_nvpair(s->records[i]->j, ql,st);
 	} else if(!strcmp(path, "/query.json")) {
 		send_http_response(ql,200,"OK","text/plain",st);
 		link_printf(ql,st,"[\n");
-		for(i = 0; i < n; i++) {
-			jx_print_link(array[i],ql,st);
-			if(i<(n-1)) link_printf(ql,st,",\n");
+		for(i = 0; i < s->n; i++) {
+			jx_print_link(s->records[i]->j,ql,st);
+			if(i<(s->n-1)) link_printf(ql,st,",\n");
 		}
 		link_printf(ql,st,"\n]\n");
+	} else if(3==sscanf(path, "/select/%ld/%[^/]/%[^/]",&since,strexpr,strfields)) {
+		return handle_select(ql,s,since,strexpr,strfields,keepalive,st) ? QUERY_KEEP : QUERY_CLOSE;
 	} else if(1==sscanf(path, "/query/%[^/]",strexpr)) {
 
 		struct buffer buf;
@@ -584,17 +1387,21 @@ static void handle_query( struct link *ql, time_t st )
 				send_http_response(ql,200,"OK","text/plain",st);
 				link_printf(ql,st,"[\n");
 
+				struct catalog_record **records;
+				int n;
+				int indexed = snapshot_plan(s,expr,&records,&n);
+
 				int count = 0;
 				for(i = 0; i < n; i++) {
-					if(jx_eval_is_true(expr,array[i])) {
+					if(jx_eval_is_true(expr,records[i]->j)) {
 						if(count>0) link_printf(ql,st,",\n");
-						jx_print_link(array[i],ql,st);
+						jx_print_link(records[i]->j,ql,st);
 						count++;
 					}
 				}
 				link_printf(ql,st,"\n]\n");
 				jx_delete(expr);
-				debug(D_DEBUG,"query '%s' matched %d records",buffer_tostring(&buf),count);
+				debug(D_DEBUG,"query '%s' matched %d of %d records%s",buffer_tostring(&buf),count,n,indexed ? " by index" : "");
 			} else {
 				send_http_response(ql,400,"Bad Request","text/plain",st);
 				link_printf(ql,st,"Invalid query text.\n");
@@ -609,14 +1416,14 @@ static void handle_query( struct link *ql, time_t st )
 
 	} else if(!strcmp(path, "/query.newclassads")) {
 		send_http_response(ql,200,"OK","text/plain",st);
-		for(i = 0; i < n; i++)
-			catalog_export_new_classads(array[i], ql,st);
+		for(i = 0; i < s->n; i++)
+			catalog_export_new_classads(s->records[i]->j, ql,st);
 	} else if(sscanf(path, "/detail/%s", key) == 1) {
-		struct jx *j;
+		struct catalog_record *r;
 		send_http_response(ql,200,"OK","text/html",st);
-		j = deltadb_lookup(table, key);
-		if(j) {
-			const char *name = jx_lookup_string(j, "name");
+		r = snapshot_lookup(s, key);
+		if(r) {
+			const char *name = jx_lookup_string(r->j, "name");
 			if(!name)
 				name = "unknown";
 			send_html_header(ql,st);
@@ -624,11 +1431,11 @@ static void handle_query( struct link *ql, time_t st )
 			link_printf(ql,st, "<h1>%s catalog server</h1>\n", preferred_hostname);
 			link_printf(ql,st, "<h2>%s</h2>\n", name);
 			if (timestamp) {
-				link_printf(ql,st, "<p><a href=/history/%ld/>return to catalog view</a><p>\n", timestamp);
+				link_printf(ql,st, "<p><a href=/history/%ld/>return to catalog view</a><p>\n", (long)timestamp);
 			} else {
 				link_printf(ql,st, "<p><a href=/>return to catalog view</a><p>\n");
 			}
-			catalog_export_html_solo(j, ql,st);
+			catalog_export_html_solo(r->j, ql,st);
 			link_printf(ql,st, "</center>\n");
 		} else {
 			send_html_header(ql,st);
@@ -640,6 +1447,7 @@ static void handle_query( struct link *ql, time_t st )
 	} else if(!strcmp(path,"/") || !strcmp(path,"/query.html") ) {
 		char avail_line[LINE_MAX];
 		char total_line[LINE_MAX];
+		char date[32];
 		INT64_T sum_total = 0;
 		INT64_T sum_avail = 0;
 		INT64_T sum_devices = 0;
@@ -650,11 +1458,11 @@ static void handle_query( struct link *ql, time_t st )
 		link_printf(ql,st, "<h1>%s catalog server</h1>\n", preferred_hostname);
 		if (timestamp) {
 			catalog_export_html_datetime_picker(ql, st, timestamp);
-			link_printf(ql,st, "<h3>Historical Snapshot as of %s</h3>", ctime(&timestamp));
-			link_printf(ql,st, "<a href=/history/%ld/query.text>text</a> - ", timestamp);
-			link_printf(ql,st, "<a href=/history/%ld/query.html>html</a> - ", timestamp);
-			link_printf(ql,st, "<a href=/history/%ld/query.json>json</a> - ", timestamp);
-			link_printf(ql,st, "<a href=/history/%ld/query.newclassads>classads</a>", timestamp);
+			link_printf(ql,st, "<h3>Historical Snapshot as of %s</h3>", ctime_r(&timestamp,date));
+			link_printf(ql,st, "<a href=/history/%ld/query.text>text</a> - ", (long)timestamp);
+			link_printf(ql,st, "<a href=/history/%ld/query.html>html</a> - ", (long)timestamp);
+			link_printf(ql,st, "<a href=/history/%ld/query.json>json</a> - ", (long)timestamp);
+			link_printf(ql,st, "<a href=/history/%ld/query.newclassads>classads</a>", (long)timestamp);
 		} else {
 			catalog_export_html_datetime_picker(ql, st, time(0));
 			link_printf(ql,st, "<a href=/query.text>text</a> - ");
@@ -664,8 +1472,8 @@ static void handle_query( struct link *ql, time_t st )
 		}
 		link_printf(ql,st, "<p>\n");
 
-		for(i = 0; i < n; i++) {
-			j = array[i];
+		for(i = 0; i < s->n; i++) {
+			j = s->records[i]->j;
 			sum_total += jx_lookup_integer(j, "total");
 			sum_avail += jx_lookup_integer(j, "avail");
 			sum_devices++;
@@ -676,15 +1484,14 @@ static void handle_query( struct link *ql, time_t st )
 		link_printf(ql,st, "<b>%sB available out of %sB on %d devices</b><p>\n", avail_line, total_line, (int) sum_devices);
 
 		catalog_export_html_header(ql, html_headers, st);
-		for(i = 0; i < n; i++) {
-			j = array[i];
-			make_hash_key(j, key);
+		for(i = 0; i < s->n; i++) {
+			struct catalog_record *r = s->records[i];
 			if (timestamp) {
-				string_nformat(url, sizeof(url), "/history/%ld/detail/%s", timestamp, key);
+				string_nformat(url, sizeof(url), "/history/%ld/detail/%s", (long)timestamp, r->key);
 			} else {
-				string_nformat(url, sizeof(url), "/detail/%s", key);
+				string_nformat(url, sizeof(url), "/detail/%s", r->key);
 			}
-			catalog_export_html_with_link(j, ql, html_headers, "name", url, st);
+			catalog_export_html_with_link(r->j, ql, html_headers, "name", url, i, st);
 		}
 		catalog_export_html_footer(ql, html_headers, st);
 		link_printf(ql,st, "</center>\n");
@@ -694,42 +1501,522 @@ static void handle_query( struct link *ql, time_t st )
 		link_printf(ql,st,"<pre>%s</pre>",path);
 		link_printf(ql,st,"<p><a href=/>Return to Index</a></p>");
 	}
+
+	return QUERY_CLOSE;
+}
+
+/*
+Queries of the history must read and replay logs from disk,
+which may take a long time, and so each is answered by a thread
+of its own, up to history_threads_max at once, so that they
+do not hold up the threads answering queries of the live table.
+*/
+
+struct history_query {
+	struct link *link;
+	char path[LINE_MAX];
+	time_t stoptime;
+};
+
+static pthread_mutex_t history_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int history_threads_count = 0;
+
+static void *history_worker( void *arg )
+{
+	struct history_query *h = arg;
+	struct link *ql = h->link;
+	time_t st = h->stoptime;
+	char path[LINE_MAX];
+	char strexpr[LINE_MAX];
+	long time_start, time_stop;
+	long timestamp = 0;
+
+	if(3==sscanf(h->path, "/updates/%ld/%ld/%[^/]",&time_start,&time_stop,strexpr)) {
+		handle_updates(ql,time_start,time_stop,strexpr,st);
+	} else {
+		if(sscanf(h->path, "/history/%ld%s", &timestamp, path)!=2) {
+			strcpy(path, "/");
+		}
+
+		struct catalog_snapshot *s = snapshot_from_history(timestamp);
+		if(s) {
+			handle_path(ql,s,path,timestamp,0,st);
+			snapshot_release(s);
+		} else {
+			send_http_response(ql,500,"Server Error","text/plain",st);
+			link_printf(ql,st,"Unable to read the history.\n");
+		}
+	}
+
+	link_flush_output(ql);
+	link_close(ql);
+	free(h);
+
+	pthread_mutex_lock(&history_mutex);
+	history_threads_count--;
+	pthread_mutex_unlock(&history_mutex);
+
+	return 0;
+}
+
+/* Hand the connection over to a new history thread, which will close it when done. */
+
+static int history_start( struct link *ql, const char *path, time_t st )
+{
+	pthread_t t;
+	int started = 0;
+
+	struct history_query *h = xxmalloc(sizeof(*h));
+	h->link = ql;
+	h->stoptime = st;
+	string_nformat(h->path, sizeof(h->path), "%s", path);
+
+	pthread_mutex_lock(&history_mutex);
+	if(history_threads_count<history_threads_max && pthread_create(&t,0,history_worker,h)==0) {
+		pthread_detach(t);
+		history_threads_count++;
+		started = 1;
+	}
+	pthread_mutex_unlock(&history_mutex);
+
+	if(!started) {
+		free(h);
+		send_http_response(ql,503,"Service Unavailable","text/plain",st);
+		link_printf(ql,st,"Too many history queries, try again later.\n");
+		return QUERY_CLOSE;
+	}
+
+	return QUERY_DETACHED;
 }
 
-void handle_tcp_query( struct link *port, int using_ssl )
+/*
+Handle one HTTP request on the connection.
+If keepalive_ok is true, and the client and the response allow it,
+the connection is left ready for another request and QUERY_KEEP is returned.
+*/
+
+static int handle_query( struct link *ql, time_t st, int keepalive_ok )
 {
-	char raddr[LINK_ADDRESS_MAX];
-	int rport;
-	link_address_remote(port, raddr, &rport);
-
-	link_buffer_output(port,4096);
-
-	if(fork_mode) {
-		pid_t pid = fork();
-		if(pid == 0) {
-			change_process_title("catalog_server [%s]", raddr);
-			alarm(child_procs_timeout);
-			if(using_ssl) {
-				if(!link_ssl_wrap_accept(port,ssl_key_filename,ssl_cert_filename)){
-					fatal("couldn't accept ssl connection from %s:%d",raddr,rport);
+	char line[LINE_MAX];
+	char url[LINE_MAX];
+	char full_path[LINE_MAX];
+	char path[LINE_MAX];
+	char action[LINE_MAX];
+	char version[LINE_MAX];
+	char hostport[LINE_MAX];
+	char addr[LINK_ADDRESS_MAX];
+	char strexpr[LINE_MAX];
+	int port;
+	int keepalive = 0;
+	long time_start, time_stop;
+	long timestamp = 0;
+
+	link_address_remote(ql, addr, &port);
+	debug(D_DEBUG, "%s query from %s:%d", link_using_ssl(ql) ? "https" : "http", addr, port);
+
+	/* The request as a whole must arrive in time, not each line of it. */
+	time_t request_stoptime = MIN(st, time(0) + HANDLE_QUERY_TIMEOUT);
+
+	if(link_readline(ql, line, LINE_MAX, request_stoptime)) {
+		string_chomp(line);
+		if(sscanf(line, "%s %s %s", action, url, version) != 3) {
+			return QUERY_CLOSE;
+		}
+
+		/* HTTP/1.1 keeps connections by default, HTTP/1.0 only if asked. */
+		keepalive = !strcmp(version,"HTTP/1.1");
+
+		// Consume the rest of the query
+		while(1) {
+			/* If we read to end-of-stream on the request, that's ok. */
+			if(!link_readline(ql, line, LINE_MAX, request_stoptime)) {
+				break;
+			}
+
+			/* If we get a blank line separator, proceed to respond. */
+			if(line[0] == 0) {
+				break;
+			}
+
+			if(!strncasecmp(line,"Connection:",11)) {
+				if(strcasestr(line+11,"close")) {
+					keepalive = 0;
+				} else if(strcasestr(line+11,"keep-alive")) {
+					keepalive = 1;
 				}
 			}
-			handle_query(port,time(0)+child_procs_timeout);
-			link_flush_output(port);
-			_exit(0);
-		} else if (pid>0) {
-			child_procs_count++;
 		}
 	} else {
-		if(using_ssl) {
-			if(!link_ssl_wrap_accept(port,ssl_key_filename,ssl_cert_filename)){
-				debug(D_DEBUG,"couldn't accept ssl connection from %s:%d",raddr,rport);
+		return QUERY_CLOSE;
+	}
+
+	keepalive = keepalive && keepalive_ok;
+
+	if(sscanf(url, "http://%[^/]%s", hostport, full_path) == 2) {
+		// continue on
+	} else {
+		strcpy(full_path, url);
+	}
+
+	// updates and historical snapshots are read from disk by a separate thread
+	if(3==sscanf(full_path, "/updates/%ld/%ld/%[^/]",&time_start,&time_stop,strexpr)) {
+		return history_start(ql,full_path,st);
+	}
+
+	int matches = sscanf(full_path, "/history/%ld%s", &timestamp, path);
+	if (matches>=1 && timestamp>0) {
+		return history_start(ql,full_path,st);
+	} else if (matches == 2) {
+		// continue on
+	} else if (matches == 1) {
+		strncpy(path, "/", sizeof(path));
+	} else {
+		strcpy(path, full_path);
+	}
+
+	struct catalog_snapshot *s = snapshot_acquire();
+	int result = handle_path(ql,s,path,0,keepalive,st);
+	snapshot_release(s);
+
+	return result;
+}
+
+/*
+Query connections are multiplexed among the query threads with epoll.
+Each connection is registered one-shot, so that exactly one thread
+wakes up when a request arrives, and is re-armed after the response
+if the client may send another. The listening ports are handled the
+same way, and re-armed as soon as a connection is accepted.
+Idle connections are closed by the main thread after KEEPALIVE_TIMEOUT.
+*/
+
+static struct link *query_port = 0;
+static struct link *query_ssl_port = 0;
+
+#ifdef CCTOOLS_OPSYS_LINUX
+
+struct query_conn {
+	UINT64_T id;
+	struct link *link;
+	int ssl_pending;   /* the ssl handshake is still to be done */
+	int busy;          /* a thread is serving the connection */
+	time_t idle_since;
+};
+
+/* Identifiers of the listening ports in the epoll set, below those of connections. */
+#define QUERY_PORT_ID 0
+#define QUERY_SSL_PORT_ID 1
+
+static int query_epoll = -1;
+
+/* Open query connections indexed by id, protected by conns_mutex. */
+static struct itable *query_conns = 0;
+static UINT64_T next_conn_id = 2;
+static pthread_mutex_t conns_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Time when idle connections were last checked. */
+static time_t last_expire_time = 0;
+
+/* Wait for one read event on fd. Returns true on success. */
+
+static int query_arm( int fd, UINT64_T id, int op )
+{
+	struct epoll_event ev;
+	ev.events = EPOLLIN | EPOLLONESHOT;
+	ev.data.u64 = id;
+	if(epoll_ctl(query_epoll,op,fd,&ev)<0) {
+		debug(D_DEBUG,"couldn't watch query connection: %s",strerror(errno));
+		return 0;
+	}
+	return 1;
+}
+
+static void query_conn_close( struct query_conn *c )
+{
+	pthread_mutex_lock(&conns_mutex);
+	itable_remove(query_conns,c->id);
+	pthread_mutex_unlock(&conns_mutex);
+
+	if(c->link) link_close(c->link);
+	free(c);
+}
+
+/*
+Mark a busy connection as idle, and wait for its next request.
+This is done under the lock, so that the connection cannot be
+expired before it is armed, nor served before it is marked idle.
+*/
+
+static void query_conn_wait( struct query_conn *c, int op )
+{
+	int ok;
+
+	pthread_mutex_lock(&conns_mutex);
+	ok = query_arm(link_fd(c->link),c->id,op);
+	if(ok) {
+		c->busy = 0;
+		c->idle_since = time(0);
+	}
+	pthread_mutex_unlock(&conns_mutex);
+
+	if(!ok) query_conn_close(c);
+}
+
+static void query_accept( struct link *port, UINT64_T port_id, int using_ssl )
+{
+	struct link *l = link_accept(port,LINK_NOWAIT);
+	query_arm(link_fd(port),port_id,EPOLL_CTL_MOD);
+	if(!l) return;
+
+	link_buffer_output(l,4096);
+
+	struct query_conn *c = xxmalloc(sizeof(*c));
+	c->link = l;
+	c->ssl_pending = using_ssl;
+	c->busy = 1;
+
+	pthread_mutex_lock(&conns_mutex);
+	c->id = next_conn_id++;
+	itable_insert(query_conns,c->id,c);
+	pthread_mutex_unlock(&conns_mutex);
+
+	query_conn_wait(c,EPOLL_CTL_ADD);
+}
+
+/* Answer requests on a busy connection until the client waits or goes away. */
+
+static void query_serve( struct query_conn *c )
+{
+	int result;
+
+	if(c->ssl_pending) {
+		c->ssl_pending = 0;
+		if(!link_ssl_wrap_accept(c->link,ssl_key_filename,ssl_cert_filename)) {
+			char addr[LINK_ADDRESS_MAX];
+			int port;
+			link_address_remote(c->link,addr,&port);
+			debug(D_DEBUG,"couldn't accept ssl connection from %s:%d",addr,port);
+			query_conn_close(c);
+			return;
+		}
+	}
+
+	/*
+	Pipelined requests are answered under one deadline, so that a client
+	cannot keep a thread from the pool beyond query_timeout by trickling
+	requests or by reading its answers slowly.
+	*/
+	time_t stoptime = time(0)+query_timeout;
+
+	do {
+		pthread_mutex_lock(&conns_mutex);
+		int keepalive_ok = itable_size(query_conns)<=KEEPALIVE_MAX;
+		pthread_mutex_unlock(&conns_mutex);
+
+		result = handle_query(c->link,stoptime,keepalive_ok);
+		if(result==QUERY_DETACHED) {
+			c->link = 0;
+			query_conn_close(c);
+			return;
+		}
+		link_flush_output(c->link);
+
+		/* A request already read into the buffer will not wake up epoll. */
+	} while(result==QUERY_KEEP && !link_buffer_empty(c->link));
+
+	if(result==QUERY_KEEP) {
+		query_conn_wait(c,EPOLL_CTL_MOD);
+	} else {
+		query_conn_close(c);
+	}
+}
+
+static void *query_worker( void *arg )
+{
+	struct epoll_event ev;
+
+	while(1) {
+		int n = epoll_wait(query_epoll,&ev,1,-1);
+		if(n<=0) continue;
+
+		if(ev.data.u64==QUERY_PORT_ID) {
+			query_accept(query_port,QUERY_PORT_ID,0);
+		} else if(ev.data.u64==QUERY_SSL_PORT_ID) {
+			query_accept(query_ssl_port,QUERY_SSL_PORT_ID,1);
+		} else {
+			pthread_mutex_lock(&conns_mutex);
+			struct query_conn *c = itable_lookup(query_conns,ev.data.u64);
+			if(c && !c->busy) {
+				c->busy = 1;
+			} else {
+				c = 0;
+			}
+			pthread_mutex_unlock(&conns_mutex);
+
+			if(c) query_serve(c);
+		}
+	}
+
+	return 0;
+}
+
+/* Close connections that have been idle for too long. Called by the main thread. */
+
+static void query_conns_expire()
+{
+	UINT64_T id;
+	struct query_conn *c;
+	time_t current = time(0);
+
+	if(current==last_expire_time) return;
+	last_expire_time = current;
+
+	struct list *expired = list_create();
+
+	pthread_mutex_lock(&conns_mutex);
+	itable_firstkey(query_conns);
+	while(itable_nextkey(query_conns,&id,(void**)&c)) {
+		if(!c->busy && (current-c->idle_since)>=KEEPALIVE_TIMEOUT) {
+			list_push_tail(expired,c);
+		}
+	}
+	while((c=list_pop_head(expired))) {
+		itable_remove(query_conns,c->id);
+		link_close(c->link);
+		free(c);
+	}
+	pthread_mutex_unlock(&conns_mutex);
+
+	list_delete(expired);
+}
+
+static void query_pool_start()
+{
+	int i;
+
+	query_conns = itable_create(0);
+
+	query_epoll = epoll_create1(EPOLL_CLOEXEC);
+	if(query_epoll<0) fatal("couldn't create epoll set: %s",strerror(errno));
+
+	link_nonblocking(query_port,1);
+	if(!query_arm(link_fd(query_port),QUERY_PORT_ID,EPOLL_CTL_ADD)) {
+		fatal("couldn't watch query port: %s",strerror(errno));
+	}
+
+	if(query_ssl_port) {
+		link_nonblocking(query_ssl_port,1);
+		if(!query_arm(link_fd(query_ssl_port),QUERY_SSL_PORT_ID,EPOLL_CTL_ADD)) {
+			fatal("couldn't watch query ssl port: %s",strerror(errno));
+		}
+	}
+
+	for(i=0;i<query_threads;i++) {
+		pthread_t t;
+		if(pthread_create(&t,0,query_worker,0)!=0) {
+			fatal("couldn't create query thread: %s",strerror(errno));
+		}
+		pthread_detach(t);
+	}
+
+	debug(D_DEBUG,"answering queries with %d threads",query_threads);
+}
+
+#else
+
+/*
+Without epoll, the query threads take turns waiting on the
+listening ports, and close each connection after one request.
+*/
+
+static pthread_mutex_t accept_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void *query_worker( void *arg )
+{
+	struct link_info info[2];
+	int i, n;
+
+	while(1) {
+		struct link *l = 0;
+		int using_ssl = 0;
+
+		pthread_mutex_lock(&accept_mutex);
+		n = 0;
+		info[n].link = query_port;
+		info[n].events = LINK_READ;
+		info[n].revents = 0;
+		n++;
+		if(query_ssl_port) {
+			info[n].link = query_ssl_port;
+			info[n].events = LINK_READ;
+			info[n].revents = 0;
+			n++;
+		}
+		if(link_poll(info,n,-1)>0) {
+			for(i=0;i<n;i++) {
+				if(info[i].revents&LINK_READ) {
+					l = link_accept(info[i].link,LINK_NOWAIT);
+					using_ssl = info[i].link==query_ssl_port;
+					break;
+				}
 			}
 		}
-		handle_query(port,time(0)+child_procs_timeout);
-		link_flush_output(port);
+		pthread_mutex_unlock(&accept_mutex);
+
+		if(!l) continue;
+
+		link_buffer_output(l,4096);
+
+		if(using_ssl && !link_ssl_wrap_accept(l,ssl_key_filename,ssl_cert_filename)) {
+			link_close(l);
+			continue;
+		}
+
+		if(handle_query(l,time(0)+query_timeout,0)!=QUERY_DETACHED) {
+			link_flush_output(l);
+			link_close(l);
+		}
+	}
+
+	return 0;
+}
+
+static void query_conns_expire()
+{
+}
+
+static void query_pool_start()
+{
+	int i;
+
+	link_nonblocking(query_port,1);
+	if(query_ssl_port) link_nonblocking(query_ssl_port,1);
+
+	for(i=0;i<query_threads;i++) {
+		pthread_t t;
+		if(pthread_create(&t,0,query_worker,0)!=0) {
+			fatal("couldn't create query thread: %s",strerror(errno));
+		}
+		pthread_detach(t);
+	}
+
+	debug(D_DEBUG,"answering queries with %d threads",query_threads);
+}
+
+#endif
+
+static void index_fields_set( const char *list )
+{
+	char *copy = xxstrdup(list);
+	char *field, *saveptr;
+
+	index_field_count = 0;
+	for(field=strtok_r(copy,",",&saveptr);field;field=strtok_r(0,",",&saveptr)) {
+		index_fields = xxrealloc(index_fields,sizeof(*index_fields)*(index_field_count+1));
+		index_fields[index_field_count++] = xxstrdup(field);
 	}
-	link_close(port);
+
+	free(copy);
 }
 
 static void show_help(const char *cmd)
@@ -744,8 +2031,8 @@ static void show_help(const char *cmd)
 	fprintf(stdout, " %-30s Listen only on this network interface.\n", "-I,--interface=<addr>");
 	fprintf(stdout, " %-30s Lifetime of data, in seconds (default is %d)\n", "-l,--lifetime=<secs>", lifetime);
 	fprintf(stdout, " %-30s Log new updates to this file.\n", "-L,--update-log=<file>");
-	fprintf(stdout, " %-30s Maximum number of child processes.\n", "-m,--max-jobs=<n>");
-	fprintf(stdout, " %-30s (default is %d)\n", "", child_procs_max);
+	fprintf(stdout, " %-30s Maximum number of history queries at once.\n", "-m,--max-jobs=<n>");
+	fprintf(stdout, " %-30s (default is %d)\n", "", history_threads_max);
 	fprintf(stdout, " %-30s Maximum size of a server to be believed.\n", "-M,--server-size=<size>");
 	fprintf(stdout, " %-30s (default is any)\n", "");
 	fprintf(stdout, " %-30s Preferred host name of this server.\n", "-n,--name=<name>");
@@ -757,9 +2044,14 @@ static void show_help(const char *cmd)
 	fprintf(stdout, " %-30s Port number to listen for HTTPS connections.\n","-,--ssl-port=<port>");
 	fprintf(stdout, " %-30s File containing SSL certificate for HTTPS.\n","-C,--ssl-cert=<file>");
 	fprintf(stdout, " %-30s File containing SSL key for HTTPS.\n","-K,--ssl-key=<file>");
-	fprintf(stdout, " %-30s Single process mode; do not work on queries.\n", "-S,--single");
-	fprintf(stdout, " %-30s Maximum time to allow a query process to run.\n", "-T,--timeout=<time>");
-	fprintf(stdout, " %-30s (default is %ds)\n", "", child_procs_timeout);
+	fprintf(stdout, " %-30s Answer queries with a single thread.\n", "-S,--single");
+	fprintf(stdout, " %-30s Maximum time to allow a query to run.\n", "-T,--timeout=<time>");
+	fprintf(stdout, " %-30s (default is %ds)\n", "", query_timeout);
+	fprintf(stdout, " %-30s Threads answering queries. (default is %d)\n", "--query-threads=<n>", QUERY_THREADS_DEFAULT);
+	fprintf(stdout, " %-30s Comma separated fields to index for queries.\n", "--index-fields=<list>");
+	fprintf(stdout, " %-30s (default is %s)\n", "", INDEX_FIELDS_DEFAULT);
+	fprintf(stdout, " %-30s Threads decoding updates, besides the main one.\n", "--update-threads=<n>");
+	fprintf(stdout, " %-30s (default is one less than the cores, up to %d)\n", "", UPDATE_THREADS_DEFAULT_MAX);
 	fprintf(stdout, " %-30s Send status updates to this host. (default is\n", "-u,--update-host=<host>");
 	fprintf(stdout, " %-30s %s)\n", "", CATALOG_HOST_DEFAULT);
 	fprintf(stdout, " %-30s Send status updates at this interval.\n", "-U,--update-interval=<time>");
@@ -770,18 +2062,22 @@ static void show_help(const char *cmd)
 	fprintf(stdout, " %-30s this file. (default: disabled)\n", "");
 }
 
+enum {
+	LONG_OPT_UPDATE_THREADS = UCHAR_MAX+1,
+	LONG_OPT_QUERY_THREADS,
+	LONG_OPT_INDEX_FIELDS,
+};
+
 int main(int argc, char *argv[])
 {
-	struct link *link;
-	struct link *query_port = 0;
-	struct link *query_ssl_port = 0;
-	signed char ch;
+	int ch;
 	time_t current;
 	int is_daemon = 0;
 	char *pidfile = NULL;
 	char *interface = NULL;
 
 	outgoing_host_list = list_create();
+	index_fields_set(INDEX_FIELDS_DEFAULT);
 
 	change_process_title_init(argv);
 
@@ -809,6 +2105,9 @@ int main(int argc, char *argv[])
 		{"timeout", required_argument, 0, 'T'},
 		{"update-host", required_argument, 0, 'u'},
 		{"update-interval", required_argument, 0, 'U'},
+		{"update-threads", required_argument, 0, LONG_OPT_UPDATE_THREADS},
+		{"query-threads", required_argument, 0, LONG_OPT_QUERY_THREADS},
+		{"index-fields", required_argument, 0, LONG_OPT_INDEX_FIELDS},
 		{"version", no_argument, 0, 'v'},
 		{"ssl-port-file", required_argument, 0, 'Y'},
 		{"port-file", required_argument, 0, 'Z'},
@@ -845,7 +2144,7 @@ int main(int argc, char *argv[])
 				interface = strdup(optarg);
 				break;
 			case 'm':
-				child_procs_max = atoi(optarg);
+				history_threads_max = atoi(optarg);
 				break;
 			case 'M':
 				max_server_size = string_metric_parse(optarg);
@@ -872,10 +2171,10 @@ int main(int argc, char *argv[])
 				ssl_key_filename = optarg;
 				break;	
 			case 'S':
-				fork_mode = 0;
+				query_threads = 1;
 				break;
 			case 'T':
-				child_procs_timeout = string_time_parse(optarg);
+				query_timeout = string_time_parse(optarg);
 				break;
 			case 'u':
 				list_push_head(outgoing_host_list, xxstrdup(optarg));
@@ -883,6 +2182,15 @@ int main(int argc, char *argv[])
 			case 'U':
 				outgoing_timeout = string_time_parse(optarg);
 				break;
+			case LONG_OPT_UPDATE_THREADS:
+				update_threads = atoi(optarg);
+				break;
+			case LONG_OPT_QUERY_THREADS:
+				query_threads = MAX(1,atoi(optarg));
+				break;
+			case LONG_OPT_INDEX_FIELDS:
+				index_fields_set(optarg);
+				break;
 			case 'v':
 				cctools_version_print(stdout, argv[0]);
 				return 0;
@@ -933,6 +2241,9 @@ int main(int argc, char *argv[])
 	if(!table)
 		fatal("couldn't create directory %s: %s\n",history_dir,strerror(errno));
 
+	deltadb_set_flush_interval(table,LOG_FLUSH_INTERVAL);
+	snapshot_init();
+
 	query_port = link_serve_address(interface, port);
 	if(query_port) {
 		/*
@@ -982,6 +2293,11 @@ int main(int argc, char *argv[])
 			fatal("couldn't listen on UDP port %d", port);
 	}
 
+	int recv_buffer = UDP_RECV_BUFFER;
+	setsockopt(datagram_fd(update_dgram), SOL_SOCKET, SO_RCVBUF, &recv_buffer, sizeof(recv_buffer));
+
+	update_pool_start();
+
 	update_port = link_serve_address(interface,port+1);
 	if(!update_port) {
 		if(interface)
@@ -990,55 +2306,38 @@ int main(int argc, char *argv[])
 			fatal("couldn't listen on TCP port %d", port+1);
 	}
 
+	query_pool_start();
+
 	opts_write_port_file(port_file,port);
 	opts_write_port_file(ssl_port_file,ssl_port);
 
 	while(1) {
 		fd_set rfds;
 		int dfd = datagram_fd(update_dgram);
-		int lfd = link_fd(query_port);
-		int sfd = query_ssl_port ? link_fd(query_ssl_port) : -1;
 		int ufd = link_fd(update_port);
 
 		int result, maxfd;
 		struct timeval timeout;
 
 		remove_expired_records();
+		flush_logs(0);
+		show_update_stats();
 
 		if(time(0) > outgoing_alarm) {
 			update_all_catalogs();
 			outgoing_alarm = time(0) + outgoing_timeout;
 		}
 
-		while(1) {
-			int status;
-			pid_t pid = waitpid(-1, &status, WNOHANG);
-			if(pid>0) {
-				child_procs_count--;
-				continue;
-			} else {
-				break;
-			}
-		}
+		snapshot_publish(0);
+		query_conns_expire();
 
 		FD_ZERO(&rfds);
 		FD_SET(dfd, &rfds);
 		FD_SET(ufd, &rfds);
+		maxfd = MAX(ufd, dfd) + 1;
 
-		/* Only accept incoming connections if child_procs available. */
-
-		if(child_procs_count < child_procs_max) {
-			/* Accept plain HTTP */ 
-			FD_SET(lfd, &rfds);
-
-			/* Accept HTTPS if enabled */
-			if(query_ssl_port) {
-				FD_SET(sfd,&rfds);
-			}
-		}
-		maxfd = MAX(ufd,MAX(dfd, lfd)) + 1;
-
-		timeout.tv_sec = 5;
+		/* Wake up in time to publish changes and close idle connections. */
+		timeout.tv_sec = SNAPSHOT_INTERVAL;
 		timeout.tv_usec = 0;
 
 		result = select(maxfd, &rfds, 0, 0, &timeout);
@@ -1052,21 +2351,6 @@ int main(int argc, char *argv[])
 		if(FD_ISSET(ufd, &rfds)) {
 			handle_tcp_update(update_port);
 		}
-
-		if(FD_ISSET(lfd, &rfds)) {
-			link = link_accept(query_port,time(0)+5);
-			if(link) {
-				handle_tcp_query(link,0);
-			}
-		}
-
-		if(query_ssl_port && FD_ISSET(sfd, &rfds)) {
-			link = link_accept(query_ssl_port,time(0)+5);
-			if(link) {
-				handle_tcp_query(link,1);
-			}
-		}
-
 	}
 
 	return 1;
@@ -5,6 +5,8 @@ See the file COPYING for details.
 */
 
 #include "deltadb.h"
+#include "deltadb_index.h"
+#include "deltadb_archive.h"
 #include "jx_print.h"
 #include "jx_parse.h"
 
@@ -12,6 +14,7 @@ See the file COPYING for details.
 #include "debug.h"
 #include "nvpair.h"
 #include "nvpair_jx.h"
+#include "stringtools.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -20,6 +23,8 @@ See the file COPYING for details.
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <stdarg.h>
+#include <unistd.h>
+#include <limits.h>
 
 struct deltadb {
 	struct hash_table *table;
@@ -28,6 +33,10 @@ struct deltadb {
 	int logday;
 	FILE *logfile;
 	time_t last_log_time;
+	int flush_interval;
+	time_t last_flush_time;
+	int checkpoint_interval;
+	time_t last_index_time;
 	bool snapshot;
 };
 
@@ -126,12 +135,39 @@ static int checkpoint_read( struct deltadb *db, const char *filename )
 	return 1;
 }
 
+/*
+Save an intra-day checkpoint of the table, then add it to the index
+of the day, with the position in the log just after the time record
+for the given time. The checkpoint is written under a temporary name,
+so that readers never see one incomplete.
+*/
+
+static int index_write( struct deltadb *db, int year, int day, time_t time, long offset )
+{
+	int success = 0;
+
+	char *filename = deltadb_index_checkpoint_name(db->logdir,year,day,time);
+	char *tmpname = string_format("%s.tmp",filename);
+
+	if(checkpoint_write(db,tmpname) && rename(tmpname,filename)==0) {
+		success = deltadb_index_add(db->logdir,year,day,time,offset);
+	} else {
+		unlink(tmpname);
+	}
+
+	free(tmpname);
+	free(filename);
+
+	return success;
+}
+
 /* Ensure that the history is writing to the correct log file for the current time. */
 
 static void log_select( struct deltadb *db )
 {
 	time_t current = time(0);
-	struct tm *t = gmtime(&current);
+	struct tm tm;
+	struct tm *t = gmtime_r(&current,&tm);
 	int write_checkpoint_file = 0;
 
 	// If the file is open to the right file, continue as before.
@@ -160,6 +196,9 @@ static void log_select( struct deltadb *db )
 	if(write_checkpoint_file) {
 		sprintf(filename,"%s/%d/%d.ckpt",db->logdir,db->logyear,db->logday);
 		checkpoint_write(db,filename);
+
+		// The daily checkpoint stands for an index entry at the start of the log.
+		db->last_index_time = current;
 	}
 
 	// Reset the time so that an absolute time record comes next.
@@ -167,6 +206,30 @@ static void log_select( struct deltadb *db )
 
 }
 
+/*
+After a time record, if the checkpoint interval has passed,
+make an intra-day checkpoint at the current position in the log,
+which must be flushed first so that readers of the index find it.
+*/
+
+static void log_index( struct deltadb *db, time_t current )
+{
+	if(db->checkpoint_interval<=0) return;
+	if((current-db->last_index_time)<db->checkpoint_interval) return;
+
+	db->last_index_time = current;
+
+	if(fflush(db->logfile)!=0) return;
+	db->last_flush_time = current;
+
+	long offset = ftell(db->logfile);
+	if(offset<0) return;
+
+	if(!index_write(db,db->logyear,db->logday,current,offset)) {
+		debug(D_NOTICE,"could not write intra-day checkpoint: %s",strerror(errno));
+	}
+}
+
 /* If time has advanced since the last event, log a time record. */
 
 static void log_time( struct deltadb *db )
@@ -175,9 +238,11 @@ static void log_time( struct deltadb *db )
 	if(db->last_log_time==0) {
 		fprintf(db->logfile,"T %lld\n",(long long)current);
 		db->last_log_time = current;
+		log_index(db,current);
 	} else if(db->last_log_time!=current) {
 		fprintf(db->logfile,"t %lld\n",(long long)current-db->last_log_time);
 		db->last_log_time = current;
+		log_index(db,current);
 	}
 
 }
@@ -272,11 +337,17 @@ static void log_delete( struct deltadb *db, const char *key )
 	log_message(db,"D %s\n",key);
 }
 
-/* Push any buffered output out to the log. */
+/* Push any buffered output out to the log, at most once per flush interval. */
 
 static void log_flush( struct deltadb *db )
 {
-	if(db->logfile) fflush(db->logfile);
+	if(!db->logfile) return;
+
+	time_t current = time(0);
+	if(db->flush_interval>0 && (current-db->last_flush_time)<db->flush_interval) return;
+
+	fflush(db->logfile);
+	db->last_flush_time = current;
 }
 
 /* Report an invalid bit of data in the log. */
@@ -302,13 +373,81 @@ static void handle_merge( struct deltadb *db, const char *key, struct jx *update
 }
 
 /*
-Replay a given log file into the hash table, up to the given snapshot time.
+While replaying a log without an index, add an intra-day checkpoint
+after a time record whenever index_interval seconds have passed.
+*/
+
+static void replay_index( struct deltadb *db, int year, int day, FILE *file, long long current, time_t *last_index, int index_interval )
+{
+	if(index_interval<=0) return;
+
+	if(*last_index==0) {
+		*last_index = current;
+	} else if((current-*last_index)>=index_interval) {
+		index_write(db,year,day,current,ftell(file));
+		*last_index = current;
+	}
+}
+
+/*
+Replay the archive of a closed day whose log has been removed,
+skipping ahead to the given current time if nonzero.
+*/
+
+static int archive_replay( struct deltadb *db, int year, int day, long long current, time_t snapshot )
+{
+	char filename[PATH_MAX];
+	sprintf(filename,"%s/%d/%d.cdb",db->logdir,year,day);
+
+	struct deltadb_archive *archive = deltadb_archive_open(filename,0);
+	if(!archive) return 0;
+
+	if(current) deltadb_archive_skip_before(archive,current);
+
+	struct deltadb_archive_event e;
+	struct jx *jobject;
+
+	while(deltadb_archive_next(archive,&e)) {
+		if(e.type=='T' || e.type=='t') {
+			if(e.time>snapshot) break;
+		} else if(e.type=='C') {
+			jx_delete(hash_table_remove(db->table,e.key));
+			hash_table_insert(db->table,e.key,e.value);
+		} else if(e.type=='M') {
+			handle_merge(db,e.key,e.value);
+		} else if(e.type=='D') {
+			jx_delete(hash_table_remove(db->table,e.key));
+		} else if(e.type=='U' || e.type=='R') {
+			jobject = hash_table_lookup(db->table,e.key);
+			if(!jobject) {
+				corrupt_data(filename,e.key);
+				jx_delete(e.value);
+				continue;
+			}
+			struct jx *jname = jx_string(e.name);
+			jx_delete(jx_remove(jobject,jname));
+			if(e.type=='U') {
+				jx_insert(jobject,jname,e.value);
+			} else {
+				jx_delete(jname);
+			}
+		}
+	}
+
+	deltadb_archive_close(archive);
+	return 1;
+}
+
+/*
+Replay the log of a given day into the hash table, up to the given snapshot time,
+starting at offset with the given current time, which is zero at the start of the log.
+If index_interval is greater than zero, intra-day checkpoints are made along the way.
 Returns true if file could be open and played, false otherwise.
 */
 
 #define LOG_LINE_MAX 65536
 
-static int log_replay( struct deltadb *db, const char *filename, time_t snapshot)
+static int log_replay( struct deltadb *db, int year, int day, long offset, long long current, time_t snapshot, int index_interval )
 {
 	char whole_line[LOG_LINE_MAX];
 	char value[LOG_LINE_MAX];
@@ -316,11 +455,18 @@ static int log_replay( struct deltadb *db, const char *filename, time_t snapshot
 	char key[LOG_LINE_MAX];
 	int n;
 	struct jx *jvalue, *jobject;
+	time_t last_index = 0;
 
-	long long current = 0;
+	char filename[PATH_MAX];
+	sprintf(filename,"%s/%d/%d.log",db->logdir,year,day);
 
 	FILE *file = fopen(filename,"r");
-	if(!file) return 0;
+	if(!file) return archive_replay(db,year,day,offset>0 ? current : 0,snapshot);
+
+	if(offset>0 && fseek(file,offset,SEEK_SET)!=0) {
+		fclose(file);
+		return 0;
+	}
 
 	while(fgets(whole_line,sizeof(whole_line),file)) {
 		char *line = whole_line;
@@ -333,10 +479,12 @@ static int log_replay( struct deltadb *db, const char *filename, time_t snapshot
 				struct nvpair *nv = nvpair_create();
 				nvpair_parse_stream(nv,file);
 				jvalue = nvpair_to_jx(nv);
+				jx_delete(hash_table_remove(db->table,key));
 				hash_table_insert(db->table,key,jvalue);
 			} else if(n==2) {
 				jvalue = jx_parse_string(value);
 				if(jvalue) {
+					jx_delete(hash_table_remove(db->table,key));
 					hash_table_insert(db->table,key,jvalue);
 				} else {
 					corrupt_data(filename,line);
@@ -438,6 +586,7 @@ static int log_replay( struct deltadb *db, const char *filename, time_t snapshot
 				continue;
 			}
 			if(current>snapshot) break;
+			replay_index(db,year,day,file,current,&last_index,index_interval);
 		} else if(line[0]=='t') {
 			long long change;
 			n = sscanf(line,"t %lld",&change);
@@ -447,6 +596,7 @@ static int log_replay( struct deltadb *db, const char *filename, time_t snapshot
 			}
 			current = current + change;
 			if(current>snapshot) break;
+			replay_index(db,year,day,file,current,&last_index,index_interval);
 		} else if(line[0]=='\n') {
 			continue;
 		} else {
@@ -462,23 +612,36 @@ static int log_replay( struct deltadb *db, const char *filename, time_t snapshot
 /*
 Recover the state of the table by loading the appropriate checkpoint
 file, then playing the corresponding log until the snapshot time is reached.
+If the day has an index, start from the latest intra-day checkpoint instead.
 Returns true if successful, false if files could not be played.
 */
 
 static int log_recover( struct deltadb *db, time_t snapshot )
 {
 	char filename[PATH_MAX];
+	time_t index_time;
+	long offset;
 
-	struct tm *t = gmtime(&snapshot);
+	struct tm tm;
+	struct tm *t = gmtime_r(&snapshot,&tm);
 
 	int year = t->tm_year + 1900;
 	int day = t->tm_yday;
 
+	if(deltadb_index_lookup(db->logdir,year,day,snapshot,&index_time,&offset)) {
+		char *ckptname = deltadb_index_checkpoint_name(db->logdir,year,day,index_time);
+		int success = checkpoint_read(db,ckptname);
+		free(ckptname);
+		if(success) {
+			log_replay(db,year,day,offset,index_time,snapshot,0);
+			return 1;
+		}
+	}
+
 	sprintf(filename,"%s/%d/%d.ckpt",db->logdir,year,day);
 	checkpoint_read(db,filename);
 
-	sprintf(filename,"%s/%d/%d.log",db->logdir,year,day);
-	log_replay(db,filename,snapshot);
+	log_replay(db,year,day,0,0,snapshot,0);
 
 	return 1;
 }
@@ -496,6 +659,10 @@ static struct deltadb * deltadb_create_instance( const char *logdir, time_t time
 	db->logday = 0;
 	db->logfile = 0;
 	db->last_log_time = 0;
+	db->flush_interval = 0;
+	db->last_flush_time = 0;
+	db->checkpoint_interval = DELTADB_CHECKPOINT_INTERVAL_DEFAULT;
+	db->last_index_time = 0;
 	db->logdir = 0;
 	db->snapshot = snapshot;
 
@@ -517,6 +684,25 @@ struct deltadb * deltadb_create_snapshot( const char *logdir, time_t timestamp )
 	return deltadb_create_instance(logdir, timestamp, true);
 }
 
+void deltadb_delete( struct deltadb *db )
+{
+	char *key;
+	struct jx *j;
+
+	if(!db) return;
+
+	if(db->logfile) fclose(db->logfile);
+
+	hash_table_firstkey(db->table);
+	while(hash_table_nextkey(db->table,&key,(void**)&j)) {
+		jx_delete(j);
+	}
+	hash_table_delete(db->table);
+
+	free((char*)db->logdir);
+	free(db);
+}
+
 void deltadb_insert( struct deltadb *db, const char *key, struct jx *nv )
 {
 	if (db->snapshot) {
@@ -563,6 +749,46 @@ struct jx * deltadb_remove( struct deltadb *db, const char *key )
 	return j;
 }
 
+void deltadb_set_flush_interval( struct deltadb *db, int interval )
+{
+	db->flush_interval = interval;
+}
+
+void deltadb_set_checkpoint_interval( struct deltadb *db, int interval )
+{
+	db->checkpoint_interval = interval;
+}
+
+int deltadb_build_index( const char *logdir, int year, int day, int interval )
+{
+	char filename[PATH_MAX];
+
+	sprintf(filename,"%s/%d/%d.idx",logdir,year,day);
+	if(access(filename,F_OK)==0) {
+		errno = EEXIST;
+		return 0;
+	}
+
+	struct deltadb *db = deltadb_create(0);
+	db->logdir = strdup(logdir);
+
+	// As in log_recover, a day without a checkpoint starts out empty.
+	sprintf(filename,"%s/%d/%d.ckpt",logdir,year,day);
+	checkpoint_read(db,filename);
+
+	int success = log_replay(db,year,day,0,0,LLONG_MAX,interval);
+
+	deltadb_delete(db);
+
+	return success;
+}
+
+void deltadb_flush( struct deltadb *db )
+{
+	if(db->logfile) fflush(db->logfile);
+	db->last_flush_time = time(0);
+}
+
 void deltadb_firstkey( struct deltadb *db )
 {
 	hash_table_firstkey(db->table);
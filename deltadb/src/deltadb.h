@@ -39,6 +39,13 @@ log file is named DIR/YEAR/DAY.log
 The checkpoint file is simply a json object containing
 the keys and values of all the objects in the database.
 
+Within a day, the writer also saves a checkpoint DIR/YEAR/DAY.TIME.ckpt
+once per checkpoint interval, and records in DIR/YEAR/DAY.idx the
+position in the log at which each one was taken, so that reaching
+a time late in the day does not require playing the whole log.
+The index is only a shortcut: it may be deleted at any time,
+and must be deleted if the log is rewritten.
+
 The log file consists of a series of entries,
 each one a json array in the following formats:
 
@@ -63,6 +70,9 @@ totalling under 8GB data per year.
 #include "jx.h"
 #include <time.h>
 
+/** The default interval between intra-day checkpoints, in seconds. */
+#define DELTADB_CHECKPOINT_INTERVAL_DEFAULT 3600
+
 /** Create a new database, recovering state from disk if available.
 @param logdir A directory to contain the database on disk.  If it does not exist, it will be created.  If null, no disk storage will be used.
 @return A pointer to a newly created history table.
@@ -78,6 +88,12 @@ struct deltadb * deltadb_create( const char *logdir );
 
 struct deltadb * deltadb_create_snapshot( const char *logdir , time_t timestamp );
 
+/** Delete a database, flushing any pending log data, and freeing all objects it contains.
+@param db The database to delete.
+*/
+
+void deltadb_delete( struct deltadb *db );
+
 /** Insert or update an object into the database.
 If an object with the same primary key exists in the database, it will generate update (U) records in the log, otherwise a create (C) record is generated against the original object.
 @param db The database to access.
@@ -104,6 +120,40 @@ Causes a delete (D) record to be generated in the log.
 
 struct jx * deltadb_remove( struct deltadb *db, const char *key );
 
+/** Set how often log records are pushed out to disk.
+By default, the log is flushed after every change. With a positive interval,
+changes are written together at most once per interval, which is much
+cheaper when many updates arrive, at the risk of losing the most recent
+changes on a crash. Use @ref deltadb_flush to push them out earlier.
+@param db The database to access.
+@param interval The minimum time between flushes, in seconds.
+*/
+
+void deltadb_set_flush_interval( struct deltadb *db, int interval );
+
+/** Set how often intra-day checkpoints are saved and indexed.
+@param db The database to access.
+@param interval The minimum time between checkpoints, in seconds, or zero to disable them.
+*/
+
+void deltadb_set_checkpoint_interval( struct deltadb *db, int interval );
+
+/** Build the index of a day which was logged without one.
+@param logdir The directory of the database.
+@param year The year of the log.
+@param day The day of the year of the log.
+@param interval The time between intra-day checkpoints, in seconds.
+@return True on success, false otherwise, with errno set to EEXIST if the day already has an index.
+*/
+
+int deltadb_build_index( const char *logdir, int year, int day, int interval );
+
+/** Push all buffered log records out to disk.
+@param db The database to access.
+*/
+
+void deltadb_flush( struct deltadb *db );
+
 /** Begin iteration over all keys in the database.
 This function begins a new iteration over the database.
 allowing you to visit every primary key in the database.
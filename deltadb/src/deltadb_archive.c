@@ -0,0 +1,716 @@
+/*
+Copyright (C) 2026 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#include "deltadb_archive.h"
+
+#include "buffer.h"
+#include "debug.h"
+#include "jx_parse.h"
+#include "jx_print.h"
+#include "xxmalloc.h"
+
+#include "zlib.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARCHIVE_MAGIC "DDBA"
+#define ARCHIVE_VERSION 1
+
+/*
+Each column is identified by a number in the table of a block.
+The values of the field with name number j in the block are
+kept in column COLUMN_FIELDS+2*j, with their dictionary in the next.
+Columns are written in order of number, so that the name
+dictionary is known before reaching the fields.
+*/
+
+#define COLUMN_TIMES     0
+#define COLUMN_TYPES     1
+#define COLUMN_KEYS      2
+#define COLUMN_KEY_DICT  3
+#define COLUMN_NFIELDS   4
+#define COLUMN_NAMES     5
+#define COLUMN_NAME_DICT 6
+#define COLUMN_FIELDS    8
+
+struct dictionary {
+	struct hash_table *index;
+	buffer_t text;
+	int count;
+};
+
+struct field_column {
+	buffer_t values;
+	struct dictionary dict;
+};
+
+struct deltadb_archive_writer {
+	FILE *file;
+	int failed;
+	int nevents;
+	int started;
+	time_t tmin;
+	time_t tmax;
+	time_t current;
+	time_t last_time;
+	buffer_t times;
+	buffer_t types;
+	buffer_t keys;
+	buffer_t nfields;
+	buffer_t names;
+	struct dictionary key_dict;
+	struct dictionary name_dict;
+	struct field_column **fields;
+	int fields_size;
+};
+
+static void put_varint( buffer_t *b, uint64_t v )
+{
+	char bytes[10];
+	int n = 0;
+	while(v>=0x80) {
+		bytes[n++] = (v&0x7f)|0x80;
+		v >>= 7;
+	}
+	bytes[n++] = v;
+	buffer_putlstring(b,bytes,n);
+}
+
+static uint64_t zigzag( int64_t v )
+{
+	return ((uint64_t)v<<1) ^ (uint64_t)(v>>63);
+}
+
+static int64_t unzigzag( uint64_t v )
+{
+	return (int64_t)(v>>1) ^ -(int64_t)(v&1);
+}
+
+static void dictionary_init( struct dictionary *d )
+{
+	d->index = hash_table_create(0,0);
+	buffer_init(&d->text);
+	d->count = 0;
+}
+
+static void dictionary_free( struct dictionary *d )
+{
+	hash_table_delete(d->index);
+	buffer_free(&d->text);
+}
+
+/* Give the number of a string in a dictionary, adding it if new. */
+
+static int dictionary_lookup( struct dictionary *d, const char *str )
+{
+	intptr_t n = (intptr_t) hash_table_lookup(d->index,str);
+	if(n) return n-1;
+
+	hash_table_insert(d->index,str,(void*)(intptr_t)(d->count+1));
+	buffer_putlstring(&d->text,str,strlen(str)+1);
+	return d->count++;
+}
+
+static void writer_reset( struct deltadb_archive_writer *w )
+{
+	buffer_init(&w->times);
+	buffer_init(&w->types);
+	buffer_init(&w->keys);
+	buffer_init(&w->nfields);
+	buffer_init(&w->names);
+	dictionary_init(&w->key_dict);
+	dictionary_init(&w->name_dict);
+	w->fields = 0;
+	w->fields_size = 0;
+	w->nevents = 0;
+	w->tmin = w->tmax = 0;
+	w->last_time = 0;
+}
+
+static void writer_free( struct deltadb_archive_writer *w )
+{
+	buffer_free(&w->times);
+	buffer_free(&w->types);
+	buffer_free(&w->keys);
+	buffer_free(&w->nfields);
+	buffer_free(&w->names);
+	dictionary_free(&w->key_dict);
+	dictionary_free(&w->name_dict);
+	for(int i=0;i<w->fields_size;i++) {
+		struct field_column *f = w->fields[i];
+		if(!f) continue;
+		buffer_free(&f->values);
+		dictionary_free(&f->dict);
+		free(f);
+	}
+	free(w->fields);
+}
+
+struct deltadb_archive_writer * deltadb_archive_writer_create( FILE *file )
+{
+	struct deltadb_archive_writer *w = xxmalloc(sizeof(*w));
+	memset(w,0,sizeof(*w));
+	w->file = file;
+	writer_reset(w);
+
+	fputs(ARCHIVE_MAGIC,file);
+	fputc(ARCHIVE_VERSION,file);
+
+	return w;
+}
+
+static void column_add( buffer_t *table, buffer_t *payload, int id, buffer_t *column, int *ncolumns )
+{
+	size_t length;
+	const char *data = buffer_tolstring(column,&length);
+	if(length==0) return;
+
+	uLongf zlength = compressBound(length);
+	Bytef *zdata = xxmalloc(zlength);
+	if(compress2(zdata,&zlength,(const Bytef*)data,length,Z_DEFAULT_COMPRESSION)!=Z_OK) {
+		fatal("couldn't compress archive column");
+	}
+
+	put_varint(table,id);
+	put_varint(table,length);
+	put_varint(table,zlength);
+	buffer_putlstring(payload,(const char*)zdata,zlength);
+	(*ncolumns)++;
+
+	free(zdata);
+}
+
+static void writer_flush( struct deltadb_archive_writer *w )
+{
+	if(w->nevents==0) return;
+
+	buffer_t table, payload, header;
+	buffer_init(&table);
+	buffer_init(&payload);
+	buffer_init(&header);
+
+	int ncolumns = 0;
+	column_add(&table,&payload,COLUMN_TIMES,&w->times,&ncolumns);
+	column_add(&table,&payload,COLUMN_TYPES,&w->types,&ncolumns);
+	column_add(&table,&payload,COLUMN_KEYS,&w->keys,&ncolumns);
+	column_add(&table,&payload,COLUMN_KEY_DICT,&w->key_dict.text,&ncolumns);
+	column_add(&table,&payload,COLUMN_NFIELDS,&w->nfields,&ncolumns);
+	column_add(&table,&payload,COLUMN_NAMES,&w->names,&ncolumns);
+	column_add(&table,&payload,COLUMN_NAME_DICT,&w->name_dict.text,&ncolumns);
+
+	for(int i=0;i<w->fields_size;i++) {
+		struct field_column *f = w->fields[i];
+		if(!f) continue;
+		column_add(&table,&payload,COLUMN_FIELDS+2*i,&f->values,&ncolumns);
+		column_add(&table,&payload,COLUMN_FIELDS+2*i+1,&f->dict.text,&ncolumns);
+	}
+
+	put_varint(&header,w->nevents);
+	put_varint(&header,zigzag(w->tmin));
+	put_varint(&header,zigzag(w->tmax));
+	put_varint(&header,ncolumns);
+
+	size_t length;
+	const char *data;
+
+	data = buffer_tolstring(&header,&length);
+	if(fwrite(data,1,length,w->file)!=length) w->failed = 1;
+	data = buffer_tolstring(&table,&length);
+	if(fwrite(data,1,length,w->file)!=length) w->failed = 1;
+	data = buffer_tolstring(&payload,&length);
+	if(fwrite(data,1,length,w->file)!=length) w->failed = 1;
+
+	buffer_free(&header);
+	buffer_free(&table);
+	buffer_free(&payload);
+
+	writer_free(w);
+	writer_reset(w);
+}
+
+/* Times are written relative to the previous one in the same block. */
+
+static void writer_event( struct deltadb_archive_writer *w, char type )
+{
+	time_t time = w->current;
+
+	if(w->nevents>=DELTADB_ARCHIVE_BLOCK_EVENTS) writer_flush(w);
+
+	if(w->nevents==0) {
+		w->tmin = w->tmax = time;
+	} else {
+		if(time<w->tmin) w->tmin = time;
+		if(time>w->tmax) w->tmax = time;
+	}
+
+	put_varint(&w->times,zigzag(time-w->last_time));
+	buffer_putlstring(&w->types,&type,1);
+	w->last_time = time;
+	w->nevents++;
+}
+
+static void writer_field( struct deltadb_archive_writer *w, const char *name, struct jx *value )
+{
+	int n = dictionary_lookup(&w->name_dict,name);
+	put_varint(&w->names,n);
+
+	if(!value) return;
+
+	if(n>=w->fields_size) {
+		int size = w->fields_size ? w->fields_size*2 : 16;
+		while(size<=n) size *= 2;
+		w->fields = realloc(w->fields,size*sizeof(*w->fields));
+		memset(&w->fields[w->fields_size],0,(size-w->fields_size)*sizeof(*w->fields));
+		w->fields_size = size;
+	}
+
+	struct field_column *f = w->fields[n];
+	if(!f) {
+		f = w->fields[n] = xxmalloc(sizeof(*f));
+		buffer_init(&f->values);
+		dictionary_init(&f->dict);
+	}
+
+	char *str = jx_print_string(value);
+	put_varint(&f->values,dictionary_lookup(&f->dict,str));
+	free(str);
+}
+
+void deltadb_archive_write_time( struct deltadb_archive_writer *w, time_t time )
+{
+	/* A relative time record suffices unless time went back. */
+	char type = !w->started || time<w->current ? 'T' : 't';
+
+	w->started = 1;
+	w->current = time;
+	writer_event(w,type);
+}
+
+void deltadb_archive_write( struct deltadb_archive_writer *w, char type, const char *key, const char *name, struct jx *value )
+{
+	writer_event(w,type);
+
+	put_varint(&w->keys,dictionary_lookup(&w->key_dict,key));
+
+	if(type=='C' || type=='M') {
+		int n = 0;
+		struct jx_pair *p;
+		for(p=value->u.pairs;p;p=p->next) {
+			if(p->key->type==JX_STRING) n++;
+		}
+		put_varint(&w->nfields,n);
+		for(p=value->u.pairs;p;p=p->next) {
+			if(p->key->type==JX_STRING) writer_field(w,p->key->u.string_value,p->value);
+		}
+	} else if(type=='U') {
+		writer_field(w,name,value);
+	} else if(type=='R') {
+		writer_field(w,name,0);
+	}
+}
+
+int deltadb_archive_writer_finish( struct deltadb_archive_writer *w )
+{
+	writer_flush(w);
+	writer_free(w);
+
+	int success = !w->failed && fflush(w->file)==0 && !ferror(w->file);
+	free(w);
+
+	return success;
+}
+
+/*
+The reader decompresses the columns of one block at a time,
+skipping those of fields that are not wanted, and keeps a cursor
+in each one.
+*/
+
+struct cursor {
+	unsigned char *data;
+	size_t size;
+	size_t pos;
+};
+
+struct field_reader {
+	int wanted;
+	struct cursor values;
+	struct jx **dict;
+	int dict_count;
+};
+
+struct deltadb_archive {
+	FILE *file;
+	struct hash_table *fields;
+	time_t skip_time;
+	int corrupt;
+
+	int nevents;
+	int ievent;
+	time_t current;
+
+	struct cursor times;
+	struct cursor types;
+	struct cursor keys;
+	struct cursor nfields;
+	struct cursor names;
+
+	unsigned char *key_text;
+	char **key_dict;
+	int key_count;
+
+	unsigned char *name_text;
+	char **name_dict;
+	int name_count;
+
+	struct field_reader *field_readers;
+	int field_count;
+};
+
+static uint64_t get_varint( struct deltadb_archive *a, struct cursor *c )
+{
+	uint64_t v = 0;
+	int shift = 0;
+	while(c->pos<c->size && shift<64) {
+		unsigned char b = c->data[c->pos++];
+		v |= (uint64_t)(b&0x7f)<<shift;
+		if(!(b&0x80)) return v;
+		shift += 7;
+	}
+	a->corrupt = 1;
+	return 0;
+}
+
+static int file_varint( FILE *file, uint64_t *v )
+{
+	int shift = 0;
+	*v = 0;
+	while(shift<64) {
+		int b = fgetc(file);
+		if(b==EOF) return 0;
+		*v |= (uint64_t)(b&0x7f)<<shift;
+		if(!(b&0x80)) return 1;
+		shift += 7;
+	}
+	return 0;
+}
+
+static void cursor_free( struct cursor *c )
+{
+	free(c->data);
+	memset(c,0,sizeof(*c));
+}
+
+/* Split a dictionary into its strings, which point into the text. */
+
+static char ** dictionary_split( unsigned char *text, size_t size, int *count )
+{
+	int n = 0;
+	for(size_t i=0;i<size;i++) {
+		if(!text[i]) n++;
+	}
+
+	char **strings = xxmalloc((n+1)*sizeof(char*));
+	char *s = (char*)text;
+	for(int i=0;i<n;i++) {
+		strings[i] = s;
+		s += strlen(s)+1;
+	}
+
+	*count = n;
+	return strings;
+}
+
+static void block_free( struct deltadb_archive *a )
+{
+	cursor_free(&a->times);
+	cursor_free(&a->types);
+	cursor_free(&a->keys);
+	cursor_free(&a->nfields);
+	cursor_free(&a->names);
+
+	free(a->key_text);
+	free(a->key_dict);
+	a->key_text = 0;
+	a->key_dict = 0;
+	a->key_count = 0;
+
+	free(a->name_text);
+	free(a->name_dict);
+	a->name_text = 0;
+	a->name_dict = 0;
+	a->name_count = 0;
+
+	for(int i=0;i<a->field_count;i++) {
+		struct field_reader *f = &a->field_readers[i];
+		cursor_free(&f->values);
+		for(int j=0;j<f->dict_count;j++) jx_delete(f->dict[j]);
+		free(f->dict);
+	}
+	free(a->field_readers);
+	a->field_readers = 0;
+	a->field_count = 0;
+
+	a->nevents = a->ievent = 0;
+}
+
+static int column_read( FILE *file, size_t length, size_t zlength, struct cursor *c )
+{
+	Bytef *zdata = xxmalloc(zlength ? zlength : 1);
+	if(fread(zdata,1,zlength,file)!=zlength) {
+		free(zdata);
+		return 0;
+	}
+
+	c->data = xxmalloc(length ? length : 1);
+	c->size = length;
+	c->pos = 0;
+
+	uLongf actual = length;
+	int result = uncompress(c->data,&actual,zdata,zlength);
+	free(zdata);
+
+	return result==Z_OK && actual==length;
+}
+
+/* Load the next block with changes at or after the skip time. */
+
+static int block_load( struct deltadb_archive *a )
+{
+	uint64_t nevents, tmin, tmax, ncolumns;
+
+	block_free(a);
+
+	while(1) {
+		if(!file_varint(a->file,&nevents)) return 0;
+		if(!file_varint(a->file,&tmin)) return 0;
+		if(!file_varint(a->file,&tmax)) return 0;
+		if(!file_varint(a->file,&ncolumns)) return 0;
+
+		uint64_t *ids = xxmalloc(ncolumns*3*sizeof(uint64_t)+1);
+		uint64_t total = 0;
+		for(uint64_t i=0;i<ncolumns;i++) {
+			if(!file_varint(a->file,&ids[3*i]) || !file_varint(a->file,&ids[3*i+1]) || !file_varint(a->file,&ids[3*i+2])) {
+				free(ids);
+				return 0;
+			}
+			total += ids[3*i+2];
+		}
+
+		/* Skip a block entirely before the time of interest. */
+
+		if(unzigzag(tmax)<a->skip_time) {
+			free(ids);
+			if(fseek(a->file,total,SEEK_CUR)!=0) return 0;
+			continue;
+		}
+
+		int ok = 1;
+		for(uint64_t i=0;i<ncolumns && ok;i++) {
+			uint64_t id = ids[3*i];
+			uint64_t length = ids[3*i+1];
+			uint64_t zlength = ids[3*i+2];
+			struct cursor c;
+			memset(&c,0,sizeof(c));
+
+			if(id>=COLUMN_FIELDS) {
+				uint64_t n = (id-COLUMN_FIELDS)/2;
+				if(n>=(uint64_t)a->field_count || !a->field_readers[n].wanted) {
+					ok = fseek(a->file,zlength,SEEK_CUR)==0;
+					continue;
+				}
+				struct field_reader *f = &a->field_readers[n];
+				ok = column_read(a->file,length,zlength,&c);
+				if(!ok) break;
+				if((id-COLUMN_FIELDS)%2==0) {
+					f->values = c;
+				} else {
+					int count;
+					char **strings = dictionary_split(c.data,c.size,&count);
+					f->dict = xxmalloc((count+1)*sizeof(struct jx*));
+					f->dict_count = count;
+					for(int j=0;j<count;j++) {
+						f->dict[j] = jx_parse_string(strings[j]);
+						if(!f->dict[j]) f->dict[j] = jx_string(strings[j]);
+					}
+					free(strings);
+					cursor_free(&c);
+				}
+				continue;
+			}
+
+			ok = column_read(a->file,length,zlength,&c);
+			if(!ok) break;
+
+			switch(id) {
+				case COLUMN_TIMES: a->times = c; break;
+				case COLUMN_TYPES: a->types = c; break;
+				case COLUMN_KEYS: a->keys = c; break;
+				case COLUMN_NFIELDS: a->nfields = c; break;
+				case COLUMN_NAMES: a->names = c; break;
+				case COLUMN_KEY_DICT:
+					a->key_text = c.data;
+					a->key_dict = dictionary_split(c.data,c.size,&a->key_count);
+					break;
+				case COLUMN_NAME_DICT:
+					a->name_text = c.data;
+					a->name_dict = dictionary_split(c.data,c.size,&a->name_count);
+					a->field_count = a->name_count;
+					a->field_readers = xxmalloc((a->field_count+1)*sizeof(*a->field_readers));
+					memset(a->field_readers,0,(a->field_count+1)*sizeof(*a->field_readers));
+					for(int j=0;j<a->field_count;j++) {
+						a->field_readers[j].wanted = !a->fields || hash_table_lookup(a->fields,a->name_dict[j]);
+					}
+					break;
+				default:
+					cursor_free(&c);
+					break;
+			}
+		}
+
+		free(ids);
+
+		if(!ok) {
+			debug(D_NOTICE,"corrupt archive block");
+			block_free(a);
+			return 0;
+		}
+
+		a->nevents = nevents;
+		a->ievent = 0;
+		return 1;
+	}
+}
+
+struct deltadb_archive * deltadb_archive_open( const char *filename, struct hash_table *fields )
+{
+	char magic[5];
+
+	FILE *file = fopen(filename,"r");
+	if(!file) return 0;
+
+	if(fread(magic,1,5,file)!=5 || memcmp(magic,ARCHIVE_MAGIC,4) || magic[4]!=ARCHIVE_VERSION) {
+		fclose(file);
+		return 0;
+	}
+
+	struct deltadb_archive *a = xxmalloc(sizeof(*a));
+	memset(a,0,sizeof(*a));
+	a->file = file;
+	a->fields = fields;
+
+	return a;
+}
+
+void deltadb_archive_skip_before( struct deltadb_archive *a, time_t time )
+{
+	a->skip_time = time;
+}
+
+static const char * dict_string( struct deltadb_archive *a, char **dict, int count, uint64_t n )
+{
+	if(n>=(uint64_t)count) {
+		a->corrupt = 1;
+		return "";
+	}
+	return dict[n];
+}
+
+/* Read the value of a field, if it is wanted, giving its name. */
+
+static const char * read_field( struct deltadb_archive *a, int with_value, struct jx **value, int make_value )
+{
+	uint64_t n = get_varint(a,&a->names);
+	const char *name = dict_string(a,a->name_dict,a->name_count,n);
+
+	*value = 0;
+	if(a->corrupt || !a->field_readers[n].wanted) return 0;
+	if(!with_value) return name;
+
+	struct field_reader *f = &a->field_readers[n];
+	uint64_t v = get_varint(a,&f->values);
+	if(v>=(uint64_t)f->dict_count) {
+		a->corrupt = 1;
+		return 0;
+	}
+	if(make_value) *value = jx_copy(f->dict[v]);
+	return name;
+}
+
+int deltadb_archive_next( struct deltadb_archive *a, struct deltadb_archive_event *e )
+{
+	while(1) {
+		if(a->corrupt) {
+			debug(D_NOTICE,"corrupt archive data");
+			return 0;
+		}
+
+		if(a->ievent>=a->nevents) {
+			if(!block_load(a)) return 0;
+			continue;
+		}
+
+		if(a->ievent==0) a->current = 0;
+		a->ievent++;
+
+		if(a->types.pos>=a->types.size) {
+			a->corrupt = 1;
+			continue;
+		}
+		char type = a->types.data[a->types.pos++];
+		a->current += unzigzag(get_varint(a,&a->times));
+
+		int keep = a->current>=a->skip_time;
+
+		e->type = type;
+		e->time = a->current;
+		e->key = 0;
+		e->name = 0;
+		e->value = 0;
+
+		if(type=='T' || type=='t') {
+			if(keep) return 1;
+			continue;
+		}
+
+		e->key = dict_string(a,a->key_dict,a->key_count,get_varint(a,&a->keys));
+
+		if(type=='C' || type=='M') {
+			uint64_t n = get_varint(a,&a->nfields);
+			struct jx *object = keep ? jx_object(0) : 0;
+			struct jx_pair **tail = object ? &object->u.pairs : 0;
+			for(uint64_t i=0;i<n && !a->corrupt;i++) {
+				struct jx *value;
+				const char *name = read_field(a,1,&value,keep);
+				if(name && value) {
+					*tail = jx_pair(jx_string(name),value,0);
+					tail = &(*tail)->next;
+				}
+			}
+			e->value = object;
+		} else if(type=='U') {
+			e->name = read_field(a,1,&e->value,keep);
+		} else if(type=='R') {
+			e->name = read_field(a,0,&e->value,keep);
+		}
+
+		if(keep && !a->corrupt) return 1;
+
+		jx_delete(e->value);
+	}
+}
+
+void deltadb_archive_close( struct deltadb_archive *a )
+{
+	if(!a) return;
+	block_free(a);
+	fclose(a->file);
+	free(a);
+}
+
+/* vim: set noexpandtab tabstop=4: */
@@ -0,0 +1,109 @@
+/*
+Copyright (C) 2026 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#ifndef DELTADB_ARCHIVE_H
+#define DELTADB_ARCHIVE_H
+
+/*
+An archive DIR/YEAR/DAY.cdb holds the same changes as the log DIR/YEAR/DAY.log
+of a closed day, in a compact form which is faster to read.
+
+The changes are divided into blocks of up to DELTADB_ARCHIVE_BLOCK_EVENTS,
+each beginning with the number of changes, the earliest and latest time,
+and a table of the columns of the block, each compressed with zlib.
+The times, types, keys, field counts, and field names of the changes
+are kept in columns of their own, and the values of each field name
+are kept in a separate column, so that a reader interested in only a
+few fields need not decompress or parse the others.  Keys, names, and
+values are dictionary encoded within a block, so each distinct value
+is only parsed once per block.
+
+Objects created or merged are kept as their fields, and so come
+back equal but not necessarily identical in text to the log.
+*/
+
+#include "jx.h"
+#include "hash_table.h"
+
+#include <stdio.h>
+#include <time.h>
+
+#define DELTADB_ARCHIVE_BLOCK_EVENTS 65536
+
+struct deltadb_archive_writer;
+struct deltadb_archive;
+
+/** A change read from an archive. */
+
+struct deltadb_archive_event {
+	char type;          /**< One of the log record types: T t C D U M R */
+	time_t time;        /**< The time of the change. */
+	const char *key;    /**< The key of the object changed. */
+	const char *name;   /**< The field changed by U or R, or null if not wanted. */
+	struct jx *value;   /**< The object for C or M, or the value for U, to be deleted by the caller. */
+};
+
+/** Begin writing an archive.
+@param file The file to write, which remains open.
+@return A new writer.
+*/
+
+struct deltadb_archive_writer * deltadb_archive_writer_create( FILE *file );
+
+/** Write a time record.
+@param w The writer.
+@param time The current time.
+*/
+
+void deltadb_archive_write_time( struct deltadb_archive_writer *w, time_t time );
+
+/** Write a change other than a time record.
+@param w The writer.
+@param type The record type: C D U M R
+@param key The key of the object.
+@param name The field name for U and R, otherwise null.
+@param value The object for C and M, the value for U, otherwise null.
+*/
+
+void deltadb_archive_write( struct deltadb_archive_writer *w, char type, const char *key, const char *name, struct jx *value );
+
+/** Write any buffered changes and delete the writer.
+@param w The writer.
+@return True on success, false if any write failed.
+*/
+
+int deltadb_archive_writer_finish( struct deltadb_archive_writer *w );
+
+/** Open an archive for reading.
+@param filename The archive file.
+@param fields If not null, a table of the only field names wanted.
+@return A new reader, or null if the file is not an archive.
+*/
+
+struct deltadb_archive * deltadb_archive_open( const char *filename, struct hash_table *fields );
+
+/** Skip the changes made before a given time, without decoding them where possible.
+@param a The reader.
+@param time The earliest time of interest.
+*/
+
+void deltadb_archive_skip_before( struct deltadb_archive *a, time_t time );
+
+/** Read the next change.
+@param a The reader.
+@param e Filled in with the change, whose strings are valid until the next call.
+@return True if a change was read, false at the end of the archive.
+*/
+
+int deltadb_archive_next( struct deltadb_archive *a, struct deltadb_archive_event *e );
+
+/** Close an archive.
+@param a The reader.
+*/
+
+void deltadb_archive_close( struct deltadb_archive *a );
+
+#endif
@@ -0,0 +1,235 @@
+/*
+Copyright (C) 2026 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+/*
+Convert the logs of closed days in a deltadb directory into archives,
+which are smaller and faster to query.  The log of the current day is
+still being written and is never converted.  Each archive is written
+under a temporary name and read back before it takes its place,
+after which the log may be removed with -r.  Queries and recovery
+use the archive of a day in preference to its log.
+*/
+
+#include "deltadb_archive.h"
+#include "deltadb_stream.h"
+
+#include "jx.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include <time.h>
+#include <unistd.h>
+
+static struct deltadb_archive_writer *writer = 0;
+static int nevents = 0;
+
+static int archive_create( struct deltadb_query *query, const char *key, struct jx *jobject )
+{
+	if(jx_istype(jobject,JX_OBJECT)) {
+		deltadb_archive_write(writer,'C',key,0,jobject);
+		nevents++;
+	}
+	jx_delete(jobject);
+	return 1;
+}
+
+static int archive_delete( struct deltadb_query *query, const char *key )
+{
+	deltadb_archive_write(writer,'D',key,0,0);
+	nevents++;
+	return 1;
+}
+
+static int archive_update( struct deltadb_query *query, const char *key, const char *name, struct jx *jvalue )
+{
+	deltadb_archive_write(writer,'U',key,name,jvalue);
+	nevents++;
+	jx_delete(jvalue);
+	return 1;
+}
+
+static int archive_merge( struct deltadb_query *query, const char *key, struct jx *jobject )
+{
+	if(jx_istype(jobject,JX_OBJECT)) {
+		deltadb_archive_write(writer,'M',key,0,jobject);
+		nevents++;
+	}
+	jx_delete(jobject);
+	return 1;
+}
+
+static int archive_remove( struct deltadb_query *query, const char *key, const char *name )
+{
+	deltadb_archive_write(writer,'R',key,name,0);
+	nevents++;
+	return 1;
+}
+
+static int archive_time( struct deltadb_query *query, time_t starttime, time_t stoptime, time_t current )
+{
+	deltadb_archive_write_time(writer,current);
+	nevents++;
+	return 1;
+}
+
+static int archive_raw( struct deltadb_query *query, const char *line )
+{
+	return 1;
+}
+
+static struct deltadb_event_handlers handlers = {
+	archive_create,
+	archive_delete,
+	archive_update,
+	archive_merge,
+	archive_remove,
+	archive_time,
+	archive_raw
+};
+
+/* Count the changes in an archive, or return -1 if it cannot be read. */
+
+static int archive_count( const char *filename )
+{
+	struct deltadb_archive *a = deltadb_archive_open(filename,0);
+	if(!a) return -1;
+
+	struct deltadb_archive_event e;
+	int count = 0;
+	while(deltadb_archive_next(a,&e)) {
+		jx_delete(e.value);
+		count++;
+	}
+
+	deltadb_archive_close(a);
+	return count;
+}
+
+static int convert_day( const char *logdir, int year, int day, int remove_log )
+{
+	char logname[4096];
+	char archivename[4096];
+	char tmpname[4096];
+
+	snprintf(logname,sizeof(logname),"%s/%d/%d.log",logdir,year,day);
+	snprintf(archivename,sizeof(archivename),"%s/%d/%d.cdb",logdir,year,day);
+	snprintf(tmpname,sizeof(tmpname),"%s/%d/%d.cdb.tmp",logdir,year,day);
+
+	if(access(archivename,F_OK)==0) return 1;
+
+	FILE *input = fopen(logname,"r");
+	if(!input) {
+		fprintf(stderr,"couldn't open %s: %s\n",logname,strerror(errno));
+		return 0;
+	}
+
+	FILE *output = fopen(tmpname,"w");
+	if(!output) {
+		fprintf(stderr,"couldn't create %s: %s\n",tmpname,strerror(errno));
+		fclose(input);
+		return 0;
+	}
+
+	writer = deltadb_archive_writer_create(output);
+	nevents = 0;
+
+	deltadb_process_stream(0,&handlers,input,0,0,0);
+	fclose(input);
+
+	int success = deltadb_archive_writer_finish(writer);
+	writer = 0;
+	if(fclose(output)!=0) success = 0;
+
+	if(!success) {
+		fprintf(stderr,"couldn't write %s: %s\n",tmpname,strerror(errno));
+		unlink(tmpname);
+		return 0;
+	}
+
+	if(archive_count(tmpname)!=nevents) {
+		fprintf(stderr,"couldn't verify %s\n",tmpname);
+		unlink(tmpname);
+		return 0;
+	}
+
+	if(rename(tmpname,archivename)!=0) {
+		fprintf(stderr,"couldn't rename %s: %s\n",tmpname,strerror(errno));
+		unlink(tmpname);
+		return 0;
+	}
+
+	printf("archived %s\n",logname);
+
+	if(remove_log && unlink(logname)!=0) {
+		fprintf(stderr,"couldn't remove %s: %s\n",logname,strerror(errno));
+		return 0;
+	}
+
+	return 1;
+}
+
+int main( int argc, char *argv[] )
+{
+	char path[4096];
+	int year, day;
+	char extra;
+	int failures = 0;
+	int remove_log = 0;
+	const char *logdir;
+
+	if(argc==3 && !strcmp(argv[1],"-r")) {
+		remove_log = 1;
+		logdir = argv[2];
+	} else if(argc==2) {
+		logdir = argv[1];
+	} else {
+		fprintf(stderr,"use: %s [-r] <logdir>\n",argv[0]);
+		fprintf(stderr,"Convert the logs of closed days into archives.\n");
+		fprintf(stderr,"  -r  Remove each log once it is archived.\n");
+		return 1;
+	}
+
+	time_t now = time(0);
+	struct tm tm;
+	struct tm *t = gmtime_r(&now,&tm);
+	int thisyear = t->tm_year + 1900;
+	int thisday = t->tm_yday;
+
+	DIR *topdir = opendir(logdir);
+	if(!topdir) {
+		fprintf(stderr,"couldn't open %s: %s\n",logdir,strerror(errno));
+		return 1;
+	}
+
+	struct dirent *y;
+	while((y = readdir(topdir))) {
+		if(sscanf(y->d_name,"%d%c",&year,&extra)!=1) continue;
+
+		snprintf(path,sizeof(path),"%s/%d",logdir,year);
+		DIR *yeardir = opendir(path);
+		if(!yeardir) continue;
+
+		struct dirent *d;
+		while((d = readdir(yeardir))) {
+			if(sscanf(d->d_name,"%d.lo%c",&day,&extra)!=2 || extra!='g') continue;
+			if(strcmp(strchr(d->d_name,'.'),".log")) continue;
+
+			/* The current day is still being written. */
+			if(year>thisyear || (year==thisyear && day>=thisday)) continue;
+
+			if(!convert_day(logdir,year,day,remove_log)) failures++;
+		}
+		closedir(yeardir);
+	}
+	closedir(topdir);
+
+	return failures ? 1 : 0;
+}
+
+/* vim: set noexpandtab tabstop=4: */
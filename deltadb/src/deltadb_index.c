@@ -0,0 +1,60 @@
+/*
+Copyright (C) 2026 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#include "deltadb_index.h"
+
+#include "stringtools.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+char * deltadb_index_checkpoint_name( const char *logdir, int year, int day, time_t time )
+{
+	return string_format("%s/%d/%d.%lld.ckpt",logdir,year,day,(long long)time);
+}
+
+int deltadb_index_lookup( const char *logdir, int year, int day, time_t time, time_t *found_time, long *offset )
+{
+	char line[256];
+	long long t;
+	long o;
+	int found = 0;
+
+	char *filename = string_format("%s/%d/%d.idx",logdir,year,day);
+	FILE *file = fopen(filename,"r");
+	free(filename);
+	if(!file) return 0;
+
+	/* Entries are normally in time order, but take the best of all to be safe. */
+
+	while(fgets(line,sizeof(line),file)) {
+		if(sscanf(line,"%lld %ld",&t,&o)!=2) continue;
+		if(t>time || o<0) continue;
+		if(!found || t>*found_time) {
+			*found_time = t;
+			*offset = o;
+			found = 1;
+		}
+	}
+
+	fclose(file);
+
+	return found;
+}
+
+int deltadb_index_add( const char *logdir, int year, int day, time_t time, long offset )
+{
+	char *filename = string_format("%s/%d/%d.idx",logdir,year,day);
+	FILE *file = fopen(filename,"a");
+	free(filename);
+	if(!file) return 0;
+
+	fprintf(file,"%lld %ld\n",(long long)time,offset);
+
+	return fclose(file)==0;
+}
+
+/* vim: set noexpandtab tabstop=4: */
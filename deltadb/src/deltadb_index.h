@@ -0,0 +1,56 @@
+/*
+Copyright (C) 2026 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#ifndef DELTADB_INDEX_H
+#define DELTADB_INDEX_H
+
+/*
+So that a query need not replay a whole day of log to reach the
+time it starts, the writer periodically saves an intra-day checkpoint
+DIR/YEAR/DAY.TIME.ckpt with the state of the table at TIME, and adds
+a line "TIME OFFSET" to the index DIR/YEAR/DAY.idx, where OFFSET is
+the position in DIR/YEAR/DAY.log just after the time record that
+brought the time to TIME.  Reading the checkpoint, then playing the
+log from OFFSET with the current time set to TIME, gives the same state
+as playing the whole day.  Days without an index are played from the start.
+*/
+
+#include <time.h>
+
+/** Get the name of the intra-day checkpoint for a given time.
+@param logdir The directory of the database.
+@param year The year of the log.
+@param day The day of the year of the log.
+@param time The time of the checkpoint.
+@return The file name, which should be freed when done.
+*/
+
+char * deltadb_index_checkpoint_name( const char *logdir, int year, int day, time_t time );
+
+/** Find the latest intra-day checkpoint at or before a given time.
+@param logdir The directory of the database.
+@param year The year of the log.
+@param day The day of the year of the log.
+@param time The time to look for.
+@param found_time Set to the time of the checkpoint found.
+@param offset Set to the offset in the log at which to continue from the checkpoint.
+@return True if a checkpoint was found, false if the day must be played from the start.
+*/
+
+int deltadb_index_lookup( const char *logdir, int year, int day, time_t time, time_t *found_time, long *offset );
+
+/** Add an intra-day checkpoint to the index of a day, once the checkpoint and the log up to offset are on disk.
+@param logdir The directory of the database.
+@param year The year of the log.
+@param day The day of the year of the log.
+@param time The time of the checkpoint.
+@param offset The offset in the log just after the time record for time.
+@return True on success, false otherwise.
+*/
+
+int deltadb_index_add( const char *logdir, int year, int day, time_t time, long offset );
+
+#endif
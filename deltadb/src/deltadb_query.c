@@ -5,6 +5,8 @@ See the file COPYING for details.
 */
 
 #include "deltadb_stream.h"
+#include "deltadb_archive.h"
+#include "deltadb_index.h"
 #include "deltadb_reduction.h"
 #include "deltadb_query.h"
 
@@ -28,6 +30,41 @@ See the file COPYING for details.
 #include <sys/types.h>
 #include <stdarg.h>
 #include <ctype.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/*
+A segment of a parallel query, played into a query of its own,
+notes where its output may need corrections, described below.
+*/
+
+#define SEGMENT_DISPLAYS_KEPT 2
+
+struct segment_display {
+	time_t time;
+	long start;
+	long end;
+	struct list *reductions;
+};
+
+struct deltadb_segment {
+	int year;
+	int day;
+	int ndays;
+	int first;
+	time_t display_start;
+	struct deltadb_query *query;
+	int result;
+	int failed;
+	int file_errors;
+	int done;
+	long time_start;
+	long time_end;
+	time_t time_value;
+	int ndisplays;
+	struct segment_display displays[SEGMENT_DISPLAYS_KEPT];
+};
 
 struct deltadb_query {
 	struct hash_table *table;
@@ -42,6 +79,9 @@ struct deltadb_query {
 	time_t deferred_time;
 	time_t last_output_time;
 	deltadb_display_mode_t display_mode;
+	int threads;
+	struct deltadb_segment *segment;
+	struct hash_table *fields;
 };
 
 struct deltadb_query * deltadb_query_create()
@@ -82,6 +122,8 @@ void deltadb_query_delete( struct deltadb_query *query )
 	}
 	list_delete(query->reduce_exprs);
 
+	if(query->fields) hash_table_delete(query->fields);
+
 	free(query);
 }
 
@@ -115,6 +157,11 @@ void deltadb_query_set_interval( struct deltadb_query *query, int interval )
 	query->display_every = interval;
 }
 
+void deltadb_query_set_threads( struct deltadb_query *query, int threads )
+{
+	query->threads = threads;
+}
+
 void deltadb_query_add_output( struct deltadb_query *query, struct jx *expr )
 {
 	list_push_tail(query->output_exprs,expr);
@@ -206,14 +253,19 @@ static int checkpoint_read( struct deltadb_query *query, const char *filename )
 	return 1;
 }
 
-static void reset_reductions( struct deltadb_query *query, deltadb_scope_t scope )
+static void reset_reductions_list( struct list *reductions, deltadb_scope_t scope )
 {
-	list_first_item(query->reduce_exprs);
-	for(struct deltadb_reduction *r; (r = list_next_item(query->reduce_exprs));) {
+	list_first_item(reductions);
+	for(struct deltadb_reduction *r; (r = list_next_item(reductions));) {
 		deltadb_reduction_reset(r,scope);
 	}
 }
 
+static void reset_reductions( struct deltadb_query *query, deltadb_scope_t scope )
+{
+	reset_reductions_list(query->reduce_exprs,scope);
+}
+
 static void update_reductions( struct deltadb_query *query, const char *key, struct jx *jobject, deltadb_scope_t scope )
 {
 	/* Skip if the where expression doesn't match */
@@ -230,34 +282,24 @@ static void update_reductions( struct deltadb_query *query, const char *key, str
 	}
 }
 
-static void display_reduce_exprs( struct deltadb_query *query, time_t current )
-{
-	/* Reset all spatial reductions. */
-	reset_reductions(query,DELTADB_SCOPE_SPATIAL);
-
-	/* For each object in the hash table: */
-
-	char *key;
-	struct jx *jobject;
-	hash_table_firstkey(query->table);
-	while(hash_table_nextkey(query->table,&key,(void**)&jobject)) {
-		/* Update each local reduction with its value. */
-		update_reductions(query,key,jobject,DELTADB_SCOPE_SPATIAL);
-	}
+static struct list * reductions_copy_empty( struct list *reductions );
 
+static void display_reduce_line( struct deltadb_query *query, struct list *reductions, time_t current )
+{
 	/* Emit the current time */
 
 	if(query->epoch_mode) {
 		fprintf(query->output_stream,"%lld\t",(long long) current);
 	} else {
 		char str[32];
-		strftime(str,sizeof(str),"%F %T",localtime(&current));
+		struct tm tm;
+		strftime(str,sizeof(str),"%F %T",localtime_r(&current,&tm));
 		fprintf(query->output_stream,"%s\t",str);
 	}
 
 	/* For each reduction, display the final value. */
-	list_first_item(query->reduce_exprs);
-	for(struct deltadb_reduction *r; (r = list_next_item(query->reduce_exprs));) {
+	list_first_item(reductions);
+	for(struct deltadb_reduction *r; (r = list_next_item(reductions));) {
 		if (r->scope == DELTADB_SCOPE_TEMPORAL) {
 			struct jx *column = jx_object(0);
 			char *key;
@@ -282,6 +324,31 @@ static void display_reduce_exprs( struct deltadb_query *query, time_t current )
 	}
 
 	fprintf(query->output_stream,"\n");
+}
+
+static void display_reduce_exprs( struct deltadb_query *query, time_t current )
+{
+	/* Reset all spatial reductions. */
+	reset_reductions(query,DELTADB_SCOPE_SPATIAL);
+
+	/* For each object in the hash table: */
+
+	char *key;
+	struct jx *jobject;
+	hash_table_firstkey(query->table);
+	while(hash_table_nextkey(query->table,&key,(void**)&jobject)) {
+		/* Update each local reduction with its value. */
+		update_reductions(query,key,jobject,DELTADB_SCOPE_SPATIAL);
+	}
+
+	display_reduce_line(query,query->reduce_exprs,current);
+
+	/* A segment of a parallel query keeps the reductions of its first displays for merging. */
+	struct deltadb_segment *s = query->segment;
+	if(s && s->ndisplays<SEGMENT_DISPLAYS_KEPT) {
+		s->displays[s->ndisplays].reductions = query->reduce_exprs;
+		query->reduce_exprs = reductions_copy_empty(query->reduce_exprs);
+	}
 
 	/* Reset temporal and global reductions to compute new values. */
 	reset_reductions(query,DELTADB_SCOPE_TEMPORAL);
@@ -307,7 +374,8 @@ static void display_output_exprs( struct deltadb_query *query, time_t current )
 			fprintf(query->output_stream,"%lld\t",(long long) current);
 		} else {
 			char str[32];
-			strftime(str,sizeof(str),"%F %T",localtime(&current));
+			struct tm tm;
+			strftime(str,sizeof(str),"%F %T",localtime_r(&current,&tm));
 			fprintf(query->output_stream,"%s\t",str);
 		}
 
@@ -368,7 +436,14 @@ static void display_deferred_time( struct deltadb_query *query )
 		if(query->last_output_time) {
 			fprintf(query->output_stream,"t %ld\n",query->deferred_time-query->last_output_time);
 		} else {
+			/* A segment of a parallel query notes where its absolute time is. */
+			struct deltadb_segment *s = query->segment;
+			if(s) {
+				s->time_start = ftell(query->output_stream);
+				s->time_value = query->deferred_time;
+			}
 			fprintf(query->output_stream,"T %ld\n",query->deferred_time);
+			if(s) s->time_end = ftell(query->output_stream);
 		}
 		query->last_output_time = query->deferred_time;
 		query->deferred_time = 0;
@@ -385,6 +460,8 @@ int deltadb_create_event( struct deltadb_query *query, const char *key, struct j
 	update_reductions(query,key,jobject,DELTADB_SCOPE_GLOBAL);
 	update_reductions(query,key,jobject,DELTADB_SCOPE_TEMPORAL);
 
+	/* A log played from an intra-day checkpoint may create an object it already has. */
+	jx_delete(hash_table_remove(query->table,key));
 	hash_table_insert(query->table,key,jobject);
 
 	if(query->display_mode==DELTADB_DISPLAY_STREAM) {
@@ -519,7 +596,21 @@ int deltadb_time_event( struct deltadb_query *query, time_t starttime, time_t st
 	if(query->display_mode==DELTADB_DISPLAY_STREAM) {
 		query->deferred_time = current;
 		return 1;
-	} else if(query->display_mode==DELTADB_DISPLAY_EXPRS) {
+	}
+
+	/*
+	The first display of a later segment of a parallel query stands for
+	whichever display was due at its first time record, so the next one
+	is the first after that record.
+	*/
+	struct deltadb_segment *s = query->segment;
+	if(s && !s->first && s->ndisplays==0 && query->display_every>0 && query->display_next<=current) {
+		query->display_next += ((current-query->display_next)/query->display_every+1)*query->display_every;
+	}
+
+	long start = s ? ftell(query->output_stream) : 0;
+
+	if(query->display_mode==DELTADB_DISPLAY_EXPRS) {
 		display_output_exprs(query,current);
 	} else if(query->display_mode==DELTADB_DISPLAY_OBJECTS) {
 		display_output_objects(query,current);
@@ -527,6 +618,14 @@ int deltadb_time_event( struct deltadb_query *query, time_t starttime, time_t st
 		display_reduce_exprs(query,current);
 	}
 
+	/* A segment of a parallel query notes where its first displays are. */
+	if(s && s->ndisplays<SEGMENT_DISPLAYS_KEPT) {
+		s->displays[s->ndisplays].time = current;
+		s->displays[s->ndisplays].start = start;
+		s->displays[s->ndisplays].end = ftell(query->output_stream);
+	}
+	if(s) s->ndisplays++;
+
 	return 1;
 }
 
@@ -573,66 +672,208 @@ int deltadb_query_execute_stream( struct deltadb_query *query, FILE *stream, tim
 {
 	query->display_next = starttime;
 	if(is_fast_query(query)) {
-		return deltadb_process_stream_fast(query,&handlers,stream,starttime,stoptime);
+		return deltadb_process_stream_fast(query,&handlers,stream,starttime,stoptime,0);
 	} else {
-		return deltadb_process_stream(query,&handlers,stream,starttime,stoptime);
+		return deltadb_process_stream(query,&handlers,stream,starttime,stoptime,0);
 	}
 }
 
 /*
-Execute a query on a directory structure.
-Play the log from starttime to stoptime by opening the appropriate
-checkpoint file and working ahead in the various log files.
+Collect the names of the fields used by an expression.
+Returns false if the expression calls a function, which might
+look at fields that are not named directly.
 */
 
-int deltadb_query_execute_dir( struct deltadb_query *query, const char *logdir, time_t starttime, time_t stoptime )
+static int collect_symbols( struct jx *j, struct hash_table *fields )
 {
-	int file_errors = 0;
+	if(!j) return 1;
+
+	switch(j->type) {
+		case JX_SYMBOL:
+			hash_table_insert(fields,j->u.symbol_name,(void*)1);
+			return 1;
+		case JX_ARRAY:
+			for(struct jx_item *i = j->u.items; i; i = i->next) {
+				if(!collect_symbols(i->value,fields)) return 0;
+				for(struct jx_comprehension *c = i->comp; c; c = c->next) {
+					if(!collect_symbols(c->elements,fields)) return 0;
+					if(!collect_symbols(c->condition,fields)) return 0;
+				}
+			}
+			return 1;
+		case JX_OBJECT:
+			for(struct jx_pair *p = j->u.pairs; p; p = p->next) {
+				if(!collect_symbols(p->key,fields)) return 0;
+				if(!collect_symbols(p->value,fields)) return 0;
+				for(struct jx_comprehension *c = p->comp; c; c = c->next) {
+					if(!collect_symbols(c->elements,fields)) return 0;
+					if(!collect_symbols(c->condition,fields)) return 0;
+				}
+			}
+			return 1;
+		case JX_OPERATOR:
+			if(j->u.oper.type==JX_OP_CALL) return 0;
+			return collect_symbols(j->u.oper.left,fields) && collect_symbols(j->u.oper.right,fields);
+		default:
+			return 1;
+	}
+}
 
-	query->display_next = starttime;
+/*
+When a query only displays expressions or reductions, the fields they
+use are the only ones that need to be read from an archive.
+Otherwise, or if they cannot be known, the fields are left null.
+*/
 
-	struct tm *starttm = localtime(&starttime);
+static void query_set_fields( struct deltadb_query *query )
+{
+	if(query->display_mode!=DELTADB_DISPLAY_EXPRS && query->display_mode!=DELTADB_DISPLAY_REDUCE) return;
 
-	int year = starttm->tm_year + 1900;
-	int day = starttm->tm_yday;
+	struct hash_table *fields = hash_table_create(0,0);
+	int ok = collect_symbols(query->filter_expr,fields) && collect_symbols(query->where_expr,fields);
 
-	struct tm *stoptm = localtime(&stoptime);
+	list_first_item(query->output_exprs);
+	for(struct jx *j; ok && (j = list_next_item(query->output_exprs));) {
+		ok = collect_symbols(j,fields);
+	}
 
-	int stopyear = stoptm->tm_year + 1900;
-	int stopday = stoptm->tm_yday;
+	list_first_item(query->reduce_exprs);
+	for(struct deltadb_reduction *r; ok && (r = list_next_item(query->reduce_exprs));) {
+		ok = collect_symbols(r->expr,fields);
+	}
+
+	if(ok) {
+		query->fields = fields;
+	} else {
+		hash_table_delete(fields);
+	}
+}
+
+/*
+Play one day from its archive if it has one, or else from its log.
+Returns 1 to continue, 0 if stoptime was reached, and -1 if neither
+could be opened.  An index offset applies only to the log, so
+an archive is instead skipped ahead to initialtime.
+*/
+
+static int query_play_day( struct deltadb_query *query, const char *logdir, int year, int day, time_t starttime, time_t stoptime, time_t initialtime, long offset )
+{
+	char *filename = string_format("%s/%d/%d.cdb",logdir,year,day);
+	struct deltadb_archive *archive = deltadb_archive_open(filename,query->fields);
+	free(filename);
+
+	if(archive) {
+		if(initialtime) deltadb_archive_skip_before(archive,initialtime);
+		int keepgoing;
+		if(is_fast_query(query)) {
+			keepgoing = deltadb_process_archive_fast(query,&handlers,archive,starttime,stoptime);
+		} else {
+			keepgoing = deltadb_process_archive(query,&handlers,archive,starttime,stoptime);
+		}
+		deltadb_archive_close(archive);
+		return keepgoing;
+	}
+
+	filename = string_format("%s/%d/%d.log",logdir,year,day);
+	FILE *file = fopen(filename,"r");
+	if(!file) {
+		fprintf(stderr,"couldn't open %s: %s\n",filename,strerror(errno));
+		free(filename);
+		return -1;
+	}
+
+	if(offset>0 && fseek(file,offset,SEEK_SET)!=0) {
+		fprintf(stderr,"couldn't seek in %s: %s\n",filename,strerror(errno));
+	}
+	free(filename);
+
+	int keepgoing;
+	if(is_fast_query(query)) {
+		keepgoing = deltadb_process_stream_fast(query,&handlers,file,starttime,stoptime,initialtime);
+	} else {
+		keepgoing = deltadb_process_stream(query,&handlers,file,starttime,stoptime,initialtime);
+	}
+
+	fclose(file);
+	return keepgoing;
+}
+
+/*
+An intra-day checkpoint holds exactly the table that playing the day
+up to its time would build, but not what a query accumulates along the
+way: stream mode shows every change of the day, a filter admits an object
+according to its values when the object is created, not as it stands in
+the checkpoint, and global and temporal reductions count from the start
+of the day.  Only queries with none of these may start from the index.
+*/
+
+static int query_can_use_index( struct deltadb_query *query )
+{
+	if(query->display_mode==DELTADB_DISPLAY_STREAM) return 0;
+	if(query->filter_expr) return 0;
+
+	list_first_item(query->reduce_exprs);
+	for(struct deltadb_reduction *r; (r = list_next_item(query->reduce_exprs));) {
+		if(r->scope!=DELTADB_SCOPE_SPATIAL) return 0;
+	}
+
+	return 1;
+}
+
+/*
+Load the state of the table at the start of a query, from the latest
+intra-day checkpoint before starttime if the day has an index and the
+query allows it, or else from the daily checkpoint.  The checkpoint at
+time T may already contain changes logged at T, after the time record,
+so it must lie strictly before starttime to be displayed correctly.
+Gives the time and offset at which to start playing the log, both zero
+for the start of the day.
+*/
+
+static int query_load_start( struct deltadb_query *query, const char *logdir, int year, int day, time_t starttime, time_t *initialtime, long *offset )
+{
+	*initialtime = 0;
+	*offset = 0;
+
+	if(query_can_use_index(query) && deltadb_index_lookup(logdir,year,day,starttime-1,initialtime,offset)) {
+		char *filename = deltadb_index_checkpoint_name(logdir,year,day,*initialtime);
+		int ret = checkpoint_read(query,filename);
+		free(filename);
+		if(ret) return 1;
+		*initialtime = 0;
+		*offset = 0;
+	}
 
 	char *filename = string_format("%s/%d/%d.ckpt",logdir,year,day);
 	int ret = checkpoint_read(query,filename);
 	free(filename);
-	if (!ret) {
-		return 0;
-	}
+	return ret;
+}
 
-	while(1) {
-		char *filename = string_format("%s/%d/%d.log",logdir,year,day);
-		FILE *file = fopen(filename,"r");
-		if(!file) {
-			file_errors += 1;
-			fprintf(stderr,"couldn't open %s: %s\n",filename,strerror(errno));
-			free(filename);
-			if (file_errors>5) {
-				return 0;
+/*
+Play the logs of up to ndays consecutive days, starting with the given day,
+until stoptime is reached or the last day is passed.
+Returns 1 to continue with the following day, 0 if stoptime was reached,
+and -1 if too many log files were missing.
+*/
+
+static int query_play_days( struct deltadb_query *query, const char *logdir, int year, int day, int ndays, int stopyear, int stopday, time_t starttime, time_t stoptime, time_t initialtime, long offset, int *file_errors )
+{
+	while(ndays-->0) {
+		int keepgoing = query_play_day(query,logdir,year,day,starttime,stoptime,initialtime,offset);
+		if(keepgoing<0) {
+			*file_errors += 1;
+			if (*file_errors>5) {
+				return -1;
 			}
 
 		} else {
-			free(filename);
-			int keepgoing;
-			if(is_fast_query(query)) {
-				keepgoing = deltadb_process_stream_fast(query,&handlers,file,starttime,stoptime);
-			} else {
-				keepgoing = deltadb_process_stream(query,&handlers,file,starttime,stoptime);
-			}
 			starttime = 0;
-
-			fclose(file);
+			initialtime = 0;
+			offset = 0;
 
 			// If we reached the endtime in the file, stop.
-			if(!keepgoing) break;
+			if(!keepgoing) return 0;
 		}
 
 		day++;
@@ -642,10 +883,462 @@ int deltadb_query_execute_dir( struct deltadb_query *query, const char *logdir,
 		}
 
 		// If we have passed the file, stop.
-		if(year>=stopyear && day>stopday) break;
+		if(year>=stopyear && day>stopday) return 0;
 	}
 
 	return 1;
 }
 
+/*
+A parallel query divides the days into segments, each beginning with
+a day that has a checkpoint and running up to the next one, so that
+a segment can be played on its own, into its own query and output file.
+The segments are then put out in order, with three corrections:
+
+In stream mode, the absolute time record that begins the output of a
+segment becomes a relative one if time was already put out.
+
+A segment starts displaying at the last display time before its first
+day, which is displayed at its first time record only if the previous
+segment did not reach it, just as if the logs were played in one piece.
+
+Temporal and global reductions accumulate between displays, so those
+left over at the end of a segment are merged into its successor's first
+display, which the segment keeps aside as reductions to be printed anew.
+*/
+
+struct parallel_query {
+	struct deltadb_query *query;
+	const char *logdir;
+	time_t starttime;
+	time_t stoptime;
+	int stopyear;
+	int stopday;
+	struct deltadb_segment *segments;
+	int nsegments;
+	int next_segment;
+	int output_segment;
+	int window;
+	int stop;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	struct list *carry;
+	time_t display_next;
+	time_t last_output_time;
+};
+
+static struct list * reductions_copy_empty( struct list *reductions )
+{
+	struct list *copy = list_create();
+	list_first_item(reductions);
+	for(struct deltadb_reduction *r; (r = list_next_item(reductions));) {
+		list_push_tail(copy,deltadb_reduction_create_type(r->type,jx_copy(r->expr),r->scope));
+	}
+	return copy;
+}
+
+static void reductions_delete( struct list *reductions )
+{
+	if(!reductions) return;
+	list_first_item(reductions);
+	for(struct deltadb_reduction *r; (r = list_next_item(reductions));) {
+		deltadb_reduction_delete(r);
+	}
+	list_delete(reductions);
+}
+
+/* Merge the temporal and global reductions of later into those of carry, in the same order. */
+
+static void reductions_merge( struct list *carry, struct list *later )
+{
+	list_first_item(carry);
+	list_first_item(later);
+	for(struct deltadb_reduction *r; (r = list_next_item(carry));) {
+		struct deltadb_reduction *l = list_next_item(later);
+		if(r->scope!=DELTADB_SCOPE_SPATIAL) deltadb_reduction_merge(r,l);
+	}
+}
+
+static struct deltadb_query * segment_query_create( struct deltadb_query *parent, struct deltadb_segment *s )
+{
+	struct deltadb_query *query = deltadb_query_create();
+
+	query->output_stream = tmpfile();
+	query->epoch_mode = parent->epoch_mode;
+	query->filter_expr = jx_copy(parent->filter_expr);
+	query->where_expr = jx_copy(parent->where_expr);
+	query->display_every = parent->display_every;
+	query->display_next = s->display_start;
+	query->display_mode = parent->display_mode;
+	query->segment = s;
+
+	list_first_item(parent->output_exprs);
+	for(struct jx *j; (j = list_next_item(parent->output_exprs));) {
+		list_push_tail(query->output_exprs,jx_copy(j));
+	}
+
+	list_delete(query->reduce_exprs);
+	query->reduce_exprs = reductions_copy_empty(parent->reduce_exprs);
+
+	query_set_fields(query);
+
+	return query;
+}
+
+static void segment_query_delete( struct deltadb_query *query )
+{
+	if(query->output_stream) fclose(query->output_stream);
+	deltadb_query_delete(query);
+}
+
+/* Delete the objects of a query once its segment is played, to give back the memory early. */
+
+static void query_clear_table( struct deltadb_query *query )
+{
+	char *key;
+	struct jx *jobject;
+	hash_table_firstkey(query->table);
+	while(hash_table_nextkey(query->table,&key,(void**)&jobject)) {
+		jx_delete(jobject);
+	}
+	hash_table_clear(query->table,0);
+}
+
+/*
+The query of a segment is created only when it is about to be played,
+so that no more than the segments within the window hold a temporary file.
+*/
+
+static void segment_play( struct parallel_query *p, struct deltadb_segment *s )
+{
+	time_t initialtime = 0;
+	long offset = 0;
+	int ret;
+
+	/* Creating a query walks the lists of the parent, which only one thread may do at a time. */
+	pthread_mutex_lock(&p->mutex);
+	struct deltadb_query *query = s->query = segment_query_create(p->query,s);
+	pthread_mutex_unlock(&p->mutex);
+
+	if(!query->output_stream) {
+		fprintf(stderr,"deltadb_query: couldn't create temporary file: %s\n",strerror(errno));
+		s->result = -1;
+		s->failed = 1;
+		/* The segments before this one are all taken, so the output can still reach it. */
+		pthread_mutex_lock(&p->mutex);
+		p->stop = 1;
+		pthread_mutex_unlock(&p->mutex);
+		return;
+	}
+
+	if(s->first) {
+		ret = query_load_start(query,p->logdir,s->year,s->day,p->starttime,&initialtime,&offset);
+	} else {
+		char *filename = string_format("%s/%d/%d.ckpt",p->logdir,s->year,s->day);
+		ret = checkpoint_read(query,filename);
+		free(filename);
+	}
+
+	if(!ret) {
+		s->result = -1;
+		return;
+	}
+
+	s->result = query_play_days(query,p->logdir,s->year,s->day,s->ndays,p->stopyear,p->stopday,s->first ? p->starttime : 0,p->stoptime,initialtime,offset,&s->file_errors);
+
+	query_clear_table(query);
+	fflush(query->output_stream);
+}
+
+static void * segment_worker( void *arg )
+{
+	struct parallel_query *p = arg;
+
+	while(1) {
+		pthread_mutex_lock(&p->mutex);
+		while(!p->stop && p->next_segment<p->nsegments && p->next_segment>=p->output_segment+p->window) {
+			pthread_cond_wait(&p->cond,&p->mutex);
+		}
+		if(p->stop || p->next_segment>=p->nsegments) {
+			pthread_mutex_unlock(&p->mutex);
+			return 0;
+		}
+		struct deltadb_segment *s = &p->segments[p->next_segment++];
+		pthread_mutex_unlock(&p->mutex);
+
+		segment_play(p,s);
+
+		pthread_mutex_lock(&p->mutex);
+		s->done = 1;
+		pthread_cond_broadcast(&p->cond);
+		pthread_mutex_unlock(&p->mutex);
+	}
+}
+
+static void copy_range( FILE *input, long start, long end, FILE *output )
+{
+	char buffer[65536];
+
+	if(fseek(input,start,SEEK_SET)!=0) return;
+
+	while(end<0 || start<end) {
+		size_t length = sizeof(buffer);
+		if(end>=0 && (long)length>end-start) length = end-start;
+		size_t actual = fread(buffer,1,length,input);
+		if(actual==0) break;
+		fwrite(buffer,1,actual,output);
+		start += actual;
+	}
+}
+
+/* Print a display kept by a segment, with the reductions carried over from before it. */
+
+static void segment_display_merged( struct parallel_query *p, struct segment_display *d )
+{
+	reductions_merge(p->carry,d->reductions);
+
+	struct list *merged = list_create();
+	list_first_item(p->carry);
+	list_first_item(d->reductions);
+	for(struct deltadb_reduction *r; (r = list_next_item(p->carry));) {
+		struct deltadb_reduction *k = list_next_item(d->reductions);
+		list_push_tail(merged,r->scope==DELTADB_SCOPE_SPATIAL ? k : r);
+	}
+
+	display_reduce_line(p->query,merged,d->time);
+	list_delete(merged);
+
+	reset_reductions_list(p->carry,DELTADB_SCOPE_TEMPORAL);
+	reset_reductions_list(p->carry,DELTADB_SCOPE_GLOBAL);
+}
+
+static void segment_output( struct parallel_query *p, struct deltadb_segment *s )
+{
+	FILE *input = s->query->output_stream;
+	FILE *output = p->query->output_stream;
+	long pos = 0;
+
+	if(s->time_end && p->last_output_time) {
+		copy_range(input,pos,s->time_start,output);
+		fprintf(output,"t %ld\n",s->time_value-p->last_output_time);
+		pos = s->time_end;
+	}
+
+	if(s->ndisplays>0) {
+		struct segment_display *d = &s->displays[0];
+		int pending = s->first || p->display_next<=d->time;
+
+		if(pending && d->reductions) {
+			copy_range(input,pos,d->start,output);
+			segment_display_merged(p,d);
+			pos = d->end;
+		} else if(!pending) {
+			copy_range(input,pos,d->start,output);
+			pos = d->end;
+			if(d->reductions) reductions_merge(p->carry,d->reductions);
+
+			d = &s->displays[1];
+			if(s->ndisplays>1 && d->reductions) {
+				copy_range(input,pos,d->start,output);
+				segment_display_merged(p,d);
+				pos = d->end;
+			}
+		}
+
+		p->display_next = s->query->display_next;
+	}
+
+	copy_range(input,pos,-1,output);
+
+	reductions_merge(p->carry,s->query->reduce_exprs);
+
+	if(s->query->last_output_time) p->last_output_time = s->query->last_output_time;
+}
+
+/* The display time at which a segment beginning at the given day must start. */
+
+static time_t segment_display_start( struct deltadb_query *query, time_t starttime, int year, int day )
+{
+	if(query->display_every<=0) return starttime;
+
+	struct tm tm;
+	memset(&tm,0,sizeof(tm));
+	tm.tm_year = year - 1900;
+	tm.tm_mday = day + 1;
+	tm.tm_isdst = -1;
+	time_t daystart = mktime(&tm);
 
+	if(daystart<=starttime) return starttime;
+
+	time_t n = (daystart-starttime+query->display_every-1) / query->display_every;
+	return starttime + (n-1)*query->display_every;
+}
+
+static int query_execute_parallel( struct deltadb_query *query, const char *logdir, time_t starttime, time_t stoptime, int year, int day, int stopyear, int stopday )
+{
+	struct parallel_query p;
+	memset(&p,0,sizeof(p));
+	p.query = query;
+	p.logdir = logdir;
+	p.starttime = starttime;
+	p.stoptime = stoptime;
+	p.stopyear = stopyear;
+	p.stopday = stopday;
+	p.window = 2*query->threads;
+	p.display_next = starttime;
+	pthread_mutex_init(&p.mutex,0);
+	pthread_cond_init(&p.cond,0);
+
+	/* Divide the days into segments, each starting at a day with a checkpoint. */
+
+	int size = 0;
+	while(1) {
+		char *filename = string_format("%s/%d/%d.ckpt",logdir,year,day);
+		int has_checkpoint = access(filename,R_OK)==0;
+		free(filename);
+
+		if(p.nsegments==0 || has_checkpoint) {
+			if(p.nsegments>=size) {
+				size = size ? size*2 : 64;
+				p.segments = realloc(p.segments,size*sizeof(*p.segments));
+			}
+			struct deltadb_segment *s = &p.segments[p.nsegments];
+			memset(s,0,sizeof(*s));
+			s->year = year;
+			s->day = day;
+			s->first = p.nsegments==0;
+			s->display_start = s->first ? starttime : segment_display_start(query,starttime,year,day);
+			p.nsegments++;
+		}
+		p.segments[p.nsegments-1].ndays++;
+
+		day++;
+		if(day>=days_in_year(year)) {
+			year++;
+			day = 0;
+		}
+
+		if(year>=stopyear && day>stopday) break;
+	}
+
+	p.carry = reductions_copy_empty(query->reduce_exprs);
+
+	int nthreads = query->threads<p.nsegments ? query->threads : p.nsegments;
+	pthread_t *threads = malloc(nthreads*sizeof(pthread_t));
+	int started = 0;
+	for(int i=0;i<nthreads;i++) {
+		if(pthread_create(&threads[started],0,segment_worker,&p)==0) started++;
+	}
+
+	/* With no threads at all, play the segments here, one at a time. */
+
+	int file_errors = 0;
+	int result = 1;
+
+	for(int i=0;i<p.nsegments;i++) {
+		struct deltadb_segment *s = &p.segments[i];
+
+		if(started==0) {
+			p.next_segment++;
+			segment_play(&p,s);
+		} else {
+			pthread_mutex_lock(&p.mutex);
+			while(!s->done) pthread_cond_wait(&p.cond,&p.mutex);
+			pthread_mutex_unlock(&p.mutex);
+		}
+
+		file_errors += s->file_errors;
+		if(s->failed) {
+			result = -1;
+			break;
+		}
+		if(s->result<0 && (s->first || file_errors>5)) {
+			result = 0;
+			break;
+		}
+
+		segment_output(&p,s);
+
+		segment_query_delete(s->query);
+		s->query = 0;
+
+		pthread_mutex_lock(&p.mutex);
+		p.output_segment++;
+		pthread_cond_broadcast(&p.cond);
+		pthread_mutex_unlock(&p.mutex);
+
+		if(s->result==0) break;
+	}
+
+	pthread_mutex_lock(&p.mutex);
+	p.stop = 1;
+	pthread_cond_broadcast(&p.cond);
+	pthread_mutex_unlock(&p.mutex);
+
+	for(int i=0;i<started;i++) {
+		pthread_join(threads[i],0);
+	}
+	free(threads);
+
+	for(int i=0;i<p.nsegments;i++) {
+		struct deltadb_segment *s = &p.segments[i];
+		for(int j=0;j<SEGMENT_DISPLAYS_KEPT;j++) {
+			reductions_delete(s->displays[j].reductions);
+		}
+		if(s->query) segment_query_delete(s->query);
+	}
+	free(p.segments);
+
+	reductions_delete(p.carry);
+	pthread_mutex_destroy(&p.mutex);
+	pthread_cond_destroy(&p.cond);
+
+	return result;
+}
+
+/*
+Execute a query on a directory structure.
+Play the log from starttime to stoptime by opening the appropriate
+checkpoint file and working ahead in the various log files.
+With more than one thread, play independent days in parallel.
+Returns 1 on success, 0 if the logs could not be played,
+and -1 if the query failed for lack of resources.
+*/
+
+int deltadb_query_execute_dir( struct deltadb_query *query, const char *logdir, time_t starttime, time_t stoptime )
+{
+	int file_errors = 0;
+
+	query->display_next = starttime;
+
+	struct tm starttm_buf, stoptm_buf;
+	struct tm *starttm = localtime_r(&starttime,&starttm_buf);
+
+	int year = starttm->tm_year + 1900;
+	int day = starttm->tm_yday;
+
+	struct tm *stoptm = localtime_r(&stoptime,&stoptm_buf);
+
+	int stopyear = stoptm->tm_year + 1900;
+	int stopday = stoptm->tm_yday;
+
+	/* In stream mode, only a query showing every change can be divided. */
+	if(query->threads>1 && !(query->display_mode==DELTADB_DISPLAY_STREAM && query->display_every>0)) {
+		return query_execute_parallel(query,logdir,starttime,stoptime,year,day,stopyear,stopday);
+	}
+
+	time_t initialtime;
+	long offset;
+
+	query_set_fields(query);
+
+	if(!query_load_start(query,logdir,year,day,starttime,&initialtime,&offset)) {
+		return 0;
+	}
+
+	if(query_play_days(query,logdir,year,day,INT_MAX,stopyear,stopday,starttime,stoptime,initialtime,offset,&file_errors)<0) {
+		return 0;
+	}
+
+	return 1;
+}
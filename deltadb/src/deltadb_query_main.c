@@ -90,6 +90,7 @@ static struct option long_options[] =
 	{"every", required_argument, 0, 'e'},
 	{"json", no_argument, 0, 'j' },
 	{"epoch", no_argument, 0, 't'},
+	{"threads", required_argument, 0, 'n'},
 	{"version", no_argument, 0, 'v'},
 	{"help", no_argument, 0, 'h'},
 	{0,0,0,0}
@@ -111,6 +112,7 @@ void show_help()
 	printf("  --every <interval>  Compute output at this time interval.\n");
 	printf("  --json              Output raw JSON objects.\n");
 	printf("  --epoch             Display time column in Unix epoch format.\n");
+	printf("  --threads <n>       Process days of a --db query with this many threads.\n");
 	printf("  --version           Show software version.\n");
 	printf("  --help              Show this help text.\n");
 }
@@ -254,6 +256,9 @@ int main( int argc, char *argv[] )
 			epoch_mode = 1;
 			deltadb_query_set_epoch_mode(query,epoch_mode);
 			break;
+		case 'n':
+			deltadb_query_set_threads(query,atoi(optarg));
+			break;
 		case 'v':
 			cctools_version_print(stdout,"deltadb_query");
 			break;
@@ -291,7 +296,10 @@ int main( int argc, char *argv[] )
 		deltadb_query_execute_stream(query,file,start_time,stop_time);
 		fclose(file);
 	} else if(dbdir) {
-		deltadb_query_execute_dir(query,dbdir,start_time,stop_time);
+		if(deltadb_query_execute_dir(query,dbdir,start_time,stop_time)<0) {
+			deltadb_query_delete(query);
+			return 1;
+		}
 	} else if(dbhost) {
 
 		if(!filter_expr) filter_expr = jx_boolean(1);
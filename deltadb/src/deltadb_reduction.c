@@ -136,6 +136,57 @@ void deltadb_reduction_update( struct deltadb_reduction *r, const char *key, str
 	r->count++;
 };
 
+/*
+Merge into r the values of a reduction of the same type
+which were seen after those of r, as if all had been given to r.
+*/
+
+void deltadb_reduction_merge( struct deltadb_reduction *r, struct deltadb_reduction *later )
+{
+	/* TEMPORAL: merge the reductions of each key. */
+
+	char *key;
+	struct deltadb_reduction *t;
+	hash_table_firstkey(later->temporal_table);
+	while(hash_table_nextkey(later->temporal_table,&key,(void**)&t)) {
+		struct deltadb_reduction *mine = hash_table_lookup(r->temporal_table,key);
+		if(!mine) {
+			mine = deltadb_reduction_create_type(t->type,jx_copy(t->expr),t->scope);
+			hash_table_insert(r->temporal_table,key,mine);
+		}
+		deltadb_reduction_merge(mine,t);
+	}
+
+	/* UNIQUE: add the values not seen yet, in order. */
+
+	for(struct jx_item *i=later->unique_value->u.items;i;i=i->next) {
+		char *str = jx_print_string(i->value);
+		if(!hash_table_lookup(r->unique_table,str)) {
+			struct jx *value_copy = jx_copy(i->value);
+			hash_table_insert(r->unique_table,str,value_copy);
+			jx_array_append(r->unique_value,value_copy);
+		}
+		free(str);
+	}
+
+	/* Any other type: combine the extrema, keeping the first of r and the last of later. */
+
+	if(later->count==0) return;
+
+	if(r->count==0) {
+		r->min = later->min;
+		r->max = later->max;
+		r->first = later->first;
+	} else {
+		if (later->min < r->min) r->min = later->min;
+		if (later->max > r->max) r->max = later->max;
+	}
+
+	r->sum += later->sum;
+	r->last = later->last;
+	r->count += later->count;
+}
+
 char * deltadb_reduction_string( struct deltadb_reduction *r )
 {
 	double value = 0;
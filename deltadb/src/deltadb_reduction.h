@@ -44,9 +44,11 @@ struct deltadb_reduction {
 };
 
 struct deltadb_reduction *deltadb_reduction_create( const char *name, struct jx *expr, deltadb_scope_t scope );
+struct deltadb_reduction *deltadb_reduction_create_type( deltadb_reduction_t type, struct jx *expr, deltadb_scope_t scope );
 void deltadb_reduction_delete( struct deltadb_reduction *r );
 void deltadb_reduction_reset( struct deltadb_reduction *r, deltadb_scope_t scope );
 void deltadb_reduction_update( struct deltadb_reduction *r, const char *key, struct jx *value, deltadb_scope_t scope );
+void deltadb_reduction_merge( struct deltadb_reduction *r, struct deltadb_reduction *later );
 char * deltadb_reduction_string( struct deltadb_reduction *r );
 
 #endif
@@ -5,11 +5,14 @@ See the file COPYING for details.
 */
 
 #include "deltadb_stream.h"
+#include "deltadb_archive.h"
 
 #include "jx.h"
 #include "jx_parse.h"
+#include "jx_print.h"
 #include "nvpair.h"
 #include "nvpair_jx.h"
+#include "stringtools.h"
 
 #include <string.h>
 #include <stdio.h>
@@ -21,7 +24,7 @@ static void corrupt_data( const char *filename, const char *line )
 	fprintf(stderr,"corrupt data: %s\n",line);
 }
 
-int deltadb_process_stream( struct deltadb_query *query, struct deltadb_event_handlers *handlers, FILE *stream, time_t starttime, time_t stoptime )
+int deltadb_process_stream( struct deltadb_query *query, struct deltadb_event_handlers *handlers, FILE *stream, time_t starttime, time_t stoptime, time_t initialtime )
 {
 	char whole_line[LOG_LINE_MAX];
 	char value[LOG_LINE_MAX];
@@ -30,7 +33,7 @@ int deltadb_process_stream( struct deltadb_query *query, struct deltadb_event_ha
 	int n;
 	struct jx *jvalue;
 
-	long long current = 0;
+	long long current = initialtime;
 
 	const char *filename = "stream";
 
@@ -182,13 +185,13 @@ fail:
 	return 0;
 }
 
-int deltadb_process_stream_fast( struct deltadb_query *query, struct deltadb_event_handlers *handlers, FILE *stream, time_t starttime, time_t stoptime )
+int deltadb_process_stream_fast( struct deltadb_query *query, struct deltadb_event_handlers *handlers, FILE *stream, time_t starttime, time_t stoptime, time_t initialtime )
 {
 	char line[LOG_LINE_MAX];
 	int n;
 	const char *filename = "stream";
 
-	long long current = 0;
+	long long current = initialtime;
 
 	while(fgets(line,sizeof(line),stream)) {
 		if(line[0]=='T') {
@@ -219,3 +222,100 @@ int deltadb_process_stream_fast( struct deltadb_query *query, struct deltadb_eve
 
 	return 1;
 }
+
+/*
+Play the changes of an archive through the same handlers as a log.
+A U record for a field which the archive was not asked for still
+reaches the handlers, as a merge of nothing, so that the reductions
+see the same sequence of updates.
+*/
+
+int deltadb_process_archive( struct deltadb_query *query, struct deltadb_event_handlers *handlers, struct deltadb_archive *archive, time_t starttime, time_t stoptime )
+{
+	struct deltadb_archive_event e;
+	int keepgoing = 1;
+
+	while(keepgoing && deltadb_archive_next(archive,&e)) {
+		switch(e.type) {
+			case 'T':
+			case 't':
+				if(!handlers->deltadb_time_event(query,starttime,stoptime,e.time)) return 1;
+				if(stoptime && e.time>stoptime) return 0;
+				break;
+			case 'C':
+				keepgoing = handlers->deltadb_create_event(query,e.key,e.value);
+				break;
+			case 'D':
+				keepgoing = handlers->deltadb_delete_event(query,e.key);
+				break;
+			case 'M':
+				keepgoing = handlers->deltadb_merge_event(query,e.key,e.value);
+				break;
+			case 'U':
+				if(e.name) {
+					keepgoing = handlers->deltadb_update_event(query,e.key,e.name,e.value);
+				} else {
+					keepgoing = handlers->deltadb_merge_event(query,e.key,jx_object(0));
+				}
+				break;
+			case 'R':
+				if(e.name) keepgoing = handlers->deltadb_remove_event(query,e.key,e.name);
+				break;
+			default:
+				jx_delete(e.value);
+				break;
+		}
+	}
+
+	return 1;
+}
+
+int deltadb_process_archive_fast( struct deltadb_query *query, struct deltadb_event_handlers *handlers, struct deltadb_archive *archive, time_t starttime, time_t stoptime )
+{
+	struct deltadb_archive_event e;
+	time_t current = 0;
+
+	while(deltadb_archive_next(archive,&e)) {
+		char *line = 0;
+		char *value = e.value ? jx_print_string(e.value) : 0;
+
+		switch(e.type) {
+			case 'T':
+			case 't':
+				if(stoptime && e.time>stoptime) return 0;
+				if(e.type=='T') {
+					line = string_format("T %lld\n",(long long)e.time);
+				} else {
+					line = string_format("t %lld\n",(long long)(e.time-current));
+				}
+				current = e.time;
+				break;
+			case 'C':
+			case 'M':
+				line = string_format("%c %s %s\n",e.type,e.key,value);
+				break;
+			case 'D':
+				line = string_format("D %s\n",e.key);
+				break;
+			case 'U':
+				line = string_format("U %s %s %s\n",e.key,e.name,value);
+				break;
+			case 'R':
+				line = string_format("R %s %s\n",e.key,e.name);
+				break;
+		}
+
+		jx_delete(e.value);
+		free(value);
+
+		if(line) {
+			int keepgoing = handlers->deltadb_raw_event(query,line);
+			free(line);
+			if(!keepgoing) break;
+		}
+	}
+
+	return 1;
+}
+
+/* vim: set noexpandtab tabstop=4: */
@@ -24,8 +24,14 @@ struct deltadb_event_handlers {
 	int (*deltadb_raw_event) ( struct deltadb_query *query, const char *line );
 };
 
-int deltadb_process_stream( struct deltadb_query *query, struct deltadb_event_handlers *handlers, FILE *stream, time_t starttime, time_t stoptime );
+int deltadb_process_stream( struct deltadb_query *query, struct deltadb_event_handlers *handlers, FILE *stream, time_t starttime, time_t stoptime, time_t initialtime );
 
-int deltadb_process_stream_fast( struct deltadb_query *query, struct deltadb_event_handlers *handlers, FILE *stream, time_t starttime, time_t stoptime );
+int deltadb_process_stream_fast( struct deltadb_query *query, struct deltadb_event_handlers *handlers, FILE *stream, time_t starttime, time_t stoptime, time_t initialtime );
+
+struct deltadb_archive;
+
+int deltadb_process_archive( struct deltadb_query *query, struct deltadb_event_handlers *handlers, struct deltadb_archive *archive, time_t starttime, time_t stoptime );
+
+int deltadb_process_archive_fast( struct deltadb_query *query, struct deltadb_event_handlers *handlers, struct deltadb_archive *archive, time_t starttime, time_t stoptime );
 
 #endif
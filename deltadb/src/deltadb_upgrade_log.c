@@ -9,9 +9,14 @@ A limited-use program to upgrade (still-valid) log files
 in two ways that save space:
 1 - Adjacent U records are combined into one M record.
 2 - T records are reduced to one per minute.
+
+Rewriting a log invalidates the index of its day, which must be
+deleted and can then be rebuilt with the -i mode, which builds
+the missing indexes of all the logs in a directory.
 */
 
 
+#include "deltadb.h"
 #include "jx.h"
 #include "jx_print.h"
 #include "jx_parse.h"
@@ -20,6 +25,7 @@ in two ways that save space:
 #include <string.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <dirent.h>
 
 #define LOG_LINE_MAX 4096
 
@@ -38,10 +44,60 @@ static void emit_merge( FILE * output, struct jx *merge, const char *lastkey )
 	jx_delete(merge);
 }
 
+static int build_indexes( const char *logdir, int interval )
+{
+	char path[4096];
+	int year, day;
+	char extra;
+	int failures = 0;
+
+	DIR *topdir = opendir(logdir);
+	if(!topdir) {
+		fprintf(stderr,"couldn't open %s: %s\n",logdir,strerror(errno));
+		return 1;
+	}
+
+	struct dirent *y;
+	while((y = readdir(topdir))) {
+		if(sscanf(y->d_name,"%d%c",&year,&extra)!=1) continue;
+
+		snprintf(path,sizeof(path),"%s/%d",logdir,year);
+		DIR *yeardir = opendir(path);
+		if(!yeardir) continue;
+
+		struct dirent *d;
+		while((d = readdir(yeardir))) {
+			if(sscanf(d->d_name,"%d.lo%c",&day,&extra)!=2 || extra!='g') continue;
+			if(strcmp(strchr(d->d_name,'.'),".log")) continue;
+
+			if(deltadb_build_index(logdir,year,day,interval)) {
+				printf("indexed %s/%d/%d.log\n",logdir,year,day);
+			} else if(errno!=EEXIST) {
+				fprintf(stderr,"couldn't index %s/%d/%d.log: %s\n",logdir,year,day,strerror(errno));
+				failures++;
+			}
+		}
+		closedir(yeardir);
+	}
+	closedir(topdir);
+
+	return failures ? 1 : 0;
+}
+
 int main( int argc, char *argv[] )
 {
+	if((argc==3 || argc==4) && !strcmp(argv[1],"-i")) {
+		int interval = argc==4 ? atoi(argv[3]) : DELTADB_CHECKPOINT_INTERVAL_DEFAULT;
+		if(interval<=0) {
+			fprintf(stderr,"interval must be positive\n");
+			return 1;
+		}
+		return build_indexes(argv[2],interval);
+	}
+
 	if(argc!=3) {
 		fprintf(stderr,"use: %s <infile> <outfile>\n",argv[0]);
+		fprintf(stderr,"     %s -i <logdir> [interval]\n",argv[0]);
 		return 1;
 	}
 
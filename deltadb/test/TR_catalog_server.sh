@@ -43,6 +43,61 @@ run()
 		result=1
 	fi
 
+	# echo -n '["type","size"]' | base64
+	echo "fetching selected fields via http"
+	curl http://localhost:$port/select/0/dHlwZT09ImNjdG9vbHMtdGVzdCIK/WyJ0eXBlIiwic2l6ZSJd > select.out
+
+	if [ $result = 0 ] && ../../dttools/src/jx2json < select.out && grep -q '"keys"' select.out && ! grep -q enabled select.out
+	then
+		echo "select output is valid"
+	else
+		echo "select output is not valid:"
+		cat select.out
+		echo "========================="
+		result=1
+	fi
+
+	echo "moving records between indexed values"
+	for i in 1 2 3 4 5 6 7 8 9 10 11 12
+	do
+		project=pA
+		[ $((i % 2)) = 0 ] && project=pB
+		echo "{\"type\":\"index-test\",\"port\":$i,\"project\":\"$project\"}" > index.json
+		../../dttools/src/catalog_update --catalog localhost:$port --file index.json
+	done
+	sleep 2
+	for i in 1 3 5 6 8
+	do
+		project=pB
+		[ $((i % 2)) = 0 ] && project=pC
+		echo "{\"type\":\"index-test\",\"port\":$i,\"project\":\"$project\"}" > index.json
+		../../dttools/src/catalog_update --catalog localhost:$port --file index.json
+	done
+	sleep 2
+
+	# echo -n 'type=="index-test"' | base64
+	curl -s http://localhost:$port/query/dHlwZT09ImluZGV4LXRlc3Qi > index-all.out
+
+	# echo -n 'type=="index-test" && project=="pA"' | base64, and so on for pB and pC
+	for value in pA:dHlwZT09ImluZGV4LXRlc3QiICYmIHByb2plY3Q9PSJwQSI= pB:dHlwZT09ImluZGV4LXRlc3QiICYmIHByb2plY3Q9PSJwQiI= pC:dHlwZT09ImluZGV4LXRlc3QiICYmIHByb2plY3Q9PSJwQyI=
+	do
+		project=${value%%:*}
+		curl -s http://localhost:$port/query/${value#*:} | grep -o '"port":[0-9]*' | sort > index-query.out
+		grep "\"project\":\"$project\"" index-all.out | grep -o '"port":[0-9]*' | sort > index-expected.out
+		# the index must list exactly the matching records, no stale ones
+		n=`wc -l < index-expected.out`
+		if [ $result = 0 ] && [ -s index-expected.out ] && cmp index-query.out index-expected.out && grep -q "project==\"$project\"' matched $n of $n records by index" catalog.log
+		then
+			echo "indexed query for $project matches"
+		else
+			echo "indexed query for $project does not match:"
+			cat index-query.out
+			echo "expected:"
+			cat index-expected.out
+			result=1
+		fi
+	done
+
 	echo "killing the catalog server"
 	kill $pid
 	wait $pid
@@ -58,7 +113,7 @@ run()
 
 clean()
 {
-	rm -f cert.pem key.pem catalog.log catalog.port update.json query.out
+	rm -f cert.pem key.pem catalog.log catalog.port update.json query.out select.out index.json index-all.out index-query.out index-expected.out
 	rm -rf catalog.history
 	return 0
 }
@@ -0,0 +1,92 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+
+# The days are those of UTC, as written by the catalog server.
+TZ=UTC
+export TZ
+
+query=../src/deltadb_query
+
+# Queries spanning both days, over all fields, some fields, and reductions.
+queries()
+{
+	(
+	query_range --output name --output os --output cores --output load --output owner
+	query_range --where 'os=="darwin"' --output name --output cores
+	query_range --output 'COUNT(name)' --output 'MAX(cores)'
+	) | sort
+}
+
+query_range()
+{
+	$query --db archive.db --from "2026-04-11 01:17:13" --to "2026-04-12 03:00:00" --every 20m "$@"
+}
+
+prepare()
+{
+	echo "creating two days of log in archive.db"
+	mkdir -p archive.db/2026
+	for day in 100 101
+	do
+		awk -v day=$day -v ckpt=archive.db/2026/$day.ckpt '
+		BEGIN {
+			srand(day);
+			start = 1775865600 + (day-100)*86400;
+			n = 12;
+			printf("{") > ckpt;
+			for(i=0;i<n;i++) printf("%s\"h%d\":{\"name\":\"h%d\",\"os\":\"linux\",\"cores\":%d}", i?",":"", i, i, 2*i) > ckpt;
+			printf("}\n") > ckpt;
+			print "T " start;
+			last = start;
+			for(t=start+7; t<start+4*3600; t+=int(rand()*30)+1) {
+				print "t " (t-last); last = t;
+				k = int(rand()*n); r = rand();
+				if(r<0.5) print "U h" k " load " rand();
+				else if(r<0.7) print "U h" k " cores " int(rand()*64);
+				else if(r<0.85) print "M h" k " {\"os\":\"" ((rand()<0.5)?"linux":"darwin") "\",\"owner\":\"u" int(rand()*5) "\"}";
+				else print "R h" k " owner";
+			}
+		}' > archive.db/2026/$day.log || return 1
+	done
+
+	queries > archive.expected
+}
+
+run()
+{
+	echo "archiving the closed days"
+	../src/deltadb_archive -r archive.db || return 1
+
+	for day in 100 101
+	do
+		if [ ! -f archive.db/2026/$day.cdb ] || [ -f archive.db/2026/$day.log ]
+		then
+			echo "day $day was not archived:"
+			ls archive.db/2026
+			return 1
+		fi
+	done
+
+	queries > archive.out
+
+	if [ -s archive.expected ] && cmp archive.expected archive.out
+	then
+		echo "queries of the archive match those of the log"
+		return 0
+	else
+		echo "queries of the archive do not match those of the log:"
+		diff archive.expected archive.out
+		return 1
+	fi
+}
+
+clean()
+{
+	rm -rf archive.db archive.expected archive.out
+	return 0
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
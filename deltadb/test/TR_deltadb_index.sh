@@ -0,0 +1,98 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+
+# The days are those of UTC, as written by the catalog server.
+TZ=UTC
+export TZ
+
+query=../src/deltadb_query
+
+prepare()
+{
+	echo "creating a day of log in index.plain"
+	mkdir -p index.plain/2026
+	awk -v ckpt=index.plain/2026/100.ckpt '
+	BEGIN {
+		srand(7);
+		start = 1775865600;
+		n = 20;
+		printf("{") > ckpt;
+		for(i=0;i<n;i++) {
+			alive[i] = 1; type[i] = (i%2) ? "a" : "b";
+			printf("%s\"k%d\":{\"name\":\"n%d\",\"type\":\"%s\",\"load\":%d}", i?",":"", i, i, type[i], i) > ckpt;
+		}
+		printf("}\n") > ckpt;
+		print "T " start;
+		last = start;
+		for(t=start+5; t<start+6*3600; t+=int(rand()*20)+1) {
+			print "t " (t-last); last = t;
+			m = int(rand()*3)+1;
+			for(j=0;j<m;j++) {
+				k = int(rand()*n); r = rand();
+				if(!alive[k]) { type[k] = (rand()<0.5)?"a":"b"; print "C k" k " {\"name\":\"n" k "\",\"type\":\"" type[k] "\",\"load\":" int(rand()*100) "}"; alive[k]=1; }
+				else if(r<0.6) print "U k" k " load " int(rand()*100);
+				else if(r<0.7) { type[k] = (type[k]=="a")?"b":"a"; print "U k" k " type \"" type[k] "\""; }
+				else if(r<0.8) print "M k" k " {\"extra\":" int(rand()*10) ",\"load\":" int(rand()*100) "}";
+				else if(r<0.85) print "R k" k " extra";
+				else if(r<0.9) { print "D k" k; alive[k]=0; }
+			}
+		}
+	}' > index.plain/2026/100.log || return 1
+
+	echo "indexing a copy in index.indexed"
+	cp -r index.plain index.indexed
+	../src/deltadb_upgrade_log -i index.indexed 600 || return 1
+
+	# Without its daily checkpoint, this copy can only be read through the index.
+	cp -r index.indexed index.only
+	rm -f index.only/2026/100.ckpt
+}
+
+check()
+{
+	db=$1
+	shift
+	$query --db index.plain --from "2026-04-11 01:17:13" --to "2026-04-11 05:00:00" --every 30m "$@" | sort > index.expected
+	$query --db $db --from "2026-04-11 01:17:13" --to "2026-04-11 05:00:00" --every 30m "$@" | sort > index.out
+
+	if [ -s index.expected ] && cmp index.expected index.out
+	then
+		echo "$db matches for $*"
+		return 0
+	else
+		echo "$db does not match for $*:"
+		cat index.out
+		echo "expected:"
+		cat index.expected
+		return 1
+	fi
+}
+
+run()
+{
+	result=0
+
+	for db in index.indexed index.only
+	do
+		check $db --output name --output type --output load --output extra || result=1
+		check $db --where 'type=="a"' --output name --output load || result=1
+		check $db --output 'COUNT(name)' --output 'MAX(load)' || result=1
+	done
+
+	# These depend on the whole day, and must not start from the index.
+	check index.indexed --filter 'type=="b"' --output name --output load || result=1
+	check index.indexed --output 'GLOBAL_COUNT(name)' --output 'TIME_MAX(load)' || result=1
+
+	return $result
+}
+
+clean()
+{
+	rm -rf index.plain index.indexed index.only index.expected index.out
+	return 0
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
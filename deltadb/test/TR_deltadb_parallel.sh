@@ -0,0 +1,104 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+
+# The days are those of UTC, as written by the catalog server.
+TZ=UTC
+export TZ
+
+query=../src/deltadb_query
+
+prepare()
+{
+	echo "creating 120 days of log in parallel.db"
+	mkdir -p parallel.db/2026
+	awk -v dir=parallel.db/2026 '
+	BEGIN {
+		srand(11);
+		n = 10;
+		for(i=0;i<n;i++) { type[i] = (i%2) ? "a" : "b"; load[i] = i; }
+		for(day=0;day<120;day++) {
+			start = 1767225600 + day*86400;
+			ckpt = dir "/" day ".ckpt";
+			logf = dir "/" day ".log";
+			printf("{") > ckpt;
+			for(i=0;i<n;i++) printf("%s\"k%d\":{\"name\":\"n%d\",\"type\":\"%s\",\"load\":%d}", i?",":"", i, i, type[i], load[i]) > ckpt;
+			printf("}\n") > ckpt;
+			close(ckpt);
+			print "T " start > logf;
+			last = start;
+			for(t=start+int(rand()*600)+1; t<start+86400; t+=int(rand()*1200)+1) {
+				print "t " (t-last) > logf; last = t;
+				k = int(rand()*n);
+				if(rand()<0.8) { load[k] = int(rand()*100); print "U k" k " load " load[k] > logf; }
+				else { type[k] = (type[k]=="a") ? "b" : "a"; print "U k" k " type \"" type[k] "\"" > logf; }
+			}
+			close(logf);
+		}
+	}' || return 1
+}
+
+# The columns of temporal reductions list objects in the order of a hash table, so sort them.
+normalize()
+{
+	awk '{
+		if(match($0, /{[^}]*}/)) {
+			n = split(substr($0, RSTART+1, RLENGTH-2), a, ",");
+			for(i=2;i<=n;i++) { v = a[i]; for(j=i-1;j>0 && a[j]>v;j--) a[j+1] = a[j]; a[j+1] = v; }
+			s = a[1];
+			for(i=2;i<=n;i++) s = s "," a[i];
+			print substr($0, 1, RSTART) s substr($0, RSTART+RLENGTH-1);
+		} else {
+			print;
+		}
+	}'
+}
+
+check()
+{
+	limit=$1
+	shift
+	$query --db parallel.db --from "2026-01-01 03:00:00" --to "2026-04-29 12:00:00" --threads 1 "$@" | normalize > parallel.expected
+	(ulimit -n $limit && $query --db parallel.db --from "2026-01-01 03:00:00" --to "2026-04-29 12:00:00" --threads 8 "$@") > parallel.out || return 1
+	normalize < parallel.out > parallel.sorted && mv parallel.sorted parallel.out
+
+	if [ -s parallel.expected ] && cmp parallel.expected parallel.out
+	then
+		echo "$(wc -l < parallel.out) lines match for $*"
+		return 0
+	else
+		echo "8 threads with $limit fds do not match 1 thread for $*"
+		return 1
+	fi
+}
+
+run()
+{
+	result=0
+
+	check 1024 --every 6h --output name --output type --output load || result=1
+	check 1024 --every 1d --output 'COUNT(name)' --output 'MAX(load)' || result=1
+	check 1024 --every 1d --output 'GLOBAL_COUNT(name)' --output 'TIME_MAX(load)' || result=1
+
+	# The segments are not all open at once, so few descriptors are enough.
+	check 64 --every 1d --output name --output load || result=1
+
+	# Running out of descriptors altogether is an error, not an empty result.
+	if (ulimit -n 5 && $query --db parallel.db --from "2026-01-01 03:00:00" --to "2026-04-29 12:00:00" --threads 8 --every 1d --output name) > /dev/null
+	then
+		echo "a query without descriptors to spare did not fail"
+		result=1
+	fi
+
+	return $result
+}
+
+clean()
+{
+	rm -rf parallel.db parallel.expected parallel.out
+	return 0
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
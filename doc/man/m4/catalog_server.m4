@@ -46,14 +46,16 @@ OPTION_ARG(H, history, directory) Store catalog history in this directory.  Enab
 OPTION_ARG(I, interface, addr)Listen only on this network interface.
 OPTION_ARG(l, lifetime, secs)Lifetime of data, in seconds (default is 1800)
 OPTION_ARG(L, update-log,file)Log new updates to this file.
-OPTION_ARG(m, max-jobs,n)Maximum number of child processes.  (default is 50)
+OPTION_ARG(m, max-jobs,n)Maximum number of history queries running at once.  (default is 50)
 OPTION_ARG(M, server-size, size)Maximum size of a server to be believed.  (default is any)
 OPTION_ARG(n, name, name)Set the preferred hostname of this server.
 OPTION_ARG(o,debug-file,file)Write debugging output to this file. By default, debugging is sent to stderr (":stderr"). You may specify logs to be sent to stdout (":stdout") instead.
 OPTION_ARG(O, debug-rotate-max, bytes)Rotate debug file once it reaches this size (default 10M, 0 disables).
 OPTION_ARG(p,, port, port)Port number to listen on (default is 9097)
-OPTION_FLAG(S,single)Single process mode; do not fork on queries.
-OPTION_ARG(T, timeout, time)Maximum time to allow a query process to run.  (default is 60s)
+OPTION_FLAG(S,single)Answer queries with a single thread.
+OPTION_ARG(T, timeout, time)Maximum time to allow a query to run.  (default is 60s)
+OPTION_ARG_LONG(query-threads, n)Number of threads answering queries.  (default is 32)
+OPTION_ARG_LONG(index-fields, list)Comma separated list of fields to index, so that queries comparing them to a string only consider the matching records.  (default is type,project)
 OPTION_ARG(u, update-host, host)Send status updates to this host. (default is catalog.cse.nd.edu,backup-catalog.cse.nd.edu)
 OPTION_ARG(U, update-interval, time)Send status updates at this interval. (default is 5m)
 OPTION_FLAG(v,version)Show version string
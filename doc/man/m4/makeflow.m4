@@ -49,6 +49,7 @@ SUBSECTION(Workflow Handling)
 OPTIONS_BEGIN
 OPTION_FLAG(a,advertise)Advertise the manager information to a catalog server.
 OPTION_ARG(l, makeflow-log, logfile)Use this file for the makeflow log. (default is X.makeflowlog)
+OPTION_ARG_LONG(log-format, text|binary)Format of a new makeflow log. An existing log is continued in its own format. (default is text)
 OPTION_ARG(L, batch-log, logfile)Use this file for the batch system log. (default is X.PARAM(type)log)
 OPTION_ARG(m, email, email)Email summary of workflow to address.
 OPTION_ARG(j, max-local, #)Max number of local jobs to run at once. (default is # of cores)
@@ -58,6 +59,7 @@ OPTION_ARG(r, retry-count, n)Automatically retry failed batch jobs up to n times
 OPTION_ARG_LONG(local-cores, #)Max number of cores used for local execution.
 OPTION_ARG_LONG(local-memory, #)Max amount of memory used for local execution.
 OPTION_ARG_LONG(local-disk, #)Max amount of disk used for local execution.
+OPTION_FLAG_LONG(local-cgroups)Confine each local job to its own cgroup, enforcing its declared cores and memory.
 
 OPTION_END
 
@@ -110,6 +112,7 @@ OPTION_ARG_LONG(ssl-cert) Set the SSL certificate file for encrypting connection
 OPTION_ARG_LONG(ssl-key) Set the SSL certificate file for encrypting connection.
 OPTION_FLAG_LONG(cache-mode) Control worker caching mode. (never|workflow|forever)
 OPTION_ARG_LONG(preferred-connection,connection)Indicate preferred connection. Chose one of by_ip or by_hostname. (default is by_ip)
+OPTION_FLAG_LONG(vine-temp-files) Keep intermediate files that are only used by remote rules on the TaskVine workers.
 OPTIONS_END
 
 SUBSECTION(Monitor Options)
@@ -168,6 +171,7 @@ OPTIONS_BEGIN
 OPTION_ARG_LONG(archive)Archive results of workflow at the specified path (by default /tmp/makeflow.archive.$UID) and use outputs of any archived jobs instead of re-executing job
 OPTION_ARG_LONG(archive-dir,path)Specify archive base directory.
 OPTION_ARG_LONG(archive-read,path)Only check to see if jobs have been cached and use outputs if it has been
+OPTION_ARG_LONG(archive-threads,n)Archive jobs in the background with n threads, or at once if 0. (default is 4)
 OPTION_ARG_LONG(archive-s3,s3_bucket)Base S3 Bucket name
 OPTION_ARG_LONG(archive-s3-no-check,s3_bucket)Blind upload files to S3 bucket (No existence check in bucket).
 OPTION_ARG_LONG(s3-hostname, s3_hostname)Base S3 hostname. Used for AWS S3.
@@ -19,6 +19,8 @@ OPTIONS_BEGIN
 OPTION_ARG_LONG(check-driver,driver) Check for the presence of a given driver (e.g. http, ftp, etc) and return success if it is currently enabled.
 OPTION_ARG(a,chirp-auth,unix|hostname|ticket|globus|kerberos)Use this Chirp authentication method.  May be invoked multiple times to indicate a preferred list, in order.
 OPTION_ARG(b,block-size,bytes)Set the I/O block size hint.
+OPTION_ARG_LONG(cache-blocks,bytes)Cache remote files in blocks of this size, fetching only the blocks that are read, instead of fetching each whole file when it is opened. Applies to HTTP and to services that support reads at any offset. (PARROT_CACHE_BLOCKS)
+OPTION_ARG_LONG(cache-size,bytes)Limit the file cache to this many bytes, evicting the least recently used files to make room. The limit is shared by all instances of Parrot using the same cache directory. (PARROT_CACHE_SIZE)
 OPTION_ARG(c,status-file,file)Print exit status information to file.
 OPTION_FLAG(C,channel-auth)Enable data channel authentication in GridFTP.
 OPTION_ARG(d,debug,flag)Enable debugging for this sub-system.
@@ -49,6 +51,7 @@ OPTION_FLAG_LONG(cvmfs-repo-switching) Allow repository switching with CVMFS.
 OPTION_ARG(R,root-checksum,cksum)Enforce this root filesystem checksum, where available.
 OPTION_FLAG(s,stream-no-cache)Use streaming protocols without caching.
 OPTION_FLAG(S,session-caching)Enable whole session caching for all protocols.
+OPTION_FLAG_LONG(seccomp)Trap only system calls that may need virtualization, using a seccomp filter. Requires Linux 4.8 or later on x86_64.
 OPTION_FLAG_LONG(syscall-disable-debug)Disable tracee access to the Parrot debug syscall.
 OPTION_ARG(t,tempdir,dir)Where to store temporary files.
 OPTION_ARG(T,timeout,time)Maximum amount of time to retry failures.
@@ -11,73 +11,41 @@
 
 /** Begin: internals **/
 
-/* Create a bucketing point
+/* Append a bucketing point to the unsorted tail of the array of points in
+ * amortized O(1). The point is merged into the sorted part on the next update.
+ * @param s the relevant bucketing state
  * @param val value of point
- * @param sig significance of point
- * @return pointer to created point
- * @return NULL if failure */
-static bucketing_point_t *bucketing_point_create(double val, double sig)
+ * @param sig significance of point */
+static void bucketing_append_point(bucketing_state_t *s, double val, double sig)
 {
-	bucketing_point_t *p = xxmalloc(sizeof(*p));
-
-	p->val = val;
-	p->sig = sig;
-
-	return p;
-}
+	if (s->num_points >= s->sorted_points_capacity) {
+		s->sorted_points_capacity = s->sorted_points_capacity > 0 ? 2 * s->sorted_points_capacity : 64;
+		s->sorted_points = xxrealloc(s->sorted_points, s->sorted_points_capacity * sizeof(*s->sorted_points));
+	}
 
-/* Delete a bucketing point
- * @param p the bucketing point to be deleted */
-static void bucketing_point_delete(bucketing_point_t *p)
-{
-	free(p);
+	s->sorted_points[s->num_points].val = val;
+	s->sorted_points[s->num_points].sig = sig;
 }
 
-/* Insert a bucketing point into a sorted list of points in O(log(n))
- * @param l pointer to sorted list of points
- * @param p pointer to point */
-static void bucketing_insert_point_to_sorted_list(struct list *l, bucketing_point_t *p)
+/* Compare two points by increasing value, and by decreasing significance
+ * for equal values, so that a later point comes before earlier ones.
+ * @param p1 first point
+ * @param p2 second point
+ * @return negative if p1 goes first, positive if p2 goes first, 0 otherwise */
+static int bucketing_compare_points(const void *p1, const void *p2)
 {
-	struct list_cursor *lc = list_cursor_create(l);
-	if (!lc) {
-		fatal("Cannot create list cursor\n");
-		return;
-	}
-
-	/* If list is empty, append new point to list */
-	if (list_length(l) == 0) {
-		list_insert(lc, p);
-		list_cursor_destroy(lc);
-		return;
-	}
+	const bucketing_point_t *a = p1;
+	const bucketing_point_t *b = p2;
 
-	/* Linear insert a data point */
-	if (!list_seek(lc, 0)) {
-		fatal("Cannot seek list to index 0\n");
-		return;
-	}
-
-	bucketing_point_t *bpp = 0;
-	int inserted = 0;
-	do {
-		if (!list_get(lc, (void **)&bpp)) {
-			fatal("Cannot get element from list.\n");
-			return;
-		}
-
-		if (bpp->val >= p->val) {
-			list_insert(lc, p);
-			inserted = 1;
-			break;
-		}
-	} while (list_next(lc));
-
-	/* Append point if it isn't inserted */
-	if (inserted == 0) {
-		list_insert(lc, p);
-	}
-
-	list_cursor_destroy(lc);
+	if (a->val < b->val)
+		return -1;
+	if (a->val > b->val)
+		return 1;
+	if (a->sig > b->sig)
+		return -1;
+	if (a->sig < b->sig)
+		return 1;
+	return 0;
 }
 
 static void generate_next_task_sig(bucketing_state_t *s)
@@ -166,8 +134,9 @@ bucketing_state_t *bucketing_state_create(double default_value, int num_sampling
 
 	bucketing_state_t *s = xxmalloc(sizeof(*s));
 
-	s->sorted_points = list_create();
-	s->sequence_points = list_create();
+	s->sorted_points = 0;
+	s->num_sorted_points = 0;
+	s->sorted_points_capacity = 0;
 	s->sorted_buckets = list_create();
 
 	s->num_points = 0;
@@ -188,12 +157,7 @@ bucketing_state_t *bucketing_state_create(double default_value, int num_sampling
 void bucketing_state_delete(bucketing_state_t *s)
 {
 	if (s) {
-		list_clear(s->sorted_points, (void *)bucketing_point_delete);
-		list_delete(s->sorted_points);
-
-		/* pointers already free'd as sorted_points and sequence_points
-		 * share the same set of pointers */
-		list_delete(s->sequence_points);
+		free(s->sorted_points);
 		list_clear(s->sorted_buckets, (void *)bucketing_bucket_delete);
 		list_delete(s->sorted_buckets);
 		free(s);
@@ -236,19 +200,8 @@ void bucketing_state_tune(bucketing_state_t *s, const char *field, void *val)
 
 void bucketing_add(bucketing_state_t *s, double val)
 {
-	/* insert to sorted list and append to sequence list */
-	bucketing_point_t *p = bucketing_point_create(val, s->next_task_sig);
-	if (!p) {
-		fatal("Cannot create point\n");
-		return;
-	}
-
-	bucketing_insert_point_to_sorted_list(s->sorted_points, p);
-
-	if (!list_push_tail(s->sequence_points, p)) {
-		fatal("Cannot push point to list tail\n");
-		return;
-	}
+	/* append to array of points, sorted on next update */
+	bucketing_append_point(s, val, s->next_task_sig);
 
 	/* Change to predicting phase if appropriate */
 	++s->num_points;
@@ -353,6 +306,33 @@ double bucketing_predict(bucketing_state_t *s, double prev_val)
 	return -1;
 }
 
+void bucketing_merge_points(bucketing_state_t *s)
+{
+	int num_new = s->num_points - s->num_sorted_points;
+	if (num_new < 1)
+		return;
+
+	/* sort new points, then merge them with the sorted ones from the back.
+	 * New points go before sorted points of equal value, as they were added later. */
+	bucketing_point_t *new_points = xxmalloc(num_new * sizeof(*new_points));
+	memcpy(new_points, &s->sorted_points[s->num_sorted_points], num_new * sizeof(*new_points));
+	qsort(new_points, num_new, sizeof(*new_points), bucketing_compare_points);
+
+	int i = s->num_sorted_points - 1;
+	int j = num_new - 1;
+	int k = s->num_points - 1;
+	while (j >= 0) {
+		if (i >= 0 && s->sorted_points[i].val >= new_points[j].val) {
+			s->sorted_points[k--] = s->sorted_points[i--];
+		} else {
+			s->sorted_points[k--] = new_points[j--];
+		}
+	}
+
+	free(new_points);
+	s->num_sorted_points = s->num_points;
+}
+
 /** End: APIs **/
 
 /** Begin: debug functions **/
@@ -371,17 +351,14 @@ void bucketing_sorted_buckets_print(struct list *l)
 	}
 }
 
-void bucketing_sorted_points_print(struct list *l)
+void bucketing_sorted_points_print(bucketing_state_t *s)
 {
-	if (!l)
+	if (!s)
 		return;
-	bucketing_point_t *tmp;
-	list_first_item(l);
+	bucketing_merge_points(s);
 	printf("Printing sorted points\n");
-	int i = 0;
-	while ((tmp = list_next_item(l))) {
-		printf("pos: %d, value: %lf, sig: %lf\n", i, tmp->val, tmp->sig);
-		++i;
+	for (int i = 0; i < s->num_points; ++i) {
+		printf("pos: %d, value: %lf, sig: %lf\n", i, s->sorted_points[i].val, s->sorted_points[i].sig);
 	}
 }
 
@@ -45,16 +45,19 @@ typedef struct
 typedef struct
 {
     /** Begin: internally maintained fields **/
-    /* a doubly linked list of pointers to points of type 'bucketing_point_t'
-     * sorted by 'point->val' in increasing order
-     * sorted_points and sequence_points share the same set of pointers */
-    struct list *sorted_points;
-
-    /* a doubly linked list of pointers to points of type 'bucketing_point_t'
-     * sorted by 'point->sig' in increasing order
-     * sequence_points and sorted_points share the same set of pointers */
-    struct list *sequence_points;
-    
+    /* an array of points of type 'bucketing_point_t'. The first
+     * 'num_sorted_points' entries are sorted by 'point->val' in increasing
+     * order, with a later point placed before all earlier points of equal
+     * value. Points added since the last update are appended unsorted after
+     * them until bucketing_merge_points is called. */
+    bucketing_point_t *sorted_points;
+
+    /* number of sorted points at the beginning of sorted_points */
+    int num_sorted_points;
+
+    /* number of points the sorted_points array can hold before growing */
+    int sorted_points_capacity;
+
     /* a doubly linked list of pointers to buckets of type 'bucketing_bucket_t'
      * sorted by 'bucket->val' in increasing order */
     struct list *sorted_buckets;
@@ -148,6 +151,11 @@ void bucketing_add(bucketing_state_t* s, double val);
  * @return -1 if failure */
 double bucketing_predict(bucketing_state_t* s, double prev_val);
 
+/* Merge the points added since the last update into the sorted array of points.
+ * Must be called before reading s->sorted_points, as the update functions do.
+ * @param s the relevant bucketing state */
+void bucketing_merge_points(bucketing_state_t* s);
+
 /** End: APIs **/
 
 /** Begin: debug functions **/
@@ -156,9 +164,9 @@ double bucketing_predict(bucketing_state_t* s, double prev_val);
  * @param l the list of buckets */
 void bucketing_sorted_buckets_print(struct list* l);
 
-/* Print a sorted list of bucketing_point_t
- * @param l the list of points */
-void bucketing_sorted_points_print(struct list* l);
+/* Print the sorted array of bucketing_point_t of a bucketing state
+ * @param s the relevant bucketing state */
+void bucketing_sorted_points_print(bucketing_state_t* s);
 
 /** End: debug functions **/
 
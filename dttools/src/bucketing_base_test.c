@@ -55,7 +55,7 @@ int main(int argc, char** argv)
     for (int i = 0; i < iters; ++i)
     {
         num = num * multiple % prime;
-        bucketing_sorted_points_print(s->sorted_points);
+        bucketing_sorted_points_print(s);
         bucketing_sorted_buckets_print(s->sorted_buckets);
         printf("iteration %d data value %d\n", i, num);
         while ((pred = bucketing_predict(s, prev_val)))
@@ -85,7 +85,7 @@ int main(int argc, char** argv)
             //printf("Finding buckets\n");
         //    bucketing_greedy_update_buckets(s);
         //}
-        //printf("Sorted list length %d\n", list_length(s->sorted_points));
+        //printf("Sorted list length %d\n", s->num_points);
         printf("----------------------------------\n");
     }
     bucketing_state_delete(s);
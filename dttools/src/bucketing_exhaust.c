@@ -62,39 +62,35 @@ static double *bucketing_reweight_bucket_probs(bucketing_bucket_t **bucket_array
 
 /* Compute the expectations of tasks' values in all buckets
  * @param s the relevant bucketing state
- * @param bucket_list the list of buckets
+ * @param bucket_array the array of buckets
+ * @param num_buckets the number of buckets
  * @return pointer to a malloc'ed array of values
  * @return 0 if failure */
-static double *bucketing_exhaust_compute_task_exps(bucketing_state_t *s, struct list *bucket_list)
+static double *bucketing_exhaust_compute_task_exps(bucketing_state_t *s, bucketing_bucket_t **bucket_array, int num_buckets)
 {
-	if (!s || !bucket_list) {
+	if (!s || !bucket_array) {
 		fatal("At least one parameter is empty\n");
 		return 0;
 	}
 
-	double *task_exps = xxcalloc(list_size(bucket_list), sizeof(*task_exps));
+	double *task_exps = xxcalloc(num_buckets, sizeof(*task_exps));
 
 	bucketing_point_t *tmp_pnt;
-	bucketing_bucket_t *tmp_buck;
 	int i = 0;
+	int j = 0;
 	double total_sig_buck = 0;
 
-	list_first_item(s->sorted_points);
-	list_first_item(bucket_list);
-	tmp_pnt = list_next_item(s->sorted_points);
-	tmp_buck = list_next_item(bucket_list);
-
 	/* Loop though all points to compute expected value of task if it is in a given bucket */
-	while ((tmp_pnt)) {
-		if (tmp_pnt->val <= tmp_buck->val) {
+	while (j < s->num_points) {
+		tmp_pnt = &s->sorted_points[j];
+		if (tmp_pnt->val <= bucket_array[i]->val) {
 			total_sig_buck += tmp_pnt->sig;
 			task_exps[i] += tmp_pnt->val * tmp_pnt->sig;
-			tmp_pnt = list_next_item(s->sorted_points);
+			++j;
 		} else {
 			task_exps[i] /= total_sig_buck;
 			++i;
 			total_sig_buck = 0;
-			tmp_buck = list_next_item(bucket_list);
 		}
 	}
 
@@ -119,19 +115,19 @@ static double bucketing_exhaust_compute_cost(bucketing_state_t *s, struct list *
 	int N = list_size(bucket_list);
 	double cost_table[N][N];
 
-	/* Compute task expectation in each bucket */
-	double *task_exps = bucketing_exhaust_compute_task_exps(s, bucket_list);
-	if (!task_exps) {
-		fatal("Cannot compute task expectations\n");
-		return -1;
-	}
-
 	bucketing_bucket_t **bucket_array = bucketing_bucket_list_to_array(bucket_list);
 	if (!bucket_array) {
 		fatal("Cannot convert list of buckets to array of buckets\n");
 		return -1;
 	}
 
+	/* Compute task expectation in each bucket */
+	double *task_exps = bucketing_exhaust_compute_task_exps(s, bucket_array, N);
+	if (!task_exps) {
+		fatal("Cannot compute task expectations\n");
+		return -1;
+	}
+
 	/* i is task in which bucket, j is which bucket is chosen */
 	/* fill easy entries */
 	for (int j = 0; j < N; ++j) {
@@ -141,21 +137,23 @@ static double bucketing_exhaust_compute_cost(bucketing_state_t *s, struct list *
 	}
 
 	double *upper_bucket_probs;
-	/* fill entries that depend on other entries */
-	for (int i = N - 1; i > -1; --i) {
-		for (int j = i - 1; j > -1; --j) {
-			cost_table[i][j] = bucket_array[j]->val;
-			upper_bucket_probs = bucketing_reweight_bucket_probs(bucket_array, j + 1, N - 1);
-			if (!upper_bucket_probs) {
-				fatal("Cannot reweight buckets\n");
-				return -1;
-			}
+	/* fill entries that depend on other entries, entry (i, j) depends on
+	 * entries (i, k) for k > j, so going down in j computes them in order.
+	 * The reweighted probabilities of buckets above j are shared by all i. */
+	for (int j = N - 2; j > -1; --j) {
+		upper_bucket_probs = bucketing_reweight_bucket_probs(bucket_array, j + 1, N - 1);
+		if (!upper_bucket_probs) {
+			fatal("Cannot reweight buckets\n");
+			return -1;
+		}
 
+		for (int i = N - 1; i > j; --i) {
+			cost_table[i][j] = bucket_array[j]->val;
 			for (int k = j + 1; k < N; ++k) {
 				cost_table[i][j] += upper_bucket_probs[k - (j + 1)] * cost_table[i][k];
 			}
-			free(upper_bucket_probs);
 		}
+		free(upper_bucket_probs);
 	}
 
 	/* Compute final cost */
@@ -184,18 +182,12 @@ static struct list *bucketing_exhaust_get_buckets(bucketing_state_t *s, int n)
 		return 0;
 	}
 
-	if (!s->sorted_points) {
-		fatal("sorted list of points is empty\n");
-		return 0;
-	}
-
-	bucketing_point_t *tmp_point = list_peek_tail(s->sorted_points);
-	if (!tmp_point) {
-		fatal("list of points is empty so can't get a list of buckets\n");
+	if (!s->sorted_points || s->num_points < 1) {
+		fatal("array of points is empty so can't get a list of buckets\n");
 		return 0;
 	}
 
-	double max_val = tmp_point->val; // max value in all points
+	double max_val = s->sorted_points[s->num_points - 1].val; // max value in all points
 
 	int steps;
 	if (max_val == 0) // corner case where max value is 0, so no possible steps are available
@@ -231,8 +223,8 @@ static struct list *bucketing_exhaust_get_buckets(bucketing_state_t *s, int n)
 		candidate_probs[i] = 0;
 
 	i = 0;
-	list_first_item(s->sorted_points);
-	bucketing_point_t *tmp = list_next_item(s->sorted_points);
+	int j = 0; // track index to sorted points
+	bucketing_point_t *tmp = &s->sorted_points[0];
 
 	/* loop through points to fill values for buckets */
 	while ((tmp) && (i < steps + n)) {
@@ -246,7 +238,8 @@ static struct list *bucketing_exhaust_get_buckets(bucketing_state_t *s, int n)
 			prev_val = tmp->val;
 			buck_sig += tmp->sig;
 
-			tmp = list_next_item(s->sorted_points);
+			++j;
+			tmp = j < s->num_points ? &s->sorted_points[j] : 0;
 		}
 	}
 
@@ -336,6 +329,9 @@ void bucketing_exhaust_update_buckets(bucketing_state_t *s)
 		return;
 	}
 
+	/* Bring newly added points into sorted order */
+	bucketing_merge_points(s);
+
 	/* Destroy old list */
 	list_free(s->sorted_buckets);
 	list_delete(s->sorted_buckets);
@@ -4,13 +4,15 @@
 #include "bucketing_manager.h"
 #include "debug.h"
 #include "twister.h"
+#include "timestamp.h"
 
 extern struct hash_table* info_of_resource_table;
 
 int main(int argc, char** argv)
 {
     bucketing_mode_t mode;
-    if (argc == 2)
+    int iters = 50;
+    if (argc == 2 || argc == 3)
     {
         if (strncmp(*(argv+1), "-greedy", 7) == 0)
             mode = BUCKETING_MODE_GREEDY;
@@ -21,10 +23,12 @@ int main(int argc, char** argv)
             fatal("invalid bucketing mode\n");
             return 1;
         }
+        if (argc == 3)
+            iters = atoi(*(argv+2));
     }
     else
     {
-        fatal("must specify bucketing mode\n");
+        fatal("usage: %s -greedy|-exhaust [iterations]\n", *argv);
         return 1;
     }
     double default_value;
@@ -52,7 +56,6 @@ int main(int argc, char** argv)
     int prime_core = 7;
     int num_core = 2;
     int multiple = 2;
-    int iters = 50;
 
     struct rmsummary* task_r;
     struct rmsummary* pred_task_r;
@@ -67,6 +70,10 @@ int main(int argc, char** argv)
 
     int task_id = 1;
 
+    timestamp_t start_time = timestamp_get();
+    timestamp_t report_time = 0;
+    timestamp_t tmp_time;
+
     //printf("Adding values\n");
     for (int i = 0; i < iters; ++i)
     {
@@ -98,7 +105,9 @@ int main(int argc, char** argv)
 
             if (pred_task_r->cores >= task_r->cores && pred_task_r->memory >= task_r->memory && pred_task_r->disk >= task_r->disk)
             {
+                tmp_time = timestamp_get();
                 bucketing_manager_add_resource_report(m, task_id, task_r, 1);
+                report_time += timestamp_get() - tmp_time;
                 rmsummary_delete(pred_task_r);
                 break;
             }
@@ -129,6 +138,9 @@ int main(int argc, char** argv)
         ++task_id;
         printf("----------------------------------\n");
     }
+    timestamp_t total_time = timestamp_get() - start_time;
+    printf("timing: %d iterations in %.6lf s, adding successful reports (and updating buckets) took %.6lf s, %.3lf ms per report\n",
+        iters, total_time / 1000000.0, report_time / 1000000.0, iters > 0 ? report_time / 1000.0 / iters : 0);
     bucketing_manager_delete(m);
     hash_table_delete(info_of_resource_table);
     return 0;
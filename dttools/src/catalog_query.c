@@ -6,6 +6,7 @@ See the file COPYING for details.
 */
 
 #include <errno.h>
+#include <pthread.h>
 #include <string.h>
 #include <sys/wait.h>
 
@@ -17,6 +18,7 @@ See the file COPYING for details.
 #include "domain_name.h"
 #include "domain_name_cache.h"
 #include "fd.h"
+#include "hash_table.h"
 #include "http_query.h"
 #include "jx.h"
 #include "jx_eval.h"
@@ -29,9 +31,21 @@ See the file COPYING for details.
 #include "xxmalloc.h"
 #include "zlib.h"
 
+#define CATALOG_HTTP_LINE_MAX 4096
+
+/* Limits on the state kept between queries. */
+#define CATALOG_QUERY_CACHE_MAX 16
+#define CATALOG_QUERY_LINKS_MAX 8
+#define CATALOG_LEGACY_HOSTS_MAX 64
+
+/* Seconds before a server without /select is asked again, in case it was upgraded. */
+#define CATALOG_LEGACY_RECHECK 3600
+
 struct catalog_query {
 	struct jx *data;
 	struct jx *filter_expr;
+	struct jx *fields;
+	int filtered; /* if true, the server already applied filter_expr and fields */
 	struct jx_item *current;
 };
 
@@ -41,8 +55,38 @@ struct catalog_host {
 	int down;
 };
 
+/*
+The records of a query previously sent to a host, kept so that the
+next identical query only needs the records updated since then.
+*/
+
+struct catalog_cache {
+	struct hash_table *records; /* record key -> jx record */
+	struct jx *keys;	    /* keys of the matching records, in server order */
+	time_t server_time;	    /* server time of the last response */
+	time_t fetch_time;	    /* local time of the last response */
+};
+
 static struct set *down_hosts = NULL;
 
+/*
+down_hosts and the tables below are shared by all threads of the process,
+and guarded by catalog_query_mutex. A cached result or a connection is
+removed from its table while a query uses it, so that the lock is not
+held during I/O.
+*/
+
+static pthread_mutex_t catalog_query_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Cached query results, keyed by host, port, filter, and fields. */
+static struct hash_table *query_cache = NULL;
+
+/* Connections to catalog servers kept open between queries, keyed by host:port. */
+static struct hash_table *query_links = NULL;
+
+/* Servers known to lack the /select interface, keyed by host:port, with the time that was found. */
+static struct hash_table *legacy_hosts = NULL;
+
 /* Given a comma delimited list of host:port or host, set the values pointed
    to by host and port, using the default port if not provided. Return the address
    of the next hostport in the string, or NULL if there are no more
@@ -128,6 +172,384 @@ struct jx *catalog_query_send_query(struct catalog_host *h, struct jx *expr, tim
 	return j;
 }
 
+/*
+Perform one HTTP GET on a connection that may be kept open for later queries.
+The complete body of the response is read into buf, so that the connection
+is ready for the next request. Returns the HTTP response code, or zero if
+the connection failed.
+*/
+
+static int catalog_query_http_exchange(struct link *l, struct catalog_host *h, const char *path, buffer_t *buf, int *keepalive, time_t stoptime)
+{
+	char line[CATALOG_HTTP_LINE_MAX];
+	int64_t length = -1;
+	int response;
+
+	*keepalive = 1;
+
+	if (link_printf(l, stoptime, "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: keep-alive\r\n\r\n", path, h->host) < 0)
+		return 0;
+
+	if (!link_readline(l, line, sizeof(line), stoptime))
+		return 0;
+	if (sscanf(line, "HTTP/%*d.%*d %d", &response) != 1)
+		return 0;
+
+	while (1) {
+		if (!link_readline(l, line, sizeof(line), stoptime))
+			return 0;
+		string_chomp(line);
+		if (!line[0])
+			break;
+		if (!strncasecmp(line, "Content-Length:", 15)) {
+			length = strtoll(line + 15, 0, 10);
+		} else if (!strncasecmp(line, "Connection:", 11) && strstr(line + 11, "close")) {
+			*keepalive = 0;
+		}
+	}
+
+	if (response != 200) {
+		*keepalive = 0;
+		return response;
+	}
+
+	if (length < 0) {
+		/* Without a length, the body runs until the server closes. */
+		*keepalive = 0;
+		char chunk[65536];
+		ssize_t n;
+		while ((n = link_read(l, chunk, sizeof(chunk), stoptime)) > 0) {
+			buffer_putlstring(buf, chunk, n);
+		}
+	} else {
+		char *data = xxmalloc(length + 1);
+		ssize_t n = link_read(l, data, length, stoptime);
+		if (n == length)
+			buffer_putlstring(buf, data, length);
+		free(data);
+		if (n != length)
+			return 0;
+	}
+
+	return response;
+}
+
+static int catalog_query_http_get(struct catalog_host *h, const char *path, buffer_t *buf, time_t stoptime)
+{
+	char *hostport = string_format("%s:%d", h->host, h->port);
+	int response = 0;
+	int attempt;
+
+	/* A kept connection may have been closed by the server while idle, so try once more on a new one. */
+	for (attempt = 0; attempt < 2; attempt++) {
+		pthread_mutex_lock(&catalog_query_mutex);
+		if (!query_links)
+			query_links = hash_table_create(0, 0);
+		struct link *l = hash_table_remove(query_links, hostport);
+		pthread_mutex_unlock(&catalog_query_mutex);
+		int reused = l != 0;
+
+		if (!l) {
+			/* The name cache is not safe to use from several threads. */
+			char addr[LINK_ADDRESS_MAX];
+			pthread_mutex_lock(&catalog_query_mutex);
+			int found = domain_name_cache_lookup(h->host, addr);
+			pthread_mutex_unlock(&catalog_query_mutex);
+			if (!found)
+				break;
+			l = link_connect(addr, h->port, stoptime);
+			if (!l)
+				break;
+		}
+
+		int keepalive;
+		buffer_rewind(buf, 0);
+		response = catalog_query_http_exchange(l, h, path, buf, &keepalive, stoptime);
+
+		/* Keep the connection, unless another query kept one meanwhile or too many are kept. */
+		if (response > 0 && keepalive) {
+			pthread_mutex_lock(&catalog_query_mutex);
+			if (hash_table_size(query_links) < CATALOG_QUERY_LINKS_MAX && hash_table_insert(query_links, hostport, l)) {
+				l = 0;
+			}
+			pthread_mutex_unlock(&catalog_query_mutex);
+		}
+		if (l) {
+			link_close(l);
+		}
+
+		if (response > 0 || !reused)
+			break;
+
+		debug(D_DEBUG, "connection to catalog %s was closed, reconnecting", hostport);
+	}
+
+	free(hostport);
+	return response;
+}
+
+static void catalog_cache_delete(struct catalog_cache *c)
+{
+	char *key;
+	struct jx *j;
+
+	if (!c)
+		return;
+
+	HASH_TABLE_ITERATE(c->records, key, j)
+	{
+		jx_delete(j);
+	}
+	hash_table_delete(c->records);
+	jx_delete(c->keys);
+	free(c);
+}
+
+/*
+Merge the response to a /select query into the cached records.
+Records not listed in keys no longer match, and are dropped.
+Returns true on success, false if the response refers to a record
+that is neither updated nor already cached.
+*/
+
+static int catalog_cache_apply(struct catalog_cache *c, struct jx *response)
+{
+	struct jx *jtime = jx_lookup(response, "time");
+	struct jx *keys = jx_lookup(response, "keys");
+	struct jx *updated = jx_lookup(response, "updated");
+
+	if (!jx_istype(jtime, JX_INTEGER) || !jx_istype(keys, JX_ARRAY) || !jx_istype(updated, JX_OBJECT))
+		return 0;
+
+	void *i = NULL;
+	struct jx *value;
+	while ((value = jx_iterate_values(updated, &i))) {
+		const char *key = jx_get_key(&i);
+		jx_delete(hash_table_remove(c->records, key));
+		hash_table_insert(c->records, key, jx_copy(value));
+	}
+
+	struct hash_table *records = hash_table_create(0, 0);
+	struct jx *jkey;
+	int ok = 1;
+
+	i = NULL;
+	while ((jkey = jx_iterate_array(keys, &i))) {
+		if (!jx_istype(jkey, JX_STRING)) {
+			ok = 0;
+			break;
+		}
+		struct jx *record = hash_table_remove(c->records, jkey->u.string_value);
+		if (!record) {
+			ok = 0;
+			break;
+		}
+		hash_table_insert(records, jkey->u.string_value, record);
+	}
+
+	char *key;
+	struct jx *record;
+	HASH_TABLE_ITERATE(c->records, key, record)
+	{
+		jx_delete(record);
+	}
+	hash_table_delete(c->records);
+	c->records = records;
+
+	jx_delete(c->keys);
+	c->keys = jx_copy(keys);
+	c->server_time = jtime->u.integer_value;
+	c->fetch_time = time(0);
+
+	return ok;
+}
+
+/* Copy the cached records into a new array, in server order. */
+
+static struct jx *catalog_cache_result(struct catalog_cache *c)
+{
+	struct jx *result = jx_array(0);
+	struct jx_item **tail = &result->u.items;
+	struct jx *jkey;
+	void *i = NULL;
+
+	while ((jkey = jx_iterate_array(c->keys, &i))) {
+		*tail = jx_item(jx_copy(hash_table_lookup(c->records, jkey->u.string_value)), 0);
+		tail = &(*tail)->next;
+	}
+
+	return result;
+}
+
+/*
+Put a result back in the cache after a query. If the cache is full, the
+result fetched longest ago is dropped. Must be called with the lock held.
+*/
+
+static void catalog_cache_insert(const char *cache_key, struct catalog_cache *c)
+{
+	if (!query_cache)
+		query_cache = hash_table_create(0, 0);
+
+	/* An identical query may have finished meanwhile, keep the latest. */
+	catalog_cache_delete(hash_table_remove(query_cache, cache_key));
+
+	if (hash_table_size(query_cache) >= CATALOG_QUERY_CACHE_MAX) {
+		char *key, *oldest_key = 0;
+		struct catalog_cache *other, *oldest = 0;
+		HASH_TABLE_ITERATE(query_cache, key, other)
+		{
+			if (!oldest || other->fetch_time < oldest->fetch_time) {
+				oldest = other;
+				oldest_key = key;
+			}
+		}
+		catalog_cache_delete(hash_table_remove(query_cache, oldest_key));
+	}
+
+	hash_table_insert(query_cache, cache_key, c);
+}
+
+static int catalog_legacy_host(const char *hostport)
+{
+	int legacy = 0;
+
+	pthread_mutex_lock(&catalog_query_mutex);
+	if (legacy_hosts) {
+		time_t found = (time_t)hash_table_lookup(legacy_hosts, hostport);
+		if (found && time(0) - found < CATALOG_LEGACY_RECHECK) {
+			legacy = 1;
+		} else if (found) {
+			hash_table_remove(legacy_hosts, hostport);
+		}
+	}
+	pthread_mutex_unlock(&catalog_query_mutex);
+
+	return legacy;
+}
+
+static void catalog_legacy_host_insert(const char *hostport)
+{
+	pthread_mutex_lock(&catalog_query_mutex);
+	if (!legacy_hosts)
+		legacy_hosts = hash_table_create(0, 0);
+	if (hash_table_size(legacy_hosts) < CATALOG_LEGACY_HOSTS_MAX) {
+		hash_table_insert(legacy_hosts, hostport, (void *)time(0));
+	}
+	pthread_mutex_unlock(&catalog_query_mutex);
+}
+
+/*
+Query a server through /select/<since>/<expr>/<fields>, which evaluates
+the filter and projects the fields on the server, and only sends the
+records updated since the previous identical query, along with the keys
+of all matching records. If max_age is not negative, the records are
+cached in the process for the next identical query, which uses them
+without contacting the server if they were fetched less than max_age
+seconds ago. If the server does not know /select, *legacy is set and
+the caller should fall back to the old query.
+*/
+
+static struct jx *catalog_query_select(struct catalog_host *h, struct jx *expr, struct jx *fields, int max_age, int *legacy, time_t stoptime)
+{
+	char *expr_str = expr ? jx_print_string(expr) : strdup("true");
+	char *fields_str = jx_print_string(fields);
+	char *hostport = string_format("%s:%d", h->host, h->port);
+	char *cache_key = string_format("%s\n%s\n%s", hostport, expr_str, fields_str);
+	struct jx *result = 0;
+
+	*legacy = 0;
+
+	if (getenv("HTTP_PROXY") || catalog_legacy_host(hostport)) {
+		*legacy = 1;
+		goto done;
+	}
+
+	struct catalog_cache *c = 0;
+	if (max_age >= 0) {
+		pthread_mutex_lock(&catalog_query_mutex);
+		if (query_cache) {
+			c = hash_table_lookup(query_cache, cache_key);
+			if (c && (time(0) - c->fetch_time) < max_age) {
+				debug(D_DEBUG, "using cached catalog query result from %s", hostport);
+				result = catalog_cache_result(c);
+				pthread_mutex_unlock(&catalog_query_mutex);
+				goto done;
+			}
+			hash_table_remove(query_cache, cache_key);
+		}
+		pthread_mutex_unlock(&catalog_query_mutex);
+	}
+
+	buffer_t b64_expr, b64_fields, body;
+	buffer_init(&b64_expr);
+	buffer_init(&b64_fields);
+	buffer_init(&body);
+	b64_encode(expr_str, strlen(expr_str), &b64_expr);
+	b64_encode(fields_str, strlen(fields_str), &b64_fields);
+
+	/* One retry from scratch if the cached records turn out inconsistent with the server. */
+	int attempt;
+	for (attempt = 0; attempt < 2; attempt++) {
+		char *path = string_format("/select/%ld/%s/%s", c ? (long)c->server_time : 0L, buffer_tostring(&b64_expr), buffer_tostring(&b64_fields));
+		debug(D_DEBUG, "trying catalog query: http://%s%s", hostport, path);
+		int response = catalog_query_http_get(h, path, &body, stoptime);
+		free(path);
+
+		if (response == 404) {
+			debug(D_DEBUG, "catalog server %s does not support /select", hostport);
+			catalog_legacy_host_insert(hostport);
+			*legacy = 1;
+			break;
+		} else if (response != 200) {
+			break;
+		}
+
+		struct jx *j = jx_parse_string(buffer_tostring(&body));
+		if (!j) {
+			debug(D_DEBUG, "query result failed to parse as JSON");
+			break;
+		}
+
+		if (!c) {
+			c = xxcalloc(1, sizeof(*c));
+			c->records = hash_table_create(0, 0);
+			c->keys = jx_array(0);
+		}
+
+		int ok = catalog_cache_apply(c, j);
+		jx_delete(j);
+
+		if (ok) {
+			result = catalog_cache_result(c);
+			break;
+		}
+
+		debug(D_DEBUG, "cached catalog records from %s are inconsistent, refreshing", hostport);
+		catalog_cache_delete(c);
+		c = 0;
+	}
+
+	if (c && result && max_age >= 0) {
+		pthread_mutex_lock(&catalog_query_mutex);
+		catalog_cache_insert(cache_key, c);
+		pthread_mutex_unlock(&catalog_query_mutex);
+	} else {
+		catalog_cache_delete(c);
+	}
+
+	buffer_free(&b64_expr);
+	buffer_free(&b64_fields);
+	buffer_free(&body);
+
+done:
+	free(expr_str);
+	free(fields_str);
+	free(hostport);
+	free(cache_key);
+	return result;
+}
+
 struct list *catalog_query_sort_hostlist(const char *hosts)
 {
 	const char *next_host;
@@ -142,6 +564,7 @@ struct list *catalog_query_sort_hostlist(const char *hosts)
 		next_host = hosts;
 	}
 
+	pthread_mutex_lock(&catalog_query_mutex);
 	if (!down_hosts) {
 		down_hosts = set_create(0);
 	}
@@ -169,11 +592,17 @@ struct list *catalog_query_sort_hostlist(const char *hosts)
 			list_push_tail(previously_up, h);
 		}
 	} while (next_host);
+	pthread_mutex_unlock(&catalog_query_mutex);
 
 	return list_splice(previously_up, previously_down);
 }
 
 struct catalog_query *catalog_query_create(const char *hosts, struct jx *filter_expr, time_t stoptime)
+{
+	return catalog_query_create_fields(hosts, filter_expr, 0, -1, stoptime);
+}
+
+struct catalog_query *catalog_query_create_fields(const char *hosts, struct jx *filter_expr, const char **fields, int max_age, time_t stoptime)
 {
 	struct catalog_query *q = NULL;
 	char *n;
@@ -182,6 +611,17 @@ struct catalog_query *catalog_query_create(const char *hosts, struct jx *filter_
 
 	int backoff_interval = 1;
 
+	struct jx *jfields;
+	if (fields) {
+		jfields = jx_array(0);
+		int i;
+		for (i = 0; fields[i]; i++) {
+			jx_array_append(jfields, jx_string(fields[i]));
+		}
+	} else {
+		jfields = jx_null();
+	}
+
 	list_first_item(sorted_hosts);
 	while (time(NULL) < stoptime) {
 		if (!(h = list_next_item(sorted_hosts))) {
@@ -193,16 +633,26 @@ struct catalog_query *catalog_query_create(const char *hosts, struct jx *filter_
 
 			continue;
 		}
-		struct jx *j = catalog_query_send_query(h, filter_expr, time(NULL) + 5);
+		int legacy;
+		int filtered = 1;
+		struct jx *j = catalog_query_select(h, filter_expr, jfields, max_age, &legacy, time(NULL) + 5);
+		if (!j && legacy) {
+			j = catalog_query_send_query(h, filter_expr, time(NULL) + 5);
+			filtered = 0;
+		}
 
 		if (j) {
 			q = xxmalloc(sizeof(*q));
 			q->data = j;
 			q->current = j->u.items;
 			q->filter_expr = filter_expr;
+			q->fields = jfields;
+			q->filtered = filtered;
+			jfields = 0;
 
 			if (h->down) {
 				debug(D_DEBUG, "catalog server at %s is back up", h->host);
+				pthread_mutex_lock(&catalog_query_mutex);
 				set_first_element(down_hosts);
 				while ((n = set_next_element(down_hosts))) {
 					if (!strcmp(n, h->host)) {
@@ -211,12 +661,15 @@ struct catalog_query *catalog_query_create(const char *hosts, struct jx *filter_
 						break;
 					}
 				}
+				pthread_mutex_unlock(&catalog_query_mutex);
 			}
 			break;
 		} else {
 			if (!h->down) {
 				debug(D_DEBUG, "catalog server at %s seems to be down", h->host);
+				pthread_mutex_lock(&catalog_query_mutex);
 				set_insert(down_hosts, xxstrdup(h->host));
+				pthread_mutex_unlock(&catalog_query_mutex);
 			}
 		}
 	}
@@ -227,6 +680,7 @@ struct catalog_query *catalog_query_create(const char *hosts, struct jx *filter_
 		free(h);
 	}
 	list_delete(sorted_hosts);
+	jx_delete(jfields);
 	return q;
 }
 
@@ -236,7 +690,9 @@ struct jx *catalog_query_read(struct catalog_query *q, time_t stoptime)
 
 		int keepit = 1;
 
-		if (q->filter_expr) {
+		if (q->filtered) {
+			keepit = 1;
+		} else if (q->filter_expr) {
 			struct jx *b;
 			b = jx_eval(q->filter_expr, q->current->value);
 			if (jx_istype(b, JX_BOOLEAN) && b->u.boolean_value) {
@@ -250,7 +706,20 @@ struct jx *catalog_query_read(struct catalog_query *q, time_t stoptime)
 		}
 
 		if (keepit) {
-			struct jx *result = jx_copy(q->current->value);
+			struct jx *result;
+			if (!q->filtered && jx_istype(q->fields, JX_ARRAY)) {
+				/* The server did not project the fields, so do it here. */
+				result = jx_object(0);
+				struct jx *field;
+				void *i = NULL;
+				while ((field = jx_iterate_array(q->fields, &i))) {
+					struct jx *value = jx_lookup(q->current->value, field->u.string_value);
+					if (value)
+						jx_insert(result, jx_copy(field), jx_copy(value));
+				}
+			} else {
+				result = jx_copy(q->current->value);
+			}
 			q->current = q->current->next;
 			return result;
 		}
@@ -264,6 +733,7 @@ struct jx *catalog_query_read(struct catalog_query *q, time_t stoptime)
 void catalog_query_delete(struct catalog_query *q)
 {
 	jx_delete(q->filter_expr);
+	jx_delete(q->fields);
 	jx_delete(q->data);
 	free(q);
 }
@@ -42,6 +42,24 @@ If neither is set, the system will contact chirp.cse.nd.edu on port 9097.
 */
 struct catalog_query *catalog_query_create(const char *hosts, struct jx *filter_expr, time_t stoptime);
 
+/** Create a catalog query that returns only some fields of each record.
+Like @ref catalog_query_create, but the server evaluates the filter and
+returns only the named fields of each matching record, which is much
+less data when only a few fields are needed.
+A caller that repeats the same query may ask for its results to be cached
+in the process. Then only the records updated since the previous identical
+query are transferred, over a connection kept open to the server.
+@param hosts A comma delimited list of catalog servers to query, or null for the default server.
+@param filter_expr An optional expression to filter the results in JX syntax.
+ A null pointer indicates no filter.
+@param fields A null terminated array of field names to return, or null for all fields.
+@param max_age If negative, the results are not cached. Otherwise, cached results
+ fetched less than max_age seconds ago are returned without contacting the server.
+@param stoptime The absolute time at which to abort.
+@return A catalog query object on success, or null on failure.
+*/
+struct catalog_query *catalog_query_create_fields(const char *hosts, struct jx *filter_expr, const char **fields, int max_age, time_t stoptime);
+
 /** Read the next object from a query.
 Returns the next @ref jx expressions from the issued query.
 The caller may use @ref jx_lookup_string, @ref jx_lookup_integer and related
@@ -0,0 +1,252 @@
+/*
+Copyright (C) 2026 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#include "checksum.h"
+#include "load_average.h"
+#include "macros.h"
+#include "xxmalloc.h"
+
+#ifdef HAS_OPENSSL
+#include <openssl/evp.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Upper bound on threads, hashing is limited by the storage long before this. */
+#define CHECKSUM_MAX_THREADS 16
+
+struct checksum_job {
+	checksum_type_t type;
+	const char **paths;
+	int npaths;
+	unsigned char *digests;
+	int *status;
+	int nthreads;
+	int next;
+	int nsuccess;
+	pthread_mutex_t mutex;
+};
+
+/* Hint the kernel to start reading a file that will be hashed soon. */
+static void checksum_prefetch(const char *path)
+{
+#if defined(POSIX_FADV_WILLNEED)
+	int fd = open(path, O_RDONLY);
+	if (fd >= 0) {
+		posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+		close(fd);
+	}
+#endif
+}
+
+/*
+Files are hashed through OpenSSL when available, as it selects the best
+implementation for the running cpu (e.g. SHA-NI or AVX2 for SHA1).
+Otherwise, the portable md5 and sha1 modules are used.
+*/
+
+struct checksum_context {
+	checksum_type_t type;
+#ifdef HAS_OPENSSL
+	EVP_MD_CTX *evp;
+#else
+	md5_context_t md5;
+	sha1_context_t sha1;
+#endif
+};
+
+static void checksum_init(struct checksum_context *c, checksum_type_t type)
+{
+	c->type = type;
+#ifdef HAS_OPENSSL
+	c->evp = EVP_MD_CTX_create();
+	EVP_DigestInit_ex(c->evp, type == CHECKSUM_MD5 ? EVP_md5() : EVP_sha1(), NULL);
+#else
+	if (type == CHECKSUM_MD5) {
+		md5_init(&c->md5);
+	} else {
+		sha1_init(&c->sha1);
+	}
+#endif
+}
+
+static void checksum_update(struct checksum_context *c, const void *data, size_t length)
+{
+#ifdef HAS_OPENSSL
+	EVP_DigestUpdate(c->evp, data, length);
+#else
+	if (c->type == CHECKSUM_MD5) {
+		md5_update(&c->md5, data, length);
+	} else {
+		sha1_update(&c->sha1, data, length);
+	}
+#endif
+}
+
+static void checksum_final(struct checksum_context *c, unsigned char *digest)
+{
+#ifdef HAS_OPENSSL
+	EVP_DigestFinal_ex(c->evp, digest, NULL);
+	EVP_MD_CTX_destroy(c->evp);
+#else
+	if (c->type == CHECKSUM_MD5) {
+		md5_final(digest, &c->md5);
+	} else {
+		sha1_final(digest, &c->sha1);
+	}
+#endif
+}
+
+#define BUFFER_SIZE (1 << 20)
+
+/*
+Files are read rather than mapped: a file truncated by another process
+while it is being hashed, such as a cache file being rewritten, only
+ends a read early, where a mapping would raise SIGBUS in the caller.
+*/
+
+int checksum_file(checksum_type_t type, const char *path, unsigned char *digest)
+{
+	struct checksum_context c;
+	ssize_t n;
+
+	int fd = open(path, O_RDONLY | O_NOCTTY);
+	if (fd == -1)
+		return 0;
+
+#if defined(POSIX_FADV_SEQUENTIAL)
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	checksum_init(&c, type);
+
+	void *buffer = xxmalloc(BUFFER_SIZE);
+	while ((n = read(fd, buffer, BUFFER_SIZE)) > 0) {
+		checksum_update(&c, buffer, n);
+	}
+	free(buffer);
+
+	if (n < 0) {
+		int saved_errno = errno;
+		unsigned char discard[SHA1_DIGEST_LENGTH];
+		checksum_final(&c, discard);
+		close(fd);
+		errno = saved_errno;
+		return 0;
+	}
+
+	close(fd);
+	checksum_final(&c, digest);
+
+	return 1;
+}
+
+/*
+Threads claim files in order from a shared counter, and ask the kernel to
+read ahead the file that will be claimed after the ones in flight.
+Only reentrant functions may be called from here: checksum_file
+keeps all its state on the stack.
+*/
+
+static void *checksum_worker(void *arg)
+{
+	struct checksum_job *job = arg;
+	int length = checksum_digest_length(job->type);
+	int nsuccess = 0;
+
+	while (1) {
+		pthread_mutex_lock(&job->mutex);
+		int i = job->next++;
+		pthread_mutex_unlock(&job->mutex);
+
+		if (i >= job->npaths)
+			break;
+
+		if (i + job->nthreads < job->npaths) {
+			checksum_prefetch(job->paths[i + job->nthreads]);
+		}
+
+		unsigned char *digest = job->digests + (size_t)i * length;
+		int ok = checksum_file(job->type, job->paths[i], digest);
+		if (ok) {
+			nsuccess++;
+		} else {
+			memset(digest, 0, length);
+		}
+
+		if (job->status) {
+			job->status[i] = ok;
+		}
+	}
+
+	pthread_mutex_lock(&job->mutex);
+	job->nsuccess += nsuccess;
+	pthread_mutex_unlock(&job->mutex);
+
+	return 0;
+}
+
+int checksum_digest_length(checksum_type_t type)
+{
+	switch (type) {
+	case CHECKSUM_MD5:
+		return MD5_DIGEST_LENGTH;
+	case CHECKSUM_SHA1:
+		return SHA1_DIGEST_LENGTH;
+	}
+	return 0;
+}
+
+int checksum_files_parallel(checksum_type_t type, const char **paths, int npaths, unsigned char *digests, int *status, int nthreads)
+{
+	if (npaths < 1)
+		return 0;
+
+	if (nthreads < 1)
+		nthreads = load_average_get_cpus();
+
+	nthreads = MAX(1, MIN(MIN(nthreads, npaths), CHECKSUM_MAX_THREADS));
+
+	struct checksum_job job;
+	job.type = type;
+	job.paths = paths;
+	job.npaths = npaths;
+	job.digests = digests;
+	job.status = status;
+	job.nthreads = nthreads;
+	job.next = 0;
+	job.nsuccess = 0;
+	pthread_mutex_init(&job.mutex, 0);
+
+	/* start reading the first file of each thread */
+	for (int i = 0; i < nthreads; i++) {
+		checksum_prefetch(paths[i]);
+	}
+
+	/* the calling thread works as well, so start one fewer */
+	pthread_t threads[CHECKSUM_MAX_THREADS];
+	int started = 0;
+	for (int i = 1; i < nthreads; i++) {
+		if (pthread_create(&threads[started], 0, checksum_worker, &job) == 0) {
+			started++;
+		}
+	}
+
+	checksum_worker(&job);
+
+	for (int i = 0; i < started; i++) {
+		pthread_join(threads[i], 0);
+	}
+
+	pthread_mutex_destroy(&job.mutex);
+
+	return job.nsuccess;
+}
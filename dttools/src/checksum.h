@@ -0,0 +1,53 @@
+/*
+Copyright (C) 2026 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+/** @file checksum.h
+Compute MD5 or SHA1 checksums of many local files at once.
+The files are hashed concurrently by a small set of threads, and the
+kernel is asked to read ahead the next file of each thread while the
+current one is being hashed.
+*/
+
+#include "md5.h"
+#include "sha1.h"
+
+typedef enum {
+	CHECKSUM_MD5,
+	CHECKSUM_SHA1,
+} checksum_type_t;
+
+/** Length in bytes of the binary digest of a checksum type.
+@param type The checksum type.
+@return The digest length, either @ref MD5_DIGEST_LENGTH or @ref SHA1_DIGEST_LENGTH.
+*/
+int checksum_digest_length(checksum_type_t type);
+
+/** Checksum a local file.
+This produces the same digest as @ref md5_file or @ref sha1_file,
+but uses an implementation accelerated for the running cpu when available.
+@param type The checksum to compute.
+@param path Path to the file to checksum.
+@param digest Buffer of at least @ref checksum_digest_length(type) bytes for the binary digest.
+@return One on success, zero on failure.
+*/
+int checksum_file(checksum_type_t type, const char *path, unsigned char *digest);
+
+/** Checksum many local files in parallel.
+The digest of paths[i] is written in binary form at digests + i * @ref checksum_digest_length(type).
+@param type The checksum to compute.
+@param paths Array of paths of the files to checksum.
+@param npaths Number of entries in paths.
+@param digests Buffer of at least npaths * @ref checksum_digest_length(type) bytes for the digests.
+@param status If not null, array of npaths entries set to one if the file was checksummed, zero otherwise.
+@param nthreads Maximum number of files hashed at the same time. If less than one, the number of cpus is used.
+@return The number of files checksummed successfully.
+*/
+int checksum_files_parallel(checksum_type_t type, const char **paths, int npaths, unsigned char *digests, int *status, int nthreads);
+
+#endif
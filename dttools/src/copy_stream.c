@@ -23,6 +23,11 @@ See the file COPYING for details.
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(CCTOOLS_OPSYS_LINUX)
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+
 #define COPY_BUFFER_SIZE (1 << 16)
 
 int64_t copy_fd_to_stream(int fd, FILE *output)
@@ -99,6 +104,15 @@ int64_t copy_file_to_file(const char *input, const char *output)
 		return -1;
 	}
 
+#if defined(CCTOOLS_OPSYS_LINUX) && defined(FICLONE)
+	/* Where the filesystem allows it, share the blocks of the input instead of copying them. */
+	if (ioctl(out, FICLONE, in) == 0) {
+		close(in);
+		close(out);
+		return info.st_size;
+	}
+#endif
+
 	int64_t total = copy_fd_to_fd(in, out);
 
 	close(in);
@@ -133,6 +133,67 @@ int datagram_recv(struct datagram *d, char *data, int length, char *addr, int *p
 	return result;
 }
 
+int datagram_recv_batch(struct datagram *d, struct datagram_message *msgs, int count)
+{
+	char port_string[16];
+	int i, n;
+
+	if (count <= 0)
+		return 0;
+
+#if defined(CCTOOLS_OPSYS_LINUX)
+	struct mmsghdr hdrs[count];
+	struct iovec iovs[count];
+	struct sockaddr_storage iaddrs[count];
+
+	memset(hdrs, 0, sizeof(hdrs));
+	for (i = 0; i < count; i++) {
+		iovs[i].iov_base = msgs[i].data;
+		iovs[i].iov_len = msgs[i].length;
+		hdrs[i].msg_hdr.msg_iov = &iovs[i];
+		hdrs[i].msg_hdr.msg_iovlen = 1;
+		hdrs[i].msg_hdr.msg_name = &iaddrs[i];
+		hdrs[i].msg_hdr.msg_namelen = sizeof(iaddrs[i]);
+	}
+
+	do {
+		n = recvmmsg(d->fd, hdrs, count, MSG_DONTWAIT, 0);
+	} while (n < 0 && errno == EINTR);
+
+	if (n < 0)
+		return errno_is_temporary(errno) ? 0 : -1;
+
+	for (i = 0; i < n; i++) {
+		msgs[i].length = hdrs[i].msg_len;
+		getnameinfo((struct sockaddr *)&iaddrs[i], hdrs[i].msg_hdr.msg_namelen, msgs[i].addr, DATAGRAM_ADDRESS_MAX, port_string, sizeof(port_string), NI_NUMERICHOST | NI_NUMERICSERV);
+		msgs[i].port = atoi(port_string);
+	}
+#else
+	for (n = 0; n < count; n++) {
+		struct sockaddr_storage iaddr;
+		SOCKLEN_T iaddr_length = sizeof(iaddr);
+
+		int result = recvfrom(d->fd, msgs[n].data, msgs[n].length, MSG_DONTWAIT, (struct sockaddr *)&iaddr, &iaddr_length);
+		if (result < 0) {
+			if (errno == EINTR) {
+				n--;
+				continue;
+			} else if (errno_is_temporary(errno) || n > 0) {
+				break;
+			} else {
+				return -1;
+			}
+		}
+
+		msgs[n].length = result;
+		getnameinfo((struct sockaddr *)&iaddr, iaddr_length, msgs[n].addr, DATAGRAM_ADDRESS_MAX, port_string, sizeof(port_string), NI_NUMERICHOST | NI_NUMERICSERV);
+		msgs[n].port = atoi(port_string);
+	}
+#endif
+
+	return n;
+}
+
 int datagram_send(struct datagram *d, const char *data, int length, const char *addr, int port)
 {
 	int result;
@@ -98,6 +98,24 @@ void datagram_delete(struct datagram *d);
 */
 int datagram_recv(struct datagram *d, char *data, int length, char *addr, int *port, int timeout);
 
+/** A datagram received by @ref datagram_recv_batch. */
+struct datagram_message {
+	char *data;                      /**< Buffer provided by the caller to hold the message. */
+	int length;                      /**< On input, the size of data. On output, the number of bytes received. */
+	char addr[DATAGRAM_ADDRESS_MAX]; /**< Filled in with the IP address of the sender. */
+	int port;                        /**< Filled in with the port number of the sender. */
+};
+
+/** Receive several datagrams at once, without waiting.
+Where available, this uses a single system call for the whole batch,
+which is much cheaper than @ref datagram_recv when messages arrive quickly.
+@param d The datagram object.
+@param msgs An array of messages, each with data and length set to a buffer to fill in.
+@param count The number of elements in msgs.
+@return The number of datagrams received, which may be zero if none are waiting. On failure, returns less than zero and sets errno appropriately.
+*/
+int datagram_recv_batch(struct datagram *d, struct datagram_message *msgs, int count);
+
 /** Send a datagram.
 @param d The datagram object.
 @param data The data to send.
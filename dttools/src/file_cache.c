@@ -11,6 +11,8 @@ See the file COPYING for details.
 #include "domain_name_cache.h"
 #include "hash_table.h"
 #include "md5.h"
+#include "stats.h"
+#include "timestamp.h"
 
 #include <dirent.h>
 #include <errno.h>
@@ -20,6 +22,8 @@ See the file COPYING for details.
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
@@ -31,17 +35,79 @@ See the file COPYING for details.
 #define stat64 stat
 #define open64 open
 #define mkstemp64 mkstemp
+#define pread64 pread
+#define pwrite64 pwrite
+#define ftruncate64 ftruncate
 #endif
 
+/*
+The index is a table shared through mmap by every process that limits the
+size of the cache, and changed only while holding a lock on the index file.  It records the
+size and the last use of each entry, so that the least recently used entries
+can be evicted when the cache is over its limit, along with the space that
+each process has reserved for the files it is still fetching.  Entries are
+found by the digest of their path with linear probing, and a slot whose
+last_use is zero is empty.  The entries are also linked from the oldest to
+the newest use by their slot numbers, so that eviction need not search the
+table.
+*/
+
+#define INDEX_MAGIC "FCINDEX2"
+#define INDEX_SLOTS 65536
+#define INDEX_SLOTS_MAX (INDEX_SLOTS - INDEX_SLOTS / 8)
+#define INDEX_RESERVATIONS 256
+
+struct index_entry {
+	unsigned char digest[MD5_DIGEST_LENGTH];
+	int64_t size;
+	int64_t last_use;
+	int32_t older;
+	int32_t newer;
+};
+
+struct index_reservation {
+	int32_t pid;
+	uint32_t host;
+	int64_t size;
+};
+
+struct index {
+	char magic[8];
+	int64_t used;
+	int64_t clock;
+	int64_t entries;
+	int32_t oldest;
+	int32_t newest;
+	struct index_reservation reservations[INDEX_RESERVATIONS];
+	struct index_entry slots[INDEX_SLOTS];
+};
+
 struct file_cache {
 	char *root;
+	INT64_T limit;
+	int index_fd;
+	struct index *index;
+	uint32_t host;
 };
 
+static void digest_name(struct file_cache *c, unsigned char *digest, char *lpath)
+{
+	sprintf(lpath, "%s/%02x/%s", c->root, digest[0], md5_to_string(digest));
+}
+
 static void cached_name(struct file_cache *c, const char *path, char *lpath)
 {
 	unsigned char digest[MD5_DIGEST_LENGTH];
 	md5_buffer(path, strlen(path), digest);
-	sprintf(lpath, "%s/%02x/%s", c->root, digest[0], md5_to_string(digest));
+	digest_name(c, digest, lpath);
+}
+
+static void partial_names(struct file_cache *c, const char *path, char *lpath, char *mpath)
+{
+	char name[PATH_MAX];
+	cached_name(c, path, name);
+	sprintf(lpath, "%s.part", name);
+	sprintf(mpath, "%s.map", name);
 }
 
 static void txn_name(struct file_cache *c, const char *path, char *txn)
@@ -53,6 +119,324 @@ static void txn_name(struct file_cache *c, const char *path, char *txn)
 	sprintf(txn, "%s/txn/%s.%s.%d.XXXXXX", c->root, md5_to_string(digest), shortname, (int)getpid());
 }
 
+static void index_lock(struct file_cache *c)
+{
+	flock(c->index_fd, LOCK_EX);
+}
+
+static void index_unlock(struct file_cache *c)
+{
+	flock(c->index_fd, LOCK_UN);
+}
+
+static unsigned index_home(const unsigned char *digest)
+{
+	/* The first byte already picks the directory, so use the next ones. */
+	return (digest[1] | digest[2] << 8 | digest[3] << 16) % INDEX_SLOTS;
+}
+
+static struct index_entry *index_find(struct file_cache *c, const unsigned char *digest)
+{
+	unsigned i = index_home(digest);
+	while (c->index->slots[i].last_use) {
+		if (!memcmp(c->index->slots[i].digest, digest, MD5_DIGEST_LENGTH))
+			return &c->index->slots[i];
+		i = (i + 1) % INDEX_SLOTS;
+	}
+	return 0;
+}
+
+/* Point the neighbours in order of use at the entry in slot i, which has just been placed there. */
+static void index_link(struct file_cache *c, int i)
+{
+	struct index_entry *e = &c->index->slots[i];
+
+	if (e->older >= 0)
+		c->index->slots[e->older].newer = i;
+	else
+		c->index->oldest = i;
+
+	if (e->newer >= 0)
+		c->index->slots[e->newer].older = i;
+	else
+		c->index->newest = i;
+}
+
+static void index_unlink(struct file_cache *c, struct index_entry *e)
+{
+	if (e->older >= 0)
+		c->index->slots[e->older].newer = e->newer;
+	else
+		c->index->oldest = e->newer;
+
+	if (e->newer >= 0)
+		c->index->slots[e->newer].older = e->older;
+	else
+		c->index->newest = e->older;
+}
+
+/* Make an entry, linked or not, the most recently used. */
+static void index_use(struct file_cache *c, struct index_entry *e, int linked)
+{
+	if (linked)
+		index_unlink(c, e);
+
+	e->last_use = ++c->index->clock;
+	e->older = c->index->newest;
+	e->newer = -1;
+	index_link(c, e - c->index->slots);
+}
+
+static void index_remove(struct file_cache *c, struct index_entry *e)
+{
+	struct index_entry *slots = c->index->slots;
+	unsigned i = e - slots;
+	unsigned j = i;
+
+	c->index->used -= e->size;
+	c->index->entries--;
+	index_unlink(c, e);
+
+	/* Move back each later entry of the run that could no longer be found. */
+	while (1) {
+		j = (j + 1) % INDEX_SLOTS;
+		if (!slots[j].last_use)
+			break;
+		unsigned k = index_home(slots[j].digest);
+		if (i <= j ? (k <= i || k > j) : (k <= i && k > j)) {
+			slots[i] = slots[j];
+			index_link(c, i);
+			i = j;
+		}
+	}
+
+	memset(&slots[i], 0, sizeof(slots[i]));
+}
+
+static int64_t index_reserved(struct file_cache *c)
+{
+	int64_t total = 0;
+	int i;
+	for (i = 0; i < INDEX_RESERVATIONS; i++)
+		total += c->index->reservations[i].size;
+	return total;
+}
+
+/* Forget the reservations of processes on this host that have exited. */
+static void index_reap(struct file_cache *c)
+{
+	int i;
+	for (i = 0; i < INDEX_RESERVATIONS; i++) {
+		struct index_reservation *r = &c->index->reservations[i];
+		if (r->pid && r->host == c->host && kill(r->pid, 0) == -1 && errno == ESRCH) {
+			debug(D_CACHE, "dropping reservation of %" PRId64 " bytes (process %d gone)", r->size, (int)r->pid);
+			memset(r, 0, sizeof(*r));
+		}
+	}
+}
+
+/* The reservation of this process, or a free one for it, or null if all are taken. */
+static struct index_reservation *index_reservation(struct file_cache *c)
+{
+	struct index_reservation *empty = 0;
+	int i;
+
+	for (i = 0; i < INDEX_RESERVATIONS; i++) {
+		struct index_reservation *r = &c->index->reservations[i];
+		if (r->pid == getpid() && r->host == c->host)
+			return r;
+		else if (!r->pid && !empty)
+			empty = r;
+	}
+
+	return empty;
+}
+
+static int partial_retire(const char *lpath, const char *mpath, int wait);
+
+/* Evict an entry, unless it is a partial entry whose map another process holds. */
+static int index_evict(struct file_cache *c, struct index_entry *e)
+{
+	char name[PATH_MAX];
+	char lpath[PATH_MAX + 8];
+	char mpath[PATH_MAX + 8];
+
+	digest_name(c, e->digest, name);
+
+	/* The index is locked, so do not wait for a process holding the map. */
+	sprintf(lpath, "%s.part", name);
+	sprintf(mpath, "%s.map", name);
+	if (!partial_retire(lpath, mpath, 0)) {
+		debug(D_CACHE, "not evicting %s, which is in use", name);
+		return 0;
+	}
+
+	debug(D_CACHE, "evict %s (%" PRId64 " bytes)", name, e->size);
+	unlink(name);
+
+	stats_inc("file_cache.evictions", 1);
+	stats_inc("file_cache.evicted_bytes", e->size);
+
+	index_remove(c, e);
+	return 1;
+}
+
+/*
+Evict the least recently used entries, except the one given by keep and
+those in use, until the index has a free slot and size more bytes fit in
+the limit.  Returns false if that is not possible.
+*/
+
+static int index_make_room(struct file_cache *c, int64_t size, const unsigned char *keep)
+{
+	while (c->index->entries >= INDEX_SLOTS_MAX || (c->limit > 0 && c->index->used + index_reserved(c) + size > c->limit)) {
+		int i = c->index->oldest;
+
+		while (i >= 0) {
+			struct index_entry *e = &c->index->slots[i];
+			if (!(keep && !memcmp(e->digest, keep, MD5_DIGEST_LENGTH)) && index_evict(c, e))
+				break;
+			i = e->newer;
+		}
+
+		if (i < 0)
+			return 0;
+	}
+
+	return 1;
+}
+
+/* Record a use of an entry, which now holds size bytes, and evict others to make room for it. */
+static void index_update(struct file_cache *c, unsigned char *digest, int64_t size)
+{
+	struct index_entry *e = index_find(c, digest);
+
+	if (e) {
+		c->index->used += size - e->size;
+		e->size = size;
+		index_use(c, e, 1);
+	} else {
+		index_make_room(c, 0, 0);
+		unsigned i = index_home(digest);
+		while (c->index->slots[i].last_use)
+			i = (i + 1) % INDEX_SLOTS;
+		e = &c->index->slots[i];
+		memcpy(e->digest, digest, MD5_DIGEST_LENGTH);
+		e->size = size;
+		c->index->used += size;
+		c->index->entries++;
+		index_use(c, e, 0);
+	}
+
+	index_make_room(c, 0, digest);
+}
+
+static void index_touch(struct file_cache *c, const char *path, int64_t size)
+{
+	unsigned char digest[MD5_DIGEST_LENGTH];
+
+	if (!c->index)
+		return;
+
+	md5_buffer(path, strlen(path), digest);
+
+	index_lock(c);
+	struct index_entry *e = index_find(c, digest);
+	if (e) {
+		index_use(c, e, 1);
+	} else {
+		index_update(c, digest, size);
+	}
+	index_unlock(c);
+}
+
+/* Add the entries already in the cache to a new index. */
+static void index_scan(struct file_cache *c)
+{
+	char path[PATH_MAX];
+	int i;
+
+	for (i = 0; i <= 0xff; i++) {
+		struct dirent *d;
+		DIR *dir;
+
+		sprintf(path, "%s/%02x", c->root, i);
+		dir = opendir(path);
+		if (!dir)
+			continue;
+
+		while ((d = readdir(dir))) {
+			unsigned char digest[MD5_DIGEST_LENGTH];
+			struct stat64 info;
+			int j, n;
+
+			for (j = 0; j < MD5_DIGEST_LENGTH; j++) {
+				if (sscanf(&d->d_name[2 * j], "%2hhx%n", &digest[j], &n) != 1 || n != 2)
+					break;
+			}
+			if (j < MD5_DIGEST_LENGTH)
+				continue;
+			if (d->d_name[2 * MD5_DIGEST_LENGTH] && strcmp(&d->d_name[2 * MD5_DIGEST_LENGTH], ".part"))
+				continue;
+
+			sprintf(path, "%s/%02x/%s", c->root, i, d->d_name);
+			if (stat64(path, &info) == 0)
+				index_update(c, digest, info.st_size);
+		}
+
+		closedir(dir);
+	}
+
+	debug(D_CACHE, "indexed %" PRId64 " entries holding %" PRId64 " bytes", c->index->entries, c->index->used);
+}
+
+static void index_open(struct file_cache *c)
+{
+	char path[PATH_MAX];
+	struct stat64 info;
+	void *index;
+
+	sprintf(path, "%s/index", c->root);
+	c->index_fd = open64(path, O_RDWR | O_CREAT, 0777);
+	if (c->index_fd < 0) {
+		debug(D_CACHE, "couldn't open %s: %s", path, strerror(errno));
+		return;
+	}
+
+	fcntl(c->index_fd, F_SETFD, FD_CLOEXEC);
+
+	index_lock(c);
+
+	if (fstat64(c->index_fd, &info) < 0 || (info.st_size < (off_t)sizeof(struct index) && ftruncate64(c->index_fd, sizeof(struct index)) < 0)) {
+		debug(D_CACHE, "couldn't set up %s: %s", path, strerror(errno));
+		goto failure;
+	}
+
+	index = mmap(0, sizeof(struct index), PROT_READ | PROT_WRITE, MAP_SHARED, c->index_fd, 0);
+	if (index == MAP_FAILED) {
+		debug(D_CACHE, "couldn't map %s: %s", path, strerror(errno));
+		goto failure;
+	}
+
+	c->index = index;
+
+	if (memcmp(c->index->magic, INDEX_MAGIC, sizeof(c->index->magic))) {
+		debug(D_CACHE, "creating index %s", path);
+		memset(c->index, 0, sizeof(struct index));
+		c->index->oldest = c->index->newest = -1;
+		index_scan(c);
+		memcpy(c->index->magic, INDEX_MAGIC, sizeof(c->index->magic));
+	}
+
+	index_unlock(c);
+	return;
+
+failure:
+	index_unlock(c);
+	close(c->index_fd);
+	c->index_fd = -1;
+}
+
 static int wait_for_running_txn(struct file_cache *c, const char *path)
 {
 	char txn[PATH_MAX];
@@ -125,6 +509,14 @@ struct file_cache *file_cache_init(const char *root)
 		return 0;
 	}
 
+	f->limit = 0;
+	f->index_fd = -1;
+	f->index = 0;
+
+	char shortname[DOMAIN_NAME_MAX];
+	domain_name_cache_guess_short(shortname);
+	f->host = hash_string(shortname);
+
 	sprintf(path, "%s/ff", root);
 	result = stat64(path, &buf);
 	if (result != 0) {
@@ -151,6 +543,10 @@ failure:
 void file_cache_fini(struct file_cache *f)
 {
 	if (f) {
+		if (f->index)
+			munmap(f->index, sizeof(struct index));
+		if (f->index_fd >= 0)
+			close(f->index_fd);
 		free(f->root);
 		free(f);
 	}
@@ -201,6 +597,85 @@ void file_cache_cleanup(struct file_cache *f)
 	}
 
 	closedir(dir);
+
+	if (f->index) {
+		index_lock(f);
+		index_reap(f);
+		index_unlock(f);
+	}
+}
+
+void file_cache_set_limit(struct file_cache *c, INT64_T limit)
+{
+	c->limit = limit;
+
+	/* A cache without a limit never evicts, and so does not need the index. */
+	if (limit > 0 && !c->index)
+		index_open(c);
+	if (limit > 0 && !c->index)
+		debug(D_NOTICE, "cache %s has no index, so its size cannot be limited", c->root);
+}
+
+int file_cache_reserve(struct file_cache *c, INT64_T size)
+{
+	struct index_reservation *r;
+
+	if (!c->index || c->limit <= 0)
+		return 0;
+
+	if (size > c->limit) {
+		errno = ENOSPC;
+		return -1;
+	}
+
+	index_lock(c);
+
+	/* Only look for processes that have exited when their reservations are in the way. */
+	r = index_reservation(c);
+	if (!r || c->index->used + index_reserved(c) + size > c->limit) {
+		index_reap(c);
+		r = index_reservation(c);
+	}
+
+	if (!r) {
+		debug(D_CACHE, "all %d reservations of cache %s are taken", INDEX_RESERVATIONS, c->root);
+		index_unlock(c);
+		errno = ENOSPC;
+		return -1;
+	}
+
+	if (!index_make_room(c, size, 0)) {
+		index_unlock(c);
+		errno = ENOSPC;
+		return -1;
+	}
+
+	r->pid = getpid();
+	r->host = c->host;
+	r->size += size;
+
+	index_unlock(c);
+	return 0;
+}
+
+void file_cache_release(struct file_cache *c, INT64_T size)
+{
+	int i;
+
+	if (!c->index || c->limit <= 0)
+		return;
+
+	index_lock(c);
+	for (i = 0; i < INDEX_RESERVATIONS; i++) {
+		struct index_reservation *r = &c->index->reservations[i];
+		if (r->pid == getpid() && r->host == c->host) {
+			r->size -= size;
+			if (r->size <= 0)
+				memset(r, 0, sizeof(*r));
+			break;
+		}
+	}
+	index_unlock(c);
 }
 
 int file_cache_stat(struct file_cache *c, const char *path, char *lpath, struct stat64 *info)
@@ -222,6 +697,7 @@ int file_cache_contains(struct file_cache *c, const char *path, char *lpath)
 {
 	struct stat64 info;
 	if (file_cache_stat(c, path, lpath, &info) == 0) {
+		index_touch(c, path, info.st_size);
 		return 0;
 	} else {
 		return -1;
@@ -250,9 +726,12 @@ int file_cache_open(struct file_cache *c, const char *path, int flags, char *lpa
 		if (fstat64(fd, &info) == 0) {
 			if ((size == 0 || (size == info.st_size)) && ((mtime == 0) || (info.st_mtime >= mtime))) {
 				debug(D_CACHE, "hit %s %s", path, lpath);
+				stats_inc("file_cache.hits", 1);
+				index_touch(c, path, info.st_size);
 				return fd;
 			} else {
 				debug(D_CACHE, "stale %s %s", path, lpath);
+				stats_inc("file_cache.misses", 1);
 				close(fd);
 				errno = ENOENT;
 				return -1;
@@ -265,6 +744,7 @@ int file_cache_open(struct file_cache *c, const char *path, int flags, char *lpa
 		}
 	} else {
 		debug(D_CACHE, "miss %s %s", path, lpath);
+		stats_inc("file_cache.misses", 1);
 		return -1;
 	}
 }
@@ -272,9 +752,33 @@ int file_cache_open(struct file_cache *c, const char *path, int flags, char *lpa
 int file_cache_delete(struct file_cache *f, const char *path)
 {
 	char lpath[PATH_MAX];
+	char mpath[PATH_MAX];
+	int result;
+
+	/* The map is always locked before the index, as in file_cache_partial_commit. */
+	partial_names(f, path, lpath, mpath);
+	partial_retire(lpath, mpath, 1);
+
+	if (f->index) {
+		unsigned char digest[MD5_DIGEST_LENGTH];
+		md5_buffer(path, strlen(path), digest);
+		index_lock(f);
+		struct index_entry *e = index_find(f, digest);
+		if (e)
+			index_remove(f, e);
+	}
+
 	cached_name(f, path, lpath);
 	debug(D_CACHE, "remove %s %s", path, lpath);
-	return unlink(lpath);
+	result = unlink(lpath);
+
+	if (f->index) {
+		int save_errno = errno;
+		index_unlock(f);
+		errno = save_errno;
+	}
+
+	return result;
 }
 
 int file_cache_begin(struct file_cache *f, const char *path, char *txn)
@@ -299,11 +803,287 @@ int file_cache_commit(struct file_cache *f, const char *path, const char *txn)
 {
 	int result;
 	char lpath[PATH_MAX];
-	cached_name(f, path, lpath);
+	unsigned char digest[MD5_DIGEST_LENGTH];
+	struct stat64 info;
+
+	md5_buffer(path, strlen(path), digest);
+	digest_name(f, digest, lpath);
 	debug(D_CACHE, "commit %s %s %s", path, txn, lpath);
+
+	/* Entries appear and are evicted only under the lock, so that the index matches the disk. */
+	if (f->index)
+		index_lock(f);
+
 	result = rename(txn, lpath);
-	if (result < 0)
+	if (result < 0) {
+		debug(D_CACHE, "commit failed: %s", strerror(errno));
+	} else if (f->index && stat64(lpath, &info) == 0) {
+		index_update(f, digest, info.st_size);
+	}
+
+	if (f->index) {
+		int save_errno = errno;
+		index_unlock(f);
+		errno = save_errno;
+	}
+
+	return result;
+}
+
+/*
+The map of a partial entry begins with a header recording the file it
+describes, followed by one byte per block.  A byte rather than a bit per
+block lets processes sharing the cache mark blocks at the same time.
+
+Whenever the entry is reset for a new version of the file, the local file
+is replaced, and the generation in the header is incremented.  When the
+entry is deleted or evicted, the generation is incremented before the map
+is unlinked, and a new map starts from the current time rather than from
+one, so that a generation is never reused for the same path.  A process
+which opened the previous version keeps writing blocks to the old local
+file, which is no longer in the cache, and is refused by the map, so that
+blocks of the two versions are never mixed.  Checking the generation and
+marking blocks are done under a shared lock, and resetting, retiring, and
+committing under an exclusive one.
+*/
+
+#define PARTIAL_MAGIC "FCPART2\n"
+
+struct partial_header {
+	char magic[8];
+	int64_t size;
+	int64_t mtime;
+	int64_t block_size;
+	int64_t generation;
+};
+
+/* Return true if the map is still in the cache and describes the given generation, with the map locked by the caller. */
+
+static int partial_current(int mapfd, INT64_T generation)
+{
+	struct partial_header have;
+	struct stat64 info;
+
+	if (fstat64(mapfd, &info) == 0 && info.st_nlink > 0 && pread64(mapfd, &have, sizeof(have), 0) == sizeof(have) && have.generation == generation)
+		return 1;
+
+	errno = ESTALE;
+	return 0;
+}
+
+/*
+Remove a partial entry, first moving its map to the next generation so
+that processes still holding it are refused.  If wait is false and another
+process holds the map, the entry is left alone, and false is returned.
+*/
+
+static int partial_retire(const char *lpath, const char *mpath, int wait)
+{
+	struct partial_header have;
+	int mfd;
+
+	mfd = open64(mpath, O_RDWR);
+	if (mfd >= 0) {
+		if (flock(mfd, wait ? LOCK_EX : LOCK_EX | LOCK_NB) == 0) {
+			if (pread64(mfd, &have, sizeof(have), 0) == sizeof(have) && !memcmp(have.magic, PARTIAL_MAGIC, sizeof(have.magic))) {
+				have.generation++;
+				pwrite64(mfd, &have, sizeof(have), 0);
+			}
+			unlink(lpath);
+			unlink(mpath);
+			flock(mfd, LOCK_UN);
+			close(mfd);
+			return 1;
+		}
+		close(mfd);
+		return 0;
+	}
+
+	unlink(lpath);
+	unlink(mpath);
+	return 1;
+}
+
+int file_cache_partial_open(struct file_cache *c, const char *path, char *lpath, int *mapfd, INT64_T *generation, INT64_T size, time_t mtime, int block_size)
+{
+	char mpath[PATH_MAX];
+	struct partial_header want, have;
+	int fd = -1, mfd;
+
+	if (c->index && c->limit > 0 && size > c->limit) {
+		errno = ENOSPC;
+		return -1;
+	}
+
+	partial_names(c, path, lpath, mpath);
+
+	memset(&want, 0, sizeof(want));
+	memcpy(want.magic, PARTIAL_MAGIC, sizeof(want.magic));
+	want.size = size;
+	want.mtime = mtime;
+	want.block_size = block_size;
+
+	/* Only one process may check or reset the entry at a time, and it may have been retired before it was locked. */
+	while (1) {
+		struct stat64 info;
+
+		mfd = open64(mpath, O_RDWR | O_CREAT, 0700);
+		if (mfd < 0)
+			return -1;
+
+		flock(mfd, LOCK_EX);
+		if (fstat64(mfd, &info) == 0 && info.st_nlink > 0)
+			break;
+
+		flock(mfd, LOCK_UN);
+		close(mfd);
+	}
+
+	memset(&have, 0, sizeof(have));
+	int valid = pread64(mfd, &have, sizeof(have), 0) == sizeof(have) && !memcmp(have.magic, want.magic, sizeof(want.magic));
+
+	if (valid && have.size == want.size && have.mtime == want.mtime && have.block_size == want.block_size) {
+		fd = open64(lpath, O_RDWR);
+		if (fd >= 0)
+			debug(D_CACHE, "partial hit %s %s", path, lpath);
+	}
+
+	if (fd < 0) {
+		debug(D_CACHE, "partial begin %s %s", path, lpath);
+		want.generation = valid ? have.generation + 1 : 0;
+		if (want.generation < (int64_t)timestamp_get())
+			want.generation = timestamp_get();
+		unlink(lpath);
+		fd = open64(lpath, O_RDWR | O_CREAT | O_EXCL, 0700);
+		if (fd < 0 || ftruncate64(fd, size) < 0 || ftruncate64(mfd, 0) < 0 || pwrite64(mfd, &want, sizeof(want), 0) != sizeof(want)) {
+			int s = errno;
+			flock(mfd, LOCK_UN);
+			close(mfd);
+			if (fd >= 0)
+				close(fd);
+			errno = s;
+			return -1;
+		}
+		have = want;
+	}
+
+	flock(mfd, LOCK_UN);
+
+	/* A partial entry may grow to the whole file, so it is charged for all of it. */
+	if (c->index) {
+		unsigned char digest[MD5_DIGEST_LENGTH];
+		md5_buffer(path, strlen(path), digest);
+		index_lock(c);
+		index_update(c, digest, size);
+		index_unlock(c);
+	}
+
+	*mapfd = mfd;
+	*generation = have.generation;
+	return fd;
+}
+
+void file_cache_partial_touch(struct file_cache *c, const char *path)
+{
+	unsigned char digest[MD5_DIGEST_LENGTH];
+	struct index_entry *e;
+
+	if (!c->index)
+		return;
+
+	md5_buffer(path, strlen(path), digest);
+
+	/* Unlike index_touch, an entry that has been evicted is not added again. */
+	index_lock(c);
+	e = index_find(c, digest);
+	if (e)
+		index_use(c, e, 1);
+	index_unlock(c);
+}
+
+int file_cache_partial_get(int mapfd, INT64_T generation, INT64_T block, INT64_T count, char *present)
+{
+	ssize_t actual = -1;
+
+	flock(mapfd, LOCK_SH);
+	if (partial_current(mapfd, generation))
+		actual = pread64(mapfd, present, count, sizeof(struct partial_header) + block);
+	int s = errno;
+	flock(mapfd, LOCK_UN);
+	errno = s;
+
+	if (actual < 0)
+		return -1;
+
+	/* Blocks past the end of the map have not been written yet. */
+	memset(present + actual, 0, count - actual);
+	return 0;
+}
+
+int file_cache_partial_set(int mapfd, INT64_T generation, INT64_T block, INT64_T count)
+{
+	char buffer[4096];
+	int result = 0;
+	memset(buffer, 1, sizeof(buffer));
+
+	flock(mapfd, LOCK_SH);
+
+	if (!partial_current(mapfd, generation))
+		result = -1;
+
+	while (result == 0 && count > 0) {
+		INT64_T chunk = count < (INT64_T)sizeof(buffer) ? count : (INT64_T)sizeof(buffer);
+		if (pwrite64(mapfd, buffer, chunk, sizeof(struct partial_header) + block) != chunk)
+			result = -1;
+		block += chunk;
+		count -= chunk;
+	}
+
+	int s = errno;
+	flock(mapfd, LOCK_UN);
+	errno = s;
+
+	return result;
+}
+
+int file_cache_partial_commit(struct file_cache *c, const char *path, const char *lpath, int fd, int mapfd, INT64_T generation)
+{
+	char name[PATH_MAX];
+	char mpath[PATH_MAX];
+	char ppath[PATH_MAX];
+	struct stat64 mine, theirs;
+
+	partial_names(c, path, ppath, mpath);
+	cached_name(c, path, name);
+
+	debug(D_CACHE, "partial commit %s %s %s", path, lpath, name);
+
+	flock(mapfd, LOCK_EX);
+
+	/* The local file must also be the one that was filled, and not one since created for the same path. */
+	if (!partial_current(mapfd, generation) || fstat64(fd, &mine) < 0 || stat64(lpath, &theirs) < 0 || mine.st_dev != theirs.st_dev || mine.st_ino != theirs.st_ino) {
+		debug(D_CACHE, "commit failed: %s was reset", path);
+		flock(mapfd, LOCK_UN);
+		errno = ESTALE;
+		return -1;
+	}
+
+	if (c->index)
+		index_lock(c);
+
+	int result = rename(lpath, name);
+	if (result < 0) {
 		debug(D_CACHE, "commit failed: %s", strerror(errno));
+	} else {
+		unlink(mpath);
+	}
+
+	int save_errno = errno;
+	if (c->index)
+		index_unlock(c);
+	flock(mapfd, LOCK_UN);
+	errno = save_errno;
+
 	return result;
 }
 
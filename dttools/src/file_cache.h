@@ -16,6 +16,20 @@ struct file_cache *file_cache_init(const char *root);
 void file_cache_fini(struct file_cache *c);
 void file_cache_cleanup(struct file_cache *c);
 
+/*
+The cache may be limited to a number of bytes, shared by all processes using
+it, by evicting the least recently used entries.  A process fetching a file
+first reserves space for it, and releases the reservation just before the
+file is committed or aborted.  Reservations fail with ENOSPC if the space
+cannot be found, or if too many processes already hold reservations.  A limit
+of zero means no limit, and then nothing is ever evicted, however many
+entries the cache holds.
+*/
+
+void file_cache_set_limit(struct file_cache *c, INT64_T limit);
+int file_cache_reserve(struct file_cache *c, INT64_T size);
+void file_cache_release(struct file_cache *c, INT64_T size);
+
 int file_cache_open(struct file_cache *c, const char *path, int flags, char *lpath, INT64_T size, time_t mtime);
 int file_cache_delete(struct file_cache *f, const char *path);
 int file_cache_contains(struct file_cache *f, const char *path, char *lpath);
@@ -24,4 +38,30 @@ int file_cache_begin(struct file_cache *c, const char *path, char *txn);
 int file_cache_commit(struct file_cache *c, const char *path, const char *txn);
 int file_cache_abort(struct file_cache *c, const char *path, const char *txn);
 
+/*
+A partial entry holds only the blocks of a file that have been read so far,
+each at its own offset in a sparse local file, with a map recording which
+blocks are present.  file_cache_partial_open returns the local file, and the
+map in mapfd, discarding the blocks if the size, mtime, or block size of the
+file has changed.  A partial entry is charged for the whole file against the
+limit of the cache, and cannot be opened for a file larger than the limit.
+Once every block is present, file_cache_partial_commit makes the local file
+an ordinary entry of the cache.  A process reading a partial entry records
+each use with file_cache_partial_touch, so that it is not evicted as the
+least recently used while it is still being read.  An entry whose map is
+locked by another process is never evicted.
+
+Each time the blocks are discarded, the entry gets a new generation, which
+file_cache_partial_open also returns.  The other calls take the generation,
+and fail with ESTALE once the entry has been discarded, deleted, or evicted
+by another process.  file_cache_partial_commit also takes the local file
+that was filled, and fails with ESTALE if it is no longer the one at lpath.
+*/
+
+int file_cache_partial_open(struct file_cache *c, const char *path, char *lpath, int *mapfd, INT64_T *generation, INT64_T size, time_t mtime, int block_size);
+void file_cache_partial_touch(struct file_cache *c, const char *path);
+int file_cache_partial_get(int mapfd, INT64_T generation, INT64_T block, INT64_T count, char *present);
+int file_cache_partial_set(int mapfd, INT64_T generation, INT64_T block, INT64_T count);
+int file_cache_partial_commit(struct file_cache *c, const char *path, const char *lpath, int fd, int mapfd, INT64_T generation);
+
 #endif
@@ -18,6 +18,8 @@ See the file COPYING for details.
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <time.h>
 #include <unistd.h>
 
 #define HTTP_LINE_MAX 4096
@@ -62,10 +64,12 @@ struct link *http_query(const char *url, const char *action, time_t stoptime)
 	return http_query_size(url, action, &size, stoptime, 0);
 }
 
-struct link *http_query_size(const char *url, const char *action, INT64_T *size, time_t stoptime, int cache_reload)
+static struct link *http_query_range_via_proxy(const char *proxy, const char *urlin, const char *action, INT64_T offset, INT64_T length, INT64_T *size, time_t *mtime, time_t stoptime, int cache_reload);
+
+static struct link *http_query_range_any_proxy(const char *url, const char *action, INT64_T offset, INT64_T length, INT64_T *size, time_t *mtime, time_t stoptime, int cache_reload)
 {
 	if (!getenv("HTTP_PROXY")) {
-		return http_query_size_via_proxy(0, url, action, size, stoptime, cache_reload);
+		return http_query_range_via_proxy(0, url, action, offset, length, size, mtime, stoptime, cache_reload);
 	} else {
 		char proxies[HTTP_LINE_MAX];
 		char *proxy;
@@ -75,7 +79,7 @@ struct link *http_query_size(const char *url, const char *action, INT64_T *size,
 
 		while (proxy) {
 			struct link *result;
-			result = http_query_size_via_proxy(proxy, url, action, size, stoptime, cache_reload);
+			result = http_query_range_via_proxy(proxy, url, action, offset, length, size, mtime, stoptime, cache_reload);
 			if (result)
 				return result;
 			proxy = strtok(0, ";");
@@ -84,7 +88,43 @@ struct link *http_query_size(const char *url, const char *action, INT64_T *size,
 	}
 }
 
-struct link *http_query_size_via_proxy(const char *proxy, const char *urlin, const char *action, INT64_T *size, time_t stoptime, int cache_reload)
+struct link *http_query_size(const char *url, const char *action, INT64_T *size, time_t stoptime, int cache_reload)
+{
+	return http_query_range_any_proxy(url, action, 0, 0, size, 0, stoptime, cache_reload);
+}
+
+struct link *http_query_size_mtime(const char *url, const char *action, INT64_T *size, time_t *mtime, time_t stoptime, int cache_reload)
+{
+	return http_query_range_any_proxy(url, action, 0, 0, size, mtime, stoptime, cache_reload);
+}
+
+struct link *http_query_range(const char *url, const char *action, INT64_T offset, INT64_T length, INT64_T *size, time_t stoptime)
+{
+	return http_query_range_any_proxy(url, action, offset, length, size, 0, stoptime, 0);
+}
+
+struct link *http_query_size_via_proxy(const char *proxy, const char *url, const char *action, INT64_T *size, time_t stoptime, int cache_reload)
+{
+	return http_query_range_via_proxy(proxy, url, action, 0, 0, size, 0, stoptime, cache_reload);
+}
+
+/* Parse the date of a Last-Modified header, which is always in GMT, or return zero. */
+
+static time_t http_parse_date(const char *date)
+{
+	struct tm tm;
+
+	while (isspace((unsigned char)*date))
+		date++;
+
+	memset(&tm, 0, sizeof(tm));
+	if (!strptime(date, "%a, %d %b %Y %H:%M:%S GMT", &tm))
+		return 0;
+
+	return timegm(&tm);
+}
+
+static struct link *http_query_range_via_proxy(const char *proxy, const char *urlin, const char *action, INT64_T offset, INT64_T length, INT64_T *size, time_t *mtime, time_t stoptime, int cache_reload)
 {
 	char url[HTTP_LINE_MAX];
 	char newurl[HTTP_LINE_MAX];
@@ -96,6 +136,8 @@ struct link *http_query_size_via_proxy(const char *proxy, const char *urlin, con
 	char actual_host[HTTP_LINE_MAX];
 	int actual_port;
 	*size = 0;
+	if (mtime)
+		*mtime = 0;
 
 	url_encode(urlin, url, sizeof(url));
 
@@ -153,6 +195,8 @@ struct link *http_query_size_via_proxy(const char *proxy, const char *urlin, con
 		buffer_printf(&B, "%s %s HTTP/1.1\r\n", action, url);
 		if (cache_reload)
 			buffer_putliteral(&B, "Cache-Control: max-age=0\r\n");
+		if (length > 0)
+			buffer_printf(&B, "Range: bytes=%" PRId64 "-%" PRId64 "\r\n", offset, offset + length - 1);
 		buffer_putliteral(&B, "Connection: close\r\n");
 		buffer_printf(&B, "Host: %s\r\n", actual_host);
 		if (getenv("HTTP_USER_AGENT"))
@@ -177,6 +221,8 @@ struct link *http_query_size_via_proxy(const char *proxy, const char *urlin, con
 				debug(D_HTTP, "%s", line);
 				sscanf(line, "Location: %s", newurl);
 				sscanf(line, "Content-Length: %" SCNd64, size);
+				if (mtime && !strncasecmp(line, "Last-Modified:", 14))
+					*mtime = http_parse_date(line + 14);
 				if (strlen(line) <= 2) {
 					break;
 				}
@@ -184,6 +230,19 @@ struct link *http_query_size_via_proxy(const char *proxy, const char *urlin, con
 
 			switch (response) {
 			case 200:
+				if (length > 0 && offset > 0) {
+					/* The server ignored the range, so skip to the start of it. */
+					debug(D_HTTP, "server does not support ranges, skipping %" PRId64 " bytes", offset);
+					if (link_soak(link, offset, stoptime) != offset) {
+						link_close(link);
+						errno = ECONNRESET;
+						return 0;
+					}
+					*size -= offset;
+				}
+				return link;
+				break;
+			case 206:
 				return link;
 				break;
 			case 301:
@@ -197,7 +256,7 @@ struct link *http_query_size_via_proxy(const char *proxy, const char *urlin, con
 						errno = EIO;
 						return 0;
 					} else {
-						return http_query_size_via_proxy(proxy, newurl, action, size, stoptime, cache_reload);
+						return http_query_range_via_proxy(proxy, newurl, action, offset, length, size, mtime, stoptime, cache_reload);
 					}
 				} else {
 					errno = ENOENT;
@@ -14,8 +14,23 @@ See the file COPYING for details.
 struct link *http_query(const char *url, const char *action, time_t stoptime);
 struct link *http_query_no_cache(const char *url, const char *action, time_t stoptime);
 struct link *http_query_size(const char *url, const char *action, INT64_T * size, time_t stoptime, int cache_reload);
+
+/*
+As http_query_size, and also set mtime to the Last-Modified time given
+by the server, or to zero if it gives none.
+*/
+struct link *http_query_size_mtime(const char *url, const char *action, INT64_T * size, time_t * mtime, time_t stoptime, int cache_reload);
+
 struct link *http_query_size_via_proxy(const char *proxy, const char *url, const char *action, INT64_T * size, time_t stoptime, int cache_reload);
 
+/*
+Fetch length bytes of url starting at offset, using an HTTP range request.
+On success, the link is positioned at offset and size is set to the number
+of bytes that follow, which may be more than length if the server does not
+support ranges.
+*/
+struct link *http_query_range(const char *url, const char *action, INT64_T offset, INT64_T length, INT64_T *size, time_t stoptime);
+
 INT64_T http_fetch_to_file(const char *url, const char *filename, time_t stoptime);
 
 #endif
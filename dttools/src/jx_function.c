@@ -307,8 +307,11 @@ struct jx *jx_function_range(struct jx *args)
 		goto FAILURE;
 	}
 
+	// keep the tail, since appending walks the whole list
+	struct jx_item **tail = &result->u.items;
 	for (jx_int_t i = start; stop >= start ? i < stop : i > stop; i += step) {
-		jx_array_append(result, jx_integer(i));
+		*tail = jx_item(jx_integer(i), NULL);
+		tail = &(*tail)->next;
 	}
 
 FAILURE:
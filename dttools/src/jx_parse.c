@@ -81,7 +81,8 @@ struct jx_parser {
 	double double_value;
 };
 
-static bool static_mode = false;
+/* Per thread, so that threads parsing different streams do not interfere. */
+static __thread bool static_mode = false;
 
 void jx_parse_set_static_mode(bool mode)
 {
@@ -11,6 +11,7 @@ See the file COPYING for details.
 #include "debug.h"
 #include "domain_name.h"
 #include "full_io.h"
+#include "hash_table.h"
 #include "macros.h"
 #include "stringtools.h"
 
@@ -18,8 +19,12 @@ See the file COPYING for details.
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <poll.h>
+#include <pthread.h>
 #include <sys/file.h>
 #include <sys/ioctl.h>
+#ifdef CCTOOLS_OPSYS_LINUX
+#include <sys/sendfile.h>
+#endif
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -52,6 +57,27 @@ See the file COPYING for details.
 #include "openssl/err.h"
 #include "openssl/ssl.h"
 static int openssl_initialized = 0;
+
+/* Session tickets and resumption need contexts shared across links and
+ * SSL_SESSION_is_resumable, available since OpenSSL 1.1.1. */
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+#define LINK_SSL_SESSION_RESUMPTION
+#endif
+
+#ifdef LINK_SSL_SESSION_RESUMPTION
+/* Client context shared by all connecting links, so that sessions can be resumed. */
+static SSL_CTX *ssl_client_ctx = 0;
+
+/* Last session received from each server, indexed by "sni@addr:port". */
+static struct hash_table *ssl_client_sessions = 0;
+
+/* Server contexts indexed by key and certificate file, so that session
+ * tickets issued by one accepted link are accepted by the next. */
+static struct hash_table *ssl_server_ctxs = 0;
+
+/* Guards the three above, as links may be wrapped from several threads. */
+static pthread_mutex_t ssl_ctxs_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
 #endif
 
 enum link_type {
@@ -431,6 +457,15 @@ static SSL_CTX *_create_ssl_context()
 	return ctx;
 }
 
+static void _enable_ssl_ktls(SSL_CTX *ctx)
+{
+#ifdef SSL_OP_ENABLE_KTLS
+	/* Let the kernel do the record encryption when it supports the negotiated
+	 * cipher. OpenSSL silently falls back to user space otherwise. */
+	SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+#endif
+}
+
 static void _set_ssl_keys(SSL_CTX *ctx, const char *ssl_key, const char *ssl_cert)
 {
 	debug(D_SSL, "setting certificate and key");
@@ -454,6 +489,109 @@ static void _set_ssl_keys(SSL_CTX *ctx, const char *ssl_key, const char *ssl_cer
 		}
 	}
 }
+
+#ifdef LINK_SSL_SESSION_RESUMPTION
+static char *_ssl_session_key(struct link *link, const char *sni_hostname)
+{
+	return string_format("%s@%s:%d", sni_hostname ? sni_hostname : "", link->raddr, link->rport);
+}
+
+static int _ssl_new_session_cb(SSL *ssl, SSL_SESSION *session)
+{
+	struct link *link = SSL_get_app_data(ssl);
+	if (!link) {
+		return 0;
+	}
+
+	char *key = _ssl_session_key(link, SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name));
+
+	pthread_mutex_lock(&ssl_ctxs_mutex);
+	SSL_SESSION *old = hash_table_remove(ssl_client_sessions, key);
+	if (old) {
+		SSL_SESSION_free(old);
+	}
+	hash_table_insert(ssl_client_sessions, key, session);
+	pthread_mutex_unlock(&ssl_ctxs_mutex);
+
+	debug(D_SSL, "saved session for %s", key);
+	free(key);
+
+	/* we keep the reference to the session */
+	return 1;
+}
+
+static SSL_CTX *_get_ssl_client_context()
+{
+	pthread_mutex_lock(&ssl_ctxs_mutex);
+	if (!ssl_client_ctx) {
+		ssl_client_ctx = _create_ssl_context();
+		_enable_ssl_ktls(ssl_client_ctx);
+
+		/* sessions are saved by the callback, and set explicitely on each connection */
+		SSL_CTX_set_session_cache_mode(ssl_client_ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+		SSL_CTX_sess_set_new_cb(ssl_client_ctx, _ssl_new_session_cb);
+
+		ssl_client_sessions = hash_table_create(0, 0);
+	}
+
+	SSL_CTX *ctx = ssl_client_ctx;
+	SSL_CTX_up_ref(ctx);
+	pthread_mutex_unlock(&ssl_ctxs_mutex);
+
+	return ctx;
+}
+
+static SSL_CTX *_get_ssl_server_context(const char *ssl_key, const char *ssl_cert)
+{
+	pthread_mutex_lock(&ssl_ctxs_mutex);
+	if (!ssl_server_ctxs) {
+		ssl_server_ctxs = hash_table_create(0, 0);
+	}
+
+	char *key = string_format("%s\n%s", ssl_key, ssl_cert);
+
+	SSL_CTX *ctx = hash_table_lookup(ssl_server_ctxs, key);
+	if (!ctx) {
+		ctx = _create_ssl_context();
+		_set_ssl_keys(ctx, ssl_key, ssl_cert);
+		_enable_ssl_ktls(ctx);
+
+		/* the server keeps a session cache and issues tickets, which are
+		 * encrypted with a key private to this context. */
+		static const unsigned char sid_ctx[] = "cctools-link";
+		SSL_CTX_set_session_id_context(ctx, sid_ctx, sizeof(sid_ctx) - 1);
+		SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+
+		hash_table_insert(ssl_server_ctxs, key, ctx);
+	}
+	free(key);
+
+	SSL_CTX_up_ref(ctx);
+	pthread_mutex_unlock(&ssl_ctxs_mutex);
+
+	return ctx;
+}
+#endif
+
+static void _debug_ssl_state(struct link *link)
+{
+	debug(D_SSL,
+			"%s port %d: %s, %s, session %s",
+			link->raddr,
+			link->rport,
+			SSL_get_version(link->ssl),
+			SSL_get_cipher_name(link->ssl),
+			SSL_session_reused(link->ssl) ? "resumed" : "new");
+
+#ifdef SSL_OP_ENABLE_KTLS
+	debug(D_SSL,
+			"%s port %d: kernel tls send %s, receive %s",
+			link->raddr,
+			link->rport,
+			BIO_get_ktls_send(SSL_get_wbio(link->ssl)) ? "on" : "off",
+			BIO_get_ktls_recv(SSL_get_rbio(link->ssl)) ? "on" : "off");
+#endif
+}
 #endif
 
 struct link *link_serve_address(const char *addr, int port)
@@ -561,8 +699,13 @@ int link_ssl_wrap_accept(struct link *link, const char *key, const char *cert)
 			return 0;
 		}
 
+#ifdef LINK_SSL_SESSION_RESUMPTION
+		link->ctx = _get_ssl_server_context(key, cert);
+#else
 		link->ctx = _create_ssl_context();
 		_set_ssl_keys(link->ctx, key, cert);
+		_enable_ssl_ktls(link->ctx);
+#endif
 
 		link->ssl = SSL_new(link->ctx);
 		SSL_set_fd(link->ssl, link->fd);
@@ -572,6 +715,8 @@ int link_ssl_wrap_accept(struct link *link, const char *key, const char *cert)
 			debug(D_SSL, "ssl accept failed from %s port %d", link->raddr, link->rport);
 			ERR_print_errors_cb(_ssl_errors_cb, /* use warn */ (void *)1);
 			ret = 0;
+		} else {
+			_debug_ssl_state(link);
 		}
 
 		if (!link_nonblocking(link, 1)) {
@@ -595,7 +740,12 @@ int link_ssl_wrap_connect(struct link *link, const char *sni_hostname)
 		return 0;
 	}
 
+#ifdef LINK_SSL_SESSION_RESUMPTION
+	link->ctx = _get_ssl_client_context();
+#else
 	link->ctx = _create_ssl_context();
+	_enable_ssl_ktls(link->ctx);
+#endif
 	link->ssl = SSL_new(link->ctx);
 	SSL_set_fd(link->ssl, link->fd);
 
@@ -608,6 +758,26 @@ int link_ssl_wrap_connect(struct link *link, const char *sni_hostname)
 	debug(D_SSL, "Setting SNI to: %s", name);
 	SSL_set_tlsext_host_name(link->ssl, name);
 
+#ifdef LINK_SSL_SESSION_RESUMPTION
+	/* offer the last session from this server, if any, to skip the full handshake */
+	SSL_set_app_data(link->ssl, link);
+
+	/* SSL_set_session takes its own reference, so the session outlives the lock. */
+	char *session_key = _ssl_session_key(link, name);
+	pthread_mutex_lock(&ssl_ctxs_mutex);
+	SSL_SESSION *session = hash_table_lookup(ssl_client_sessions, session_key);
+	if (session) {
+		if (SSL_SESSION_is_resumable(session)) {
+			SSL_set_session(link->ssl, session);
+		} else {
+			hash_table_remove(ssl_client_sessions, session_key);
+			SSL_SESSION_free(session);
+		}
+	}
+	pthread_mutex_unlock(&ssl_ctxs_mutex);
+	free(session_key);
+#endif
+
 	int result;
 	while ((result = SSL_connect(link->ssl)) <= 0) {
 		switch (SSL_get_error(link->ssl, result)) {
@@ -624,6 +794,8 @@ int link_ssl_wrap_connect(struct link *link, const char *sni_hostname)
 		}
 	}
 
+	_debug_ssl_state(link);
+
 	if (!link_nonblocking(link, 1)) {
 		debug(D_SSL, "Could not switch link back to non-blocking after SSL handshake: %s", strerror(errno));
 		return 0;
@@ -1286,10 +1458,94 @@ int64_t link_stream_to_file(struct link *link, FILE *file, int64_t length, time_
 	return total;
 }
 
+#ifdef CCTOOLS_OPSYS_LINUX
+/* Send length bytes from fd to the link without copying them through user space.
+ * Uses sendfile on plain links, and SSL_sendfile when the kernel does the tls
+ * encryption for the link. Returns true and sets total as link_stream_from_fd
+ * would, or false if zero-copy is not possible and nothing was sent, in which
+ * case the caller should copy the data through a buffer instead. */
+static int link_stream_from_fd_zero_copy(struct link *link, int fd, int64_t length, time_t stoptime, int64_t *result)
+{
+	if (link->type != LINK_TYPE_STANDARD)
+		return 0;
+
+	off_t offset = lseek(fd, 0, SEEK_CUR);
+	if (offset == -1)
+		return 0;
+
+#ifdef HAS_OPENSSL
+	int use_ssl_sendfile = 0;
+	if (link->ssl) {
+#ifdef SSL_OP_ENABLE_KTLS
+		use_ssl_sendfile = BIO_get_ktls_send(SSL_get_wbio(link->ssl));
+#endif
+		if (!use_ssl_sendfile)
+			return 0;
+	}
+#endif
+
+	int64_t total = 0;
+
+	while (length > 0) {
+		size_t chunk = MIN(1 << 30, length);
+		ssize_t actual;
+
+#if defined(HAS_OPENSSL) && defined(SSL_OP_ENABLE_KTLS)
+		if (use_ssl_sendfile) {
+			actual = SSL_sendfile(link->ssl, fd, offset, chunk, 0);
+			if (actual < 0) {
+				int err = SSL_get_error(link->ssl, actual);
+				if (err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ) {
+					errno = EAGAIN;
+				} else if (errno == 0) {
+					errno = EIO;
+				}
+			} else {
+				offset += actual;
+			}
+		} else
+#endif
+		{
+			actual = sendfile(link->fd, fd, &offset, chunk);
+		}
+
+		if (actual < 0) {
+			if (errno_is_temporary(errno)) {
+				if (link_sleep(link, stoptime, 0, 1)) {
+					continue;
+				}
+			} else if (total == 0 && (errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP)) {
+				/* file or socket type not supported, fall back to copying */
+				return 0;
+			}
+			total = -1;
+			break;
+		} else if (actual == 0) {
+			break;
+		}
+
+		link->written += actual;
+		total += actual;
+		length -= actual;
+	}
+
+	/* leave the file offset where a read loop would have left it */
+	lseek(fd, offset, SEEK_SET);
+
+	*result = total;
+	return 1;
+}
+#endif
+
 int64_t link_stream_from_fd(struct link *link, int fd, int64_t length, time_t stoptime)
 {
 	int64_t total = 0;
 
+#ifdef CCTOOLS_OPSYS_LINUX
+	if (link_stream_from_fd_zero_copy(link, fd, length, stoptime, &total))
+		return total;
+#endif
+
 	while (length > 0) {
 		char buffer[1 << 16];
 		size_t chunk = MIN(sizeof(buffer), (size_t)length);
@@ -12,6 +12,11 @@ See the file COPYING for details.
 
 #include "list.h"
 
+struct list_cursor {
+	struct list *list;
+	struct list_item *target;
+};
+
 struct list {
 	// We keep a refcount on the list itself so we know how many cursors
 	// are out there. The list cannot be deleted while it has living cursors.
@@ -20,6 +25,7 @@ struct list {
 	struct list_item *head;
 	struct list_item *tail;
 	struct list_cursor *iter; // global iterator for backwards compatibility
+	struct list_cursor iter_storage; // kept with the list, as every list has one
 };
 
 struct list_item {
@@ -27,17 +33,12 @@ struct list_item {
 	// that has cursors on it, so we wait until the item is marked
 	// dead AND the refcount hits zero to free() it.
 	unsigned refcount;
+	// drop() just marks an item removed, hiding from all operations
+	bool dead;
 	struct list *list;
 	struct list_item *next;
 	struct list_item *prev;
 	void *data;
-	// drop() just marks an item removed, hiding from all operations
-	bool dead;
-};
-
-struct list_cursor {
-	struct list *list;
-	struct list_item *target;
 };
 
 static void oom(void)
@@ -94,12 +95,31 @@ static void list_item_unref(struct list_item *item)
 	}
 }
 
+/*
+A cursor used only within a single call is kept on the stack, as
+allocating one for every push and pop dominates their cost.
+*/
+
+static void list_cursor_init(struct list_cursor *cur, struct list *list)
+{
+	cur->list = list;
+	cur->target = NULL;
+	list_ref(list);
+}
+
+static void list_cursor_fini(struct list_cursor *cur)
+{
+	list_reset(cur);
+	list_unref(cur->list);
+}
+
 struct list *list_create(void)
 {
 	struct list *out = calloc(1, sizeof(*out));
 	if (!out)
 		oom();
-	out->iter = list_cursor_create(out);
+	out->iter = &out->iter_storage;
+	list_cursor_init(out->iter, out);
 	return out;
 }
 
@@ -117,7 +137,7 @@ bool list_destroy(struct list *list)
 		return false;
 	if (list->refcount > 1)
 		return false;
-	list_cursor_destroy(list->iter);
+	list_cursor_fini(list->iter);
 	assert(list->refcount == 0);
 	free(list);
 	return true;
@@ -126,11 +146,10 @@ bool list_destroy(struct list *list)
 struct list_cursor *list_cursor_create(struct list *list)
 {
 	assert(list);
-	struct list_cursor *cur = calloc(1, sizeof(*cur));
+	struct list_cursor *cur = malloc(sizeof(*cur));
 	if (!cur)
 		oom();
-	cur->list = list;
-	list_ref(list);
+	list_cursor_init(cur, list);
 	return cur;
 }
 
@@ -145,8 +164,7 @@ void list_cursor_destroy(struct list_cursor *cur)
 {
 	assert(cur);
 	assert(cur->list);
-	list_reset(cur);
-	list_unref(cur->list);
+	list_cursor_fini(cur);
 	free(cur);
 }
 
@@ -435,18 +453,20 @@ void list_clear(struct list *l, void (*delete_func)(void *item))
 
 int list_push_head(struct list *l, void *item)
 {
-	struct list_cursor *cur = list_cursor_create(l);
-	list_seek(cur, 0);
-	list_insert(cur, item);
-	list_cursor_destroy(cur);
+	struct list_cursor cur;
+	list_cursor_init(&cur, l);
+	list_seek(&cur, 0);
+	list_insert(&cur, item);
+	list_cursor_fini(&cur);
 	return 1;
 }
 
 int list_push_tail(struct list *l, void *item)
 {
-	struct list_cursor *cur = list_cursor_create(l);
-	list_insert(cur, item);
-	list_cursor_destroy(cur);
+	struct list_cursor cur;
+	list_cursor_init(&cur, l);
+	list_insert(&cur, item);
+	list_cursor_fini(&cur);
 	return 1;
 }
 
@@ -457,11 +477,12 @@ void *list_pop_head(struct list *l)
 	if (!l)
 		return NULL;
 
-	struct list_cursor *cur = list_cursor_create(l);
-	list_seek(cur, 0);
-	list_get(cur, &item);
-	list_drop(cur);
-	list_cursor_destroy(cur);
+	struct list_cursor cur;
+	list_cursor_init(&cur, l);
+	list_seek(&cur, 0);
+	list_get(&cur, &item);
+	list_drop(&cur);
+	list_cursor_fini(&cur);
 
 	return item;
 }
@@ -473,11 +494,12 @@ void *list_pop_tail(struct list *l)
 	if (!l)
 		return NULL;
 
-	struct list_cursor *cur = list_cursor_create(l);
-	list_seek(cur, -1);
-	list_get(cur, &item);
-	list_drop(cur);
-	list_cursor_destroy(cur);
+	struct list_cursor cur;
+	list_cursor_init(&cur, l);
+	list_seek(&cur, -1);
+	list_get(&cur, &item);
+	list_drop(&cur);
+	list_cursor_fini(&cur);
 
 	return item;
 }
@@ -516,10 +538,11 @@ void *list_peek_head(struct list *l)
 	if (!l)
 		return NULL;
 
-	struct list_cursor *cur = list_cursor_create(l);
-	list_seek(cur, 0);
-	list_get(cur, &item);
-	list_cursor_destroy(cur);
+	struct list_cursor cur;
+	list_cursor_init(&cur, l);
+	list_seek(&cur, 0);
+	list_get(&cur, &item);
+	list_cursor_fini(&cur);
 
 	return item;
 }
@@ -531,10 +554,11 @@ void *list_peek_tail(struct list *l)
 	if (!l)
 		return NULL;
 
-	struct list_cursor *cur = list_cursor_create(l);
-	list_seek(cur, -1);
-	list_get(cur, &item);
-	list_cursor_destroy(cur);
+	struct list_cursor cur;
+	list_cursor_init(&cur, l);
+	list_seek(&cur, -1);
+	list_get(&cur, &item);
+	list_cursor_fini(&cur);
 
 	return item;
 }
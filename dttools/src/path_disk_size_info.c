@@ -8,9 +8,12 @@ See the file COPYING for details.
 
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <pthread.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <time.h>
 
 #include "debug.h"
 #include "list.h"
@@ -23,6 +26,263 @@ struct DIR_with_name {
 	char *name;
 };
 
+/*
+A measurement is shared by a few threads. Each thread takes a directory
+from s->current_dirs, reads all of its entries, and puts back any
+subdirectories it finds. If the time runs out in the middle of a directory,
+the directory goes back to the list with its stream still open, so that
+the next call continues from the same entry and nothing is counted twice.
+
+The calling thread starts walking alone. Another thread is started only
+when more directories are waiting than there are idle threads to take
+them, so measuring a small directory does not start any.
+*/
+
+#define PATH_DISK_SIZE_INFO_MAX_THREADS 64
+
+static int path_disk_size_info_threads = 4;
+
+struct walker {
+	struct path_disk_size_info *s;
+	struct hash_table *exclude_paths;
+	int64_t max_secs;
+	time_t start_time;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	pthread_t threads[PATH_DISK_SIZE_INFO_MAX_THREADS];
+	int started;   /* threads started besides the calling thread */
+	int starting;  /* started threads that have not looked for work yet */
+	int idle;      /* threads waiting for a directory */
+	int busy;      /* threads currently reading a directory */
+	int stop;      /* time is up, or a directory could not be opened */
+	int result;    /* -1 if any error was found */
+	int open_errno;
+	char *open_error_path;
+	int stat_errno;
+};
+
+void path_disk_size_info_set_threads(int n)
+{
+	path_disk_size_info_threads = MAX(1, MIN(n, PATH_DISK_SIZE_INFO_MAX_THREADS));
+}
+
+static void DIR_with_name_delete(struct DIR_with_name *d)
+{
+	if (d->dir)
+		closedir(d->dir);
+	free(d->name);
+	free(d);
+}
+
+/*
+Find type and size of an entry, relative to the open directory,
+asking only for the fields needed.
+Returns 0 on success, -1 on error (see errno).
+*/
+
+static int entry_info(DIR *dir, const char *name, mode_t *mode, int64_t *size)
+{
+#ifdef HAS_STATX
+	struct statx info;
+	if (statx(dirfd(dir), name, AT_SYMLINK_NOFOLLOW, STATX_TYPE | STATX_SIZE, &info) < 0)
+		return -1;
+	*mode = info.stx_mode;
+	*size = info.stx_size;
+#else
+	struct stat info;
+	if (fstatat(dirfd(dir), name, &info, AT_SYMLINK_NOFOLLOW) < 0)
+		return -1;
+	*mode = info.st_mode;
+	*size = info.st_size;
+#endif
+	return 0;
+}
+
+static int walker_timed_out(struct walker *w)
+{
+	return w->max_secs > -1 && time(0) - w->start_time >= w->max_secs;
+}
+
+/*
+Read entries of a directory until it is exhausted or the time runs out.
+Must be called without holding the lock. Subdirectories found, counters
+and the last stat error are merged into the shared state at the end.
+Returns 1 if the directory was completely read, 0 otherwise.
+*/
+
+static int walker_read_dir(struct walker *w, struct DIR_with_name *here, struct list *subdirs, int64_t *size, int64_t *count, int *stat_errno)
+{
+	struct dirent *entry;
+
+	/* Read out entries from the dir stream. */
+	while ((entry = readdir(here->dir))) {
+		if (strcmp(".", entry->d_name) == 0 || strcmp("..", entry->d_name) == 0)
+			continue;
+
+		char composed_path[PATH_MAX];
+		if (entry->d_name[0] == '/') {
+			strncpy(composed_path, entry->d_name, PATH_MAX);
+		} else {
+			snprintf(composed_path, PATH_MAX, "%s/%s", here->name, entry->d_name);
+		}
+
+		if (w->exclude_paths && hash_table_lookup(w->exclude_paths, composed_path)) {
+			continue;
+		}
+
+		/* The type from readdir saves a stat for everything but regular files. */
+		mode_t mode = 0;
+		int64_t file_size = 0;
+		switch (entry->d_type) {
+		case DT_DIR:
+			mode = S_IFDIR;
+			break;
+		case DT_LNK:
+			mode = S_IFLNK;
+			break;
+		case DT_FIFO:
+		case DT_SOCK:
+		case DT_CHR:
+		case DT_BLK:
+			mode = 0;
+			break;
+		default:
+			if (entry_info(here->dir, entry->d_name, &mode, &file_size) < 0) {
+				if (errno == ENOENT) {
+					/* our DIR structure is stale, and a file went away. We simply do nothing. */
+				} else {
+					*stat_errno = errno;
+				}
+				continue;
+			}
+			break;
+		}
+
+		(*count)++;
+		if (S_ISREG(mode)) {
+			*size += file_size;
+		} else if (S_ISDIR(mode)) {
+			/* Only add name of directory, will only open it to read when it's its turn. */
+			struct DIR_with_name *branch = calloc(1, sizeof(struct DIR_with_name));
+			branch->name = xxstrdup(composed_path);
+			list_push_head(subdirs, branch);
+		} else if (S_ISLNK(mode)) {
+			/* do nothing, avoiding infinite loops. */
+		}
+
+		if (walker_timed_out(w)) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static void *walker_helper(void *arg);
+
+/* Must be called with the lock held. */
+static void walker_grow(struct walker *w)
+{
+	while (!w->stop && w->started + 1 < path_disk_size_info_threads && list_size(w->s->current_dirs) > w->idle + w->starting) {
+		if (pthread_create(&w->threads[w->started], 0, walker_helper, w) != 0) {
+			break;
+		}
+		w->started++;
+		w->starting++;
+	}
+}
+
+/* Must be called with the lock held, which is held again on return. */
+static void walker_run(struct walker *w)
+{
+	struct path_disk_size_info *s = w->s;
+
+	while (!w->stop) {
+		struct DIR_with_name *here = list_pop_tail(s->current_dirs);
+		if (!here) {
+			if (w->busy == 0) {
+				/* nothing left to read, and nobody will add more */
+				break;
+			}
+			w->idle++;
+			pthread_cond_wait(&w->cond, &w->mutex);
+			w->idle--;
+			continue;
+		}
+
+		w->busy++;
+		pthread_mutex_unlock(&w->mutex);
+
+		struct list *subdirs = list_create();
+		int64_t size = 0;
+		int64_t count = 0;
+		int done = 0;
+		int open_errno = 0;
+		int stat_errno = 0;
+
+		if (!here->dir) { // only open dir when it's being processed
+			here->dir = opendir(here->name);
+			if (!here->dir) {
+				if (errno == ENOENT) {
+					/* Do nothing as a directory might go away. */
+					done = 1;
+				} else {
+					open_errno = errno;
+				}
+			}
+		}
+
+		if (here->dir) {
+			done = walker_read_dir(w, here, subdirs, &size, &count, &stat_errno);
+		}
+
+		pthread_mutex_lock(&w->mutex);
+		w->busy--;
+
+		s->size_so_far += size;
+		s->count_so_far += count;
+		if (stat_errno) {
+			w->stat_errno = stat_errno;
+		}
+
+		struct DIR_with_name *branch;
+		while ((branch = list_pop_tail(subdirs))) {
+			list_push_head(s->current_dirs, branch);
+		}
+		list_delete(subdirs);
+
+		if (done) {
+			DIR_with_name_delete(here);
+		} else {
+			/* keep for the next call, with its stream at the current entry */
+			list_push_tail(s->current_dirs, here);
+			w->stop = 1;
+			if (open_errno) {
+				w->open_errno = open_errno;
+				w->open_error_path = xxstrdup(here->name);
+				w->result = -1;
+			}
+		}
+
+		walker_grow(w);
+		pthread_cond_broadcast(&w->cond);
+	}
+	pthread_cond_broadcast(&w->cond);
+}
+
+static void *walker_helper(void *arg)
+{
+	struct walker *w = arg;
+
+	pthread_mutex_lock(&w->mutex);
+	w->starting--;
+	walker_run(w);
+	pthread_mutex_unlock(&w->mutex);
+
+	return 0;
+}
+
 int path_disk_size_info_get(const char *path, int64_t *measured_size, int64_t *number_of_files, struct hash_table *exclude_paths)
 {
 
@@ -82,78 +342,40 @@ int path_disk_size_info_get_r(const char *path, int64_t max_secs, struct path_di
 		}
 	}
 
-	struct DIR_with_name *tail;
-	while ((tail = list_peek_tail(s->current_dirs))) {
-		struct dirent *entry;
-		struct stat file_info;
-
-		if (!tail->dir) { // only open dir when it's being processed
-			tail->dir = opendir(tail->name);
-			if (!tail->dir) {
-				if (errno == ENOENT) {
-					/* Do nothing as a directory might go away. */
-					tail = list_pop_tail(s->current_dirs);
-					free(tail->name);
-					free(tail);
-					continue;
-				} else {
-					debug(D_DEBUG, "error opening directory '%s', errno: %s.\n", tail->name, strerror(errno));
-					result = -1;
-					goto timeout;
-				}
-			}
-		}
-		/* Read out entries from the dir stream. */
-		while ((entry = readdir(tail->dir))) {
-			if (strcmp(".", entry->d_name) == 0 || strcmp("..", entry->d_name) == 0)
-				continue;
+	struct walker w;
+	memset(&w, 0, sizeof(w));
+	w.s = s;
+	w.exclude_paths = exclude_paths;
+	w.max_secs = max_secs;
+	w.start_time = start_time;
+	pthread_mutex_init(&w.mutex, 0);
+	pthread_cond_init(&w.cond, 0);
+
+	pthread_mutex_lock(&w.mutex);
+	walker_run(&w);
+	int started = w.started; /* no thread is started once the walk is over */
+	pthread_mutex_unlock(&w.mutex);
+
+	for (int i = 0; i < started; i++) {
+		pthread_join(w.threads[i], 0);
+	}
 
-			char composed_path[PATH_MAX];
-			if (entry->d_name[0] == '/') {
-				strncpy(composed_path, entry->d_name, PATH_MAX);
-			} else {
-				snprintf(composed_path, PATH_MAX, "%s/%s", tail->name, entry->d_name);
-			}
+	pthread_cond_destroy(&w.cond);
+	pthread_mutex_destroy(&w.mutex);
 
-			if (exclude_paths && hash_table_lookup(exclude_paths, composed_path)) {
-				continue;
-			}
-
-			if (lstat(composed_path, &file_info) < 0) {
-				if (errno == ENOENT) {
-					/* our DIR structure is stale, and a file went away. We simply do nothing. */
-				} else {
-					debug(D_DEBUG, "error reading disk usage on '%s'.\n", path);
-					result = -1;
-				}
-				continue;
-			}
+	if (w.stat_errno) {
+		debug(D_DEBUG, "error reading disk usage on '%s': %s.\n", path, strerror(w.stat_errno));
+		result = -1;
+	}
 
-			s->count_so_far++;
-			if (S_ISREG(file_info.st_mode)) {
-				s->size_so_far += file_info.st_size;
-			} else if (S_ISDIR(file_info.st_mode)) {
-				/* Only add name of directory, will only open it to read when it's its turn. */
-				struct DIR_with_name *branch = calloc(1, sizeof(struct DIR_with_name));
-				branch->name = xxstrdup(composed_path);
-				list_push_head(s->current_dirs, branch);
-			} else if (S_ISLNK(file_info.st_mode)) {
-				/* do nothing, avoiding infinite loops. */
-			}
+	if (w.open_error_path) {
+		debug(D_DEBUG, "error opening directory '%s', errno: %s.\n", w.open_error_path, strerror(w.open_errno));
+		free(w.open_error_path);
+		result = -1;
+	}
 
-			if (max_secs > -1) {
-				if (time(0) - start_time >= max_secs) {
-					goto timeout;
-				}
-			}
-		}
-		/* we are done reading a complete directory, and we go to the next in the queue */
-		tail = list_pop_tail(s->current_dirs);
-		if (tail->dir) {
-			closedir(tail->dir);
-		}
-		free(tail->name);
-		free(tail);
+	if (w.stop) {
+		goto timeout;
 	}
 
 	list_delete(s->current_dirs);
@@ -185,13 +407,7 @@ void path_disk_size_info_delete_state(struct path_disk_size_info *state)
 	if (state->current_dirs) {
 		struct DIR_with_name *tail;
 		while ((tail = list_pop_tail(state->current_dirs))) {
-			if (tail->dir)
-				closedir(tail->dir);
-
-			if (tail->name)
-				free(tail->name);
-
-			free(tail);
+			DIR_with_name_delete(tail);
 		}
 		list_delete(state->current_dirs);
 	}
@@ -50,4 +50,11 @@ int path_disk_size_info_get_r(const char *path, int64_t max_secs, struct path_di
 
 void path_disk_size_info_delete_state(struct path_disk_size_info *state);
 
+/** Set the number of threads used to walk a directory tree.
+Directories are read concurrently, which helps on file systems with high
+metadata latency. With one thread, the tree is walked by the calling thread only.
+@param n Number of threads, between 1 and 64. Default is 4.
+*/
+void path_disk_size_info_set_threads(int n);
+
 #endif
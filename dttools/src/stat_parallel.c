@@ -0,0 +1,219 @@
+/*
+Copyright (C) 2026 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#include "stat_parallel.h"
+
+#include "macros.h"
+#include "xxmalloc.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+The threads spend their time waiting on the filesystem rather than
+the cpu, so the default is not tied to the number of cpus.
+*/
+#define STAT_PARALLEL_DEFAULT_THREADS 16
+#define STAT_PARALLEL_MAX_THREADS 64
+
+/* Below this many files, starting threads costs more than it saves. */
+#define STAT_PARALLEL_MIN_FILES 64
+
+struct stat_entry {
+	const char *path;
+	int index;
+	int dirlength; /* length of the directory part of the path, including the last slash */
+};
+
+struct stat_job {
+	const char **paths;
+	struct stat *info;
+	int *errors;
+	struct stat_entry *entries;
+	int *groups; /* first entry of each directory, and one past the last entry */
+	int ngroups;
+	int next;
+	int nsuccess;
+	pthread_mutex_t mutex;
+};
+
+static int stat_entry_compare(const void *a, const void *b)
+{
+	const struct stat_entry *x = a;
+	const struct stat_entry *y = b;
+
+	if (x->dirlength != y->dirlength)
+		return x->dirlength - y->dirlength;
+
+	int result = memcmp(x->path, y->path, x->dirlength);
+	if (result)
+		return result;
+
+	return x->index - y->index;
+}
+
+static int stat_one(const char *path, struct stat *info, int *error)
+{
+	if (stat(path, info) == 0) {
+		*error = 0;
+		return 1;
+	} else {
+		*error = errno;
+		return 0;
+	}
+}
+
+static int stat_group(struct stat_job *job, int first, int last)
+{
+	int nsuccess = 0;
+	int dirlength = job->entries[first].dirlength;
+	const char *path = job->entries[first].path;
+	int dirfd = -1;
+
+	/* A single file gains nothing from opening its directory. */
+	if (last - first > 1) {
+		char *dirname = dirlength ? xxstrdup(path) : xxstrdup(".");
+		if (dirlength)
+			dirname[dirlength] = 0;
+		dirfd = open(dirname, O_RDONLY | O_DIRECTORY);
+		free(dirname);
+	}
+
+	for (int i = first; i < last; i++) {
+		int index = job->entries[i].index;
+		const char *name = job->paths[index] + dirlength;
+
+		/* Paths ending in a slash are left to stat, which treats them specially. */
+		if (dirfd >= 0 && name[0] && name[strlen(name) - 1] != '/') {
+			if (fstatat(dirfd, name, &job->info[index], 0) == 0) {
+				job->errors[index] = 0;
+				nsuccess++;
+			} else {
+				job->errors[index] = errno;
+			}
+		} else {
+			nsuccess += stat_one(job->paths[index], &job->info[index], &job->errors[index]);
+		}
+	}
+
+	if (dirfd >= 0)
+		close(dirfd);
+
+	return nsuccess;
+}
+
+static void *stat_worker(void *arg)
+{
+	struct stat_job *job = arg;
+	int nsuccess = 0;
+
+	while (1) {
+		pthread_mutex_lock(&job->mutex);
+		int g = job->next++;
+		pthread_mutex_unlock(&job->mutex);
+
+		if (g >= job->ngroups)
+			break;
+
+		nsuccess += stat_group(job, job->groups[g], job->groups[g + 1]);
+	}
+
+	pthread_mutex_lock(&job->mutex);
+	job->nsuccess += nsuccess;
+	pthread_mutex_unlock(&job->mutex);
+
+	return 0;
+}
+
+int stat_files_parallel(const char **paths, int npaths, struct stat *info, int *errors, int nthreads)
+{
+	if (npaths < 1)
+		return 0;
+
+	if (npaths < STAT_PARALLEL_MIN_FILES) {
+		int nsuccess = 0;
+		for (int i = 0; i < npaths; i++) {
+			nsuccess += stat_one(paths[i], &info[i], &errors[i]);
+		}
+		return nsuccess;
+	}
+
+	if (nthreads < 1)
+		nthreads = STAT_PARALLEL_DEFAULT_THREADS;
+
+	/* Sort the files by directory, keeping the given order within each directory. */
+	struct stat_entry *entries = xxmalloc(npaths * sizeof(*entries));
+	for (int i = 0; i < npaths; i++) {
+		const char *slash = strrchr(paths[i], '/');
+		entries[i].path = paths[i];
+		entries[i].index = i;
+		entries[i].dirlength = slash ? slash - paths[i] + 1 : 0;
+	}
+
+	qsort(entries, npaths, sizeof(*entries), stat_entry_compare);
+
+	int *groups = xxmalloc((npaths + 1) * sizeof(*groups));
+	int ngroups = 0;
+	for (int i = 0; i < npaths; i++) {
+		if (i == 0 || entries[i].dirlength != entries[i - 1].dirlength || memcmp(entries[i].path, entries[i - 1].path, entries[i].dirlength)) {
+			groups[ngroups++] = i;
+		}
+	}
+	groups[ngroups] = npaths;
+
+	/*
+	A workflow often keeps most of its files in one directory, so a
+	large directory is split into pieces that may be examined at once.
+	*/
+	int piece = MAX(STAT_PARALLEL_MIN_FILES, npaths / (nthreads * 4));
+	int *pieces = xxmalloc((npaths + 1) * sizeof(*pieces));
+	int npieces = 0;
+	for (int g = 0; g < ngroups; g++) {
+		for (int i = groups[g]; i < groups[g + 1]; i += piece) {
+			pieces[npieces++] = i;
+		}
+	}
+	pieces[npieces] = npaths;
+	free(groups);
+
+	nthreads = MAX(1, MIN(MIN(nthreads, npieces), STAT_PARALLEL_MAX_THREADS));
+
+	struct stat_job job;
+	job.paths = paths;
+	job.info = info;
+	job.errors = errors;
+	job.entries = entries;
+	job.groups = pieces;
+	job.ngroups = npieces;
+	job.next = 0;
+	job.nsuccess = 0;
+	pthread_mutex_init(&job.mutex, 0);
+
+	/* the calling thread works as well, so start one fewer */
+	pthread_t threads[STAT_PARALLEL_MAX_THREADS];
+	int started = 0;
+	for (int i = 1; i < nthreads; i++) {
+		if (pthread_create(&threads[started], 0, stat_worker, &job) == 0) {
+			started++;
+		}
+	}
+
+	stat_worker(&job);
+
+	for (int i = 0; i < started; i++) {
+		pthread_join(threads[i], 0);
+	}
+
+	pthread_mutex_destroy(&job.mutex);
+	free(pieces);
+	free(entries);
+
+	return job.nsuccess;
+}
@@ -0,0 +1,31 @@
+/*
+Copyright (C) 2026 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#ifndef STAT_PARALLEL_H
+#define STAT_PARALLEL_H
+
+/** @file stat_parallel.h
+Stat many files at once.
+On a shared filesystem each stat is a round trip to the server, so
+checking a large number of files one at a time is dominated by latency.
+Here the files are grouped by directory, each directory is opened once
+and its files are looked up relative to it, and several directories
+are examined at the same time by a small set of threads.
+*/
+
+#include <sys/stat.h>
+
+/** Stat a set of files concurrently, following symbolic links as stat does.
+@param paths Array of paths of the files to examine.
+@param npaths Number of entries in paths.
+@param info Array of npaths entries filled with the status of each file that exists.
+@param errors Array of npaths entries set to zero if the file was examined, or to the errno of the failure.
+@param nthreads Maximum number of directories examined at the same time. If less than one, a default suited to network filesystems is used.
+@return The number of files examined successfully.
+*/
+int stat_files_parallel(const char **paths, int npaths, struct stat *info, int *errors, int nthreads);
+
+#endif
@@ -0,0 +1,109 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+
+exe="checksum.test"
+dir="checksum.dir"
+
+prepare()
+{
+	# checksum uses OpenSSL when it was configured with it.
+	openssl_ldflags=`sed -n 's/^CCTOOLS_OPENSSL_LDFLAGS=//p' ../../config.mk`
+
+	mkdir -p "$dir"
+	printf '' > "$dir/empty"
+	printf 'abc' > "$dir/abc"
+	awk 'BEGIN { for(i=0;i<1000;i++) { for(j=0;j<1000;j++) printf("a"); } }' > "$dir/million"
+
+	${CC} -I../src/ -g $CCTOOLS_TEST_CCFLAGS -o "$exe" -x c - -x none ../src/libdttools.a $openssl_ldflags -lpthread -lm <<EOF
+#include "checksum.h"
+#include "debug.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define check(expr) \\
+	do {\\
+		if (!(expr))\\
+			fatal("[%s:%d]: unexpected failure: %s", __FILE__, __LINE__, #expr);\\
+	} while (0)
+
+static const char *hex(checksum_type_t type, unsigned char *digest)
+{
+	return type == CHECKSUM_MD5 ? md5_to_string(digest) : sha1_string(digest);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *paths[] = {"$dir/empty", "$dir/abc", "$dir/million", "$dir/missing"};
+	const char *md5s[] = {"d41d8cd98f00b204e9800998ecf8427e", "900150983cd24fb0d6963f7d28e17f72", "7707d6ae4e027c70eea2a935c2296f21"};
+	const char *sha1s[] = {"da39a3ee5e6b4b0d3255bfef95601890afd80709", "a9993e364706816aba3e25717850c26c9cd0d89d", "34aa973cd4c4daa4f61eeb2bdbad27316534016f"};
+	unsigned char digest[SHA1_DIGEST_LENGTH];
+	unsigned char digests[4 * SHA1_DIGEST_LENGTH];
+	int status[4];
+	int i, t;
+
+	for (t = 0; t < 2; t++) {
+		checksum_type_t type = t ? CHECKSUM_SHA1 : CHECKSUM_MD5;
+		const char **expected = t ? sha1s : md5s;
+		int length = checksum_digest_length(type);
+
+		/* Each file alone, and all at once with some threads, give the known digests. */
+		for (i = 0; i < 3; i++) {
+			check(checksum_file(type, paths[i], digest) == 1);
+			check(!strcmp(hex(type, digest), expected[i]));
+		}
+		check(checksum_file(type, paths[3], digest) == 0);
+		check(errno == ENOENT);
+
+		check(checksum_files_parallel(type, paths, 4, digests, status, 3) == 3);
+		for (i = 0; i < 3; i++) {
+			check(status[i] == 1);
+			check(!strcmp(hex(type, digests + i * length), expected[i]));
+		}
+		check(status[3] == 0);
+	}
+
+	/* A file truncated while it is being hashed gives some digest, or a failure, but no signal. */
+	int fd = open("$dir/changing", O_RDWR | O_CREAT | O_TRUNC, 0644);
+	check(fd >= 0);
+	check(ftruncate(fd, 64 << 20) == 0);
+	pid_t pid = fork();
+	if (pid == 0) {
+		while (1) {
+			ftruncate(fd, 0);
+			ftruncate(fd, 64 << 20);
+		}
+	}
+	for (i = 0; i < 50; i++)
+		checksum_file(CHECKSUM_SHA1, "$dir/changing", digest);
+	kill(pid, SIGKILL);
+	waitpid(pid, 0, 0);
+	close(fd);
+
+	return 0;
+}
+EOF
+	return $?
+}
+
+run()
+{
+	./"$exe"
+}
+
+clean()
+{
+	rm -rf "$exe" "$dir"
+	return 0
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
@@ -0,0 +1,285 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+
+exe="file_cache.test"
+cache="file_cache.dir"
+
+prepare()
+{
+	${CC} -I../src/ -g $CCTOOLS_TEST_CCFLAGS -o "$exe" -x c - -x none ../src/libdttools.a -lm <<EOF
+#include "file_cache.h"
+#include "debug.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define MB (1024*1024)
+
+#define check(cmp,expr) \\
+	do {\\
+		long long rc = (expr);\\
+		if (!(cmp rc))\\
+			fatal("[%s:%d]: unexpected failure: %s %lld '%s'", __FILE__, __LINE__, #cmp, rc, strerror(errno));\\
+	} while (0)
+
+static int put(struct file_cache *c, const char *path, int size)
+{
+	char txn[4096];
+	char *data;
+	int fd;
+
+	if (file_cache_reserve(c, size) < 0)
+		return -1;
+
+	fd = file_cache_begin(c, path, txn);
+	data = calloc(1, size);
+	write(fd, data, size);
+	free(data);
+	close(fd);
+
+	file_cache_release(c, size);
+	return file_cache_commit(c, path, txn);
+}
+
+static int contains(struct file_cache *c, const char *path)
+{
+	char lpath[4096];
+	return file_cache_contains(c, path, lpath) == 0;
+}
+
+/* Total size of the entries in the cache directories. */
+static long long usage(const char *root)
+{
+	char cmd[4096];
+	long long total = 0;
+	FILE *p;
+
+	sprintf(cmd, "find %s/?? -type f -exec stat -c %%s {} +", root);
+	p = popen(cmd, "r");
+	if (p) {
+		long long size;
+		while (fscanf(p, "%lld", &size) == 1)
+			total += size;
+		pclose(p);
+	}
+	return total;
+}
+
+int main(int argc, char *argv[])
+{
+	char lpath[4096];
+	char name[64];
+	int i, p, fd;
+
+	struct file_cache *c = file_cache_init("$cache");
+	check(0 !=, c != 0);
+
+	/* Without a limit, nothing is evicted, even beyond the number of entries an index can hold. */
+	for (i = 0; i < 60000; i++) {
+		sprintf(name, "all.%d", i);
+		check(0 ==, put(c, name, 0));
+	}
+	for (i = 0; i < 60000; i++) {
+		sprintf(name, "all.%d", i);
+		check(1 ==, contains(c, name));
+		check(0 ==, file_cache_delete(c, name));
+	}
+
+	file_cache_set_limit(c, 10 * MB);
+
+	/* The least recently used entry is evicted first. */
+	check(0 ==, put(c, "a", 3 * MB));
+	check(0 ==, put(c, "b", 3 * MB));
+	check(0 ==, put(c, "c", 3 * MB));
+	fd = file_cache_open(c, "a", O_RDONLY, lpath, 0, 0);
+	check(0 <=, fd);
+	close(fd);
+	check(0 ==, put(c, "d", 3 * MB));
+	check(1 ==, contains(c, "a"));
+	check(0 ==, contains(c, "b"));
+	check(1 ==, contains(c, "c"));
+	check(1 ==, contains(c, "d"));
+
+	/* Nothing larger than the cache may be reserved. */
+	check(-1 ==, file_cache_reserve(c, 11 * MB));
+	check(ENOSPC ==, errno);
+
+	/* Processes sharing the cache stay within the limit together. */
+	for (p = 0; p < 4; p++) {
+		if (fork() == 0) {
+			struct file_cache *s = file_cache_init("$cache");
+			file_cache_set_limit(s, 10 * MB);
+			for (i = 0; i < 50; i++) {
+				sprintf(name, "%d.%d", p, i);
+				check(0 ==, put(s, name, MB / 2 + (i % 3) * MB / 4));
+			}
+			_exit(0);
+		}
+	}
+	while (wait(0) > 0)
+		;
+	check(10 * MB >=, usage("$cache"));
+
+	/* The space reserved by a process that has exited is recovered. */
+	if (fork() == 0) {
+		struct file_cache *s = file_cache_init("$cache");
+		file_cache_set_limit(s, 10 * MB);
+		check(0 ==, file_cache_reserve(s, 8 * MB));
+		_exit(0);
+	}
+	wait(0);
+	file_cache_cleanup(c);
+	check(0 ==, file_cache_reserve(c, 9 * MB));
+	file_cache_release(c, 9 * MB);
+
+	/* A new index accounts for the entries already on disk. */
+	file_cache_fini(c);
+	unlink("$cache/index");
+	c = file_cache_init("$cache");
+	file_cache_set_limit(c, 2 * MB);
+	check(0 ==, put(c, "e", MB));
+	check(2 * MB >=, usage("$cache"));
+	check(1 ==, contains(c, "e"));
+
+	/* A process left with the old version of a reset partial entry cannot mix its blocks into the new one. */
+	char ppath1[4096], ppath2[4096], present[4], data[4];
+	int map1, map2, part1, part2;
+	INT64_T gen1, gen2;
+	part1 = file_cache_partial_open(c, "p", ppath1, &map1, &gen1, 4 * 4096, 100, 4096);
+	check(0 <=, part1);
+	check(4 ==, pwrite(part1, "old", 4, 0));
+	check(0 ==, file_cache_partial_set(map1, gen1, 0, 1));
+	part2 = file_cache_partial_open(c, "p", ppath2, &map2, &gen2, 4 * 4096, 200, 4096);
+	check(0 <=, part2);
+	check(gen1 !=, gen2);
+	check(0 ==, file_cache_partial_get(map2, gen2, 0, 4, present));
+	check(0 ==, present[0]);
+	check(-1 ==, file_cache_partial_set(map1, gen1, 1, 1));
+	check(ESTALE ==, errno);
+	check(-1 ==, file_cache_partial_get(map1, gen1, 0, 4, present));
+	check(ESTALE ==, errno);
+	check(4 ==, pwrite(part1, "old", 4, 4096));
+	check(4 ==, pread(part2, data, 4, 4096));
+	check(0 ==, data[0]);
+	check(-1 ==, file_cache_partial_commit(c, "p", ppath1, part1, map1, gen1));
+	check(0 ==, contains(c, "p"));
+	check(0 ==, file_cache_partial_set(map2, gen2, 0, 4));
+	check(0 ==, file_cache_partial_commit(c, "p", ppath2, part2, map2, gen2));
+	check(1 ==, contains(c, "p"));
+	close(part1);
+	close(map1);
+	close(part2);
+	close(map2);
+
+	/* Nor can it commit the local file of a process that opened the entry after it was evicted or deleted. */
+	file_cache_set_limit(c, 64 * 1024);
+	part1 = file_cache_partial_open(c, "x", ppath1, &map1, &gen1, 2 * 4096, 100, 4096);
+	check(0 <=, part1);
+	check(0 ==, file_cache_partial_set(map1, gen1, 0, 2));
+	check(0 ==, put(c, "y", 60 * 1024));
+	part2 = file_cache_partial_open(c, "x", ppath2, &map2, &gen2, 2 * 4096, 100, 4096);
+	check(0 <=, part2);
+	check(gen1 !=, gen2);
+	check(-1 ==, file_cache_partial_commit(c, "x", ppath1, part1, map1, gen1));
+	check(ESTALE ==, errno);
+	check(-1 ==, file_cache_open(c, "x", O_RDONLY, lpath, 0, 0));
+	file_cache_delete(c, "x");
+	check(-1 ==, file_cache_partial_set(map2, gen2, 0, 2));
+	check(ESTALE ==, errno);
+	check(-1 ==, file_cache_partial_commit(c, "x", ppath2, part2, map2, gen2));
+	check(-1 ==, file_cache_open(c, "x", O_RDONLY, lpath, 0, 0));
+	close(part1);
+	close(map1);
+	close(part2);
+	close(map2);
+
+	/* A partial entry in use is not evicted, whether it is being read or its map is locked. */
+	part1 = file_cache_partial_open(c, "t", ppath1, &map1, &gen1, 2 * 4096, 100, 4096);
+	check(0 <=, part1);
+	for (i = 0; i < 20; i++) {
+		sprintf(name, "t.%d", i);
+		check(0 ==, put(c, name, 8 * 1024));
+		file_cache_partial_touch(c, "t");
+	}
+	check(0 ==, file_cache_partial_set(map1, gen1, 0, 1));
+	check(0 ==, flock(map1, LOCK_SH));
+	for (i = 0; i < 20; i++) {
+		sprintf(name, "u.%d", i);
+		check(0 ==, put(c, name, 8 * 1024));
+	}
+	check(0 ==, file_cache_partial_set(map1, gen1, 1, 1));
+	check(0 ==, file_cache_partial_commit(c, "t", ppath1, part1, map1, gen1));
+	check(1 ==, contains(c, "t"));
+	close(part1);
+	close(map1);
+
+	/* Eviction follows the order of use over many entries. */
+	file_cache_set_limit(c, 64 * 1024);
+	for (i = 0; i < 1000; i++) {
+		sprintf(name, "lru.%d", i);
+		check(0 ==, put(c, name, 1024));
+		check(1 ==, contains(c, "lru.0"));
+		fd = file_cache_open(c, "lru.0", O_RDONLY, lpath, 0, 0);
+		check(0 <=, fd);
+		close(fd);
+	}
+	check(0 ==, contains(c, "lru.1"));
+	check(0 ==, contains(c, "lru.900"));
+	check(1 ==, contains(c, "lru.999"));
+	check(64 * 1024 >=, usage("$cache"));
+
+	/* Reservations fail once every slot is held by a running process, and recover when they exit. */
+	int ready[2], hold[2];
+	check(0 ==, pipe(ready));
+	check(0 ==, pipe(hold));
+	for (p = 0; p < 256; p++) {
+		if (fork() == 0) {
+			struct file_cache *s = file_cache_init("$cache");
+			file_cache_set_limit(s, 64 * 1024);
+			close(hold[1]);
+			check(0 ==, file_cache_reserve(s, 1));
+			write(ready[1], "", 1);
+			read(hold[0], name, 1);
+			_exit(0);
+		}
+	}
+	close(hold[0]);
+	for (p = 0; p < 256; p++)
+		check(1 ==, read(ready[0], name, 1));
+	check(-1 ==, file_cache_reserve(c, 1));
+	check(ENOSPC ==, errno);
+	close(hold[1]);
+	while (wait(0) > 0)
+		;
+	check(0 ==, file_cache_reserve(c, 1));
+	file_cache_release(c, 1);
+
+	file_cache_fini(c);
+	return 0;
+}
+EOF
+	return $?
+}
+
+run()
+{
+	./"$exe"
+}
+
+clean()
+{
+	rm -rf "$exe" "$cache"
+	return 0
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
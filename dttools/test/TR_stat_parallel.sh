@@ -0,0 +1,84 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+
+exe="stat_parallel.test"
+dir="stat_parallel.dir"
+
+prepare()
+{
+	${CC} -g $CCTOOLS_TEST_CCFLAGS -o "$exe" -x c - -x none -I ../src ../src/libdttools.a -lpthread -lm <<EOF
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "stat_parallel.h"
+
+#define NPATHS 1000
+
+int main (int argc, char *argv[])
+{
+	static char names[NPATHS][64];
+	const char *paths[NPATHS];
+	struct stat info[NPATHS];
+	int errors[NPATHS];
+	int i, expected = 0;
+
+	/* Every third file is missing, and the files are spread over a few directories. */
+	for(i = 0; i < NPATHS; i++) {
+		snprintf(names[i], sizeof(names[i]), "$dir/%d/file.%d", i % 7, i);
+		paths[i] = names[i];
+		if(i % 3) {
+			FILE *file = fopen(names[i], "w");
+			if(!file) return 1;
+			fprintf(file, "%*s", i, "");
+			fclose(file);
+			expected++;
+		}
+	}
+
+	if(stat_files_parallel(paths, NPATHS, info, errors, 0) != expected) {
+		fprintf(stderr, "wrong number of files found\n");
+		return 1;
+	}
+
+	for(i = 0; i < NPATHS; i++) {
+		if(i % 3) {
+			if(errors[i] || info[i].st_size != i) {
+				fprintf(stderr, "%s: wrong status\n", paths[i]);
+				return 1;
+			}
+		} else if(errors[i] != ENOENT) {
+			fprintf(stderr, "%s: should not exist\n", paths[i]);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+EOF
+	return $?
+}
+
+run()
+{
+	mkdir -p "$dir"
+	for i in 0 1 2 3 4 5 6
+	do
+		mkdir -p "$dir/$i"
+	done
+	./"$exe"
+	return $?
+}
+
+clean()
+{
+	rm -rf "$exe" "$dir"
+	return 0
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
@@ -17,6 +17,7 @@ See the file COPYING for details.
 #include "itable.h"
 #include "hash_table.h"
 #include "list.h"
+#include "priority_queue.h"
 #include "set.h"
 #include "stringtools.h"
 #include "rmsummary.h"
@@ -44,6 +45,8 @@ struct dag *dag_create()
 	d->completed_files = 0;
 	d->deleted_files = 0;
 	d->total_file_size = 0;
+	d->names = 0;
+	d->names_left = 0;
 
 	d->categories   = hash_table_create(0, 0);
 	d->default_category = makeflow_category_lookup_or_create(d, "default");
@@ -134,6 +137,33 @@ void dag_find_ancestor_depth(struct dag *d)
 	}
 }
 
+/*
+A large workflow has millions of files, which live as long as the dag.
+Their names are packed into blocks, rather than allocated one by one.
+*/
+
+#define DAG_NAMES_BLOCK_SIZE 65536
+
+static const char *dag_name_copy(struct dag *d, const char *name)
+{
+	size_t length = strlen(name) + 1;
+
+	if(length > DAG_NAMES_BLOCK_SIZE / 16)
+		return xxstrdup(name);
+
+	if(length > d->names_left) {
+		d->names = xxmalloc(DAG_NAMES_BLOCK_SIZE);
+		d->names_left = DAG_NAMES_BLOCK_SIZE;
+	}
+
+	char *copy = d->names;
+	memcpy(copy, name, length);
+	d->names += length;
+	d->names_left -= length;
+
+	return copy;
+}
+
 /* Return the dag_file associated with the local name filename.
  * If one does not exist, it is created. */
 struct dag_file *dag_file_lookup_or_create(struct dag *d, const char *filename)
@@ -143,7 +173,8 @@ struct dag_file *dag_file_lookup_or_create(struct dag *d, const char *filename)
 	f = hash_table_lookup(d->files, filename);
 	if(f) return f;
 
-	f = dag_file_create(filename);
+	f = xxmalloc(sizeof(*f));
+	dag_file_init(f, dag_name_copy(d, filename));
 
 	hash_table_insert(d->files, f->filename, (void *) f);
 
@@ -454,4 +485,143 @@ uint64_t dag_absolute_filesize( struct dag *d )
 	}
 	return size;
 }
+
+/* Whether a file in the given state should exist, as dag_file_should_exist. */
+
+static int dag_file_state_should_exist( const struct dag_file *f, int state )
+{
+	return state == DAG_FILE_STATE_EXISTS || state == DAG_FILE_STATE_COMPLETE || dag_file_is_source(f);
+}
+
+/*
+The estimated running time of a node is its wall time, as given by the
+rule or its category, or one unit when no estimate is given.
+*/
+
+static double dag_node_estimated_time( struct dag_node *n )
+{
+	const struct rmsummary *r = dag_node_dynamic_label(n);
+	if(r && r->wall_time > 0)
+		return r->wall_time;
+	return 1;
+}
+
+/*
+Give each node the bottom level of the dag: its own estimated time plus
+the greatest priority of its descendants.  Nodes are visited from the
+leaves upward, once all of their descendants have been visited.
+*/
+
+void dag_compute_priorities( struct dag *d )
+{
+	struct dag_node *n, *m;
+	int *remaining = calloc(d->nodeid_counter + 1, sizeof(int));
+	struct list *ready = list_create();
+
+	for(n = d->nodes; n; n = n->next) {
+		n->priority = 0;
+		remaining[n->nodeid] = set_size(n->descendants);
+		if(remaining[n->nodeid] == 0)
+			list_push_tail(ready, n);
+	}
+
+	while((n = list_pop_head(ready))) {
+		n->priority += dag_node_estimated_time(n);
+
+		set_first_element(n->ancestors);
+		while((m = set_next_element(n->ancestors))) {
+			if(n->priority > m->priority)
+				m->priority = n->priority;
+			if(--remaining[m->nodeid] == 0)
+				list_push_tail(ready, m);
+		}
+	}
+
+	list_delete(ready);
+	free(remaining);
+}
+
+void dag_ready_init( struct dag *d )
+{
+	struct dag_node *n;
+	struct dag_file *f;
+
+	d->ready_remote = priority_queue_create(0);
+	d->ready_local = priority_queue_create(0);
+
+	dag_compute_priorities(d);
+
+	for(n = d->nodes; n; n = n->next) {
+		n->sources_missing = 0;
+		n->ready_queued = 0;
+		list_first_item(n->source_files);
+		while((f = list_next_item(n->source_files))) {
+			if(!dag_file_should_exist(f))
+				n->sources_missing++;
+		}
+		dag_ready_push(d, n);
+	}
+}
+
+/*
+Add a node to its ready queue if it is waiting, has all of its sources,
+and is not already queued.  Nodes are taken in order of priority.
+*/
+
+void dag_ready_push( struct dag *d, struct dag_node *n )
+{
+	if(!d->ready_remote) return;
+	if(n->ready_queued || n->state != DAG_NODE_STATE_WAITING || n->sources_missing > 0) return;
+
+	n->ready_queued = 1;
+	priority_queue_push(n->local_job ? d->ready_local : d->ready_remote, n, n->priority);
+}
+
+/*
+Take the next ready node, skipping over those which stopped being ready
+while queued, for instance because an input was deleted by a reset.
+*/
+
+struct dag_node *dag_ready_pop( struct dag *d, int local )
+{
+	struct priority_queue *q = local ? d->ready_local : d->ready_remote;
+	struct dag_node *n;
+
+	if(!q) return 0;
+
+	while((n = priority_queue_pop(q))) {
+		n->ready_queued = 0;
+		if(n->state == DAG_NODE_STATE_WAITING && n->sources_missing == 0)
+			return n;
+	}
+
+	return 0;
+}
+
+void dag_ready_file_state_change( struct dag *d, struct dag_file *f, int oldstate )
+{
+	struct dag_node *n;
+
+	if(!d->ready_remote) return;
+
+	int before = dag_file_state_should_exist(f, oldstate);
+	int after = dag_file_should_exist(f);
+	if(before == after) return;
+
+	list_first_item(f->needed_by);
+	while((n = list_next_item(f->needed_by))) {
+		if(after) {
+			n->sources_missing--;
+			dag_ready_push(d, n);
+		} else {
+			n->sources_missing++;
+		}
+	}
+}
+
+void dag_ready_node_state_change( struct dag *d, struct dag_node *n )
+{
+	dag_ready_push(d, n);
+}
+
 /* vim: set noexpandtab tabstop=4: */
@@ -37,6 +37,8 @@ struct dag {
 
 	/* Dynamic states related to execution via Makeflow. */
 	FILE *logfile;
+	int logfile_binary;                 /* Flag: is the log in the binary format of makeflow_log_binary.h? */
+	int logfile_names;                  /* The number of file names given an id in the binary log. */
 	int node_states[DAG_NODE_STATE_MAX];/* node_states[STATE] keeps the count of nodes that have state STATE \in dag_node_state_t. */
 	int nodeid_counter;                 /* Keeps a count of production rules read so far (used for the value of dag_node->nodeid). */
 
@@ -48,6 +50,12 @@ struct dag {
 	char *cache_dir;                    /* The dirname of the cache storing all the deps specified in the mountfile */
 
 	uint64_t total_file_size;           /* Keeps cumulative size of existing files. */
+
+	char *names;                        /* The unused part of the current block of file names. */
+	size_t names_left;                  /* The size of that unused part. */
+
+	struct priority_queue *ready_remote; /* Waiting nodes whose sources should all exist, by priority. */
+	struct priority_queue *ready_local;  /* The same, for nodes with prefix LOCAL. */
 };
 
 struct dag *dag_create();
@@ -77,4 +85,21 @@ int dag_mount_clean( struct dag *d );
 
 uint64_t dag_absolute_filesize( struct dag *d );
 
+/*
+Waiting nodes are kept in a ready queue once all their source files
+should exist, so that finding the nodes to run does not require a scan
+of the whole dag.  The queues are created by dag_ready_init, and from then
+on kept up to date by the state changes logged by makeflow_log.
+Ready nodes are taken in order of dag_compute_priorities, so that the
+nodes on the critical path of the workflow run first.
+*/
+
+void dag_compute_priorities( struct dag *d );
+
+void dag_ready_init( struct dag *d );
+void dag_ready_file_state_change( struct dag *d, struct dag_file *f, int oldstate );
+void dag_ready_node_state_change( struct dag *d, struct dag_node *n );
+void dag_ready_push( struct dag *d, struct dag_node *n );
+struct dag_node *dag_ready_pop( struct dag *d, int local );
+
 #endif
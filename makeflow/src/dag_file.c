@@ -12,11 +12,19 @@ See the file COPYING for details.
 #include "macros.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 struct dag_file * dag_file_create( const char *filename )
 {
-	struct dag_file *f = xxcalloc(1, sizeof(*f));
-	f->filename = xxstrdup(filename);
+	struct dag_file *f = xxmalloc(sizeof(*f));
+	dag_file_init(f, xxstrdup(filename));
+	return f;
+}
+
+void dag_file_init( struct dag_file *f, const char *filename )
+{
+	memset(f, 0, sizeof(*f));
+	f->filename = filename;
 	f->needed_by = list_create();
 	f->created_by = 0;
 	f->actual_size = 0;
@@ -27,7 +35,8 @@ struct dag_file * dag_file_create( const char *filename )
 	f->source = NULL;
 	f->cache_name = NULL;
 	f->source_type = DAG_FILE_SOURCE_LOCAL;
-	return f;
+	f->log_id = 0;
+	f->remote_temp = 0;
 }
 
 /* Return JX object containing name, remote name, and size. */
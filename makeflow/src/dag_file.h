@@ -64,6 +64,8 @@ struct dag_file {
 	char *cache_name;               /* the name of a file dependency in the cache, by default is NULL */
 	dag_file_source_t source_type;  /* the type of the source of a dependency */
 	char *hash;                     /* the hash computed based on the files contents */
+	int log_id;                     /* The id of the file in a binary log, or zero if not named there yet. */
+	int remote_temp;                /* Flag: the file stays within the batch system, and is never brought back. */
 };
 
 /** Create dag file struct.
@@ -72,6 +74,12 @@ struct dag_file {
 */
 struct dag_file *dag_file_create( const char *filename );
 
+/** Initialize a dag file struct allocated by the caller.
+@param f The dag_file to initialize.
+@param filename The unique filename, which must outlive the struct.
+*/
+void dag_file_init( struct dag_file *f, const char *filename );
+
 /** Create JX object of file struct.
 Contains dag_name (originally filename, will be outer_name in code), 
 task_name(originally remote_filename, will be inner_name in code), 
@@ -25,6 +25,14 @@ See the file COPYING for details.
 
 extern char **environ; 
 
+/*
+Most nodes have only a few variables, remote names, and neighbors,
+and a workflow may have millions of nodes, so the tables of each node
+start small and grow as needed.
+*/
+
+#define DAG_NODE_TABLE_BUCKETS 1
+
 struct dag_node *dag_node_create(struct dag *d, int linenum)
 {
 	struct dag_node *n = calloc(1, sizeof(*n));
@@ -33,17 +41,17 @@ struct dag_node *dag_node_create(struct dag *d, int linenum)
 	n->linenum = linenum;
 	n->state = DAG_NODE_STATE_WAITING;
 	n->nodeid = d->nodeid_counter++;
-	n->variables = hash_table_create(0, 0);
+	n->variables = hash_table_create(DAG_NODE_TABLE_BUCKETS, 0);
 
 	n->type = DAG_NODE_TYPE_COMMAND;
 	n->source_files = list_create();
 	n->target_files = list_create();
 
-	n->remote_names = itable_create(0);
-	n->remote_names_inv = hash_table_create(0, 0);
+	n->remote_names = itable_create(DAG_NODE_TABLE_BUCKETS);
+	n->remote_names_inv = hash_table_create(DAG_NODE_TABLE_BUCKETS, 0);
 
-	n->descendants = set_create(0);
-	n->ancestors = set_create(0);
+	n->descendants = set_create(DAG_NODE_TABLE_BUCKETS);
+	n->ancestors = set_create(DAG_NODE_TABLE_BUCKETS);
 
 	n->ancestor_depth = -1;
 
@@ -51,8 +59,9 @@ struct dag_node *dag_node_create(struct dag *d, int linenum)
 	// PROBABLY not what you want. Most likely you want dag_node_dynamic_label(n)
 	n->resources_requested = rmsummary_create(-1);
 
-	// the value of dag_node_dynamic_label(n) when this node was submitted.
-	n->resources_allocated  = rmsummary_create(-1);
+	// the value of dag_node_dynamic_label(n) when this node was submitted,
+	// created only when the node is submitted.
+	n->resources_allocated  = NULL;
 
 	// resources used by the node, as measured by the resource_monitor (if
 	// using monitoring).
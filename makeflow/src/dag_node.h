@@ -86,6 +86,9 @@ struct dag_node {
 	batch_queue_id_t jobid;               /* The id this node get, either from the local or remote batch system. */
 	dag_node_state_t state;             /* Enum: DAG_NODE_STATE_{WAITING,RUNNING,...} */
 	int failure_count;                  /* How many times has this rule failed? (see -R and -r) */
+	int sources_missing;                /* Number of source files that should not exist yet. */
+	int ready_queued;                   /* Flag: is this node in a ready queue of the dag? */
+	double priority;                    /* Estimated time along the longest path from this node to the end of the dag. */
 	time_t previous_completion;
 
 	const char *umbrella_spec;          /* the umbrella spec file for executing this job */
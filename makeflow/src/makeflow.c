@@ -35,6 +35,7 @@ See the file COPYING for details.
 #include "create_dir.h"
 #include "sha1.h"
 #include "tlq_config.h"
+#include "stat_parallel.h"
 
 #include "dag.h"
 #include "dag_node.h"
@@ -59,6 +60,7 @@ See the file COPYING for details.
 #include <assert.h>
 #include <unistd.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -213,6 +215,23 @@ once weaver/pbui tools are updated.)
 */
 static int log_verbose_mode = 0;
 
+/*
+Write a new transaction log in the binary format of makeflow_log_binary.h.
+*/
+static int log_binary_mode = 0;
+
+/*
+Keep intermediate files that are only passed between remote rules
+within the batch system, if it supports temp files.
+*/
+static int remote_temp_files = 0;
+
+/*
+Run each local job in its own cgroup, where its declared
+cores and memory are enforced and its usage is measured.
+*/
+static int local_cgroups = 0;
+
 /*
 Send periodic reports of type "makeflow" to the catalog
 server, viewable by the makeflow_status command. 
@@ -364,17 +383,21 @@ struct batch_job *makeflow_node_to_task(struct dag_node *n, struct batch_queue *
 	/* Add all input and output files to the task */
 
 	struct dag_file *f;
+	struct batch_file *bf;
 	list_first_item(n->source_files);
 	while((f = list_next_item(n->source_files))){
-		batch_job_add_input_file(task, f->filename, dag_node_get_remote_name(n, f->filename));
+		bf = batch_job_add_input_file(task, f->filename, dag_node_get_remote_name(n, f->filename));
+		if(f->remote_temp) bf->flags |= BATCH_FILE_TEMP;
 	}
 
 	list_first_item(n->target_files);
 	while((f = list_next_item(n->target_files))){
-		batch_job_add_output_file(task, f->filename, dag_node_get_remote_name(n, f->filename));
+		bf = batch_job_add_output_file(task, f->filename, dag_node_get_remote_name(n, f->filename));
+		if(f->remote_temp) bf->flags |= BATCH_FILE_TEMP;
 	}
 
 	batch_job_set_resources(task, dag_node_dynamic_label(n));
+	batch_job_set_priority(task, n->priority);
 
 	struct jx *env = dag_node_env_create(n->d, n, should_send_all_local_environment);
 	batch_job_set_envlist(task, env);
@@ -631,6 +654,8 @@ static enum job_submit_status makeflow_node_submit(struct dag *d, struct dag_nod
 			debug(D_MAKEFLOW_RUN, "node %d was successfully submitted.", n->nodeid);
 			n->jobid = task->jobid;
 			/* Not sure if this is necessary/what it does. */
+			if(!n->resources_allocated)
+				n->resources_allocated = rmsummary_create(-1);
 			memcpy(n->resources_allocated, task->resources, sizeof(struct rmsummary));
 			makeflow_log_state_change(d, n, DAG_NODE_STATE_RUNNING);
 
@@ -726,13 +751,70 @@ int makeflow_nodes_remote_waiting_count(const struct dag *d) {
 	return count;
 }
 
+/*
+Submit jobs from one of the ready queues, until the corresponding
+limit on running jobs is reached or the queue is exhausted.
+Nodes which cannot be submitted right now are set aside and put back
+at the end of the pass, so that each ready node is examined at most once
+per pass, and one blocked by local resources cannot hide those behind it.
+Returns false if the workflow was aborted.
+*/
+
+static int makeflow_dispatch_ready_queue(struct dag *d, int local, int *submission_timeout, struct list *deferred)
+{
+	struct dag_node *n;
+
+	while(1) {
+		if(local && local_queue) {
+			if(dag_local_jobs_running(d) >= local_jobs_max) break;
+		} else {
+			if(dag_remote_jobs_running(d) >= remote_jobs_max) break;
+		}
+
+		n = dag_ready_pop(d, local);
+		if(!n) break;
+
+		/* Only local jobs are tried for the rest of a pass after a submission timed out. */
+		if(*submission_timeout && !is_local_job(n)) {
+			list_push_tail(deferred, n);
+			break;
+		}
+
+		const struct rmsummary *resources = dag_node_dynamic_label(n);
+
+		if(!makeflow_node_ready(d, n, resources)) {
+			list_push_tail(deferred, n);
+			continue;
+		}
+
+		enum job_submit_status status = makeflow_node_submit(d, n, resources);
+
+		if(status == JOB_SUBMISSION_ABORTED) {
+			list_push_tail(deferred, n);
+			return 0;
+		} else if(status == JOB_SUBMISSION_TIMEOUT) {
+			debug(D_MAKEFLOW_RUN, "batch submissions are timing-out. Only submitting local jobs for the rest of this cycle.");
+			*submission_timeout = 1;
+			list_push_tail(deferred, n);
+		} else if(n->state == DAG_NODE_STATE_WAITING) {
+			/* A node put back to waiting during its submission, e.g. by a hook, is tried again next pass. */
+			list_push_tail(deferred, n);
+		}
+	}
+
+	return 1;
+}
+
 /*
 Find all jobs ready to be run, then submit them.
+The ready queues hold only the waiting nodes whose sources should all exist,
+so the cost of a pass depends on the nodes that can run, not on the size of the dag.
 */
 
 static void makeflow_dispatch_ready_jobs(struct dag *d)
 {
 	struct dag_node *n;
+	struct list *deferred = list_create();
 
 	/* When submitting to an external queue if there are no resources
 	 * available, such as vms in amazon, then the submission fails with a
@@ -744,26 +826,14 @@ static void makeflow_dispatch_ready_jobs(struct dag *d)
 	 */
 	int submission_timeout = 0;
 
-	for(n = d->nodes; n; n = n->next) {
-		if(dag_remote_jobs_running(d) >= remote_jobs_max && dag_local_jobs_running(d) >= local_jobs_max) {
-			break;
-		}
-
-		const struct rmsummary *resources = dag_node_dynamic_label(n);
-
-		if(makeflow_node_ready(d, n, resources)) {
-			if(is_local_job(n) || !submission_timeout) {
-				enum job_submit_status status = makeflow_node_submit(d, n, resources);
+	if(makeflow_dispatch_ready_queue(d, 0, &submission_timeout, deferred)) {
+		makeflow_dispatch_ready_queue(d, 1, &submission_timeout, deferred);
+	}
 
-				if(status == JOB_SUBMISSION_ABORTED) {
-					break;
-				} else if(status == JOB_SUBMISSION_TIMEOUT) {
-					debug(D_MAKEFLOW_RUN, "batch submissions are timing-out. Only submitting local jobs for the rest of this cycle.");
-					submission_timeout = 1;
-				}
-			}
-		}
+	while((n = list_pop_head(deferred))) {
+		dag_ready_push(d, n);
 	}
+	list_delete(deferred);
 }
 
 /*
@@ -837,6 +907,10 @@ static void makeflow_node_complete(struct dag *d, struct dag_node *n, struct bat
 		makeflow_local_resources_add(local_resources,n);
 	}
 
+	if(task->info->cpu_time > 0 || task->info->memory > 0) {
+		debug(D_MAKEFLOW_RUN, "node %d used %.2lfs of cpu time and %" PRId64 " MB of memory", n->nodeid, task->info->cpu_time / 1000000.0, task->info->memory);
+	}
+
 	rc = makeflow_hook_node_end(n, task);
 	if (rc != MAKEFLOW_HOOK_SUCCESS){
 		makeflow_failed_flag = 1;
@@ -846,7 +920,10 @@ static void makeflow_node_complete(struct dag *d, struct dag_node *n, struct bat
 		list_first_item(n->task->output_files);
 		while ((bf = list_next_item(n->task->output_files))) {
 			f = dag_file_lookup_or_create(d, bf->outer_name);
-			if (!makeflow_node_check_file_was_created(d, n, f)) {
+			if (f->remote_temp) {
+				/* The batch system keeps the file, so there is nothing to look for here. */
+				makeflow_log_file_state_change(d, f, DAG_FILE_STATE_EXISTS);
+			} else if (!makeflow_node_check_file_was_created(d, n, f)) {
 				job_failed = 1;
 			}
 		}
@@ -933,6 +1010,47 @@ static void makeflow_node_complete(struct dag *d, struct dag_node *n, struct bat
 	}
 }
 
+/*
+Find the intermediate files that are created by a remote rule and
+consumed only by remote rules, so that they may stay with the batch
+system rather than coming back here between rules.  Files named as
+inputs or outputs of the workflow, and files created or needed by
+local rules or sub-workflows, are always brought back.
+*/
+
+static int makeflow_node_keeps_remote_temp( struct dag_node *n )
+{
+	return n->type == DAG_NODE_TYPE_COMMAND && !n->local_job;
+}
+
+static void makeflow_mark_remote_temp_files( struct dag *d )
+{
+	struct dag_file *f;
+	struct dag_node *n;
+	char *name;
+	int count = 0;
+
+	hash_table_firstkey(d->files);
+	while(hash_table_nextkey(d->files, &name, (void **) &f)) {
+		if(dag_file_is_source(f) || dag_file_is_sink(f)) continue;
+		if(set_lookup(d->inputs, f) || set_lookup(d->outputs, f)) continue;
+		if(!makeflow_node_keeps_remote_temp(f->created_by)) continue;
+
+		int remote_only = 1;
+		list_first_item(f->needed_by);
+		while((n = list_next_item(f->needed_by))) {
+			if(!makeflow_node_keeps_remote_temp(n)) remote_only = 0;
+		}
+
+		if(remote_only) {
+			f->remote_temp = 1;
+			count++;
+		}
+	}
+
+	debug(D_MAKEFLOW_RUN, "%d intermediate files will be kept by the batch system", count);
+}
+
 /*
 Check the dag for all files that should exist,
 whether provided by the user, or created by 
@@ -941,7 +1059,6 @@ a prior run that was logged.
 
 static int makeflow_check_files(struct dag *d)
 {
-	struct stat buf;
 	struct dag_file *f;
 	char *name;
 	int errors = 0;
@@ -949,6 +1066,15 @@ static int makeflow_check_files(struct dag *d)
 
 	printf("checking files for unexpected changes...  (use --skip-file-check to skip this step)\n");
 
+	/*
+	Look at all of the files at once, since on a shared filesystem
+	each one is a round trip to the server, and then act on the
+	results one file at a time in the order of the file table.
+	*/
+
+	int nfiles = 0;
+	struct dag_file **files = xxmalloc(MAX(hash_table_size(d->files), 1) * sizeof(*files));
+
 	hash_table_firstkey(d->files);
 	while(hash_table_nextkey(d->files, &name, (void **) &f)) {
 
@@ -958,8 +1084,39 @@ static int makeflow_check_files(struct dag *d)
 		/* Skip any file that should not exist yet. */
 		if(!dag_file_should_exist(f)) continue;
 
+		/*
+		A temp file was kept by the workers of a previous run, and is gone.
+		If some rule still needs it, run the rule that creates it again.
+		*/
+		if(f->remote_temp) {
+			if(f->state == DAG_FILE_STATE_EXISTS) {
+				makeflow_log_file_state_change(d, f, DAG_FILE_STATE_UNKNOWN);
+				makeflow_node_reset(d, f->created_by);
+			}
+			continue;
+		}
+
+		files[nfiles++] = f;
+	}
+
+	const char **paths = xxmalloc(MAX(nfiles, 1) * sizeof(*paths));
+	struct stat *info = xxmalloc(MAX(nfiles, 1) * sizeof(*info));
+	int *stat_errors = xxmalloc(MAX(nfiles, 1) * sizeof(*stat_errors));
+
+	int i;
+	for(i = 0; i < nfiles; i++) paths[i] = files[i]->filename;
+
+	stat_files_parallel(paths, nfiles, info, stat_errors, 0);
+
+	for(i = 0; i < nfiles; i++) {
+		f = files[i];
+
+		/* Resetting a node for an earlier file may have changed this one. */
+		if(!dag_file_should_exist(f)) continue;
+
 		/* Check for the presence of the file. */
-		int result = stat(f->filename, &buf );
+		int result = stat_errors[i] ? -1 : 0;
+		struct stat buf = info[i];
 
 		if(dag_file_is_source(f)) {
 			/* Source files must exist before running */
@@ -984,6 +1141,11 @@ static int makeflow_check_files(struct dag *d)
 		}
 	}
 
+	free(files);
+	free(paths);
+	free(info);
+	free(stat_errors);
+
 	if(errors>0 || warnings>0) {
 		printf("found %d errors and %d warnings during consistency check.\n", errors,warnings);
 	}
@@ -1030,15 +1192,45 @@ static int makeflow_check_batch_consistency(struct dag *d)
 	}
 }
 
+/*
+Wait for jobs in one queue to complete, then complete every job the queue
+has already finished before dispatching again, so that a burst of completions
+costs one pass through the main loop rather than one pass each.
+Returns the number of jobs completed.
+*/
+
+#define MAKEFLOW_WAIT_MANY_MAX 1000
+
+static int makeflow_collect_jobs( struct dag *d, struct batch_queue *queue, struct itable *job_table, time_t stoptime, batch_queue_id_t *jobids, struct batch_job_info *infos )
+{
+	int count = batch_queue_wait_many(queue, jobids, infos, MAKEFLOW_WAIT_MANY_MAX, stoptime);
+	int i;
+
+	for(i = 0; i < count; i++) {
+		batch_queue_id_t jobid = jobids[i];
+		if(queue == remote_queue) {
+			printf("job %"PRIbjid" completed\n",jobid);
+		}
+		debug(D_MAKEFLOW_RUN, "Job %" PRIbjid " has returned.\n", jobid);
+		struct dag_node *n = itable_remove(job_table, jobid);
+		if(n){
+			// Stop gap until batch_queue_wait returns task struct
+			batch_job_set_info(n->task, &infos[i]);
+			makeflow_node_complete(d, n, queue, n->task);
+		}
+	}
+
+	return MAX(count, 0);
+}
+
 /*
 Main loop for running a makeflow: submit jobs, wait for completion, keep going until everything done.
 */
 
 static void makeflow_run( struct dag *d )
 {
-	struct dag_node *n;
-	batch_queue_id_t jobid;
-	struct batch_job_info info;
+	batch_queue_id_t *jobids = xxmalloc(MAKEFLOW_WAIT_MANY_MAX * sizeof(*jobids));
+	struct batch_job_info *infos = xxmalloc(MAKEFLOW_WAIT_MANY_MAX * sizeof(*infos));
 	// Start Catalog at current time
 	timestamp_t start = timestamp_get();
 	// Last Report is created stall for first reporting.
@@ -1053,6 +1245,8 @@ static void makeflow_run( struct dag *d )
 		makeflow_file_summary(d, project, batch_queue_type, start, file_status_name);
 	}
 	
+	dag_ready_init(d);
+
 	while(!makeflow_abort_flag) {
 		makeflow_dispatch_ready_jobs(d);
 		/*
@@ -1069,19 +1263,14 @@ static void makeflow_run( struct dag *d )
 			break;
 		}
 
+		int completed = 0;
+
+		/* Commit the events of this pass through the loop before waiting. */
+		makeflow_log_flush(d);
+
 		if(dag_remote_jobs_running(d)) {
 			int tmp_timeout = 5;
-			jobid = batch_queue_wait_timeout(remote_queue, &info, time(0) + tmp_timeout);
-			if(jobid > 0) {
-				printf("job %"PRIbjid" completed\n",jobid);
-				debug(D_MAKEFLOW_RUN, "Job %" PRIbjid " has returned.\n", jobid);
-				n = itable_remove(d->remote_job_table, jobid);
-				if(n){
-					// Stop gap until batch_queue_wait returns task struct
-					batch_job_set_info(n->task, &info);
-					makeflow_node_complete(d, n, remote_queue, n->task);
-				}
-			}
+			completed += makeflow_collect_jobs(d, remote_queue, d->remote_job_table, time(0) + tmp_timeout, jobids, infos);
 		}
 
 		if(dag_local_jobs_running(d)) {
@@ -1094,16 +1283,7 @@ static void makeflow_run( struct dag *d )
 				stoptime = time(0) + tmp_timeout;
 			}
 
-			jobid = batch_queue_wait_timeout(local_queue, &info, stoptime);
-			if(jobid > 0) {
-				debug(D_MAKEFLOW_RUN, "Job %" PRIbjid " has returned.\n", jobid);
-				n = itable_remove(d->local_job_table, jobid);
-				if(n){
-					// Stop gap until batch_queue_wait returns task struct
-					batch_job_set_info(n->task, &info);
-					makeflow_node_complete(d, n, local_queue, n->task);
-				}
-			}
+			completed += makeflow_collect_jobs(d, local_queue, d->local_job_table, stoptime, jobids, infos);
 		}
 
 		/* Report to catalog */
@@ -1125,8 +1305,8 @@ static void makeflow_run( struct dag *d )
 		/* Rather than try to garbage collect after each time in this
 		 * wait loop, perform garbage collection after a proportional
 		 * amount of tasks have passed. */
-		makeflow_gc_barrier--;
-		if(makeflow_gc_method != MAKEFLOW_GC_NONE && makeflow_gc_barrier == 0) {
+		makeflow_gc_barrier -= MAX(completed, 1);
+		if(makeflow_gc_method != MAKEFLOW_GC_NONE && makeflow_gc_barrier <= 0) {
 			makeflow_gc(d, remote_queue, makeflow_gc_method, makeflow_gc_size, makeflow_gc_count);
 			makeflow_gc_barrier = MAX(d->nodeid_counter * makeflow_gc_task_ratio, 1);
 		}
@@ -1147,6 +1327,9 @@ static void makeflow_run( struct dag *d )
 	} else if(!makeflow_failed_flag && makeflow_gc_method != MAKEFLOW_GC_NONE) {
 		makeflow_gc(d,remote_queue,MAKEFLOW_GC_ALL,0,0);
 	}
+
+	free(jobids);
+	free(infos);
 }
 
 /*
@@ -1196,6 +1379,7 @@ static void show_help_run(const char *cmd)
 	printf("    --jx-args=<file>            File defining JX variables for JX workflow.\n");
 	printf("    --jx-define=<VAR>=<EXPR>	Set the JX variable VAR to JX expression EXPR.\n");
 	printf("    --log-verbose               Add node id symbol tags in the makeflow log.\n");
+	printf("    --log-format=<text|binary>  Format of a new makeflow log. (default is text)\n");
 	printf(" -j,--max-local=<#>             Max number of local jobs to run at once.\n");
 	printf(" -J,--max-remote=<#>            Max number of remote jobs to run at once.\n");
 	printf(" -R,--retry                     Retry failed batch jobs up to 5 times.\n");
@@ -1216,6 +1400,7 @@ static void show_help_run(const char *cmd)
 	printf("    --archive-dir=<dir>         Archive directory(/tmp/makeflow.archive.USERID).\n");
 	printf("    --archive-read              Read jobs from archive.\n");
 	printf("    --archive-write             Write jobs into archive.\n");
+	printf("    --archive-threads=<n>       Archive jobs in the background with n threads. (default 4, 0 to archive at once)\n");
 	printf(" -A,--disable-afs-check         Disable the check for AFS. (experts only.)\n");
 	printf("    --cache=<dir>               Use this dir to cache downloaded mounted files.\n");
 	printf(" -X,--change-directory=<dir>    Change to <dir> before executing the workflow.\n");
@@ -1244,6 +1429,7 @@ static void show_help_run(const char *cmd)
 	printf(" -t,--keepalive-timeout=<#>     Work Queue keepalive timeout. (default: 30s)\n");
 	printf(" -u,--keepalive-interval=<#>    Work Queue keepalive interval. (default: 120s)\n");
 	printf(" -W,--schedule=<mode>           Work Queue scheduling algor. (time|files|fcfs)\n");
+	printf("    --vine-temp-files           Keep intermediate files of remote rules on TaskVine workers.\n");
 	printf("    --preferred-connection      Preferred connection: by_ip | by_hostname\n");
 	        /********************************************************************************/
 	printf("\nBatch System Options:\n");
@@ -1253,6 +1439,7 @@ static void show_help_run(const char *cmd)
 	printf("    --local-cores=#             Max number of local cores to use.\n");
 	printf("    --local-memory=#            Max amount of local memory (MB) to use.\n");
 	printf("    --local-disk=#              Max amount of local disk (MB) to use.\n");
+	printf("    --local-cgroups             Confine each local job to its own cgroup.\n");
 	printf("    --safe-submit-mode          Excludes resources at submission.\n");
 	printf("                                  (SLURM, TORQUE, and PBS)\n");
 	printf("    --verbose-jobnames          Set the job name based on the command.\n");
@@ -1417,6 +1604,7 @@ int main(int argc, char *argv[])
 		LONG_OPT_FAIL_DIR,
 		LONG_OPT_GC_SIZE,
 		LONG_OPT_IGNORE_MEM,
+		LONG_OPT_LOCAL_CGROUPS,
 		LONG_OPT_LOCAL_CORES,
 		LONG_OPT_LOCAL_MEMORY,
 		LONG_OPT_LOCAL_DISK,
@@ -1442,6 +1630,8 @@ int main(int argc, char *argv[])
 		LONG_OPT_VC3_OPT,
 		LONG_OPT_VERBOSE_PARSING,
 		LONG_OPT_LOG_VERBOSE_MODE,
+		LONG_OPT_LOG_FORMAT,
+		LONG_OPT_VINE_TEMP_FILES,
 		LONG_OPT_WORKING_DIR,
 		LONG_OPT_PREFERRED_CONNECTION,
 		LONG_OPT_WAIT_FOR_WORKERS,
@@ -1473,6 +1663,7 @@ int main(int argc, char *argv[])
 		LONG_OPT_ARCHIVE,
 		LONG_OPT_ARCHIVE_S3,
 		LONG_OPT_ARCHIVE_S3_NO_CHECK,
+		LONG_OPT_ARCHIVE_THREADS,
 		LONG_OPT_S3_HOSTNAME,
 		LONG_OPT_S3_KEYID,
 		LONG_OPT_S3_SECRETKEY,
@@ -1516,6 +1707,7 @@ int main(int argc, char *argv[])
 		{"help", no_argument, 0, 'h'},
 		{"ignore-memory-spec", no_argument, 0, LONG_OPT_IGNORE_MEM},
 		{"batch-mem-type", required_argument, 0, LONG_OPT_BATCH_MEM_TYPE},
+		{"local-cgroups", no_argument, 0, LONG_OPT_LOCAL_CGROUPS},
 		{"local-cores", required_argument, 0, LONG_OPT_LOCAL_CORES},
 		{"local-memory", required_argument, 0, LONG_OPT_LOCAL_MEMORY},
 		{"local-disk", required_argument, 0, LONG_OPT_LOCAL_DISK},
@@ -1558,6 +1750,8 @@ int main(int argc, char *argv[])
 		{"vc3-options", required_argument, 0, LONG_OPT_VC3_OPT},
 		{"version", no_argument, 0, 'v'},
 		{"log-verbose", no_argument, 0, LONG_OPT_LOG_VERBOSE_MODE},
+		{"log-format", required_argument, 0, LONG_OPT_LOG_FORMAT},
+		{"vine-temp-files", no_argument, 0, LONG_OPT_VINE_TEMP_FILES},
 		{"working-dir", required_argument, 0, LONG_OPT_WORKING_DIR},
 		{"skip-file-check", no_argument, 0, LONG_OPT_SKIP_FILE_CHECK},
 		{"umbrella-binary", required_argument, 0, LONG_OPT_UMBRELLA_BINARY},
@@ -1598,6 +1792,7 @@ int main(int argc, char *argv[])
 		{"archive-dir", required_argument, 0, LONG_OPT_ARCHIVE_DIR},
 		{"archive-read", no_argument, 0, LONG_OPT_ARCHIVE_READ},
 		{"archive-write", no_argument, 0, LONG_OPT_ARCHIVE_WRITE},
+		{"archive-threads", required_argument, 0, LONG_OPT_ARCHIVE_THREADS},
 		{"k8s-image", required_argument, 0, LONG_OPT_K8S_IMG},
 		{"verbose-jobnames", no_argument, 0, LONG_OPT_VERBOSE_JOBNAMES},
 		{"keep-wrapper-stdout", no_argument, 0, LONG_OPT_KEEP_WRAPPER_STDOUT},
@@ -1702,6 +1897,9 @@ int main(int argc, char *argv[])
 			case 'm':
 				email_summary_to = xxstrdup(optarg);
 				break;
+			case LONG_OPT_LOCAL_CGROUPS:
+				local_cgroups = 1;
+				break;
 			case LONG_OPT_LOCAL_CORES:
 				explicit_local_cores = atoi(optarg);
 				break;
@@ -1849,6 +2047,18 @@ int main(int argc, char *argv[])
 			case LONG_OPT_LOG_VERBOSE_MODE:
 				log_verbose_mode = 1;
 				break;
+			case LONG_OPT_LOG_FORMAT:
+				if(!strcmp(optarg, "binary")) {
+					log_binary_mode = 1;
+				} else if(!strcmp(optarg, "text")) {
+					log_binary_mode = 0;
+				} else {
+					fatal("unknown log format: %s (must be text or binary)", optarg);
+				}
+				break;
+			case LONG_OPT_VINE_TEMP_FILES:
+				remote_temp_files = 1;
+				break;
 			case LONG_OPT_WRAPPER:
 				if (makeflow_hook_register(&makeflow_hook_basic_wrapper, &hook_args) == MAKEFLOW_HOOK_FAILURE)
 					goto EXIT_WITH_FAILURE;
@@ -2028,6 +2238,11 @@ int main(int argc, char *argv[])
 					goto EXIT_WITH_FAILURE;
 				jx_insert(hook_args, jx_string("archive_write"), jx_boolean(1));
 				break;
+			case LONG_OPT_ARCHIVE_THREADS:
+				if (makeflow_hook_register(&makeflow_hook_archive, &hook_args) == MAKEFLOW_HOOK_FAILURE)
+					goto EXIT_WITH_FAILURE;
+				jx_insert(hook_args, jx_string("archive_threads"), jx_integer(atoi(optarg)));
+				break;
 #endif
 			case LONG_OPT_SEND_ENVIRONMENT:
 				should_send_all_local_environment = 1;
@@ -2350,6 +2565,10 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	if(local_cgroups) {
+		batch_queue_set_option(local_queue ? local_queue : remote_queue, "cgroups", "yes");
+	}
+
 	/* Remote storage modes do not (yet) support measuring storage for garbage collection. */
 
 	if(makeflow_gc_method == MAKEFLOW_GC_SIZE && !batch_queue_supports_feature(remote_queue, "gc_size")) {
@@ -2358,6 +2577,14 @@ int main(int argc, char *argv[])
 
 	makeflow_parse_input_outputs(d);
 
+	if(remote_temp_files) {
+		if(batch_queue_supports_feature(remote_queue, "temp_files")) {
+			makeflow_mark_remote_temp_files(d);
+		} else {
+			fprintf(stderr, "makeflow: --vine-temp-files is not supported by batch system %s, ignoring it.\n", batch_queue_type_to_string(batch_queue_type));
+		}
+	}
+
 	if (change_dir)
 		chdir(change_dir);
 
@@ -2409,7 +2636,7 @@ int main(int argc, char *argv[])
 	/* In case when the user uses --cache option to specify the mount cache dir and the log file also has
 	 * a cache dir logged, these two dirs must be the same. Otherwise exit.
 	 */
-	if(makeflow_log_recover(d, logfilename, log_verbose_mode, remote_queue, clean_mode )) {
+	if(makeflow_log_recover(d, logfilename, log_verbose_mode, log_binary_mode, remote_queue, clean_mode )) {
 		goto EXIT_WITH_FAILURE;
 	}
 
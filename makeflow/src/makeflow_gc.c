@@ -7,6 +7,7 @@ See the file COPYING for details.
 #include "debug.h"
 #include "xxmalloc.h"
 #include "set.h"
+#include "list.h"
 #include "timestamp.h"
 #include "host_disk_info.h"
 #include "stringtools.h"
@@ -41,6 +42,17 @@ include measuring available space and inodes consumed.
 
 static int makeflow_gc_collected = 0;
 
+/*
+Files that have become COMPLETE, meaning that every rule consuming them
+has finished, wait here to be collected.  The queue is filled as each
+file changes state, so that a collection pass only considers files that
+may actually be collected, rather than walking the whole table of files.
+It is created on the first pass, which takes in any file that was already
+complete, such as those found in a recovered log.
+*/
+
+static struct list *makeflow_gc_queue = 0;
+
 /*
 Return true if disk space falls below the fixed minimum. (inexpensive!)
 XXX this value should be configurable.
@@ -269,6 +281,22 @@ int makeflow_clean(struct dag *d, struct batch_queue *queue, makeflow_clean_dept
 	return 0;
 }
 
+static int makeflow_gc_collectable( struct dag *d, struct dag_file *f )
+{
+	return f->state == DAG_FILE_STATE_COMPLETE
+		&& !dag_file_is_source(f)
+		&& !set_lookup(d->outputs, f)
+		&& !set_lookup(d->inputs, f);
+}
+
+/* Called on every change of file state, to queue files that became collectable. */
+
+void makeflow_gc_file_state_change( struct dag *d, struct dag_file *f )
+{
+	if(makeflow_gc_queue && f->state == DAG_FILE_STATE_COMPLETE)
+		list_push_tail(makeflow_gc_queue, f);
+}
+
 /* Collect available garbage, up to a limit of maxfiles. */
 
 static void makeflow_gc_all( struct dag *d, struct batch_queue *queue, int maxfiles)
@@ -279,16 +307,23 @@ static void makeflow_gc_all( struct dag *d, struct batch_queue *queue, int maxfi
 
 	timestamp_t start_time, stop_time;
 
-	/* This will walk the table of files to collect and will remove any
-	 * that are below or equal to the threshold. */
 	start_time = timestamp_get();
-	hash_table_firstkey(d->files);
-	while(hash_table_nextkey(d->files, &name, (void **) &f) && collected < maxfiles) {
-		if(f->state == DAG_FILE_STATE_COMPLETE
-			&& !dag_file_is_source(f)
-			&& !set_lookup(d->outputs, f)
-			&& !set_lookup(d->inputs, f)
-			&& makeflow_clean_file(d, queue, f)){
+
+	if(!makeflow_gc_queue) {
+		makeflow_gc_queue = list_create();
+		hash_table_firstkey(d->files);
+		while(hash_table_nextkey(d->files, &name, (void **) &f))
+			makeflow_gc_file_state_change(d, f);
+	}
+
+	/*
+	A file may have changed state again since it was queued,
+	so check each one before removing it.  A file that could
+	not be removed is not tried again.
+	*/
+	while(collected < maxfiles && (f = list_pop_head(makeflow_gc_queue))) {
+		if(makeflow_gc_collectable(d, f) && !makeflow_clean_file(d, queue, f)
+			&& f->state == DAG_FILE_STATE_DELETE) {
 			collected++;
 		}
 	}
@@ -313,7 +348,7 @@ void makeflow_gc( struct dag *d, struct batch_queue *queue, makeflow_gc_method_t
 		break;
 	case MAKEFLOW_GC_COUNT:
 		debug(D_MAKEFLOW_RUN, "Performing incremental file (%d) garbage collection", count);
-		makeflow_gc_all(d, queue, count);
+		makeflow_gc_all(d, queue, INT_MAX);
 		break;
 	case MAKEFLOW_GC_ON_DEMAND:
 		if(d->completed_files - d->deleted_files > count || directory_low_disk(".",size)){
@@ -33,6 +33,7 @@ typedef enum {
 
 void makeflow_parse_input_outputs( struct dag *d );
 void makeflow_gc( struct dag *d, struct batch_queue *queue, makeflow_gc_method_t method, uint64_t size, int count );
+void makeflow_gc_file_state_change( struct dag *d, struct dag_file *f );
 int  makeflow_clean_file( struct dag *d, struct batch_queue *queue, struct dag_file *f );
 void makeflow_clean_node( struct dag *d, struct batch_queue *queue, struct dag_node *n );
 
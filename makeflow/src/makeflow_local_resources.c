@@ -43,6 +43,7 @@ int  makeflow_local_resources_available(struct rmsummary *local, const struct rm
 void makeflow_local_resources_subtract( struct rmsummary *local, struct dag_node *n )
 {
 	const struct rmsummary *s = n->resources_allocated;
+	if(!s) return;
 	if(s->cores>=0)  local->cores -= s->cores;
 	if(s->memory>=0) local->memory -= s->memory;		
 	if(s->disk>=0)   local->disk -= s->disk;
@@ -52,6 +53,7 @@ void makeflow_local_resources_subtract( struct rmsummary *local, struct dag_node
 void makeflow_local_resources_add( struct rmsummary *local, struct dag_node *n )
 {
 	const struct rmsummary *s = n->resources_allocated;
+	if(!s) return; /* The node was never submitted, as when taken from an archive. */
 	if(s->cores>=0)  local->cores += s->cores;
 	if(s->memory>=0) local->memory += s->memory;		
 	if(s->disk>=0)   local->disk += s->disk;
@@ -10,7 +10,9 @@ See the file COPYING for details.
 #include "dag.h"
 #include "get_line.h"
 #include "makeflow_mounts.h"
+#include "makeflow_log_binary.h"
 
+#include "buffer.h"
 #include "timestamp.h"
 #include "list.h"
 #include "debug.h"
@@ -22,6 +24,8 @@ See the file COPYING for details.
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <stdarg.h>
+#include <sys/stat.h>
 
 #define MAX_BUFFER_SIZE 4096
 
@@ -103,6 +107,14 @@ filename - the filename specified within the dag_file whose state has changed.
 timestamp - the unix time (in microseconds) when this line is written to the log file.
 
 These event types indicate that the workflow as a whole has started or completed in the indicated manner.
+
+----
+
+With --log-format=binary, a new log is written in the binary format of
+makeflow_log_binary.h instead, which carries the same events in records
+of fixed width, and names each file only once.  An existing log is always
+continued in the format it was begun with.  makeflow_log_convert turns a
+binary log into text for makeflow_monitor and other tools, and back.
 */
 
 void makeflow_node_decide_reset( struct dag *d, struct dag_node *n, int silent );
@@ -110,12 +122,14 @@ void makeflow_node_decide_reset( struct dag *d, struct dag_node *n, int silent )
 /*
 To balance between performance and consistency, we sync the log every 60 seconds
 on ordinary events, but sync immediately on important events like a makeflow restart.
+The binary log is not flushed on ordinary events at all, but in groups by
+makeflow_log_flush, which is called before makeflow waits for jobs.
 */
 
-static void makeflow_log_sync( struct dag *d, int force )
-{
-	static time_t last_fsync = 0;
+static time_t last_fsync = 0;
 
+static void makeflow_log_commit( struct dag *d, int force )
+{
 	/* Force buffered data to the kernel. */
 	fflush(d->logfile);
 
@@ -126,6 +140,44 @@ static void makeflow_log_sync( struct dag *d, int force )
 	}
 }
 
+static void makeflow_log_sync( struct dag *d, int force )
+{
+	if(d->logfile_binary && !force) return;
+	makeflow_log_commit(d, force);
+}
+
+void makeflow_log_flush( struct dag *d )
+{
+	if(!d || !d->logfile) return;
+	makeflow_log_commit(d, 0);
+}
+
+/*
+Write an event other than a change of node or file state.
+The binary log keeps the same line of text as a record of its own.
+*/
+
+static void makeflow_log_printf( struct dag *d, const char *fmt, ... )
+{
+	va_list args;
+	va_start(args, fmt);
+
+	if(d->logfile_binary) {
+		buffer_t b;
+		size_t length;
+		buffer_init(&b);
+		buffer_putvfstring(&b, fmt, args);
+		const char *line = buffer_tolstring(&b, &length);
+		if(length > 0 && line[length-1] == '\n') length--;
+		makeflow_log_binary_write_text(d->logfile, line, length);
+		buffer_free(&b);
+	} else {
+		vfprintf(d->logfile, fmt, args);
+	}
+
+	va_end(args);
+}
+
 void makeflow_log_close( struct dag *d )
 {
 	/* In the case where Makeflow exits prior to creating the DAG or opening log. */
@@ -138,7 +190,7 @@ void makeflow_log_close( struct dag *d )
 
 void makeflow_log_started_event( struct dag *d )
 {
-	fprintf(d->logfile, "# STARTED %" PRIu64 "\n", timestamp_get());
+	makeflow_log_printf(d, "# STARTED %" PRIu64 "\n", timestamp_get());
 	makeflow_log_sync(d,1);
 }
 
@@ -147,7 +199,7 @@ void makeflow_log_aborted_event( struct dag *d )
 	/* In the case where Makeflow exits prior to creating the DAG or opening log. */
 	if(!d || !d->logfile) return;
 
-	fprintf(d->logfile, "# ABORTED %" PRIu64 "\n", timestamp_get());
+	makeflow_log_printf(d, "# ABORTED %" PRIu64 "\n", timestamp_get());
 	makeflow_log_sync(d,1);
 }
 
@@ -156,7 +208,7 @@ void makeflow_log_failed_event( struct dag *d )
 	/* In the case where Makeflow exits prior to creating the DAG or opening log. */
 	if(!d || !d->logfile) return;
 
-	fprintf(d->logfile, "# FAILED %" PRIu64 "\n", timestamp_get());
+	makeflow_log_printf(d, "# FAILED %" PRIu64 "\n", timestamp_get());
 	makeflow_log_sync(d,1);
 }
 
@@ -165,23 +217,23 @@ void makeflow_log_completed_event( struct dag *d )
 	/* In the case where Makeflow exits prior to creating the DAG or opening log. */
 	if(!d || !d->logfile) return;
 
-	fprintf(d->logfile, "# COMPLETED %" PRIu64 "\n", timestamp_get());
+	makeflow_log_printf(d, "# COMPLETED %" PRIu64 "\n", timestamp_get());
 	makeflow_log_sync(d,1);
 }
 
 void makeflow_log_mount_event( struct dag *d, const char *target, const char *source, const char *cache_name, dag_file_source_t type ) {
-	fprintf(d->logfile, "# MOUNT %" PRIu64 " %s %s %s %d\n", timestamp_get(), target, source, cache_name, type);
+	makeflow_log_printf(d, "# MOUNT %" PRIu64 " %s %s %s %d\n", timestamp_get(), target, source, cache_name, type);
 	makeflow_log_sync(d,1);
 }
 
 void makeflow_log_cache_event( struct dag *d, const char *cache_dir ) {
-	fprintf(d->logfile, "# CACHE %" PRIu64 " %s\n", timestamp_get(), cache_dir);
+	makeflow_log_printf(d, "# CACHE %" PRIu64 " %s\n", timestamp_get(), cache_dir);
 	makeflow_log_sync(d,1);
 }
 
 void makeflow_log_event( struct dag *d, char *name, uint64_t value)
 {
-	fprintf(d->logfile, "# EVENT\t%"PRIu64"\t%s\t%" PRIu64 "\n", timestamp_get(), name, value);
+	makeflow_log_printf(d, "# EVENT\t%"PRIu64"\t%s\t%" PRIu64 "\n", timestamp_get(), name, value);
 	makeflow_log_sync(d,1);
 }
 
@@ -194,8 +246,14 @@ void makeflow_log_state_change( struct dag *d, struct dag_node *n, int newstate
 	}
 	n->state = newstate;
 	d->node_states[n->state]++;
+	dag_ready_node_state_change(d, n);
 
-	fprintf(d->logfile, "%" PRIu64 " %d %d %" PRIbjid " %d %d %d %d %d %d\n", timestamp_get(), n->nodeid, newstate, n->jobid, d->node_states[0], d->node_states[1], d->node_states[2], d->node_states[3], d->node_states[4], d->nodeid_counter);
+	if(d->logfile_binary) {
+		int counts[6] = { d->node_states[0], d->node_states[1], d->node_states[2], d->node_states[3], d->node_states[4], d->nodeid_counter };
+		makeflow_log_binary_write_node(d->logfile, timestamp_get(), n->nodeid, newstate, n->jobid, counts);
+	} else {
+		fprintf(d->logfile, "%" PRIu64 " %d %d %" PRIbjid " %d %d %d %d %d %d\n", timestamp_get(), n->nodeid, newstate, n->jobid, d->node_states[0], d->node_states[1], d->node_states[2], d->node_states[3], d->node_states[4], d->nodeid_counter);
+	}
 
 	makeflow_log_sync(d,0);
 }
@@ -204,13 +262,24 @@ void makeflow_log_file_state_change( struct dag *d, struct dag_file *f, int news
 {
 	debug(D_MAKEFLOW_RUN, "file %s %s -> %s\n", f->filename, dag_file_state_name(f->state), dag_file_state_name(newstate));
 
+	int oldstate = f->state;
 	f->state = newstate;
+	dag_ready_file_state_change(d, f, oldstate);
+	makeflow_gc_file_state_change(d, f);
 
 	/* If a file is a wrapper global file do not log to avoid cleaning floating global files. */
 	if(f->type == DAG_FILE_TYPE_GLOBAL) return;
 
 	timestamp_t time = timestamp_get();
-	fprintf(d->logfile, "# FILE %" PRIu64 " %s %d %" PRIu64 "\n", time, f->filename, f->state, dag_file_size(f));
+	if(d->logfile_binary) {
+		if(!f->log_id) {
+			f->log_id = ++d->logfile_names;
+			makeflow_log_binary_write_name(d->logfile, f->log_id, f->filename);
+		}
+		makeflow_log_binary_write_file(d->logfile, time, f->log_id, f->state, dag_file_size(f));
+	} else {
+		fprintf(d->logfile, "# FILE %" PRIu64 " %s %d %" PRIu64 "\n", time, f->filename, f->state, dag_file_size(f));
+	}
 	if(f->state == DAG_FILE_STATE_EXISTS){
 		d->completed_files += 1;
 		f->creation_logged = (time_t) (time / 1000000);
@@ -252,13 +321,13 @@ void makeflow_log_dag_file_list_state_change( struct dag *d, struct list *file_l
 
 void makeflow_log_alloc_event( struct dag *d, struct makeflow_alloc *a )
 {
-	fprintf(d->logfile, "# ALLOC %"PRIu64" %"PRIu64" %"PRIu64" %"PRIu64" %"PRIu64" %"PRIu64" %"PRIu64"\n", timestamp_get(), a->storage->total, a->storage->used, a->storage->greedy, a->storage->commit, a->storage->free, d->total_file_size);
+	makeflow_log_printf(d, "# ALLOC %"PRIu64" %"PRIu64" %"PRIu64" %"PRIu64" %"PRIu64" %"PRIu64" %"PRIu64"\n", timestamp_get(), a->storage->total, a->storage->used, a->storage->greedy, a->storage->commit, a->storage->free, d->total_file_size);
 	makeflow_log_sync(d,0);
 }
 
 void makeflow_log_gc_event( struct dag *d, int collected, timestamp_t elapsed, int total_collected )
 {
-	fprintf(d->logfile, "# GC %" PRIu64 " %d %" PRIu64 " %d\n", timestamp_get(), collected, elapsed, total_collected);
+	makeflow_log_printf(d, "# GC %" PRIu64 " %d %" PRIu64 " %d\n", timestamp_get(), collected, elapsed, total_collected);
 	makeflow_log_sync(d,0);
 }
 
@@ -272,44 +341,212 @@ void makeflow_log_dag_structure( struct dag *d )
 {
 	struct dag_file *f;
 	struct dag_node *n, *p;
+	buffer_t b;
+
+	buffer_init(&b);
 
 	for(n = d->nodes; n; n = n->next) {
 		/* Record node information to log */
-		fprintf(d->logfile, "# NODE\t%d\t%s\n", n->nodeid, n->command);
+		makeflow_log_printf(d, "# NODE\t%d\t%s\n", n->nodeid, n->command);
 
 		/* Record the node category to the log */
-		fprintf(d->logfile, "# CATEGORY\t%d\t%s\n", n->nodeid, n->category->name);
-		fprintf(d->logfile, "# SYMBOL\t%d\t%s\n", n->nodeid, n->category->name);   /* also write the SYMBOL as alias of CATEGORY, deprecated. */
+		makeflow_log_printf(d, "# CATEGORY\t%d\t%s\n", n->nodeid, n->category->name);
+		makeflow_log_printf(d, "# SYMBOL\t%d\t%s\n", n->nodeid, n->category->name);   /* also write the SYMBOL as alias of CATEGORY, deprecated. */
 
 		/* Record node parents to log */
-		fprintf(d->logfile, "# PARENTS\t%d", n->nodeid);
+		buffer_rewind(&b, 0);
+		buffer_printf(&b, "# PARENTS\t%d", n->nodeid);
 		list_first_item(n->source_files);
 		while( (f = list_next_item(n->source_files)) ) {
 			p = f->created_by;
 			if(p)
-				fprintf(d->logfile, "\t%d", p->nodeid);
+				buffer_printf(&b, "\t%d", p->nodeid);
 		}
-		fputc('\n', d->logfile);
+		makeflow_log_printf(d, "%s\n", buffer_tostring(&b));
 
 		/* Record node inputs to log */
-		fprintf(d->logfile, "# SOURCES\t%d", n->nodeid);
+		buffer_rewind(&b, 0);
+		buffer_printf(&b, "# SOURCES\t%d", n->nodeid);
 		list_first_item(n->source_files);
 		while( (f = list_next_item(n->source_files)) ) {
-			fprintf(d->logfile, "\t%s", f->filename);
+			buffer_printf(&b, "\t%s", f->filename);
 		}
-		fputc('\n', d->logfile);
+		makeflow_log_printf(d, "%s\n", buffer_tostring(&b));
 
 		/* Record node outputs to log */
-		fprintf(d->logfile, "# TARGETS\t%d", n->nodeid);
+		buffer_rewind(&b, 0);
+		buffer_printf(&b, "# TARGETS\t%d", n->nodeid);
 		list_first_item(n->target_files);
 		while( (f = list_next_item(n->target_files)) ) {
-			fprintf(d->logfile, "\t%s", f->filename);
+			buffer_printf(&b, "\t%s", f->filename);
 		}
-		fputc('\n', d->logfile);
+		makeflow_log_printf(d, "%s\n", buffer_tostring(&b));
 
 		/* Record translated command to log */
-		fprintf(d->logfile, "# COMMAND\t%d\t%s\n", n->nodeid, n->command);
+		makeflow_log_printf(d, "# COMMAND\t%d\t%s\n", n->nodeid, n->command);
+	}
+
+	buffer_free(&b);
+}
+
+static void makeflow_log_recover_file( struct dag *d, struct dag_file *f, int file_state, timestamp_t previous_completion_time )
+{
+	f->state = file_state;
+	if(file_state == DAG_FILE_STATE_EXISTS){
+		d->completed_files += 1;
+		f->creation_logged = (time_t) (previous_completion_time / 1000000);
+	} else if(file_state == DAG_FILE_STATE_DELETE){
+		d->deleted_files += 1;
+	}
+}
+
+static void makeflow_log_recover_node( struct dag *d, int nodeid, int state, batch_queue_id_t jobid, timestamp_t previous_completion_time )
+{
+	struct dag_node *n = itable_lookup(d->node_table, nodeid);
+	if(n) {
+		n->state = state;
+		n->jobid = jobid;
+		/* Log timestamp is in microseconds, we need seconds for diff. */
+		n->previous_completion = (time_t) (previous_completion_time / 1000000);
+	}
+}
+
+/*
+Recover one line of the text log, or one TEXT record of the binary log.
+Returns zero on success, -1 if the log conflicts with the current options,
+and -2 if the line cannot be understood.
+*/
+
+static int makeflow_log_recover_line( struct dag *d, const char *line )
+{
+	char file[MAX_BUFFER_SIZE];
+	char source[PATH_MAX], cache_dir[NAME_MAX], cache_name[NAME_MAX];
+	int nodeid, state, jobid, file_state, type;
+	struct dag_file *f;
+	timestamp_t previous_completion_time;
+	uint64_t size;
+
+	if(sscanf(line, "# FILE %" SCNu64 " %s %d %" SCNu64 "", &previous_completion_time, file, &file_state, &size) == 4) {
+		f = dag_file_lookup_or_create(d, file);
+		makeflow_log_recover_file(d, f, file_state, previous_completion_time);
+	} else if(sscanf(line, "# CACHE %" SCNu64 " %s", &previous_completion_time, cache_dir) == 2) {
+		/* if the user specifies a cache dir using --cache dir, ignore the info from the log file */
+		if(!d->cache_dir) {
+			d->cache_dir = xxstrdup(cache_dir);
+		} else {
+			/* There are two possible reasons for the inconsistency:
+			 * 1) the cache dir specified via the --cache opt and in the log file mismatch;
+			 * 2) the log file includes multiple different CACHE entries.
+			 */
+			if(strcmp(cache_dir, d->cache_dir)) {
+				fprintf(stderr, "The --cache option (%s) does not match the cache dir (%s) in the log file!\n", d->cache_dir, cache_dir);
+				return -1;
+			}
+		}
+	} else if(sscanf(line, "# MOUNT %" SCNu64 " %s %s %s %d", &previous_completion_time, file, source, cache_name, &type) == 5) {
+		f = dag_file_lookup_or_create(d, file);
+
+		if(!f->source) {
+			f->source = xxstrdup(source);
+			f->cache_name = xxstrdup(cache_name);
+			f->type = type;
+		} else {
+			/* If a mount entry is specified in the mountfile and logged in a log file at the same time, they must not conflict with each other. */
+			/* If a mount entry is logged in a log file multiple times deliberately or not, they must not conflict with each other. */
+			if(makeflow_mount_check_consistency(file, f->source, source, d->cache_dir, cache_name)) {
+				return -1;
+			}
+		}
+	} else if(line[0] == '#') {
+		/* Ignore any other comment lines */
+	} else if(sscanf(line, "%" SCNu64 " %d %d %d", &previous_completion_time, &nodeid, &state, &jobid) == 4) {
+		makeflow_log_recover_node(d, nodeid, state, jobid, previous_completion_time);
+	} else {
+		return -2;
 	}
+
+	return 0;
+}
+
+/*
+Recover from a binary log by mapping it into memory.  Each file is looked
+up by name only once, when it is named, and by its id from then on.
+A record cut short at the end by a crash is removed, so that the log may
+be continued, but a corrupted record stops the recovery with an error.
+*/
+
+static int makeflow_log_recover_binary( struct dag *d, const char *filename )
+{
+	struct makeflow_log_reader *r = makeflow_log_reader_open(filename);
+	if(!r) {
+		fprintf(stderr, "makeflow: couldn't read log file %s: %s\n", filename, strerror(errno));
+		return -1;
+	}
+
+	struct makeflow_log_record record;
+	const char *string;
+	struct dag_file **files = 0;
+	uint32_t files_size = 0;
+	int result = 0;
+	int recordnum = 0;
+	int status;
+
+	while(result == 0 && (status = makeflow_log_reader_next(r, &record, &string))) {
+		recordnum++;
+		if(status < 0) {
+			result = status;
+			break;
+		}
+		switch(record.type) {
+			case MAKEFLOW_LOG_RECORD_NODE:
+				makeflow_log_recover_node(d, record.id, record.state, record.value, record.time);
+				break;
+			case MAKEFLOW_LOG_RECORD_FILE:
+				if(record.id >= files_size || !files[record.id]) {
+					result = -2;
+					break;
+				}
+				makeflow_log_recover_file(d, files[record.id], record.state, record.time);
+				break;
+			case MAKEFLOW_LOG_RECORD_NAME:
+				if(record.id >= files_size) {
+					uint32_t size = files_size ? files_size : 1024;
+					while(size <= record.id) size *= 2;
+					files = realloc(files, size * sizeof(*files));
+					memset(files + files_size, 0, (size - files_size) * sizeof(*files));
+					files_size = size;
+				}
+				files[record.id] = dag_file_lookup_or_create(d, string);
+				files[record.id]->log_id = record.id;
+				if((int) record.id > d->logfile_names) d->logfile_names = record.id;
+				break;
+			case MAKEFLOW_LOG_RECORD_TEXT:
+				result = makeflow_log_recover_line(d, string);
+				break;
+		}
+	}
+
+	off_t length = makeflow_log_reader_offset(r);
+	makeflow_log_reader_close(r);
+	free(files);
+
+	if(result == -2) {
+		fprintf(stderr, "makeflow: %s appears to be corrupted at record %d\n", filename, recordnum);
+		exit(1);
+	} else if(result) {
+		return result;
+	}
+
+	struct stat info;
+	if(stat(filename, &info) == 0 && info.st_size > length) {
+		printf("removing incomplete record at the end of %s...\n", filename);
+		if(truncate(filename, length) != 0) {
+			fprintf(stderr, "makeflow: couldn't truncate %s: %s\n", filename, strerror(errno));
+			return -1;
+		}
+	}
+
+	return 0;
 }
 
 /*
@@ -317,78 +554,37 @@ Recover the state of the workflow so far by reading back the state
 from the log file, if it exists.  (If not, create a new log.)
 */
 
-int makeflow_log_recover(struct dag *d, const char *filename, int verbose_mode, struct batch_queue *queue, makeflow_clean_depth clean_mode )
+int makeflow_log_recover(struct dag *d, const char *filename, int verbose_mode, int binary_mode, struct batch_queue *queue, makeflow_clean_depth clean_mode )
 {
-	char *line, file[MAX_BUFFER_SIZE];
-	int nodeid, state, jobid, file_state;
+	char *line;
 	int first_run = 1;
 	struct dag_node *n;
-	struct dag_file *f;
-	timestamp_t previous_completion_time;
-	uint64_t size;
 
-	d->logfile = fopen(filename, "r");
-	if(d->logfile) {
+	if(makeflow_log_binary_check(filename)) {
+		first_run = 0;
+		d->logfile_binary = 1;
+
+		printf("recovering from log file %s...\n",filename);
+
+		if(makeflow_log_recover_binary(d, filename))
+			return -1;
+	} else if((d->logfile = fopen(filename, "r"))) {
 		int linenum = 0;
 		first_run = 0;
 
 		printf("recovering from log file %s...\n",filename);
 
+		if(binary_mode)
+			printf("continuing the existing log %s in text format...\n",filename);
+
 		while((line = get_line(d->logfile))) {
-			char source[PATH_MAX], cache_dir[NAME_MAX], cache_name[NAME_MAX];
-			int type;
 			linenum++;
 
-			if(sscanf(line, "# FILE %" SCNu64 " %s %d %" SCNu64 "", &previous_completion_time, file, &file_state, &size) == 4) {
-				f = dag_file_lookup_or_create(d, file);
-				f->state = file_state;
-				if(file_state == DAG_FILE_STATE_EXISTS){
-					d->completed_files += 1;
-					f->creation_logged = (time_t) (previous_completion_time / 1000000);
-				} else if(file_state == DAG_FILE_STATE_DELETE){
-					d->deleted_files += 1;
-				}
-			} else if(sscanf(line, "# CACHE %" SCNu64 " %s", &previous_completion_time, cache_dir) == 2) {
-				/* if the user specifies a cache dir using --cache dir, ignore the info from the log file */
-				if(!d->cache_dir) {
-					d->cache_dir = xxstrdup(cache_dir);
-				} else {
-					/* There are two possible reasons for the inconsistency:
-					 * 1) the cache dir specified via the --cache opt and in the log file mismatch;
-					 * 2) the log file includes multiple different CACHE entries.
-					 */
-					if(strcmp(cache_dir, d->cache_dir)) {
-						fprintf(stderr, "The --cache option (%s) does not match the cache dir (%s) in the log file!\n", d->cache_dir, cache_dir);
-						free(line);
-						return -1;
-					}
-				}
-			} else if(sscanf(line, "# MOUNT %" SCNu64 " %s %s %s %d", &previous_completion_time, file, source, cache_name, &type) == 5) {
-				f = dag_file_lookup_or_create(d, file);
-
-				if(!f->source) {
-					f->source = xxstrdup(source);
-					f->cache_name = xxstrdup(cache_name);
-					f->type = type;
-				} else {
-					/* If a mount entry is specified in the mountfile and logged in a log file at the same time, they must not conflict with each other. */
-					/* If a mount entry is logged in a log file multiple times deliberately or not, they must not conflict with each other. */
-					if(makeflow_mount_check_consistency(file, f->source, source, d->cache_dir, cache_name)) {
-						free(line);
-						return -1;
-					}
-				}
-			} else if(line[0] == '#') {
-				/* Ignore any other comment lines */
-			} else if(sscanf(line, "%" SCNu64 " %d %d %d", &previous_completion_time, &nodeid, &state, &jobid) == 4) {
-				n = itable_lookup(d->node_table, nodeid);
-				if(n) {
-					n->state = state;
-					n->jobid = jobid;
-					/* Log timestamp is in microseconds, we need seconds for diff. */
-					n->previous_completion = (time_t) (previous_completion_time / 1000000);
-				}
-			} else {
+			int result = makeflow_log_recover_line(d, line);
+			if(result == -1) {
+				free(line);
+				return -1;
+			} else if(result == -2) {
 				fprintf(stderr, "makeflow: %s appears to be corrupted on line %d\n", filename, linenum);
 				exit(1);
 			}
@@ -397,6 +593,7 @@ int makeflow_log_recover(struct dag *d, const char *filename, int verbose_mode,
 		fclose(d->logfile);
 	} else {
 		printf("creating new log file %s...\n",filename);
+		d->logfile_binary = binary_mode;
 	}
 
 	d->logfile = fopen(filename, "a");
@@ -404,7 +601,14 @@ int makeflow_log_recover(struct dag *d, const char *filename, int verbose_mode,
 		fprintf(stderr, "makeflow: couldn't open logfile %s: %s\n", filename, strerror(errno));
 		exit(1);
 	}
-	if(setvbuf(d->logfile, NULL, _IOLBF, BUFSIZ) != 0) {
+
+	if(d->logfile_binary) {
+		/* The binary log is fully buffered, and flushed in groups by makeflow_log_flush. */
+		if(first_run) {
+			makeflow_log_binary_write_header(d->logfile);
+			makeflow_log_sync(d, 1);
+		}
+	} else if(setvbuf(d->logfile, NULL, _IOLBF, BUFSIZ) != 0) {
 		fprintf(stderr, "makeflow: couldn't set line buffer on logfile %s: %s\n", filename, strerror(errno));
 		exit(1);
 	}
@@ -35,8 +35,12 @@ void makeflow_log_alloc_event( struct dag *d, struct makeflow_alloc *alloc );
 void makeflow_log_gc_event( struct dag *d, int collected, timestamp_t elapsed, int total_collected );
 void makeflow_log_close(struct dag *d );
 
+/* Commit any buffered events to the log, as is done in groups for the binary log. */
+void makeflow_log_flush( struct dag *d );
+
 /* return 0 on success, return non-zero on failure. */
-int makeflow_log_recover( struct dag *d, const char *filename, int verbose_mode, struct batch_queue *queue, makeflow_clean_depth clean_mode );
+/* A new log is written in the binary format if binary_mode is set; an existing log is continued in its own format. */
+int makeflow_log_recover( struct dag *d, const char *filename, int verbose_mode, int binary_mode, struct batch_queue *queue, makeflow_clean_depth clean_mode );
 
 /* write the info of a dependency specified in the mountfile into the logging system
  * @param d: a dag structure
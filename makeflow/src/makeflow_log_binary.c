@@ -0,0 +1,346 @@
+/*
+Copyright (C) 2026 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#include "makeflow_log_binary.h"
+
+#include "debug.h"
+#include "get_line.h"
+#include "hash_table.h"
+#include "stringtools.h"
+#include "xxmalloc.h"
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* The records as they are laid out in the log, described in makeflow_log_binary.h. */
+
+struct record_header {
+	uint8_t type;
+	uint8_t state;
+	uint16_t reserved;
+	uint32_t id;
+};
+
+struct node_record {
+	struct record_header header;
+	uint64_t time;
+	int64_t jobid;
+	int32_t counts[6];
+};
+
+struct file_record {
+	struct record_header header;
+	uint64_t time;
+	uint64_t size;
+};
+
+struct string_record {
+	struct record_header header;
+	uint32_t length;
+};
+
+/* The sizes given in makeflow_log_binary.h are part of the format, so a change to them fails to compile. */
+#define RECORD_SIZE_CHECK(name, record, size) typedef char name[sizeof(struct record) == (size) ? 1 : -1]
+
+RECORD_SIZE_CHECK(record_header_size_check, record_header, 8);
+RECORD_SIZE_CHECK(node_record_size_check, node_record, 48);
+RECORD_SIZE_CHECK(file_record_size_check, file_record, 24);
+RECORD_SIZE_CHECK(string_record_size_check, string_record, 12);
+
+struct makeflow_log_reader {
+	char *data;
+	off_t length;
+	off_t offset;
+};
+
+int makeflow_log_binary_check( const char *filename )
+{
+	char magic[MAKEFLOW_LOG_BINARY_MAGIC_SIZE];
+
+	int fd = open(filename, O_RDONLY);
+	if(fd < 0) return 0;
+
+	int result = read(fd, magic, sizeof(magic)) == sizeof(magic) && !memcmp(magic, MAKEFLOW_LOG_BINARY_MAGIC, sizeof(magic));
+	close(fd);
+
+	return result;
+}
+
+void makeflow_log_binary_write_header( FILE *file )
+{
+	fwrite(MAKEFLOW_LOG_BINARY_MAGIC, 1, MAKEFLOW_LOG_BINARY_MAGIC_SIZE, file);
+}
+
+void makeflow_log_binary_write_node( FILE *file, uint64_t time, int nodeid, int state, int64_t jobid, const int *counts )
+{
+	struct node_record r;
+	int i;
+
+	memset(&r, 0, sizeof(r));
+	r.header.type = MAKEFLOW_LOG_RECORD_NODE;
+	r.header.state = state;
+	r.header.id = nodeid;
+	r.time = time;
+	r.jobid = jobid;
+	for(i = 0; i < 6; i++) r.counts[i] = counts[i];
+
+	fwrite(&r, sizeof(r), 1, file);
+}
+
+void makeflow_log_binary_write_file( FILE *file, uint64_t time, int fileid, int state, uint64_t size )
+{
+	struct file_record r;
+
+	memset(&r, 0, sizeof(r));
+	r.header.type = MAKEFLOW_LOG_RECORD_FILE;
+	r.header.state = state;
+	r.header.id = fileid;
+	r.time = time;
+	r.size = size;
+
+	fwrite(&r, sizeof(r), 1, file);
+}
+
+static void write_string( FILE *file, makeflow_log_record_t type, int id, const char *string, size_t length )
+{
+	struct string_record r;
+
+	memset(&r, 0, sizeof(r));
+	r.header.type = type;
+	r.header.id = id;
+	r.length = length;
+
+	fwrite(&r, sizeof(r), 1, file);
+	fwrite(string, 1, length, file);
+	fputc(0, file);
+}
+
+void makeflow_log_binary_write_name( FILE *file, int fileid, const char *name )
+{
+	write_string(file, MAKEFLOW_LOG_RECORD_NAME, fileid, name, strlen(name));
+}
+
+void makeflow_log_binary_write_text( FILE *file, const char *line, size_t length )
+{
+	write_string(file, MAKEFLOW_LOG_RECORD_TEXT, 0, line, length);
+}
+
+struct makeflow_log_reader *makeflow_log_reader_open( const char *filename )
+{
+	struct stat info;
+
+	int fd = open(filename, O_RDONLY);
+	if(fd < 0) return 0;
+
+	if(fstat(fd, &info) < 0 || info.st_size < MAKEFLOW_LOG_BINARY_MAGIC_SIZE) {
+		close(fd);
+		return 0;
+	}
+
+	char *data = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(data == MAP_FAILED) return 0;
+
+	if(memcmp(data, MAKEFLOW_LOG_BINARY_MAGIC, MAKEFLOW_LOG_BINARY_MAGIC_SIZE)) {
+		munmap(data, info.st_size);
+		return 0;
+	}
+
+	madvise(data, info.st_size, MADV_SEQUENTIAL);
+
+	struct makeflow_log_reader *r = xxmalloc(sizeof(*r));
+	r->data = data;
+	r->length = info.st_size;
+	r->offset = MAKEFLOW_LOG_BINARY_MAGIC_SIZE;
+	return r;
+}
+
+/*
+Return the next complete record, or zero at the end of the log.
+A record or string cut short at the end is not returned.
+A record of unknown type, or a string without its terminating
+null, means that the log is corrupted.
+*/
+
+int makeflow_log_reader_next( struct makeflow_log_reader *r, struct makeflow_log_record *record, const char **string )
+{
+	const char *data = r->data + r->offset;
+	off_t left = r->length - r->offset;
+	struct record_header header;
+	off_t size;
+
+	if(left < (off_t) sizeof(header)) return 0;
+	memcpy(&header, data, sizeof(header));
+
+	memset(record, 0, sizeof(*record));
+	record->type = header.type;
+	record->state = header.state;
+	record->id = header.id;
+	*string = 0;
+
+	if(header.type == MAKEFLOW_LOG_RECORD_NODE) {
+		struct node_record n;
+		size = sizeof(n);
+		if(left < size) return 0;
+		memcpy(&n, data, size);
+		record->time = n.time;
+		record->value = n.jobid;
+		memcpy(record->counts, n.counts, sizeof(n.counts));
+	} else if(header.type == MAKEFLOW_LOG_RECORD_FILE) {
+		struct file_record f;
+		size = sizeof(f);
+		if(left < size) return 0;
+		memcpy(&f, data, size);
+		record->time = f.time;
+		record->value = f.size;
+	} else if(header.type == MAKEFLOW_LOG_RECORD_NAME || header.type == MAKEFLOW_LOG_RECORD_TEXT) {
+		struct string_record s;
+		if(left < (off_t) sizeof(s)) return 0;
+		memcpy(&s, data, sizeof(s));
+		size = sizeof(s) + (off_t) s.length + 1;
+		if(left < size) return 0;
+		if(data[size - 1]) {
+			debug(D_MAKEFLOW_RUN, "unterminated string in binary log at offset %lld", (long long) r->offset);
+			return -2;
+		}
+		record->value = s.length;
+		*string = data + sizeof(s);
+	} else {
+		debug(D_MAKEFLOW_RUN, "unknown record type %d in binary log at offset %lld", header.type, (long long) r->offset);
+		return -2;
+	}
+
+	r->offset += size;
+	return 1;
+}
+
+/* The length of the log up to the end of the last record returned. */
+
+off_t makeflow_log_reader_offset( struct makeflow_log_reader *r )
+{
+	return r->offset;
+}
+
+void makeflow_log_reader_close( struct makeflow_log_reader *r )
+{
+	munmap(r->data, r->length);
+	free(r);
+}
+
+/* These must match the lines written by makeflow_log.c. */
+
+int makeflow_log_binary_to_text( const char *filename, FILE *output )
+{
+	struct makeflow_log_reader *r = makeflow_log_reader_open(filename);
+	if(!r) return 0;
+
+	struct makeflow_log_record record;
+	const char *string;
+	const char **names = 0;
+	uint32_t names_size = 0;
+	int result;
+
+	while((result = makeflow_log_reader_next(r, &record, &string)) > 0) {
+		switch(record.type) {
+			case MAKEFLOW_LOG_RECORD_NODE:
+				fprintf(output, "%" PRIu64 " %d %d %" PRId64 " %d %d %d %d %d %d\n", record.time, (int) record.id, record.state, record.value, record.counts[0], record.counts[1], record.counts[2], record.counts[3], record.counts[4], record.counts[5]);
+				break;
+			case MAKEFLOW_LOG_RECORD_FILE:
+				if(record.id >= names_size || !names[record.id]) {
+					fprintf(stderr, "makeflow: %s refers to unknown file id %u\n", filename, record.id);
+					free(names);
+					makeflow_log_reader_close(r);
+					return 0;
+				}
+				fprintf(output, "# FILE %" PRIu64 " %s %d %" PRIu64 "\n", record.time, names[record.id], record.state, (uint64_t) record.value);
+				break;
+			case MAKEFLOW_LOG_RECORD_NAME:
+				if(record.id >= names_size) {
+					uint32_t size = names_size ? names_size : 1024;
+					while(size <= record.id) size *= 2;
+					names = realloc(names, size * sizeof(*names));
+					memset(names + names_size, 0, (size - names_size) * sizeof(*names));
+					names_size = size;
+				}
+				names[record.id] = string;
+				break;
+			case MAKEFLOW_LOG_RECORD_TEXT:
+				fprintf(output, "%s\n", string);
+				break;
+		}
+	}
+
+	if(result < 0) {
+		fprintf(stderr, "makeflow: %s is corrupted at offset %lld\n", filename, (long long) makeflow_log_reader_offset(r));
+	}
+
+	free(names);
+	makeflow_log_reader_close(r);
+	return result == 0;
+}
+
+int makeflow_log_text_to_binary( FILE *input, FILE *output )
+{
+	struct hash_table *ids = hash_table_create(0, 0);
+	char *line;
+	char *name = 0;
+	char *canonical = 0;
+	int next_id = 1;
+
+	makeflow_log_binary_write_header(output);
+
+	while((line = get_line(input))) {
+		uint64_t time, size;
+		int nodeid, state, file_state, counts[6];
+		int64_t jobid;
+
+		string_chomp(line);
+		size_t length = strlen(line);
+		name = realloc(name, length + 1);
+		canonical = realloc(canonical, length + 2);
+
+		/*
+		A line becomes a NODE or FILE record only if it is exactly the line
+		that record prints back, so that converting back gives the same log.
+		*/
+
+		if(sscanf(line, "# FILE %" SCNu64 " %s %d %" SCNu64, &time, name, &file_state, &size) == 4
+			&& file_state >= 0 && file_state <= UINT8_MAX
+			&& snprintf(canonical, length + 2, "# FILE %" PRIu64 " %s %d %" PRIu64, time, name, file_state, size) == (int) length
+			&& !strcmp(canonical, line)) {
+			intptr_t id = (intptr_t) hash_table_lookup(ids, name);
+			if(!id) {
+				id = next_id++;
+				hash_table_insert(ids, name, (void *) id);
+				makeflow_log_binary_write_name(output, id, name);
+			}
+			makeflow_log_binary_write_file(output, time, id, file_state, size);
+		} else if(sscanf(line, "%" SCNu64 " %d %d %" SCNd64 " %d %d %d %d %d %d", &time, &nodeid, &state, &jobid, &counts[0], &counts[1], &counts[2], &counts[3], &counts[4], &counts[5]) == 10
+			&& nodeid >= 0 && state >= 0 && state <= UINT8_MAX
+			&& snprintf(canonical, length + 2, "%" PRIu64 " %d %d %" PRId64 " %d %d %d %d %d %d", time, nodeid, state, jobid, counts[0], counts[1], counts[2], counts[3], counts[4], counts[5]) == (int) length
+			&& !strcmp(canonical, line)) {
+			makeflow_log_binary_write_node(output, time, nodeid, state, jobid, counts);
+		} else {
+			/* Anything else, including older forms of node lines, is kept as it is. */
+			makeflow_log_binary_write_text(output, line, length);
+		}
+
+		free(line);
+	}
+
+	free(name);
+	free(canonical);
+	hash_table_delete(ids);
+
+	return !ferror(output);
+}
+
+/* vim: set noexpandtab tabstop=4: */
@@ -0,0 +1,83 @@
+/*
+Copyright (C) 2026 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#ifndef MAKEFLOW_LOG_BINARY_H
+#define MAKEFLOW_LOG_BINARY_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+/*
+The binary makeflow log carries the same events as the text log described
+in makeflow_log.c, for workflows so large that writing and parsing text
+dominates the cost of logging and recovery.
+
+The file begins with MAKEFLOW_LOG_BINARY_MAGIC, followed by records in
+the byte order of the host, without padding.  Every record begins with
+the same eight bytes: its type, a state, two reserved bytes, and an id.
+The rest depends on the type:
+
+NODE  time, job id, and the nodes in each state (48 bytes in all)
+FILE  time and size (24 bytes in all)
+NAME  length of the file name (12 bytes), then the name and a terminating null
+TEXT  length of the line (12 bytes), then the line and a terminating null
+
+A NAME record gives a file its id the first time it appears, so that
+each FILE record carries only the id.  NODE and FILE records correspond
+to the node and file lines of the text log, and every other event is
+kept as a TEXT record holding its line of the text log.
+
+A record cut short at the end of the log by a crash is ignored on recovery.
+*/
+
+#define MAKEFLOW_LOG_BINARY_MAGIC "MFBLOG2\n"
+#define MAKEFLOW_LOG_BINARY_MAGIC_SIZE 8
+
+typedef enum {
+	MAKEFLOW_LOG_RECORD_NODE = 1, /* A node changed state. */
+	MAKEFLOW_LOG_RECORD_FILE,     /* A file changed state. */
+	MAKEFLOW_LOG_RECORD_NAME,     /* A file name was given an id. */
+	MAKEFLOW_LOG_RECORD_TEXT      /* Any other event, as a line of the text log. */
+} makeflow_log_record_t;
+
+/* A record as returned by a reader.  Only the fields of its type are set. */
+
+struct makeflow_log_record {
+	makeflow_log_record_t type;
+	int state;         /* The new state of a node or file. */
+	uint32_t id;       /* The node id, or the file id. */
+	uint64_t time;     /* The time of the event, in microseconds. */
+	int64_t value;     /* The job id of a node, the size of a file, or the length of a string. */
+	int32_t counts[6]; /* For a node, the nodes in each state and the number of nodes. */
+};
+
+/* Return true if the named file is a binary log. */
+int makeflow_log_binary_check( const char *filename );
+
+void makeflow_log_binary_write_header( FILE *file );
+void makeflow_log_binary_write_node( FILE *file, uint64_t time, int nodeid, int state, int64_t jobid, const int *counts );
+void makeflow_log_binary_write_file( FILE *file, uint64_t time, int fileid, int state, uint64_t size );
+void makeflow_log_binary_write_name( FILE *file, int fileid, const char *name );
+void makeflow_log_binary_write_text( FILE *file, const char *line, size_t length );
+
+/*
+A reader maps a whole binary log into memory and returns its records in order.
+The string of a NAME or TEXT record is valid until the reader is closed.
+makeflow_log_reader_next returns 1 for each record, 0 at the end of the log
+or at a record cut short there, and -2 if the log is corrupted.
+*/
+
+struct makeflow_log_reader *makeflow_log_reader_open( const char *filename );
+int makeflow_log_reader_next( struct makeflow_log_reader *r, struct makeflow_log_record *record, const char **string );
+off_t makeflow_log_reader_offset( struct makeflow_log_reader *r );
+void makeflow_log_reader_close( struct makeflow_log_reader *r );
+
+/* Convert a log from one format to the other, returning true on success. */
+int makeflow_log_binary_to_text( const char *filename, FILE *output );
+int makeflow_log_text_to_binary( FILE *input, FILE *output );
+
+#endif
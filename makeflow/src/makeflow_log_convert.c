@@ -0,0 +1,75 @@
+/*
+Copyright (C) 2026 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+/*
+Convert a makeflow log between the text and binary formats.
+A binary log is converted to text, so that makeflow_monitor and
+other tools may read it, and a text log is converted to binary.
+Converting a log and back gives the original log.
+*/
+
+#include "makeflow_log_binary.h"
+
+#include "cctools.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void show_help( const char *cmd )
+{
+	fprintf(stdout, "use: %s <input-log> <output-log>\n", cmd);
+	fprintf(stdout, "Convert a binary makeflow log to text, or a text makeflow log to binary.\n");
+	fprintf(stdout, "If the output is -, it is written to the standard output.\n");
+}
+
+int main( int argc, char *argv[] )
+{
+	if(argc != 3) {
+		show_help(argv[0]);
+		return 1;
+	}
+
+	const char *input_name = argv[1];
+	const char *output_name = argv[2];
+	int to_text = makeflow_log_binary_check(input_name);
+
+	FILE *output;
+	if(!strcmp(output_name, "-")) {
+		output = stdout;
+	} else {
+		output = fopen(output_name, "w");
+		if(!output) {
+			fprintf(stderr, "%s: couldn't open %s: %s\n", argv[0], output_name, strerror(errno));
+			return 1;
+		}
+	}
+
+	int success;
+	if(to_text) {
+		success = makeflow_log_binary_to_text(input_name, output);
+	} else {
+		FILE *input = fopen(input_name, "r");
+		if(!input) {
+			fprintf(stderr, "%s: couldn't open %s: %s\n", argv[0], input_name, strerror(errno));
+			return 1;
+		}
+		success = makeflow_log_text_to_binary(input, output);
+		fclose(input);
+	}
+
+	if(fclose(output) != 0) success = 0;
+
+	if(!success) {
+		fprintf(stderr, "%s: couldn't convert %s\n", argv[0], input_name);
+		return 1;
+	}
+
+	return 0;
+}
+
+/* vim: set noexpandtab tabstop=4: */
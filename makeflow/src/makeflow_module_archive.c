@@ -13,10 +13,12 @@ Updated for S3 bucket handling and directory handling for input and output files
 #include <string.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <assert.h>
 #include <unistd.h>
 #include <libgen.h>
 #include <time.h>
+#include <pthread.h>
 #include <sys/time.h>
 
 #include "copy_stream.h"
@@ -37,6 +39,8 @@ Updated for S3 bucket handling and directory handling for input and output files
 #include "copy_tree.h"
 #include "s3_file_io.h"
 
+#include "batch_file.h"
+#include "batch_job.h"
 #include "batch_queue.h"
 #include "batch_wrapper.h"
 
@@ -49,6 +53,7 @@ Updated for S3 bucket handling and directory handling for input and output files
 
 #define MAKEFLOW_ARCHIVE_DEFAULT_DIRECTORY "/tmp/makeflow.archive."
 #define MAKEFLOW_ARCHIVE_DEFAULT_S3_BUCKET "makeflows3archive"
+#define MAKEFLOW_ARCHIVE_DEFAULT_THREADS 4
 
 float total_up_time = 0.0;
 float total_down_time = 0.0;
@@ -67,6 +72,28 @@ struct archive_instance {
 
 	/* Runtime data struct */
 	char *source_makeflow;
+
+	/* Tasks waiting for and being archived in the background */
+	int threads;
+	pthread_t *thread_ids;
+	int threads_started;
+	struct list *pending;
+	int active;
+	int failures;
+	int shutdown;
+	int staging_count;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+};
+
+/* A task to be archived, with everything needed once its node has moved on. */
+struct archive_job {
+	struct batch_job *task;
+	char *id;
+	const char *src_command;
+	int src_line;
+	int nodeid;
+	char *staging_dir;
 };
 
 struct archive_instance *archive_instance_create()
@@ -151,6 +178,21 @@ static int create( void ** instance_struct, struct jx *hook_args )
 		a->write = 1;
 	}
 
+	if(jx_lookup(hook_args, "archive_threads")){
+		a->threads = jx_lookup_integer(hook_args, "archive_threads");
+	} else {
+		a->threads = MAKEFLOW_ARCHIVE_DEFAULT_THREADS;
+	}
+
+	/* Uploads to S3 are archived at once, as they always have been. */
+	if(a->s3){
+		a->threads = 0;
+	}
+
+	a->pending = list_create();
+	pthread_mutex_init(&a->mutex, NULL);
+	pthread_cond_init(&a->cond, NULL);
+
 	if (!create_dir(a->dir, 0777) && errno != EEXIST){
 		debug(D_ERROR|D_MAKEFLOW_HOOK, "could not create base archiving directory %s: %d %s\n", 
 			a->dir, errno, strerror(errno));
@@ -175,15 +217,36 @@ static int create( void ** instance_struct, struct jx *hook_args )
 	}
 	free(tasks_dir);
 
+	char *staging_dir = string_format("%s/staging", a->dir);
+	if (!create_dir(staging_dir, 0777) && errno != EEXIST){
+		debug(D_ERROR|D_MAKEFLOW_HOOK, "could not create staging directory %s: %d %s\n",
+			staging_dir, errno, strerror(errno));
+		free(staging_dir);
+		return MAKEFLOW_HOOK_FAILURE;
+	}
+	free(staging_dir);
+
+	/* Checksums of unchanged files are kept with the archive, so that they are not computed again. */
+	char *checksums = string_format("%s/checksums", a->dir);
+	batch_file_set_checksum_cache(checksums);
+	free(checksums);
+
 	s3_set_bucket (a->s3_dir);
 
 	return MAKEFLOW_HOOK_SUCCESS;
 }
 
+static void makeflow_archive_stop_threads(struct archive_instance *a);
+
 static int destroy( void * instance_struct, struct dag *d)
 {
 	struct archive_instance *a = (struct archive_instance*)instance_struct;
 
+	makeflow_archive_stop_threads(a);
+	list_delete(a->pending);
+	pthread_mutex_destroy(&a->mutex);
+	pthread_cond_destroy(&a->cond);
+
 	free(a->dir);
 	free(a->source_makeflow);
 	free(a);
@@ -291,7 +354,19 @@ static int makeflow_archive_task_adheres_to_sandbox( struct batch_job *t ){
 
 /* Write the task and run info to the task directory
  *	These files are hardcoded to task_info and run_info */
-static int makeflow_archive_write_task_info(struct archive_instance *a, struct dag_node *n, struct batch_job *t, char *archive_path) {
+/* Return the content based id of a file or directory, or null if it cannot be read. */
+static char *makeflow_archive_file_id(struct batch_file *f) {
+	if(path_is_dir(f->outer_name) == 1){
+		free(f->hash);
+		f->hash = batch_file_generate_id_dir(f->outer_name);
+		return f->hash ? xxstrdup(f->hash) : NULL;
+	} else {
+		return batch_file_generate_id(f);
+	}
+}
+
+static int makeflow_archive_write_task_info(struct archive_instance *a, struct archive_job *j, char *archive_path) {
+	struct batch_job *t = j->task;
 	struct batch_file *f;
 
 /* task_info :
@@ -304,20 +379,20 @@ static int makeflow_archive_write_task_info(struct archive_instance *a, struct d
  */
 	struct jx *task_jx = jx_object(NULL);
 	jx_insert(task_jx, jx_string("COMMAND"), jx_string(t->command));
-	jx_insert(task_jx, jx_string("SRC_COMMAND"), jx_string(n->command));
-	jx_insert(task_jx, jx_string("SRC_LINE"), jx_integer(n->linenum));
+	jx_insert(task_jx, jx_string("SRC_COMMAND"), jx_string(j->src_command));
+	jx_insert(task_jx, jx_string("SRC_LINE"), jx_integer(j->src_line));
 	jx_insert(task_jx, jx_string("SRC_MAKEFLOW"), jx_string(a->source_makeflow));
 	struct jx * input_files = jx_object(NULL);
 	struct list_cursor *cur = list_cursor_create(t->input_files);
 	for(list_seek(cur, 0); list_get(cur, (void**)&f); list_next(cur)) {
 		/* Generate the file archive id (content based) if does not exist. */
-		char * id;
-		if(path_is_dir(f->inner_name) == 1){
-			f->hash = batch_file_generate_id_dir(f->inner_name);
-			id = xxstrdup(f->hash);
-		}
-		else{
-			id = batch_file_generate_id(f);
+		char * id = makeflow_archive_file_id(f);
+		if(!id){
+			list_cursor_destroy(cur);
+			jx_delete(input_files);
+			jx_delete(task_jx);
+			debug(D_ERROR|D_MAKEFLOW_HOOK, "could not checksum %s for node %d archive", f->outer_name, j->nodeid);
+			return 0;
 		}
 		jx_insert(input_files, jx_string(f->inner_name), jx_string(id));
 		free(id);
@@ -329,13 +404,13 @@ static int makeflow_archive_write_task_info(struct archive_instance *a, struct d
 	cur = list_cursor_create(t->output_files);
 	for(list_seek(cur, 0); list_get(cur, (void**)&f); list_next(cur)) {
 		/* Generate the file archive id (content based) if does not exist. */
-		char * id;
-		if(path_is_dir(f->inner_name) == 1){
-			f->hash = batch_file_generate_id_dir(f->inner_name);
-			id = xxstrdup(f->hash);
-		}
-		else{
-			id = batch_file_generate_id(f);
+		char * id = makeflow_archive_file_id(f);
+		if(!id){
+			list_cursor_destroy(cur);
+			jx_delete(output_files);
+			jx_delete(task_jx);
+			debug(D_ERROR|D_MAKEFLOW_HOOK, "could not checksum %s for node %d archive", f->outer_name, j->nodeid);
+			return 0;
 		}
 		jx_insert(output_files, jx_string(f->inner_name), jx_string(id));
 		free(id);
@@ -347,7 +422,8 @@ static int makeflow_archive_write_task_info(struct archive_instance *a, struct d
 	FILE *fp = fopen(task_info, "w");
 	if (fp == NULL) {
 		free(task_info);
-		debug(D_ERROR|D_MAKEFLOW_HOOK, "could not create task_info for node %d archive", n->nodeid);
+		jx_delete(task_jx);
+		debug(D_ERROR|D_MAKEFLOW_HOOK, "could not create task_info for node %d archive", j->nodeid);
 		return 0;
 	} else {
 		jx_pretty_print_stream(task_jx, fp);
@@ -377,7 +453,8 @@ static int makeflow_archive_write_task_info(struct archive_instance *a, struct d
 	fp = fopen(task_info, "w");
 	if (fp == NULL) {
 		free(task_info);
-		debug(D_ERROR|D_MAKEFLOW_HOOK, "could not create run_info for node %d archive", n->nodeid);
+		jx_delete(run_jx);
+		debug(D_ERROR|D_MAKEFLOW_HOOK, "could not create run_info for node %d archive", j->nodeid);
 		return 0;
 	} else {
 		jx_pretty_print_stream(run_jx, fp);
@@ -474,13 +551,10 @@ static int makeflow_archive_s3_file(struct archive_instance *a, char *batchID, c
  */
 static int makeflow_archive_file(struct archive_instance *a, struct batch_file *f, char *job_file_archive_path) {
 	/* Generate the file archive id (content based) if does not exist. */
-	char * id;
-	if(path_is_dir(f->inner_name) == 1){
-		f->hash = batch_file_generate_id_dir(f->inner_name);
-				id = xxstrdup(f->hash);
-	}
-	else{
-		id = batch_file_generate_id(f);
+	char * id = makeflow_archive_file_id(f);
+	if(!id){
+		debug(D_ERROR|D_MAKEFLOW_HOOK, "could not checksum file %s for archiving\n", f->outer_name);
+		return 1;
 	}
 
 	struct stat buf;
@@ -504,12 +578,18 @@ static int makeflow_archive_file(struct archive_instance *a, struct batch_file *
 	/* File did not already exist, store in general file area */
 	} else {
 		if(path_is_dir(f->outer_name) != 1){
-			if (!copy_file_to_file(f->outer_name, file_archive_path)){
+			/* Copy beside the final name and rename, so that a file in the archive is always whole,
+			 * even when several threads archive the same contents at once. */
+			char *tmp_path = string_format("%s.tmp.%d.%lu", file_archive_path, (int) getpid(), (unsigned long) pthread_self());
+			if (copy_file_to_file(f->outer_name, tmp_path) < 0 || rename(tmp_path, file_archive_path) < 0){
 				debug(D_ERROR|D_MAKEFLOW_HOOK, "could not archive output file %s at %s: %d %s\n",
 					f->outer_name, file_archive_path, errno, strerror(errno));
+				unlink(tmp_path);
+				free(tmp_path);
 				rv = 1;
 				goto FAIL;
 			}
+			free(tmp_path);
 		}
 		else{
 			debug(D_MAKEFLOW,"COPYING %s to the archive",f->outer_name);
@@ -634,9 +714,9 @@ static int makeflow_archive_create_dir(char * prefix, char * name){
  *
 @return 1 if archive was successful, 0 if archive failed.
  */
-static int makeflow_archive_task(struct archive_instance *a, struct dag_node *n, struct batch_job *t) {
-	// Generates a hash id for the task
-	char *id = batch_job_generate_id(t);
+static int makeflow_archive_task(struct archive_instance *a, struct archive_job *j) {
+	struct batch_job *t = j->task;
+	char *id = j->id;
 	int result = 1;
 
 	/* The archive name is binned by the first 2 characters of the id for compactness */
@@ -655,7 +735,7 @@ static int makeflow_archive_task(struct archive_instance *a, struct dag_node *n,
 	}
 
 	/* Log the task info in the task directory */
-	if(!makeflow_archive_write_task_info(a, n, t, archive_directory_path)){
+	if(!makeflow_archive_write_task_info(a, j, archive_directory_path)){
 		result = 0;
 		goto FAIL;
 	}
@@ -676,7 +756,6 @@ static int makeflow_archive_task(struct archive_instance *a, struct dag_node *n,
 FAIL:
 	// Free all of the memory
 	free(archive_directory_path);
-	free(id);
 	return result;
 }
 
@@ -684,14 +763,13 @@ FAIL:
 /* Remove partial or corrupted archive.
 @return 1 if archive was successful, 0 if archive failed.
  */
-static int makeflow_archive_remove_task(struct archive_instance *a, struct dag_node *n, struct batch_job *t) {
-	/* Generate the task id */
-	char *id = batch_job_generate_id(t);
+static int makeflow_archive_remove_task(struct archive_instance *a, struct archive_job *j) {
+	struct batch_job *t = j->task;
+	char *id = j->id;
 
 	/* The archive name is binned by the first 2 characters of the id for compactness */
 	char *archive_directory_path = string_format("%s/tasks/%.2s/%s", a->dir, id, id);
 	debug(D_MAKEFLOW_HOOK, "removing corrupt archive for task %d at %s", t->taskid, archive_directory_path);
-	free(id);
 
 	if(!unlink_recursive(archive_directory_path)){
 		debug(D_MAKEFLOW_HOOK, "unable to remove corrupt archive for task %d", t->taskid);
@@ -1004,6 +1082,174 @@ static int makeflow_archive_s3_task(struct archive_instance *a, char *taskID, ch
 
 	return 1;
 }
+/*
+Archiving a task hashes and copies all of its files, which would hold up
+the workflow, so it is handed to a bounded pool of threads.  The files of
+the task are first hard linked into a staging directory of the archive,
+so that the workflow may go on to delete or replace them.  A task with a
+directory, or with a file on another filesystem, is archived at once.
+
+A link shares the inode, so it does not protect against a later job that
+rewrites the same file in place: "cmd > out" truncates and writes the
+inode that was staged, and the archive may then store the new contents,
+or a mix of both, under the id of the old task.  Only files replaced by
+a new inode (deleted, or renamed over) are safe to change meanwhile.
+*/
+
+static void makeflow_archive_job_delete(struct archive_job *j)
+{
+	if(j->staging_dir){
+		unlink_recursive(j->staging_dir);
+		free(j->staging_dir);
+	}
+	batch_job_delete(j->task);
+	free(j->id);
+	free((char *) j->src_command);
+	free(j);
+}
+
+/* Stage the files of a task, and return a copy of the task that reads them from the staging directory. */
+static struct archive_job *makeflow_archive_job_stage(struct archive_instance *a, struct dag_node *n, struct batch_job *t, const char *id)
+{
+	struct archive_job *j = calloc(1, sizeof(*j));
+	j->id = xxstrdup(id);
+	j->src_command = xxstrdup(n->command);
+	j->src_line = n->linenum;
+	j->nodeid = n->nodeid;
+	j->task = batch_job_create(NULL);
+	j->task->taskid = t->taskid;
+	j->task->command = xxstrdup(t->command);
+	memcpy(j->task->info, t->info, sizeof(*t->info));
+
+	j->staging_dir = string_format("%s/staging/%d.%d", a->dir, (int) getpid(), a->staging_count++);
+	if(!create_dir(j->staging_dir, 0777)){
+		debug(D_MAKEFLOW_HOOK, "could not create staging directory %s: %s", j->staging_dir, strerror(errno));
+		free(j->staging_dir);
+		j->staging_dir = NULL;
+		makeflow_archive_job_delete(j);
+		return NULL;
+	}
+
+	struct list *lists[2] = {t->input_files, t->output_files};
+	int count = 0;
+	int i;
+	for(i = 0; i < 2; i++){
+		struct batch_file *f;
+		struct list_cursor *cur = list_cursor_create(lists[i]);
+		for(list_seek(cur, 0); list_get(cur, (void**)&f); list_next(cur)) {
+			char *staged = string_format("%s/%d", j->staging_dir, count++);
+			if(path_is_dir(f->outer_name) == 1 || linkat(AT_FDCWD, f->outer_name, AT_FDCWD, staged, AT_SYMLINK_FOLLOW) < 0){
+				debug(D_MAKEFLOW_HOOK, "task %d will be archived at once, as %s cannot be staged", t->taskid, f->outer_name);
+				free(staged);
+				list_cursor_destroy(cur);
+				makeflow_archive_job_delete(j);
+				return NULL;
+			}
+			if(i == 0){
+				batch_job_add_input_file(j->task, staged, f->inner_name);
+			} else {
+				batch_job_add_output_file(j->task, staged, f->inner_name);
+			}
+			free(staged);
+		}
+		list_cursor_destroy(cur);
+	}
+
+	return j;
+}
+
+static void *makeflow_archive_thread(void *arg)
+{
+	struct archive_instance *a = arg;
+
+	pthread_mutex_lock(&a->mutex);
+	while(1){
+		struct archive_job *j = list_pop_head(a->pending);
+		if(!j){
+			if(a->shutdown)
+				break;
+			pthread_cond_wait(&a->cond, &a->mutex);
+			continue;
+		}
+
+		a->active++;
+		pthread_cond_broadcast(&a->cond);
+		pthread_mutex_unlock(&a->mutex);
+
+		int archived = makeflow_archive_task(a, j);
+		if(!archived){
+			debug(D_ERROR|D_MAKEFLOW_HOOK, "unable to archive task %d in directory: %s\n", j->task->taskid, a->dir);
+			makeflow_archive_remove_task(a, j);
+		}
+		makeflow_archive_job_delete(j);
+
+		pthread_mutex_lock(&a->mutex);
+		if(!archived)
+			a->failures++;
+		a->active--;
+		pthread_cond_broadcast(&a->cond);
+	}
+	pthread_mutex_unlock(&a->mutex);
+
+	return NULL;
+}
+
+/* Queue a staged task for the pool, waiting while the queue is full. Return false if there is no pool. */
+static int makeflow_archive_enqueue(struct archive_instance *a, struct archive_job *j)
+{
+	pthread_mutex_lock(&a->mutex);
+
+	if(!a->thread_ids){
+		a->thread_ids = calloc(a->threads, sizeof(pthread_t));
+		while(a->threads_started < a->threads && pthread_create(&a->thread_ids[a->threads_started], NULL, makeflow_archive_thread, a) == 0){
+			a->threads_started++;
+		}
+		debug(D_MAKEFLOW_HOOK, "started %d threads for archiving", a->threads_started);
+	}
+
+	if(!a->threads_started){
+		pthread_mutex_unlock(&a->mutex);
+		return 0;
+	}
+
+	while(list_size(a->pending) >= a->threads_started * 4){
+		pthread_cond_wait(&a->cond, &a->mutex);
+	}
+
+	list_push_tail(a->pending, j);
+	pthread_cond_broadcast(&a->cond);
+	pthread_mutex_unlock(&a->mutex);
+
+	return 1;
+}
+
+static void makeflow_archive_wait_pending(struct archive_instance *a)
+{
+	pthread_mutex_lock(&a->mutex);
+	while(list_size(a->pending) > 0 || a->active > 0){
+		pthread_cond_wait(&a->cond, &a->mutex);
+	}
+	pthread_mutex_unlock(&a->mutex);
+}
+
+static void makeflow_archive_stop_threads(struct archive_instance *a)
+{
+	int i;
+
+	pthread_mutex_lock(&a->mutex);
+	a->shutdown = 1;
+	pthread_cond_broadcast(&a->cond);
+	pthread_mutex_unlock(&a->mutex);
+
+	for(i = 0; i < a->threads_started; i++){
+		pthread_join(a->thread_ids[i], NULL);
+	}
+
+	free(a->thread_ids);
+	a->thread_ids = NULL;
+	a->threads_started = 0;
+}
+
 static int node_success( void * instance_struct, struct dag_node *n, struct batch_job *t){
 	struct archive_instance *a = (struct archive_instance*)instance_struct;
 	/* store node into archiving directory  */
@@ -1028,12 +1274,28 @@ static int node_success( void * instance_struct, struct dag_node *n, struct batc
 			return MAKEFLOW_HOOK_SUCCESS;
 		}
 
+		// Hand the task to the archiving threads if its files can be staged
+		if(a->threads > 0){
+			struct archive_job *j = makeflow_archive_job_stage(a, n, t, id);
+			if(j && makeflow_archive_enqueue(a, j)){
+				debug(D_MAKEFLOW_HOOK, "archiving task %d in the background in directory: %s\n", t->taskid, a->dir);
+				free(id);
+				free(task_path);
+				return MAKEFLOW_HOOK_SUCCESS;
+			}
+			if(j)
+				makeflow_archive_job_delete(j);
+		}
+
 		// Otherwise archive the task
 		debug(D_MAKEFLOW_HOOK, "archiving task %d in directory: %s\n",t->taskid, a->dir);
-		int archived = makeflow_archive_task(a, n, t);
+		struct archive_job j = {t, id, n->command, n->linenum, n->nodeid, NULL};
+		int archived = makeflow_archive_task(a, &j);
 		if(!archived){
 			debug(D_MAKEFLOW_HOOK, "unable to archive task %d in directory: %s\n",t->taskid, a->dir);
-			makeflow_archive_remove_task(a, n, t);
+			makeflow_archive_remove_task(a, &j);
+			free(id);
+			free(task_path);
 			return MAKEFLOW_HOOK_FAILURE;
 		}
 		debug(D_MAKEFLOW_HOOK,"The task ID in node_success is %s",id);
@@ -1059,6 +1321,20 @@ static int node_success( void * instance_struct, struct dag_node *n, struct batc
 	return MAKEFLOW_HOOK_SUCCESS;
 }
 
+/* Tasks still being archived must be finished before the workflow is. */
+static int dag_end( void * instance_struct, struct dag *d){
+	struct archive_instance *a = (struct archive_instance*)instance_struct;
+
+	makeflow_archive_wait_pending(a);
+
+	if(a->failures > 0){
+		debug(D_ERROR|D_MAKEFLOW_HOOK, "%d tasks could not be archived in directory: %s", a->failures, a->dir);
+		return MAKEFLOW_HOOK_FAILURE;
+	}
+
+	return MAKEFLOW_HOOK_SUCCESS;
+}
+
 struct makeflow_hook makeflow_hook_archive = {
 	.module_name = "Archive",
 	.create = create,
@@ -1066,6 +1342,7 @@ struct makeflow_hook makeflow_hook_archive = {
 
 	.dag_check = dag_check,
 	.dag_loop = dag_loop,
+	.dag_end = dag_end,
 
 	.batch_submit = batch_submit,
 	.batch_retrieve = batch_retrieve,
@@ -61,7 +61,6 @@ struct dag *dag_from_file(const char *filename, dag_syntax_type format, struct j
 {
 	FILE *dagfile = NULL;
 	struct jx *dag = NULL;
-	struct jx *jx_tmp = NULL;
 	struct dag *d = NULL;
 
 	// Initial verification of file existence
@@ -93,12 +92,14 @@ struct dag *dag_from_file(const char *filename, dag_syntax_type format, struct j
 
 			fclose(dagfile);
 			break;
-		case DAG_SYNTAX_JX: //Evaluates the pending JX Variables from args file
-			jx_tmp = jx_eval_with_defines(dag,args);
+		case DAG_SYNTAX_JX: //Evaluates the JX rules one at a time with the args file
+			if(!dag_parse_jx_with_defines(d, dag, args)){
+				free(d);
+				d = NULL;
+			}
 			jx_delete(dag);
-			dag = jx_tmp;
-			 //Intentional fall-through as JX and JSON both use dag_parse_jx
-			/* falls through */
+			errno = EINVAL;
+			break;
 		case DAG_SYNTAX_JSON:
 			if(!dag_parse_jx(d, dag)){
 				free(d);
@@ -23,6 +23,7 @@ See the file COPYING for details.
 #include "jx_print.h"
 
 #include <assert.h>
+#include <string.h>
 
 /* Print error to stderr for the user, and with D_NOTICE, for logs. */
 void report_error(int64_t line, const char *message, struct jx *actual)
@@ -287,17 +288,8 @@ static int category_from_jx(struct dag *d, const char *name, struct jx *j)
 	return 1;
 }
 
-struct dag *dag_parse_jx(struct dag *d, struct jx *j)
+static int header_from_jx(struct dag *d, struct jx *j)
 {
-	if(!j) {
-		report_error(0, "a workflow definition is missing.", NULL);
-		return NULL;
-	}
-	if(!jx_istype(j, JX_OBJECT)) {
-		report_error(0, "a workflow definition as a JSON object", j);
-		return NULL;
-	}
-
 	debug(D_MAKEFLOW_PARSER, "Parsing categories");
 	struct jx *categories = jx_lookup(j, "categories");
 	if(jx_istype(categories, JX_OBJECT)) {
@@ -307,7 +299,7 @@ struct dag *dag_parse_jx(struct dag *d, struct jx *j)
 			struct jx *value = jx_lookup(categories, key);
 			if(!category_from_jx(d, key, value)) {
 				report_error(value->line, "a category definition as a JSON object", j);
-				return NULL;
+				return 0;
 			}
 		}
 	} else {
@@ -326,11 +318,38 @@ struct dag *dag_parse_jx(struct dag *d, struct jx *j)
 	struct jx *environment = jx_lookup(j, "environment");
 	if(environment && !environment_from_jx(d, NULL, d->default_category->mf_variables, environment)) {
 		report_error(environment->line, "an environment definition as a JSON object", environment);
-		return NULL;
+		return 0;
 	} else {
 		debug(D_MAKEFLOW_PARSER, "Workflow at line %u: Top-level environment malformed or missing", j->line);
 	}
 
+	return 1;
+}
+
+static void dag_parse_jx_finish(struct dag *d)
+{
+	dag_close_over_environment(d);
+	dag_close_over_nodes(d);
+	dag_close_over_categories(d);
+
+	dag_compile_ancestors(d);
+}
+
+struct dag *dag_parse_jx(struct dag *d, struct jx *j)
+{
+	if(!j) {
+		report_error(0, "a workflow definition is missing.", NULL);
+		return NULL;
+	}
+	if(!jx_istype(j, JX_OBJECT)) {
+		report_error(0, "a workflow definition as a JSON object", j);
+		return NULL;
+	}
+
+	if(!header_from_jx(d, j)) {
+		return NULL;
+	}
+
 	struct jx *rules = jx_lookup(j, "rules");
 	if(jx_istype(rules, JX_ARRAY)) {
 		struct jx *item;
@@ -343,11 +362,192 @@ struct dag *dag_parse_jx(struct dag *d, struct jx *j)
 		}
 	}
 
-	dag_close_over_environment(d);
-	dag_close_over_nodes(d);
-	dag_close_over_categories(d);
-
-	dag_compile_ancestors(d);
+	dag_parse_jx_finish(d);
 
 	return d;
 }
+
+/*
+Evaluate one rule expression and add it to the dag.
+The evaluated rule is deleted as soon as its node is made.
+*/
+
+static int rule_from_expression(struct dag *d, struct jx *expr, struct jx *context)
+{
+	struct jx *rule = jx_eval(expr, context);
+	int ok = 0;
+
+	if(!rule || jx_istype(rule, JX_ERROR)) {
+		report_error(expr->line, "a rule", rule);
+	} else if(!rule_from_jx(d, rule)) {
+		report_error(expr->line, "error parsing the rule.", NULL);
+	} else {
+		ok = 1;
+	}
+
+	jx_delete(rule);
+	return ok;
+}
+
+/*
+Expand a rule comprehension one rule at a time, in the same order as
+jx_eval would.  Rather than copying the whole context for each element,
+the loop variable is pushed onto the front of the context, where it hides
+any outer binding of the same name, and popped off again afterwards.
+*/
+
+static int rules_from_comprehension(struct dag *d, struct jx *body, struct jx_comprehension *comp, struct jx *context)
+{
+	struct jx *list = jx_eval(comp->elements, context);
+	if(!jx_istype(list, JX_ARRAY)) {
+		report_error(comp->line, "an array for the rule comprehension", list);
+		jx_delete(list);
+		return 0;
+	}
+
+	int ok = 1;
+	struct jx *item;
+	void *i = NULL;
+	while(ok && (item = jx_iterate_array(list, &i))) {
+		context->u.pairs = jx_pair(jx_string(comp->variable), jx_copy(item), context->u.pairs);
+
+		int selected = 1;
+		if(comp->condition) {
+			struct jx *cond = jx_eval(comp->condition, context);
+			if(jx_istype(cond, JX_BOOLEAN)) {
+				selected = cond->u.boolean_value;
+			} else {
+				report_error(comp->line, "a boolean for the rule comprehension condition", cond);
+				ok = 0;
+			}
+			jx_delete(cond);
+		}
+
+		if(ok && selected) {
+			if(comp->next) {
+				ok = rules_from_comprehension(d, body, comp->next, context);
+			} else {
+				ok = rule_from_expression(d, body, context);
+			}
+		}
+
+		struct jx_pair *binding = context->u.pairs;
+		context->u.pairs = binding->next;
+		binding->next = NULL;
+		jx_pair_delete(binding);
+	}
+
+	jx_delete(list);
+	return ok;
+}
+
+static int rules_from_expression(struct dag *d, struct jx *rules, struct jx *context)
+{
+	/* Anything but a literal list of rules is evaluated as a whole. */
+	if(!jx_istype(rules, JX_ARRAY)) {
+		struct jx *value = jx_eval(rules, context);
+		int ok = 1;
+		if(jx_istype(value, JX_ERROR)) {
+			report_error(rules->line, "a list of rules", value);
+			ok = 0;
+		} else if(jx_istype(value, JX_ARRAY)) {
+			struct jx *item;
+			void *i = NULL;
+			while(ok && (item = jx_iterate_array(value, &i))) {
+				if(!rule_from_jx(d, item)) {
+					report_error(item->line, "error parsing the rule.", NULL);
+					ok = 0;
+				}
+			}
+		}
+		jx_delete(value);
+		return ok;
+	}
+
+	struct jx_item *item;
+	for(item = rules->u.items; item; item = item->next) {
+		int ok;
+		if(item->comp) {
+			ok = rules_from_comprehension(d, item->value, item->comp, context);
+		} else {
+			ok = rule_from_expression(d, item->value, context);
+		}
+		if(!ok) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+struct dag *dag_parse_jx_with_defines(struct dag *d, struct jx *j, struct jx *args)
+{
+	if(!j) {
+		report_error(0, "a workflow definition is missing.", NULL);
+		return NULL;
+	}
+	if(!jx_istype(j, JX_OBJECT)) {
+		report_error(0, "a workflow definition as a JSON object", j);
+		return NULL;
+	}
+
+	/*
+	A key computed by a comprehension might be "rules" itself,
+	so such a workflow can only be evaluated as a whole.
+	*/
+	struct jx_pair *p;
+	for(p = j->u.pairs; p; p = p->next) {
+		if(p->comp) {
+			struct jx *e = jx_eval_with_defines(j, args);
+			struct dag *result = dag_parse_jx(d, e);
+			jx_delete(e);
+			return result;
+		}
+	}
+
+	struct jx *defines = jx_lookup(j, "define");
+	struct jx *empty = jx_object(0);
+	struct jx *context = jx_merge(defines ? defines : empty, args ? args : empty, 0);
+	jx_delete(empty);
+
+	/* Evaluate everything but the rules, which are done one at a time below. */
+	struct jx *header = jx_object(0);
+	struct jx_pair **tail = &header->u.pairs;
+	struct jx *rules = NULL;
+	struct dag *result = NULL;
+
+	for(p = j->u.pairs; p; p = p->next) {
+		struct jx *key = jx_eval(p->key, context);
+		if(jx_istype(key, JX_STRING) && !strcmp(key->u.string_value, "rules")) {
+			jx_delete(key);
+			rules = p->value;
+			continue;
+		}
+
+		struct jx *value = jx_eval(p->value, context);
+		if(jx_istype(key, JX_ERROR) || jx_istype(value, JX_ERROR)) {
+			report_error(p->line, "a valid workflow definition", jx_istype(key, JX_ERROR) ? key : value);
+			jx_delete(key);
+			jx_delete(value);
+			goto done;
+		}
+		*tail = jx_pair(key, value, NULL);
+		tail = &(*tail)->next;
+	}
+
+	if(!header_from_jx(d, header)) {
+		goto done;
+	}
+
+	if(rules && !rules_from_expression(d, rules, context)) {
+		goto done;
+	}
+
+	dag_parse_jx_finish(d);
+	result = d;
+
+done:
+	jx_delete(header);
+	jx_delete(context);
+	return result;
+}
@@ -11,5 +11,12 @@ See the file COPYING for details.
 
 struct dag *dag_parse_jx(struct dag *d, struct jx *);
 
+/*
+Evaluate and parse an unevaluated JX workflow with the given arguments.
+Each rule is evaluated and added to the dag before the next one,
+so that the fully evaluated workflow is never held in memory.
+*/
+struct dag *dag_parse_jx_with_defines(struct dag *d, struct jx *j, struct jx *args);
+
 #endif
 
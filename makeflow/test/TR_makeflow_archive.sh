@@ -0,0 +1,124 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+
+test_dir=`basename $0 .sh`.dir
+
+check_needed()
+{
+	# The archive module is only built along with curl.
+	grep -q '^CCTOOLS_CURL_AVAILABLE=yes' ../../config.mk || return 1
+	return 0
+}
+
+prepare()
+{
+	mkdir $test_dir
+	cd $test_dir
+	ln -sf ../../src/makeflow .
+	echo "hello" > file.0
+	dd if=/dev/urandom of=big.0 bs=1024 count=2048 2>/dev/null
+
+cat > test.jx << EOF
+{
+	"rules" :
+	[
+		{
+			"command" : format("cat file.%d big.0 > file.%d && echo %d >> ran.log",i,i+1,i),
+			"inputs"  : [ "file."+i, "big.0" ],
+			"outputs" : [ "file."+(i+1) ]
+		} for i in range(0,4)
+	] + [
+		{
+			"command" : format("cp file.0 side.%d && echo side.%d >> ran.log",i,i),
+			"inputs"  : [ "file.0" ],
+			"outputs" : [ "side."+i ]
+		} for i in range(0,8)
+	]
+}
+EOF
+	exit 0
+}
+
+run()
+{
+	cd $test_dir
+	archive=`pwd`/archive
+
+	echo "+++++ first run: should run and archive 12 jobs +++++"
+	./makeflow --archive --archive-dir=$archive --archive-threads=3 --jx test.jx || exit 1
+	for f in file.1 file.2 file.3 file.4 side.0 side.7
+	do
+		cp $f $f.expected
+	done
+
+	count=`wc -l < ran.log`
+	echo "+++++ $count jobs run, expecting 12 +++++"
+	[ $count -eq 12 ] || exit 1
+
+	if [ -n "`ls $archive/staging`" ]
+	then
+		echo "files were left in the staging directory"
+		exit 1
+	fi
+
+	# Every stored file is complete, and named by its checksum rather than a temporary name.
+	for f in $archive/files/*/*
+	do
+		name=`basename $f`
+		case $name in
+			????????????????????????????????????????) ;;
+			*) echo "unexpected file $name in the archive"; exit 1 ;;
+		esac
+		if [ -f $f ] && [ "`sha1sum < $f | cut -d' ' -f1`" != $name ]
+		then
+			echo "archived file $name does not match its checksum"
+			exit 1
+		fi
+	done
+
+	[ -s $archive/checksums ] || exit 1
+
+	echo "+++++ cleaning the workflow +++++"
+	./makeflow --clean --jx test.jx || exit 1
+	rm -f ran.log
+
+	echo "+++++ second run: should pull 12 jobs from the archive +++++"
+	./makeflow --archive --archive-dir=$archive --archive-threads=3 -d makeflow -o debug.log --jx test.jx | tee output.2 || exit 1
+
+	count=`grep -c "was pulled from archive" output.2`
+	echo "+++++ $count jobs pulled, expecting 12 +++++"
+	[ $count -eq 12 ] || exit 1
+
+	if [ -f ran.log ]
+	then
+		echo "jobs were run again"
+		exit 1
+	fi
+
+	for f in file.1 file.2 file.3 file.4 side.0 side.7
+	do
+		cmp $f $f.expected || exit 1
+	done
+
+	# The unchanged inputs are not hashed again, as their checksums are kept from the first run.
+	grep "loaded [1-9][0-9]* checksums from $archive/checksums" debug.log || exit 1
+	grep -q "Cached CHECKSUM hash of big.0" debug.log || exit 1
+	if grep "Checksum hash of big.0 is" debug.log
+	then
+		echo "big.0 was hashed again"
+		exit 1
+	fi
+
+	exit 0
+}
+
+clean()
+{
+	rm -rf $test_dir
+	exit 0
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
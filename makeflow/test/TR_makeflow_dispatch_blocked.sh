@@ -0,0 +1,52 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+
+test_dir=dispatch_blocked.dir
+
+# While "big" runs, more than a thousand ready rules of greater priority
+# cannot fit in local memory.  The small rule behind them must still start.
+
+prepare()
+{
+	mkdir $test_dir
+	cd $test_dir
+	{
+		printf '.MAKEFLOW CATEGORY big\n.MAKEFLOW MEMORY 900\n.MAKEFLOW WALL_TIME 1000\n'
+		printf 'big.out:\n\tsleep 4; date +%%s > big.out\n\n'
+		printf '.MAKEFLOW CATEGORY blocked\n.MAKEFLOW MEMORY 1000\n.MAKEFLOW WALL_TIME 100\n'
+		i=0
+		while [ $i -lt 1100 ]
+		do
+			printf 'blocked.%d:\n\ttouch blocked.%d\n\n' $i $i
+			i=$((i+1))
+		done
+		printf '.MAKEFLOW CATEGORY small\n.MAKEFLOW MEMORY 10\n.MAKEFLOW WALL_TIME 1\n'
+		printf 'small.out:\n\tdate +%%s > small.out\n'
+	} > Makeflow
+	exit 0
+}
+
+run()
+{
+	cd $test_dir
+	../../src/makeflow --local-cores 8 --local-memory 1000 || exit 1
+
+	if [ "$(cat small.out)" -lt "$(cat big.out)" ]
+	then
+		exit 0
+	else
+		echo "small.out finished at $(cat small.out), after big.out at $(cat big.out)"
+		exit 1
+	fi
+}
+
+clean()
+{
+	rm -fr $test_dir
+	exit 0
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
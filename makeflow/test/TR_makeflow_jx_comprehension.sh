@@ -0,0 +1,54 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+
+# Rules generated by nested comprehensions with conditions are expanded
+# one at a time, and the loop variables hide any define of the same name.
+
+prepare()
+{
+cat > comprehension.jx << EOF
+{
+	"define": { "i": 99 },
+	"rules": [
+		{
+			"command": format("echo %d %d > pair.%d.%d", i, j, i, j),
+			"outputs": [ format("pair.%d.%d", i, j) ]
+		} for i in range(3) if i != 1 for j in range(i + 1) if j != i,
+		{
+			"command": format("echo %d > define.%d", i, i),
+			"outputs": [ format("define.%d", i) ]
+		}
+	]
+}
+EOF
+
+cat > comprehension.expected << EOF
+2 0
+2 1
+99
+EOF
+}
+
+run()
+{
+	../src/makeflow --jx comprehension.jx || exit 1
+	ls pair.* > comprehension.list
+	cat pair.2.0 pair.2.1 define.99 > comprehension.out
+	if [ "$(cat comprehension.list | tr '\n' ' ')" != "pair.2.0 pair.2.1 " ]
+	then
+		echo "ERROR: unexpected outputs: $(cat comprehension.list)"
+		exit 1
+	fi
+	require_identical_files comprehension.expected comprehension.out
+}
+
+clean()
+{
+	rm -f comprehension.jx comprehension.expected comprehension.list comprehension.out pair.* define.* comprehension.jx.makeflowlog
+	exit 0
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
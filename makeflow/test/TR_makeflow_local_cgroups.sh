@@ -0,0 +1,78 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+
+test_dir=`basename $0 .sh`.dir
+
+prepare()
+{
+	mkdir $test_dir
+	cd $test_dir
+
+	# The first rule leaves a process running in the background.
+cat > background.sh << EOF
+sleep 60 &
+echo \$! > background.pid
+EOF
+
+cat > Makeflow << EOF
+a.out: background.sh
+	sh background.sh; echo hello > a.out
+
+b.out: a.out
+	cat a.out > b.out
+EOF
+	exit 0
+}
+
+run()
+{
+	cd $test_dir
+
+	../../src/makeflow --local-cgroups -d batch -o debug.log 2> stderr.log || exit 1
+	cat stderr.log
+	[ "`cat b.out`" = hello ] || exit 1
+
+	if grep -q "placing local jobs in cgroup" debug.log
+	then
+		base=`sed -n 's/.*placing local jobs in cgroup //p' debug.log`
+		if [ -d "$base" ]
+		then
+			echo "cgroup $base was left behind"
+			exit 1
+		fi
+		# The process is killed, but may take a moment to be reaped.
+		for i in 1 2 3 4 5
+		do
+			kill -0 `cat background.pid` 2> /dev/null || break
+			sleep 1
+		done
+		if kill -0 `cat background.pid` 2> /dev/null
+		then
+			echo "the background process of a job was left running"
+			exit 1
+		fi
+	fi
+
+	# Without the cpu and memory controllers, the jobs run unconfined, and say so.
+	if grep -q "couldn't enable the cpu and memory controllers\|cgroup v2 is not available\|couldn't create cgroup" debug.log
+	then
+		grep -q "notice: " stderr.log || exit 1
+	fi
+
+	exit 0
+}
+
+clean()
+{
+	if [ -f $test_dir/background.pid ]
+	then
+		kill `cat $test_dir/background.pid` 2> /dev/null
+	fi
+	rm -fr $test_dir
+	exit 0
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
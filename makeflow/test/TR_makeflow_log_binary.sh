@@ -0,0 +1,102 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+
+test_dir=`basename $0 .sh`.dir
+
+prepare()
+{
+	mkdir $test_dir
+	cd $test_dir
+	ln -sf ../../src/makeflow .
+	ln -sf ../../src/makeflow_log_convert .
+	echo "hello" > file.1
+
+cat > test.jx << EOF
+{
+	"rules" :
+	[
+		{
+			"command" : format("cp file.%d file.%d",i,i+1),
+			"inputs"  : [ "file."+i ],
+			"outputs" : [ "file."+(i+1) ]
+		} for i in range(1,10)
+	]
+}
+EOF
+	exit 0
+}
+
+run()
+{
+	cd $test_dir
+
+	echo "+++++ first run: should make 10 files with a binary log +++++"
+	./makeflow --log-format=binary --jx test.jx || exit 1
+
+	if [ "`head -c 7 test.jx.makeflowlog`" != "MFBLOG2" ]
+	then
+		echo "log is not in binary format"
+		exit 1
+	fi
+
+	echo "+++++ deleting file.5 manually +++++"
+	rm file.5
+
+	echo "+++++ second run: should rebuild 6 files +++++"
+	./makeflow --jx test.jx | tee output.2
+
+	count=`grep "^deleted file." output.2 | wc -l`
+
+	echo "+++++ $count files deleted, expecting 6 +++++"
+	if [ $count -ne 6 ]
+	then
+		exit 1
+	fi
+
+	echo "+++++ converting to text and back +++++"
+	./makeflow_log_convert test.jx.makeflowlog text.log || exit 1
+	grep -q "^# COMPLETED" text.log || exit 1
+	./makeflow_log_convert text.log binary.log || exit 1
+	cmp binary.log test.jx.makeflowlog || exit 1
+
+	echo "+++++ the binary log is smaller than the text log +++++"
+	[ `wc -c < binary.log` -lt `wc -c < text.log` ] || exit 1
+
+	echo "+++++ a record cut short at the end is removed +++++"
+	size=`wc -c < binary.log`
+	head -c $((size-3)) binary.log > test.jx.makeflowlog
+	./makeflow --jx test.jx | tee output.short
+	grep -q "removing incomplete record" output.short || exit 1
+
+	echo "+++++ a record of unknown type is refused +++++"
+	cp binary.log test.jx.makeflowlog
+	printf '\377\0\0\0\0\0\0\0' >> test.jx.makeflowlog
+	if ./makeflow --jx test.jx
+	then
+		echo "makeflow accepted a corrupted log"
+		exit 1
+	fi
+	if [ `wc -c < test.jx.makeflowlog` -ne $((size+8)) ]
+	then
+		echo "the corrupted log was modified"
+		exit 1
+	fi
+
+	echo "+++++ third run: the log continues in text +++++"
+	mv text.log test.jx.makeflowlog
+	./makeflow --jx test.jx | tee output.3
+	grep -q "nothing left to do" output.3 || exit 1
+
+	exit 0
+}
+
+clean()
+{
+	rm -fr $test_dir
+	exit 0
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
@@ -0,0 +1,65 @@
+#!/bin/sh
+
+# Intermediate files passed only between remote rules stay on the
+# taskvine worker, and only the final output comes back.
+
+. ../../dttools/test/test_runner_common.sh
+
+MAKE_FILE="temp_files.makeflow"
+PORT_FILE="makeflow.port"
+WORKER_LOG="worker.log"
+
+prepare()
+{
+cat > input.txt <<EOF
+hello
+EOF
+
+cat > $MAKE_FILE <<EOF
+MAKEFLOW_INPUTS=input.txt
+MAKEFLOW_OUTPUTS=out.actual
+
+temp.1: input.txt
+	cat input.txt input.txt > temp.1
+
+temp.2: temp.1
+	tr a-z A-Z < temp.1 > temp.2
+
+out.actual: temp.1 temp.2
+	cat temp.1 temp.2 > out.actual
+EOF
+
+cat > out.expected <<EOF
+hello
+hello
+HELLO
+HELLO
+EOF
+}
+
+run()
+{
+	../src/makeflow -T vine --vine-temp-files -Z "$PORT_FILE" "$MAKE_FILE" &
+
+	run_taskvine_worker "$PORT_FILE" "$WORKER_LOG"
+
+	require_identical_files out.actual out.expected || return 1
+
+	if [ -e temp.1 ] || [ -e temp.2 ]
+	then
+		echo "intermediate files were brought back to the manager"
+		return 1
+	fi
+
+	return 0
+}
+
+clean()
+{
+	../src/makeflow -c $MAKE_FILE
+	rm -f $MAKE_FILE $PORT_FILE $WORKER_LOG temp.1 temp.2 out.actual out.expected input.txt
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
@@ -3612,7 +3612,7 @@ void pfs_dispatch32( struct pfs_process *p )
 	switch(p->state) {
 		case PFS_PROCESS_STATE_KERNEL:
 		case PFS_PROCESS_STATE_USER:
-			tracer_continue(p->tracer,0);
+			pfs_process_continue(p,0);
 			break;
 		default:
 			assert(0);
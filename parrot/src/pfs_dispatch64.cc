@@ -24,6 +24,7 @@ int pfs_dispatch64( struct pfs_process *p )
 #include "pfs_dispatch.h"
 #include "pfs_pointer.h"
 #include "pfs_process.h"
+#include "pfs_seccomp.h"
 #include "pfs_service.h"
 #include "pfs_sys.h"
 #include "pfs_time.h"
@@ -169,6 +170,17 @@ static void divert_to_dummy( struct pfs_process *p, INT64_T result )
 	tracer_args_set(p->tracer,SYSCALL64_getpid,0,0);
 }
 
+/*
+Let this incoming system call run natively, with nothing to do at its exit.
+In seccomp mode, that means the process need not stop at the exit at all.
+*/
+
+static void pass_to_kernel( struct pfs_process *p )
+{
+	if (pfs_seccomp)
+		p->state = PFS_PROCESS_STATE_USER;
+}
+
 /* The purpose of this is to allocate a unique file and use up an fd so it
  * isn't used in the future. We also need the inode # to get its unique
  * identifier.
@@ -929,12 +941,16 @@ static void decode_mmap( struct pfs_process *p, int entering, const INT64_T *arg
 		debug(D_SYSCALL,"mmap addr=0x%" PRIx64 " len=0x%" PRIx64 " prot=0x%" PRIx64 " flags=0x%" PRIx64 " fd=%d offset=0x%" PRIx64,addr,length,prot,flags,fd,source_offset);
 
 	if(p->table->isnative(fd)) {
-		if (entering)
+		if (entering) {
 			debug(D_DEBUG, "fallthrough mmap on native fd");
+			pass_to_kernel(p);
+		}
 		return;
 	} else if (flags&MAP_ANONYMOUS) {
-		if (entering)
+		if (entering) {
 			debug(D_SYSCALL,"mmap skipped b/c anonymous");
+			pass_to_kernel(p);
+		}
 		return;
 	} else if(entering) {
 		INT64_T nargs[] = {args[0], args[1], args[2], args[3], args[4], args[5]};
@@ -1056,7 +1072,8 @@ static void decode_syscall( struct pfs_process *p, int entering )
 	*/
 	switch(p->syscall) {
 		/* A wide variety of calls have no relation to file access, so we
-		 * simply send them along to the underlying OS.
+		 * simply send them along to the underlying OS.  In seccomp mode they
+		 * never stop at all; keep this list in step with pfs_seccomp.cc.
 		 */
 
 		case SYSCALL64__sysctl:
@@ -1539,7 +1556,10 @@ static void decode_syscall( struct pfs_process *p, int entering )
 		case SYSCALL64_getdents:
 		case SYSCALL64_getdents64:
 			if (p->table->isnative(args[0])) {
-				if (entering) debug(D_DEBUG, "fallthrough %s(%" PRId64 ", %" PRId64 ", %" PRId64 ")", tracer_syscall_name(p->tracer,p->syscall), args[0], args[1], args[2]);
+				if (entering) {
+					debug(D_DEBUG, "fallthrough %s(%" PRId64 ", %" PRId64 ", %" PRId64 ")", tracer_syscall_name(p->tracer,p->syscall), args[0], args[1], args[2]);
+					pass_to_kernel(p);
+				}
 			} else if (entering) {
 				INT64_T fd = args[0];
 				uintptr_t uaddr = args[1];
@@ -1613,7 +1633,10 @@ static void decode_syscall( struct pfs_process *p, int entering )
 		case SYSCALL64_read:
 		case SYSCALL64_pread64:
 			if (p->table->isnative(args[0])) {
-				if (entering) debug(D_DEBUG, "fallthrough %s(%" PRId64 ", %" PRId64 ", %" PRId64 ")", tracer_syscall_name(p->tracer,p->syscall), args[0], args[1], args[2]);
+				if (entering) {
+					debug(D_DEBUG, "fallthrough %s(%" PRId64 ", %" PRId64 ", %" PRId64 ")", tracer_syscall_name(p->tracer,p->syscall), args[0], args[1], args[2]);
+					pass_to_kernel(p);
+				}
 			} else {
 				decode_read(p,entering,p->syscall,args);
 			}
@@ -1622,7 +1645,10 @@ static void decode_syscall( struct pfs_process *p, int entering )
 		case SYSCALL64_write:
 		case SYSCALL64_pwrite64:
 			if (p->table->isnative(args[0])) {
-				if (entering) debug(D_DEBUG, "fallthrough %s(%" PRId64 ", %" PRId64 ", %" PRId64 ")", tracer_syscall_name(p->tracer,p->syscall), args[0], args[1], args[2]);
+				if (entering) {
+					debug(D_DEBUG, "fallthrough %s(%" PRId64 ", %" PRId64 ", %" PRId64 ")", tracer_syscall_name(p->tracer,p->syscall), args[0], args[1], args[2]);
+					pass_to_kernel(p);
+				}
 			} else {
 				decode_write(p,entering,p->syscall,args);
 			}
@@ -1630,7 +1656,10 @@ static void decode_syscall( struct pfs_process *p, int entering )
 
 		case SYSCALL64_readv:
 			if (p->table->isnative(args[0])) {
-				if (entering) debug(D_DEBUG, "fallthrough %s(%" PRId64 ", %" PRId64 ", %" PRId64 ")", tracer_syscall_name(p->tracer,p->syscall), args[0], args[1], args[2]);
+				if (entering) {
+					debug(D_DEBUG, "fallthrough %s(%" PRId64 ", %" PRId64 ", %" PRId64 ")", tracer_syscall_name(p->tracer,p->syscall), args[0], args[1], args[2]);
+					pass_to_kernel(p);
+				}
 			} else {
 				decode_readv(p,entering,p->syscall,args);
 			}
@@ -1638,7 +1667,10 @@ static void decode_syscall( struct pfs_process *p, int entering )
 
 		case SYSCALL64_writev:
 			if (p->table->isnative(args[0])) {
-				if (entering) debug(D_DEBUG, "fallthrough %s(%" PRId64 ", %" PRId64 ", %" PRId64 ")", tracer_syscall_name(p->tracer,p->syscall), args[0], args[1], args[2]);
+				if (entering) {
+					debug(D_DEBUG, "fallthrough %s(%" PRId64 ", %" PRId64 ", %" PRId64 ")", tracer_syscall_name(p->tracer,p->syscall), args[0], args[1], args[2]);
+					pass_to_kernel(p);
+				}
 			} else {
 				decode_writev(p,entering,p->syscall,args);
 			}
@@ -1872,7 +1904,10 @@ static void decode_syscall( struct pfs_process *p, int entering )
 
 		case SYSCALL64_lseek:
 			if (p->table->isnative(args[0])) {
-				if (entering) debug(D_DEBUG, "fallthrough %s(%" PRId64 ", %" PRId64 ", %" PRId64 ")", tracer_syscall_name(p->tracer,p->syscall), args[0], args[1], args[2]);
+				if (entering) {
+					debug(D_DEBUG, "fallthrough %s(%" PRId64 ", %" PRId64 ", %" PRId64 ")", tracer_syscall_name(p->tracer,p->syscall), args[0], args[1], args[2]);
+					pass_to_kernel(p);
+				}
 			} else if(entering) {
 				p->syscall_result = pfs_lseek(args[0],args[1],args[2]);
 				if(p->syscall_result<0) p->syscall_result = -errno;
@@ -1882,7 +1917,10 @@ static void decode_syscall( struct pfs_process *p, int entering )
 
 		case SYSCALL64_ftruncate:
 			if (p->table->isnative(args[0])) {
-				if (entering) debug(D_DEBUG, "fallthrough %s(%" PRId64 ", %" PRId64 ", %" PRId64 ")", tracer_syscall_name(p->tracer,p->syscall), args[0], args[1], args[2]);
+				if (entering) {
+					debug(D_DEBUG, "fallthrough %s(%" PRId64 ", %" PRId64 ", %" PRId64 ")", tracer_syscall_name(p->tracer,p->syscall), args[0], args[1], args[2]);
+					pass_to_kernel(p);
+				}
 			} else if(entering) {
 				p->syscall_result = pfs_ftruncate(args[0],args[1]);
 				if(p->syscall_result<0) p->syscall_result = -errno;
@@ -1892,7 +1930,10 @@ static void decode_syscall( struct pfs_process *p, int entering )
 
 		case SYSCALL64_fstat:
 			if (p->table->isnative(args[0])) {
-				if (entering) debug(D_DEBUG, "fallthrough %s(%" PRId64 ", %" PRId64 ", %" PRId64 ")", tracer_syscall_name(p->tracer,p->syscall), args[0], args[1], args[2]);
+				if (entering) {
+					debug(D_DEBUG, "fallthrough %s(%" PRId64 ", %" PRId64 ", %" PRId64 ")", tracer_syscall_name(p->tracer,p->syscall), args[0], args[1], args[2]);
+					pass_to_kernel(p);
+				}
 			} else {
 				decode_stat(p,entering,SYSCALL64_fstat,args);
 			}
@@ -1900,7 +1941,10 @@ static void decode_syscall( struct pfs_process *p, int entering )
 
 		case SYSCALL64_fstatfs:
 			if (p->table->isnative(args[0])) {
-				if (entering) debug(D_DEBUG, "fallthrough %s(%" PRId64 ", %" PRId64 ", %" PRId64 ")", tracer_syscall_name(p->tracer,p->syscall), args[0], args[1], args[2]);
+				if (entering) {
+					debug(D_DEBUG, "fallthrough %s(%" PRId64 ", %" PRId64 ", %" PRId64 ")", tracer_syscall_name(p->tracer,p->syscall), args[0], args[1], args[2]);
+					pass_to_kernel(p);
+				}
 			} else {
 				decode_statfs(p,entering,SYSCALL64_fstatfs,args);
 			}
@@ -1908,7 +1952,10 @@ static void decode_syscall( struct pfs_process *p, int entering )
 
 		case SYSCALL64_flock:
 			if (p->table->isnative(args[0])) {
-				if (entering) debug(D_DEBUG, "fallthrough %s(%" PRId64 ", %" PRId64 ", %" PRId64 ")", tracer_syscall_name(p->tracer,p->syscall), args[0], args[1], args[2]);
+				if (entering) {
+					debug(D_DEBUG, "fallthrough %s(%" PRId64 ", %" PRId64 ", %" PRId64 ")", tracer_syscall_name(p->tracer,p->syscall), args[0], args[1], args[2]);
+					pass_to_kernel(p);
+				}
 			} else if (entering) {
 				p->syscall_result = pfs_flock(args[0],args[1]);
 				if(p->syscall_result<0) p->syscall_result = -errno;
@@ -1919,7 +1966,10 @@ static void decode_syscall( struct pfs_process *p, int entering )
 		case SYSCALL64_fsync:
 		case SYSCALL64_fdatasync:
 			if (p->table->isnative(args[0])) {
-				if (entering) debug(D_DEBUG, "fallthrough %s(%" PRId64 ", %" PRId64 ", %" PRId64 ")", tracer_syscall_name(p->tracer,p->syscall), args[0], args[1], args[2]);
+				if (entering) {
+					debug(D_DEBUG, "fallthrough %s(%" PRId64 ", %" PRId64 ", %" PRId64 ")", tracer_syscall_name(p->tracer,p->syscall), args[0], args[1], args[2]);
+					pass_to_kernel(p);
+				}
 			} else if (entering) {
 				p->syscall_result = pfs_fsync(args[0]);
 				if(p->syscall_result<0) p->syscall_result = -errno;
@@ -1939,7 +1989,10 @@ static void decode_syscall( struct pfs_process *p, int entering )
 
 		case SYSCALL64_fchown:
 			if (p->table->isnative(args[0])) {
-				if (entering) debug(D_DEBUG, "fallthrough %s(%" PRId64 ", %" PRId64 ", %" PRId64 ")", tracer_syscall_name(p->tracer,p->syscall), args[0], args[1], args[2]);
+				if (entering) {
+					debug(D_DEBUG, "fallthrough %s(%" PRId64 ", %" PRId64 ", %" PRId64 ")", tracer_syscall_name(p->tracer,p->syscall), args[0], args[1], args[2]);
+					pass_to_kernel(p);
+				}
 			} else if (entering) {
 				p->syscall_result = pfs_fchown(args[0],p,args[1],args[2]);
 				if(p->syscall_result<0) p->syscall_result = -errno;
@@ -1949,7 +2002,10 @@ static void decode_syscall( struct pfs_process *p, int entering )
 
 		case SYSCALL64_fchmod:
 			if (p->table->isnative(args[0])) {
-				if (entering) debug(D_DEBUG, "fallthrough %s(%" PRId64 ", %" PRId64 ", %" PRId64 ")", tracer_syscall_name(p->tracer,p->syscall), args[0], args[1], args[2]);
+				if (entering) {
+					debug(D_DEBUG, "fallthrough %s(%" PRId64 ", %" PRId64 ", %" PRId64 ")", tracer_syscall_name(p->tracer,p->syscall), args[0], args[1], args[2]);
+					pass_to_kernel(p);
+				}
 			} else if (entering) {
 				p->syscall_result = pfs_fchmod(args[0],args[1]);
 				if(p->syscall_result<0) p->syscall_result = -errno;
@@ -1961,7 +2017,10 @@ static void decode_syscall( struct pfs_process *p, int entering )
 
 		case SYSCALL64_fgetxattr:
 			if (p->table->isnative(args[0])) {
-				if (entering) debug(D_DEBUG, "fallthrough %s(%" PRId64 ", %" PRId64 ", %" PRId64 ")", tracer_syscall_name(p->tracer,p->syscall), args[0], args[1], args[2]);
+				if (entering) {
+					debug(D_DEBUG, "fallthrough %s(%" PRId64 ", %" PRId64 ", %" PRId64 ")", tracer_syscall_name(p->tracer,p->syscall), args[0], args[1], args[2]);
+					pass_to_kernel(p);
+				}
 			} else if (entering) {
 				int fd = args[0]; /* args[0] */
 				char name[4096]; /* args[1] */
@@ -1986,7 +2045,10 @@ static void decode_syscall( struct pfs_process *p, int entering )
 
 		case SYSCALL64_flistxattr:
 			if (p->table->isnative(args[0])) {
-				if (entering) debug(D_DEBUG, "fallthrough %s(%" PRId64 ", %" PRId64 ", %" PRId64 ")", tracer_syscall_name(p->tracer,p->syscall), args[0], args[1], args[2]);
+				if (entering) {
+					debug(D_DEBUG, "fallthrough %s(%" PRId64 ", %" PRId64 ", %" PRId64 ")", tracer_syscall_name(p->tracer,p->syscall), args[0], args[1], args[2]);
+					pass_to_kernel(p);
+				}
 			} else if (entering) {
 				int fd = args[0]; /* args[0] */
 				/* char *list; args[1] */
@@ -2009,7 +2071,10 @@ static void decode_syscall( struct pfs_process *p, int entering )
 
 		case SYSCALL64_fsetxattr:
 			if (p->table->isnative(args[0])) {
-				if (entering) debug(D_DEBUG, "fallthrough %s(%" PRId64 ", %" PRId64 ", %" PRId64 ")", tracer_syscall_name(p->tracer,p->syscall), args[0], args[1], args[2]);
+				if (entering) {
+					debug(D_DEBUG, "fallthrough %s(%" PRId64 ", %" PRId64 ", %" PRId64 ")", tracer_syscall_name(p->tracer,p->syscall), args[0], args[1], args[2]);
+					pass_to_kernel(p);
+				}
 			} else if (entering) {
 				int fd = args[0]; /* args[0] */
 				char name[4096]; /* args[1] */
@@ -2034,7 +2099,10 @@ static void decode_syscall( struct pfs_process *p, int entering )
 
 		case SYSCALL64_fremovexattr:
 			if (p->table->isnative(args[0])) {
-				if (entering) debug(D_DEBUG, "fallthrough %s(%" PRId64 ", %" PRId64 ", %" PRId64 ")", tracer_syscall_name(p->tracer,p->syscall), args[0], args[1], args[2]);
+				if (entering) {
+					debug(D_DEBUG, "fallthrough %s(%" PRId64 ", %" PRId64 ", %" PRId64 ")", tracer_syscall_name(p->tracer,p->syscall), args[0], args[1], args[2]);
+					pass_to_kernel(p);
+				}
 			} else if (entering) {
 				int fd = args[0]; /* args[0] */
 				char name[4096]; /* args[1] */
@@ -3325,7 +3393,7 @@ void pfs_dispatch64( struct pfs_process *p )
 	switch(p->state) {
 		case PFS_PROCESS_STATE_KERNEL:
 		case PFS_PROCESS_STATE_USER:
-			tracer_continue(p->tracer,0);
+			pfs_process_continue(p,0);
 			break;
 		default:
 			assert(0);
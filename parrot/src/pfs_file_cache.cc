@@ -16,6 +16,8 @@ extern "C" {
 #include "file_cache.h"
 #include "full_io.h"
 #include "hash_table.h"
+#include "macros.h"
+#include "xxmalloc.h"
 }
 
 #include <unistd.h>
@@ -32,11 +34,15 @@ extern "C" {
 extern struct file_cache *pfs_file_cache;
 extern int pfs_session_cache;
 extern int pfs_main_timeout;
+extern int pfs_cache_block_size;
 
 static struct hash_table * not_found_table = 0;
 
 #define BUFFER_SIZE 65536
 
+/* The most data fetched by a single remote read. */
+#define FETCH_MAX (16*1024*1024)
+
 static pfs_ssize_t copy_fd_to_file( int fd, pfs_file *file )
 {
 	pfs_ssize_t ractual, wactual, offset = 0;
@@ -170,6 +176,229 @@ public:
 	}
 };
 
+/*
+A block cached file is fetched one block at a time, as the blocks are read,
+instead of all at once on open.  Adjacent missing blocks are fetched with a
+single remote read, which for HTTP is a single range request.  Once every
+block has been fetched, the file becomes an ordinary entry of the cache.
+
+If another process resets the entry for a newer version of the file,
+this one is left with the local file of the version it opened, which is
+no longer in the cache.  It goes on fetching the blocks it lacks into that
+file by itself, without sharing them.
+*/
+
+class pfs_file_block_cached : public pfs_file
+{
+private:
+	int fd;
+	int mapfd;
+	INT64_T generation;
+	int stale;
+	char lpath[PFS_PATH_MAX];
+	pfs_file *rfile;
+	pfs_ssize_t size;
+	pfs_ssize_t block_size;
+	pfs_ssize_t blocks;
+	pfs_ssize_t missing;
+	char *present;
+	time_t ctime;
+	time_t mtime;
+	ino_t inode;
+	pfs_ssize_t fetched_bytes;
+	pfs_ssize_t fetches;
+
+	int fetch_run( pfs_ssize_t first, pfs_ssize_t last ) {
+		pfs_off_t offset = first*block_size;
+		pfs_size_t length = MIN(last*block_size,size)-offset;
+		pfs_size_t total = 0;
+
+		char *buffer = (char*) malloc(length);
+		if(!buffer) return -1;
+
+		debug(D_CACHE,"fetching %s blocks %lld-%lld",name.path,(long long)first,(long long)last-1);
+
+		while(total<length) {
+			pfs_ssize_t actual = rfile->read(buffer+total,length-total,offset+total);
+			if(actual<=0) {
+				if(actual==0) errno = EIO;
+				free(buffer);
+				return -1;
+			}
+			total += actual;
+		}
+
+		if(full_pwrite64(fd,buffer,length,offset)!=(pfs_ssize_t)length) {
+			free(buffer);
+			return -1;
+		}
+
+		if(!stale && file_cache_partial_set(mapfd,generation,first,last-first)<0) {
+			if(errno!=ESTALE) {
+				free(buffer);
+				return -1;
+			}
+			went_stale();
+		}
+
+		/* Keep the entry from being evicted as the least recently used while it is still being read. */
+		if(!stale) file_cache_partial_touch(pfs_file_cache,name.path);
+
+		free(buffer);
+
+		memset(present+first,1,last-first);
+		missing -= last-first;
+		fetched_bytes += length;
+		fetches++;
+
+		if(missing==0) commit();
+
+		return 0;
+	}
+
+	void went_stale() {
+		debug(D_CACHE,"%s was reset by another process, fetching the rest alone",name.path);
+		stale = 1;
+	}
+
+	void commit() {
+		if(stale) return;
+		struct utimbuf ut;
+		ut.actime = mtime;
+		ut.modtime = mtime;
+		::utime(lpath,&ut);
+		if(file_cache_partial_commit(pfs_file_cache,name.path,lpath,fd,mapfd,generation)<0 && errno==ESTALE) went_stale();
+	}
+
+	int fetch( pfs_ssize_t first, pfs_ssize_t last ) {
+		pfs_ssize_t i, run_max = MAX(1,FETCH_MAX/block_size);
+
+		if(missing==0) return 0;
+
+		/* Small reads usually fall within blocks this process has already. */
+		for(i=first;i<last && present[i];i++) {}
+		if(i==last) return 0;
+
+		/* Another process sharing the cache may have fetched some already. */
+		if(!stale) {
+			char *now = (char*) malloc(last-first);
+			if(!now) return -1;
+			if(file_cache_partial_get(mapfd,generation,first,last-first,now)<0) {
+				free(now);
+				if(errno!=ESTALE) return -1;
+				went_stale();
+			} else {
+				for(i=first;i<last;i++) {
+					if(!present[i] && now[i-first]) {
+						present[i] = 1;
+						missing--;
+					}
+				}
+				free(now);
+			}
+		}
+
+		if(missing==0) {
+			commit();
+			return 0;
+		}
+
+		i = first;
+		while(i<last) {
+			if(present[i]) {
+				i++;
+			} else {
+				pfs_ssize_t j = i;
+				while(j<last && !present[j] && j-i<run_max) j++;
+				if(fetch_run(i,j)<0) return -1;
+				i = j;
+			}
+		}
+
+		return 0;
+	}
+
+public:
+	pfs_file_block_cached( pfs_name *n, pfs_file *r, int f, int mf, INT64_T g, const char *l, pfs_ssize_t s, int bs, time_t c, time_t m, ino_t i ) : pfs_file(n) {
+		fd = f;
+		mapfd = mf;
+		generation = g;
+		stale = 0;
+		strcpy(lpath,l);
+		rfile = r;
+		size = s;
+		block_size = bs;
+		blocks = (size+block_size-1)/block_size;
+		present = (char*) xxcalloc(blocks ? blocks : 1,1);
+		missing = blocks;
+		ctime = c;
+		mtime = m;
+		inode = i;
+		fetched_bytes = 0;
+		fetches = 0;
+	}
+
+	virtual ~pfs_file_block_cached() {
+		free(present);
+	}
+
+	virtual int close() {
+		debug(D_CACHE,"%s: fetched %lld bytes in %lld reads",name.path,(long long)fetched_bytes,(long long)fetches);
+		rfile->close();
+		delete rfile;
+		::close(mapfd);
+		::close(fd);
+		return 0;
+	}
+
+	virtual pfs_ssize_t read( void *d, pfs_size_t length, pfs_off_t offset ) {
+		if(offset>=size) return 0;
+		length = MIN(length,(pfs_size_t)(size-offset));
+		if(fetch(offset/block_size,(offset+length+block_size-1)/block_size)<0) return -1;
+		return ::full_pread64(fd,d,length,offset);
+	}
+
+	virtual int fstat( struct pfs_stat *buf ) {
+		int result;
+		struct stat64 lbuf;
+		result = ::fstat64(fd,&lbuf);
+		if(result>=0) {
+			COPY_STAT(lbuf,*buf);
+			buf->st_ctime = ctime;
+			buf->st_ino = inode;
+		}
+		return result;
+	}
+
+	virtual int fstatfs( struct pfs_statfs *buf ) {
+		struct statfs64 lbuf;
+		int result = ::fstatfs64(fd,&lbuf);
+		if(result>=0){
+				COPY_STATFS(lbuf,*buf);
+		}
+		return result;
+	}
+
+	virtual pfs_ssize_t get_size() {
+		return size;
+	}
+
+	/* A local name is only needed to exec or map the whole file. */
+	virtual int get_local_name( char *n ) {
+		if(fetch(0,blocks)<0) return -1;
+		/* The cache now holds another version, and lpath may be its partial file. */
+		if(stale) {
+			errno = ESTALE;
+			return -1;
+		}
+		return file_cache_contains(pfs_file_cache,name.path,n);
+	}
+
+	virtual int is_seekable() {
+		return 1;
+	}
+};
+
 pfs_file * pfs_cache_open( pfs_name *name, int flags, mode_t mode )
 {
 	struct pfs_stat buf;
@@ -214,10 +443,39 @@ pfs_file * pfs_cache_open( pfs_name *name, int flags, mode_t mode )
 		debug(D_DEBUG, "file cache lookup failed: %s", strerror(errno));
 	}
 
+	if(pfs_cache_block_size>0 && !pfs_session_cache && (flags&O_ACCMODE)==O_RDONLY && buf.st_size>0) {
+		int mapfd;
+		INT64_T generation;
+		rfile = name->service->open_ranges(name);
+		if(rfile) {
+			fd = file_cache_partial_open(pfs_file_cache,name->path,txn,&mapfd,&generation,buf.st_size,buf.st_mtime,pfs_cache_block_size);
+			if(fd>=0) {
+				return new pfs_file_block_cached(name,rfile,fd,mapfd,generation,txn,buf.st_size,pfs_cache_block_size,buf.st_ctime,buf.st_mtime,buf.st_ino);
+			}
+			int save_errno = errno;
+			rfile->close();
+			delete rfile;
+			errno = save_errno;
+		}
+		debug(D_CACHE,"couldn't cache %s in blocks: %s",name->path,strerror(errno));
+	}
+
 	debug(D_CACHE,"loading %s",name->path);
 
+	if(file_cache_reserve(pfs_file_cache,buf.st_size)<0) {
+		/* The file cannot fit in the cache, but it can still be read as a stream. */
+		if((flags&O_ACCMODE)==O_RDONLY && !(flags&(O_CREAT|O_TRUNC))) {
+			debug(D_CACHE,"%s is too large to cache, streaming it instead",name->path);
+			return name->service->open(name,flags,mode);
+		}
+		return 0;
+	}
+
 	fd = file_cache_begin(pfs_file_cache,name->path,txn);
-	if(fd<0) return 0;
+	if(fd<0) {
+		file_cache_release(pfs_file_cache,buf.st_size);
+		return 0;
+	}
 
 	if(flags&O_TRUNC) {
 		rfile = 0;
@@ -231,7 +489,10 @@ pfs_file * pfs_cache_open( pfs_name *name, int flags, mode_t mode )
 	}
 
 	if(rfile) {
-		if(copy_file_to_fd(rfile,fd)==0) {
+		int copied = copy_file_to_fd(rfile,fd);
+		/* Once committed, the file is charged to its own entry. */
+		file_cache_release(pfs_file_cache,buf.st_size);
+		if(copied==0) {
 			if(rfile->close()<0) {
 				file_cache_abort(pfs_file_cache,name->path,txn);
 				if(sleep_time<pfs_main_timeout) {
@@ -263,6 +524,7 @@ pfs_file * pfs_cache_open( pfs_name *name, int flags, mode_t mode )
 		delete rfile;
 		errno = save_errno;
 	} else if(ok_to_fail) {
+		file_cache_release(pfs_file_cache,buf.st_size);
 		result = name->service->open(name,flags,mode);
 		if(result) {
 			result->close();
@@ -270,6 +532,7 @@ pfs_file * pfs_cache_open( pfs_name *name, int flags, mode_t mode )
 			if(result) result->ftruncate(0);
 		}
 	} else {
+		file_cache_release(pfs_file_cache,buf.st_size);
 		result = 0;
 	}
 
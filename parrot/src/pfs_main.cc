@@ -11,6 +11,7 @@ See the file COPYING for details.
 #include "pfs_dispatch.h"
 #include "pfs_paranoia.h"
 #include "pfs_process.h"
+#include "pfs_seccomp.h"
 #include "pfs_service.h"
 #include "pfs_table.h"
 #include "pfs_time.h"
@@ -94,6 +95,8 @@ int pfs_force_cache = 0;
 int pfs_force_sync = 0;
 int pfs_follow_symlinks = 1;
 int pfs_session_cache = 0;
+int pfs_cache_block_size = 0;
+INT64_T pfs_cache_size = 0;
 int pfs_use_helper = 0;
 int pfs_checksum_files = 1;
 int pfs_write_rval = 0;
@@ -180,6 +183,9 @@ enum {
 	LONG_OPT_DISABLE_SERVICE,
 	LONG_OPT_NO_FLOCK,
 	LONG_OPT_EXT_IMAGE,
+	LONG_OPT_SECCOMP,
+	LONG_OPT_CACHE_BLOCKS,
+	LONG_OPT_CACHE_SIZE,
 };
 
 static void get_linux_version(const char *cmd)
@@ -277,9 +283,12 @@ static void show_help( const char *cmd )
 	printf( " %-30s Enable valgrind support for Parrot.\n", "   --valgrind");
 	printf( " %-30s Initial working directory.\n", "-w,--work-dir=<dir>");
 	printf( " %-30s Display table of system calls trapped.\n", "-W,--syscall-table");
+	printf( " %-30s Trap only system calls that may need virtualization.\n", "   --seccomp");
 	printf("\n");
 	printf("Performance and consistency options:\n");
 	printf( " %-30s Set the I/O block size hint.              (PARROT_BLOCK_SIZE)\n", "-b,--block-size=<bytes>");
+	printf( " %-30s Cache remote files in blocks of this size.(PARROT_CACHE_BLOCKS)\n", "   --cache-blocks=<bytes>");
+	printf( " %-30s Limit the size of the file cache.         (PARROT_CACHE_SIZE)\n", "   --cache-size=<bytes>");
 	printf( " %-30s Disable small file optimizations.\n", "-D,--no-optimize");
 	printf( " %-30s Enable file snapshot caching for all protocols.\n", "-F,--with-snapshots");
 	printf( " %-30s Disable following symlinks.\n", "-f,--no-follow-symlinks");
@@ -398,6 +407,10 @@ static void handle_event( pid_t pid, int status, struct rusage *usage )
 	if (WIFSTOPPED(status) && WSTOPSIG(status) == (SIGTRAP|0x80)) {
 		/* The common case, a syscall delivery stop. */
 		pfs_dispatch(p);
+	} else if (status>>8 == (SIGTRAP | (PTRACE_EVENT_SECCOMP<<8))) {
+		/* In seccomp mode, a trapped system call stops here instead of at syscall entry. */
+		assert(p->state == PFS_PROCESS_STATE_USER);
+		pfs_dispatch(p);
 	} else if (status>>8 == (SIGTRAP | (PTRACE_EVENT_CLONE<<8)) || status>>8 == (SIGTRAP | (PTRACE_EVENT_FORK<<8)) || status>>8 == (SIGTRAP | (PTRACE_EVENT_VFORK<<8))) {
 		pid_t cpid;
 		struct pfs_process *child;
@@ -416,11 +429,11 @@ static void handle_event( pid_t pid, int status, struct rusage *usage )
 		}
 		child = pfs_process_create(cpid,p,p->syscall_args[0]&CLONE_THREAD,clone_files);
 		child->syscall_result = 0;
-		if (tracer_continue(p->tracer,0) == -1) /* child starts stopped. */
+		if (pfs_process_continue(p,0) == -1) /* child starts stopped. */
 			return;
 	} else if (status>>8 == (SIGTRAP | (PTRACE_EVENT_EXEC<<8))) {
 		pfs_process_exec(p);
-		if (tracer_continue(p->tracer,0) == -1)
+		if (pfs_process_continue(p,0) == -1)
 			return;
 	} else if (status>>8 == (SIGTRAP | (PTRACE_EVENT_EXIT<<8)) || WIFEXITED(status) || WIFSIGNALED(status)) {
 		/* In my own testing, if we use PTRACE_O_TRACEEXIT then we never get
@@ -462,7 +475,7 @@ static void handle_event( pid_t pid, int status, struct rusage *usage )
 			 *     PTRACE_SEIZE was used.
 			 */
 			debug(D_DEBUG, "%d received PTRACE_EVENT_STOP, continuing...", (int)pid);
-			if (tracer_continue(p->tracer, 0) == -1)
+			if (pfs_process_continue(p,0) == -1)
 				return;
 		} else if((linux_available(3,4,0) && ((status>>16) == PTRACE_EVENT_STOP)) || (!linux_available(3,4,0) && SIG_ISSTOP(signum) && ptrace(PTRACE_GETSIGINFO, pid, 0, &info) == -1 && errno == EINVAL)) {
 			/* group-stop, `man ptrace` for more information */
@@ -516,7 +529,7 @@ static void handle_event( pid_t pid, int status, struct rusage *usage )
 					break;
 				}
 			}
-			if (tracer_continue(p->tracer,signum) == -1) /* deliver (or not) the signal */
+			if (pfs_process_continue(p,signum) == -1) /* deliver (or not) the signal */
 				return;
 		}
 	} else {
@@ -726,6 +739,12 @@ int main( int argc, char *argv[] )
 	s = getenv("PARROT_SESSION_CACHE");
 	if(s) pfs_session_cache = 1;
 
+	s = getenv("PARROT_CACHE_BLOCKS");
+	if(s) pfs_cache_block_size = string_metric_parse(s);
+
+	s = getenv("PARROT_CACHE_SIZE");
+	if(s) pfs_cache_size = string_metric_parse(s);
+
 	s = getenv("PARROT_HOST_NAME");
 	if(s) pfs_false_uname = xxstrdup(pfs_false_uname);
 
@@ -815,6 +834,8 @@ int main( int argc, char *argv[] )
 	static const struct option long_options[] = {
 		{"auto-decompress", no_argument, 0, 'Z'},
 		{"block-size", required_argument, 0, 'b'},
+		{"cache-blocks", required_argument, 0, LONG_OPT_CACHE_BLOCKS},
+		{"cache-size", required_argument, 0, LONG_OPT_CACHE_SIZE},
 		{"channel-auth", no_argument, 0, 'C'},
 		{"check-driver", required_argument, 0, LONG_OPT_CHECK_DRIVER },
 		{"chirp-auth",  required_argument, 0, 'a'},
@@ -854,6 +875,7 @@ int main( int argc, char *argv[] )
 		{"pid-warp", no_argument, 0, LONG_OPT_PID_WARP},
 		{"proxy", required_argument, 0, 'p'},
 		{"root-checksum", required_argument, 0, 'R'},
+		{"seccomp", no_argument, 0, LONG_OPT_SECCOMP},
 		{"session-caching", no_argument, 0, 'S'},
 		{"stats-file", required_argument, 0, LONG_OPT_STATS_FILE},
 		{"status-file", required_argument, 0, 'c'},
@@ -1071,6 +1093,15 @@ int main( int argc, char *argv[] )
 		case LONG_OPT_VALGRIND:
 			valgrind = 1;
 			break;
+		case LONG_OPT_SECCOMP:
+			pfs_seccomp = 1;
+			break;
+		case LONG_OPT_CACHE_BLOCKS:
+			pfs_cache_block_size = string_metric_parse(optarg);
+			break;
+		case LONG_OPT_CACHE_SIZE:
+			pfs_cache_size = string_metric_parse(optarg);
+			break;
 		case LONG_OPT_CHECK_DRIVER:
 			if(pfs_service_lookup(optarg)) {
 				printf("%s is enabled\n",optarg);
@@ -1200,6 +1231,11 @@ int main( int argc, char *argv[] )
 
 	get_linux_version(argv[0]);
 
+	if (pfs_seccomp && (valgrind || !pfs_seccomp_available())) {
+		debug(D_NOTICE, "seccomp mode needs Linux 4.8 or later on x86_64, and cannot be used with valgrind; tracing every system call instead");
+		pfs_seccomp = 0;
+	}
+
 	if (envlist[0]) {
 		extern char **environ;
 		if(access(envlist, F_OK) == 0)
@@ -1232,6 +1268,7 @@ int main( int argc, char *argv[] )
 
 	pfs_file_cache = file_cache_init(pfs_temp_dir);
 	if(!pfs_file_cache) fatal("couldn't setup cache in %s: %s\n",pfs_temp_dir,strerror(errno));
+	file_cache_set_limit(pfs_file_cache,pfs_cache_size);
 	file_cache_cleanup(pfs_file_cache);
 
 	string_nformat(pfs_cvmfs_locks_dir, sizeof(pfs_cvmfs_locks_dir), "%s/cvmfs_locks_XXXXXX", pfs_temp_per_instance_dir);
@@ -1338,6 +1375,10 @@ int main( int argc, char *argv[] )
 			signal(SIGUSR1, set_attached_and_ready);
 			raise(SIGSTOP); /* synchronize with parent, above */
 			while (!attached_and_ready) ; /* spin waiting to be traced (NO SLEEPING/STOPPING) */
+			if (pfs_seccomp && pfs_seccomp_install() == -1) {
+				fprintf(stderr, "unable to install seccomp filter: %s\n", strerror(errno));
+				_exit(1);
+			}
 			execvp(argv[optind],&argv[optind]);
 		}
 		fprintf(stderr, "unable to execute %s: %s\n", argv[optind], strerror(errno));
@@ -1358,7 +1399,7 @@ int main( int argc, char *argv[] )
 
 	root_pid = pid;
 	debug(D_PROCESS,"attaching to pid %d",pid);
-	if (tracer_attach(pid) == -1) {
+	if (tracer_attach(pid, pfs_seccomp) == -1) {
 		if (errno == EPERM) {
 			fprintf(stderr,
 				"The `ptrace` system call appears to be disabled.\n"
@@ -8,6 +8,7 @@ See the file COPYING for details.
 #include "pfs_channel.h"
 #include "pfs_paranoia.h"
 #include "pfs_process.h"
+#include "pfs_seccomp.h"
 
 extern "C" {
 #include "debug.h"
@@ -318,6 +319,17 @@ void pfs_process_exec( struct pfs_process *p )
 	p->table->close_on_exec();
 }
 
+/* In seccomp mode, a process outside of a traced system call runs until the next trap. */
+
+int pfs_process_continue( struct pfs_process *p, int signum )
+{
+	if(pfs_seccomp && p->state == PFS_PROCESS_STATE_USER) {
+		return tracer_resume(p->tracer, signum);
+	} else {
+		return tracer_continue(p->tracer, signum);
+	}
+}
+
 static void pfs_process_delete( struct pfs_process *p )
 {
 	if(p->table) {
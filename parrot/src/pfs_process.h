@@ -82,6 +82,7 @@ struct pfs_process {
 struct pfs_process * pfs_process_create( pid_t pid, struct pfs_process *parent, int thread, int share_table );
 void pfs_process_exec( struct pfs_process *p );
 void pfs_process_stop( struct pfs_process *p, int status, struct rusage *usage );
+int pfs_process_continue( struct pfs_process *p, int signum );
 
 extern "C" int pfs_process_getpid();
 int  pfs_process_count();
@@ -0,0 +1,235 @@
+/*
+Copyright (C) 2026 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#include "pfs_seccomp.h"
+#include "pfs_time.h"
+
+extern "C" {
+#include "debug.h"
+#include "linux-version.h"
+#include "tracer.h"
+}
+
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#ifndef SECCOMP_SET_MODE_FILTER
+#	define SECCOMP_SET_MODE_FILTER 1
+#endif
+#ifndef __X32_SYSCALL_BIT
+#	define __X32_SYSCALL_BIT 0x40000000
+#endif
+
+int pfs_seccomp = 0;
+
+/*
+ * These are exactly the calls that decode_syscall in pfs_dispatch64.cc
+ * hands to the kernel untouched, without looking at the arguments or the
+ * result, so running them natively changes nothing but the cost.  Keep the
+ * two lists in step.
+ */
+
+static const unsigned native_syscalls[] = {
+	SYSCALL64__sysctl,
+	SYSCALL64_adjtimex,
+	SYSCALL64_afs_syscall,
+	SYSCALL64_alarm,
+	SYSCALL64_arch_prctl,
+	SYSCALL64_brk,
+	SYSCALL64_capget,
+	SYSCALL64_capset,
+	SYSCALL64_clock_getres,
+	SYSCALL64_clock_nanosleep,
+	SYSCALL64_clock_settime,
+	SYSCALL64_create_module,
+	SYSCALL64_delete_module,
+	SYSCALL64_exit,
+	SYSCALL64_exit_group,
+	SYSCALL64_futex,
+	SYSCALL64_get_kernel_syms,
+	SYSCALL64_get_robust_list,
+	SYSCALL64_get_thread_area,
+	SYSCALL64_getcpu,
+	SYSCALL64_getitimer,
+	SYSCALL64_getpgid,
+	SYSCALL64_getpgrp,
+	SYSCALL64_getppid,
+	SYSCALL64_getpriority,
+	SYSCALL64_getrandom,
+	SYSCALL64_getrlimit,
+	SYSCALL64_getrusage,
+	SYSCALL64_getsid,
+	SYSCALL64_gettid,
+	SYSCALL64_init_module,
+	SYSCALL64_ioperm,
+	SYSCALL64_iopl,
+	SYSCALL64_kcmp,
+	SYSCALL64_madvise,
+	SYSCALL64_membarrier,
+	SYSCALL64_migrate_pages,
+	SYSCALL64_mincore,
+	SYSCALL64_mlock,
+	SYSCALL64_mlockall,
+	SYSCALL64_modify_ldt,
+	SYSCALL64_move_pages,
+	SYSCALL64_mprotect,
+	SYSCALL64_mremap,
+	SYSCALL64_msync,
+	SYSCALL64_munlock,
+	SYSCALL64_munlockall,
+	SYSCALL64_nanosleep,
+	SYSCALL64_pause,
+	SYSCALL64_prctl,
+	SYSCALL64_prlimit64,
+	SYSCALL64_process_vm_readv,
+	SYSCALL64_process_vm_writev,
+	SYSCALL64_query_module,
+	SYSCALL64_quotactl,
+	SYSCALL64_reboot,
+	SYSCALL64_restart_syscall,
+	SYSCALL64_rt_sigaction,
+	SYSCALL64_rt_sigpending,
+	SYSCALL64_rt_sigprocmask,
+	SYSCALL64_rt_sigqueueinfo,
+	SYSCALL64_rt_sigreturn,
+	SYSCALL64_rt_sigsuspend,
+	SYSCALL64_rt_sigtimedwait,
+	SYSCALL64_sched_get_priority_max,
+	SYSCALL64_sched_get_priority_min,
+	SYSCALL64_sched_getaffinity,
+	SYSCALL64_sched_getattr,
+	SYSCALL64_sched_getparam,
+	SYSCALL64_sched_getscheduler,
+	SYSCALL64_sched_rr_get_interval,
+	SYSCALL64_sched_setaffinity,
+	SYSCALL64_sched_setattr,
+	SYSCALL64_sched_setparam,
+	SYSCALL64_sched_setscheduler,
+	SYSCALL64_sched_yield,
+	SYSCALL64_set_robust_list,
+	SYSCALL64_set_thread_area,
+	SYSCALL64_set_tid_address,
+	SYSCALL64_setdomainname,
+	SYSCALL64_sethostname,
+	SYSCALL64_setitimer,
+	SYSCALL64_setpgid,
+	SYSCALL64_setpriority,
+	SYSCALL64_setrlimit,
+	SYSCALL64_setsid,
+	SYSCALL64_settimeofday,
+	SYSCALL64_shmat,
+	SYSCALL64_shmctl,
+	SYSCALL64_shmdt,
+	SYSCALL64_shmget,
+	SYSCALL64_sigaltstack,
+	SYSCALL64_swapoff,
+	SYSCALL64_swapon,
+	SYSCALL64_sync,
+	SYSCALL64_sysinfo,
+	SYSCALL64_syslog,
+	SYSCALL64_timer_create,
+	SYSCALL64_timer_delete,
+	SYSCALL64_timer_getoverrun,
+	SYSCALL64_timer_gettime,
+	SYSCALL64_timer_settime,
+	SYSCALL64_times,
+	SYSCALL64_ustat,
+	SYSCALL64_vhangup,
+	SYSCALL64_wait4,
+	SYSCALL64_waitid,
+};
+
+/* Parrot only answers these itself when virtual time is stopped or warped. */
+
+static const unsigned time_syscalls[] = {
+	SYSCALL64_clock_gettime,
+	SYSCALL64_gettimeofday,
+	SYSCALL64_time,
+};
+
+#define COUNT(a) (sizeof(a)/sizeof(a[0]))
+
+/* Room for the fixed part of the program, plus two instructions per native call. */
+#define FILTER_MAX (16 + 2*(COUNT(native_syscalls) + COUNT(time_syscalls)))
+
+int pfs_seccomp_available(void)
+{
+#ifdef CCTOOLS_CPU_X86_64
+	/* Before 4.8, the seccomp stop came before the syscall-entry stop and a
+	 * changed system call was not checked again, which Parrot cannot use. */
+	return linux_available(4,8,0);
+#else
+	return 0;
+#endif
+}
+
+int pfs_seccomp_install(void)
+{
+	if (!pfs_seccomp_available())
+		return errno = ENOSYS, -1;
+
+	struct sock_filter filter[FILTER_MAX];
+	unsigned n = 0;
+	unsigned i;
+
+#define STATEMENT(code, k) (filter[n++] = (struct sock_filter) BPF_STMT(code, k))
+#define JUMP(code, k, jt, jf) (filter[n++] = (struct sock_filter) BPF_JUMP(code, k, jt, jf))
+#define ALLOW_IF(nr) (JUMP(BPF_JMP|BPF_JEQ|BPF_K, nr, 0, 1), STATEMENT(BPF_RET|BPF_K, SECCOMP_RET_ALLOW))
+
+	/* 32-bit and x32 programs are always traced. */
+	STATEMENT(BPF_LD|BPF_W|BPF_ABS, offsetof(struct seccomp_data, arch));
+	JUMP(BPF_JMP|BPF_JEQ|BPF_K, AUDIT_ARCH_X86_64, 1, 0);
+	STATEMENT(BPF_RET|BPF_K, SECCOMP_RET_TRACE);
+	STATEMENT(BPF_LD|BPF_W|BPF_ABS, offsetof(struct seccomp_data, nr));
+	JUMP(BPF_JMP|BPF_JGE|BPF_K, __X32_SYSCALL_BIT, 0, 1);
+	STATEMENT(BPF_RET|BPF_K, SECCOMP_RET_TRACE);
+
+	for (i = 0; i < COUNT(native_syscalls); i++)
+		ALLOW_IF(native_syscalls[i]);
+
+	if (pfs_time_mode == PFS_TIME_MODE_NORMAL) {
+		for (i = 0; i < COUNT(time_syscalls); i++)
+			ALLOW_IF(time_syscalls[i]);
+	}
+
+	/* Anonymous memory needs no help, but mapping a Parrot file does. The
+	 * flags are an int, so the low word of the argument is enough. */
+	JUMP(BPF_JMP|BPF_JEQ|BPF_K, SYSCALL64_mmap, 0, 3);
+	STATEMENT(BPF_LD|BPF_W|BPF_ABS, offsetof(struct seccomp_data, args[3]));
+	JUMP(BPF_JMP|BPF_JSET|BPF_K, MAP_ANONYMOUS, 0, 1);
+	STATEMENT(BPF_RET|BPF_K, SECCOMP_RET_ALLOW);
+
+	STATEMENT(BPF_RET|BPF_K, SECCOMP_RET_TRACE);
+
+#undef ALLOW_IF
+#undef JUMP
+#undef STATEMENT
+
+	struct sock_fprog program;
+	program.len = n;
+	program.filter = filter;
+
+	/* Required to install a filter without CAP_SYS_ADMIN. */
+	if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == -1)
+		return -1;
+
+	if (syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER, 0, &program) == -1)
+		return -1;
+
+	return 0;
+}
+
+/* vim: set noexpandtab tabstop=4: */
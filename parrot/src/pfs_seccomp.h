@@ -0,0 +1,34 @@
+/*
+Copyright (C) 2026 The University of Notre Dame
+This software is distributed under the GNU General Public License.
+See the file COPYING for details.
+*/
+
+#ifndef PFS_SECCOMP_H
+#define PFS_SECCOMP_H
+
+/*
+ * In seccomp mode, each traced process carries a seccomp-bpf filter that
+ * returns SECCOMP_RET_TRACE only for the system calls Parrot may need to
+ * virtualize.  Everything else runs natively, without stopping the tracer.
+ * A trapped system call arrives as PTRACE_EVENT_SECCOMP in place of the
+ * syscall-entry stop, and the process is resumed with PTRACE_SYSCALL only
+ * if Parrot needs to see the exit as well.
+ */
+
+extern int pfs_seccomp;
+
+/*
+ * Returns true if the running kernel and CPU support seccomp mode.
+ */
+int pfs_seccomp_available(void);
+
+/*
+ * Install the filter in the calling process.  Call this in the tracee just
+ * before exec, after the tracer has attached with PTRACE_O_TRACESECCOMP:
+ * without a tracer, every trapped system call fails with ENOSYS.
+ * Returns 0 on success, -1 on failure with errno set.
+ */
+int pfs_seccomp_install(void);
+
+#endif
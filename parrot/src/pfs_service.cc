@@ -51,6 +51,22 @@ int pfs_service::is_local()
 	return 0;
 }
 
+/*
+Open a file to be read at any offset, so that the cache can fetch
+only the blocks that are needed.  Services that can only stream
+a file from the beginning fail with ENOTSUP.
+*/
+
+pfs_file * pfs_service::open_ranges( pfs_name *name )
+{
+	if(is_seekable()) {
+		return open(name,O_RDONLY,0);
+	} else {
+		errno = ENOTSUP;
+		return 0;
+	}
+}
+
 pfs_file * pfs_service::open( pfs_name *name, int flags, mode_t mode )
 {
 	errno = ENOENT;
@@ -27,6 +27,7 @@ public:
 	virtual int is_local();
 
 	virtual pfs_file * open( pfs_name *name, int flags, mode_t mode );
+	virtual pfs_file * open_ranges( pfs_name *name );
 	virtual pfs_dir * getdir( pfs_name *name );
 
 	virtual int stat( pfs_name *name, struct pfs_stat *buf );
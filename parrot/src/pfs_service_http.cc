@@ -15,6 +15,7 @@ extern "C" {
 #include "file_cache.h"
 #include "full_io.h"
 #include "http_query.h"
+#include "macros.h"
 }
 
 #include <unistd.h>
@@ -32,7 +33,7 @@ extern "C" {
 
 extern int pfs_main_timeout;
 
-static struct link * http_fetch( pfs_name *name, const char *action, INT64_T *size )
+static struct link * http_fetch( pfs_name *name, const char *action, INT64_T *size, time_t *mtime = 0 )
 {
 	char url[HTTP_LINE_MAX];
 
@@ -42,7 +43,20 @@ static struct link * http_fetch( pfs_name *name, const char *action, INT64_T *si
 	}
 
 	sprintf(url,"http://%s:%d%s",name->host,name->port,name->rest);
-	return http_query_size(url,action,size,time(0)+pfs_main_timeout,0);
+	return http_query_size_mtime(url,action,size,mtime,time(0)+pfs_main_timeout,0);
+}
+
+static struct link * http_fetch_range( pfs_name *name, INT64_T offset, INT64_T length, INT64_T *size )
+{
+	char url[HTTP_LINE_MAX];
+
+	if(!name->host[0]) {
+		errno = ENOENT;
+		return 0;
+	}
+
+	sprintf(url,"http://%s:%d%s",name->host,name->port,name->rest);
+	return http_query_range(url,"GET",offset,length,size,time(0)+pfs_main_timeout);
 }
 
 class pfs_file_http : public pfs_file
@@ -50,11 +64,15 @@ class pfs_file_http : public pfs_file
 private:
 	struct link *link;
 	INT64_T size;
+	INT64_T position;
+	INT64_T limit;
 
 public:
 	pfs_file_http( pfs_name *n, struct link *l, INT64_T s ) : pfs_file(n) {
 		link = l;
 		size = s;
+		position = 0;
+		limit = -1;
 	}
 
 	virtual int close() {
@@ -63,7 +81,30 @@ public:
 	}
 
 	virtual pfs_ssize_t read( void *d, pfs_size_t length, pfs_off_t offset ) {
-		return link_read(link,(char*)d,length,LINK_FOREVER);
+		pfs_ssize_t result;
+
+		/* A read anywhere but the end of the last one starts a range request. */
+		if(!link || offset!=position || (limit>=0 && position>=limit)) {
+			INT64_T actual;
+			struct link *l;
+
+			if(size>0 && offset>=size) return 0;
+			if(size>0) length = MIN(length,size-offset);
+
+			l = http_fetch_range(&name,offset,length,&actual);
+			if(!l) return -1;
+
+			link_close(link);
+			link = l;
+			position = offset;
+			limit = actual>0 ? offset+actual : -1;
+		}
+
+		if(limit>=0) length = MIN(length,limit-position);
+
+		result = link_read(link,(char*)d,length,LINK_FOREVER);
+		if(result>0) position += result;
+		return result;
 	}
 
 	virtual int fstat( struct pfs_stat *buf ) {
@@ -102,16 +143,24 @@ public:
 		}
 	}
 
+	/* Nothing is fetched until the first read, which asks for a range. */
+	virtual pfs_file * open_ranges( pfs_name *name ) {
+		return new pfs_file_http(name,0,0);
+	}
+
 	virtual int stat( pfs_name *name, struct pfs_stat *buf ) {
 		struct link *link;
 		INT64_T size;
+		time_t mtime;
 
-		link = http_fetch(name,"HEAD",&size);
+		link = http_fetch(name,"HEAD",&size,&mtime);
 		if(link) {
 			link_close(link);
 			pfs_service_emulate_stat(name,buf);
 			buf->st_mode = HTTP_FILE_MODE;
 			buf->st_size = size;
+			/* Without Last-Modified, the time is that emulated for every file. */
+			if(mtime>0) buf->st_mtime = mtime;
 			return 0;
 		} else {
 			return -1;
@@ -125,6 +174,7 @@ public:
 	virtual int is_seekable (void) {
 		return 0;
 	}
+
 };
 
 static pfs_service_http pfs_service_http_instance;
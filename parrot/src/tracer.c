@@ -88,10 +88,13 @@ struct tracer {
 	int has_args5_bug;
 };
 
-int tracer_attach (pid_t pid)
+int tracer_attach (pid_t pid, int seccomp)
 {
 	intptr_t options = PTRACE_O_TRACESYSGOOD|PTRACE_O_TRACEEXEC|PTRACE_O_TRACEEXIT|PTRACE_O_TRACECLONE|PTRACE_O_TRACEFORK|PTRACE_O_TRACEVFORK;
 
+	if (seccomp)
+		options |= PTRACE_O_TRACESECCOMP;
+
 	if (linux_available(3,8,0))
 		options |= PTRACE_O_EXITKILL;
 	assert(linux_available(2,5,60));
@@ -205,6 +208,24 @@ int tracer_continue( struct tracer *t, int signum )
 	return 0;
 }
 
+/*
+Like tracer_continue, but the process does not stop at the next system call,
+only at a seccomp trap or another event.
+*/
+
+int tracer_resume( struct tracer *t, int signum )
+{
+	t->gotregs = 0;
+	if(t->setregs) {
+		if(ptrace(PTRACE_SETREGS,t->pid,0,&t->regs) == -1)
+			return -1;
+		t->setregs = 0;
+	}
+	if (ptrace(PTRACE_CONT,t->pid,0,signum) == -1)
+		ERROR;
+	return 0;
+}
+
 int tracer_args_get( struct tracer *t, INT64_T *syscall, INT64_T args[TRACER_ARGS_MAX] )
 {
 	if(!t->gotregs) {
@@ -15,10 +15,11 @@ See the file COPYING for details.
 
 struct tracer;
 
-int tracer_attach( pid_t pid );
+int tracer_attach( pid_t pid, int seccomp );
 void tracer_detach( struct tracer *t );
 struct tracer *tracer_init( pid_t pid );
 int tracer_continue( struct tracer *t, int signum );
+int tracer_resume( struct tracer *t, int signum );
 int tracer_listen( struct tracer *t );
 int tracer_getevent( struct tracer *t, unsigned long *message );
 
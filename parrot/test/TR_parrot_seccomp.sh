@@ -0,0 +1,113 @@
+#!/bin/sh
+
+. ../../dttools/test/test_runner_common.sh
+. ./parrot-test.sh
+
+exe="seccomp.test"
+data="seccomp.data"
+
+check_needed()
+{
+	# The program is linked statically, so that it runs the same in both modes without the loader.
+	echo 'int main() { return 0; }' | gcc -static -o "$exe" -x c - > /dev/null 2>&1 || return 1
+	rm -f "$exe"
+	return 0
+}
+
+prepare()
+{
+	gcc -static -g $CCTOOLS_TEST_CCFLAGS -o "$exe" -x c - <<EOF
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static volatile sig_atomic_t caught = 0;
+
+static void handler(int sig)
+{
+	caught = sig;
+}
+
+int main(int argc, char *argv[])
+{
+	char buf[16];
+	int fd, i, status;
+	pid_t pid;
+
+	if (argc > 1) {
+		printf("exec %s\\n", argv[1]);
+		return 0;
+	}
+
+	/* Calls that run natively in seccomp mode, between the virtualized ones. */
+	for (i = 0; i < 1000; i++)
+		getppid();
+
+	fd = open("$data", O_RDONLY);
+	if (fd < 0)
+		return 1;
+	for (i = 0; i < 4; i++) {
+		memset(buf, 0, sizeof(buf));
+		pread(fd, buf, 4, i * 8);
+		printf("pread %d %s\\n", i * 8, buf);
+	}
+
+	char *map = mmap(0, 32, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+		return 1;
+	printf("mmap %.8s\\n", map + 16);
+	munmap(map, 32);
+	close(fd);
+
+	fflush(stdout);
+	pid = fork();
+	if (pid == 0) {
+		printf("child\\n");
+		fflush(stdout);
+		_exit(3);
+	}
+	waitpid(pid, &status, 0);
+	printf("wait %d\\n", WEXITSTATUS(status));
+
+	signal(SIGUSR1, handler);
+	kill(getpid(), SIGUSR1);
+	printf("signal %d\\n", caught == SIGUSR1);
+
+	fflush(stdout);
+	pid = fork();
+	if (pid == 0) {
+		execl("./$exe", "$exe", "child", (char *)0);
+		_exit(1);
+	}
+	waitpid(pid, &status, 0);
+	printf("wait %d\\n", WEXITSTATUS(status));
+
+	return 0;
+}
+EOF
+	[ $? -eq 0 ] || return 1
+	printf 'aaaaaaa bbbbbbb ccccccc ddddddd ' > "$data"
+}
+
+run()
+{
+	parrot -- ./"$exe" > ptrace.out || return 1
+	parrot --seccomp -- ./"$exe" > seccomp.out || return 1
+	cat ptrace.out
+	diff ptrace.out seccomp.out
+}
+
+clean()
+{
+	rm -f "$exe" "$data" ptrace.out seccomp.out
+	return 0
+}
+
+dispatch "$@"
+
+# vim: set noexpandtab tabstop=4:
@@ -10,6 +10,7 @@ See the file COPYING for details.
 #include "debug.h"
 #include "domain_name.h"
 #include "jx.h"
+#include "jx_parse.h"
 #include "list.h"
 #include "stringtools.h"
 #include "xxmalloc.h"
@@ -33,13 +34,17 @@ struct list *vine_catalog_query(const char *catalog_host, int catalog_port, cons
 	time_t stoptime = time(0) + 60;
 	struct catalog_query *q;
 
+	// Let the server discard records of other types.
+	struct jx *jexpr = jx_parse_string("type==\"vine_manager\"");
+
 	if (catalog_port > 0) {
 		sprintf(hostport, "%s:%d", catalog_host, catalog_port);
-		q = catalog_query_create(hostport, 0, stoptime);
+		q = catalog_query_create(hostport, jexpr, stoptime);
 	} else {
-		q = catalog_query_create(catalog_host, 0, stoptime);
+		q = catalog_query_create(catalog_host, jexpr, stoptime);
 	}
 	if (!q) {
+		jx_delete(jexpr);
 		debug(D_NOTICE, "unable to contact catalog server at %s:%d\n", catalog_host, catalog_port);
 		return 0;
 	}
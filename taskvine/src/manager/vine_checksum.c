@@ -6,6 +6,7 @@ See the file COPYING for details.
 
 #include "vine_checksum.h"
 
+#include "checksum.h"
 #include "debug.h"
 #include "md5.h"
 #include "sort_dir.h"
@@ -14,6 +15,7 @@ See the file COPYING for details.
 #include "xxmalloc.h"
 
 #include <dirent.h>
+#include <errno.h>
 #include <string.h>
 #include <sys/stat.h>
 
@@ -34,11 +36,42 @@ XXX For consistency, this should sort the directory entries before hashing.
 static char *vine_checksum_dir(const char *path, ssize_t *totalsize)
 {
 	char *dirstring = xxstrdup("");
+	char *result = 0;
 	char **entries;
 	struct stat info;
-	if (!sort_dir(path, &entries, strcmp))
+	if (!sort_dir(path, &entries, strcmp)) {
+		free(dirstring);
 		return 0;
+	}
 	int i;
+
+	/* Checksum all the regular files of the directory at once, in parallel. */
+	int nentries = 0;
+	while (entries[nentries])
+		nentries++;
+
+	const char **files = xxmalloc(sizeof(*files) * (nentries + 1));
+	int *file_index = xxmalloc(sizeof(*file_index) * (nentries + 1));
+	int nfiles = 0;
+	for (i = 0; entries[i]; i++) {
+		file_index[i] = -1;
+		if (!strcmp(entries[i], ".") || !strcmp(entries[i], ".."))
+			continue;
+
+		char *subpath = string_format("%s/%s", path, entries[i]);
+		if (!lstat(subpath, &info) && S_ISREG(info.st_mode)) {
+			file_index[i] = nfiles;
+			files[nfiles++] = subpath;
+			*totalsize += info.st_size;
+		} else {
+			free(subpath);
+		}
+	}
+
+	unsigned char *digests = xxmalloc(MD5_DIGEST_LENGTH * (nfiles + 1));
+	int *status = xxmalloc(sizeof(*status) * (nfiles + 1));
+	checksum_files_parallel(CHECKSUM_MD5, files, nfiles, digests, status, 0);
+
 	for (i = 0; entries[i]; i++) {
 
 		if (!strcmp(entries[i], "."))
@@ -47,10 +80,22 @@ static char *vine_checksum_dir(const char *path, ssize_t *totalsize)
 			continue;
 
 		char *subpath = string_format("%s/%s", path, entries[i]);
-		if (stat(subpath, &info))
-			return 0;
-
-		char *subhash = vine_checksum_any(subpath, totalsize);
+		if (stat(subpath, &info)) {
+			free(subpath);
+			goto done;
+		}
+
+		char *subhash;
+		if (file_index[i] >= 0) {
+			if (!status[file_index[i]]) {
+				debug(D_NOTICE, "couldn't checksum %s", subpath);
+				free(subpath);
+				goto done;
+			}
+			subhash = xxstrdup(md5_to_string(digests + MD5_DIGEST_LENGTH * file_index[i]));
+		} else {
+			subhash = vine_checksum_any(subpath, totalsize);
+		}
 		char *line = string_format("%s:%o:%s:%s:\n", entries[i], info.st_mode, ctime(&info.st_mtime), subhash);
 
 		dirstring = string_combine(dirstring, line);
@@ -60,9 +105,17 @@ static char *vine_checksum_dir(const char *path, ssize_t *totalsize)
 		free(line);
 	}
 
-	sort_dir_free(entries);
-	char *result = md5_of_string(dirstring);
+	result = md5_of_string(dirstring);
 
+done:
+	for (i = 0; i < nfiles; i++)
+		free((char *)files[i]);
+	free(files);
+	free(file_index);
+	free(digests);
+	free(status);
+
+	sort_dir_free(entries);
 	free(dirstring);
 
 	return result;
@@ -71,7 +124,10 @@ static char *vine_checksum_dir(const char *path, ssize_t *totalsize)
 static char *vine_checksum_file(const char *path)
 {
 	unsigned char digest[MD5_DIGEST_LENGTH];
-	md5_file(path, digest);
+	if (!checksum_file(CHECKSUM_MD5, path, digest)) {
+		debug(D_NOTICE, "couldn't checksum %s: %s", path, strerror(errno));
+		return 0;
+	}
 	return xxstrdup(md5_to_string(digest));
 }
 
@@ -175,9 +175,10 @@ void vine_manager_factory_update_all(struct vine_manager *q, time_t stoptime)
 	jexpr = jx_parse_string(buffer_tolstring(&filter, NULL));
 	buffer_free(&filter);
 
-	// Query the catalog server
+	// Query the catalog server, only for the fields needed by vine_manager_factory_update.
+	const char *fields[] = {"factory_name", "max_workers", 0};
 	debug(D_VINE, "Retrieving factory info from catalog server(s) at %s ...", q->catalog_hosts);
-	if ((cq = catalog_query_create(q->catalog_hosts, jexpr, stoptime))) {
+	if ((cq = catalog_query_create_fields(q->catalog_hosts, jexpr, fields, 0, stoptime))) {
 		// Update the table
 		while ((j = catalog_query_read(cq, stoptime))) {
 			vine_manager_factory_update(q, j);
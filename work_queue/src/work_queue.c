@@ -1056,9 +1056,10 @@ void update_read_catalog_factory(struct work_queue *q, time_t stoptime) {
 	jexpr = jx_parse_string(buffer_tolstring(&filter, NULL));
 	buffer_free(&filter);
 
-	// Query the catalog server
+	// Query the catalog server, only for the fields needed by update_factory.
+	const char *fields[] = {"factory_name", "max_workers", 0};
 	debug(D_WQ, "Retrieving factory info from catalog server(s) at %s ...", q->catalog_hosts);
-	if ( (cq = catalog_query_create(q->catalog_hosts, jexpr, stoptime)) ) {
+	if ( (cq = catalog_query_create_fields(q->catalog_hosts, jexpr, fields, 0, stoptime)) ) {
 		// Update the table
 		while((j = catalog_query_read(cq, stoptime))) {
 			update_factory(q, j);
@@ -6944,6 +6945,47 @@ static int connect_new_workers(struct work_queue *q, int stoptime, int max_new_w
 }
 
 
+/* Find a task already retrieved from its worker, and mark it done. */
+static struct work_queue_task *find_task_to_return(struct work_queue *q, const char *tag)
+{
+	struct work_queue_task *t;
+
+	if(tag) {
+		t = task_state_any_with_tag(q, WORK_QUEUE_TASK_RETRIEVED, tag);
+	} else {
+		t = task_state_any(q, WORK_QUEUE_TASK_RETRIEVED);
+	}
+
+	if(t) {
+		change_task_state(q, t, WORK_QUEUE_TASK_DONE);
+
+		if( t->result != WORK_QUEUE_RESULT_SUCCESS )
+		{
+			q->stats->tasks_failed++;
+		}
+	}
+
+	return t;
+}
+
+struct work_queue_task *work_queue_no_wait(struct work_queue *q)
+{
+	// account for time we spend outside work_queue_wait
+	if(q->time_last_wait > 0) {
+		q->stats->time_application += timestamp_get() - q->time_last_wait;
+	} else {
+		q->stats->time_application += timestamp_get() - q->stats->time_when_started;
+	}
+
+	BEGIN_ACCUM_TIME(q, time_internal);
+	struct work_queue_task *t = find_task_to_return(q, NULL);
+	END_ACCUM_TIME(q, time_internal);
+
+	q->time_last_wait = timestamp_get();
+
+	return t;
+}
+
 struct work_queue_task *work_queue_wait_internal(struct work_queue *q, int timeout, struct link *foreman_uplink, int *foreman_uplink_active, const char *tag)
 {
 /*
@@ -6985,19 +7027,8 @@ struct work_queue_task *work_queue_wait_internal(struct work_queue *q, int timeo
 		// task completed?
 		if (t == NULL)
 		{
-			if(tag) {
-				t = task_state_any_with_tag(q, WORK_QUEUE_TASK_RETRIEVED, tag);
-			} else {
-				t = task_state_any(q, WORK_QUEUE_TASK_RETRIEVED);
-			}
+			t = find_task_to_return(q, tag);
 			if(t) {
-				change_task_state(q, t, WORK_QUEUE_TASK_DONE);
-
-				if( t->result != WORK_QUEUE_RESULT_SUCCESS )
-				{
-					q->stats->tasks_failed++;
-				}
-
 				// return completed task (t) to the user. We do not return right
 				// away, and instead break out of the loop to correctly update the
 				// queue time statistics.
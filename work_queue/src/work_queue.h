@@ -826,6 +826,15 @@ Similar to @ref work_queue_wait, but guarantees that the returned task has the s
 */
 struct work_queue_task *work_queue_wait_for_tag(struct work_queue *q, const char *tag, int timeout);
 
+/** Return a task which has already completed, without waiting.
+Unlike @ref work_queue_wait with a timeout of zero, this call does not communicate
+with the workers, and so returns immediately.  It is useful for collecting
+all of the tasks that completed during a previous call to @ref work_queue_wait.
+@param q A work queue object.
+@returns A completed task description, or null if no task has completed.
+*/
+struct work_queue_task *work_queue_no_wait(struct work_queue *q);
+
 /** Determine whether the queue is 'hungry' for more tasks.
 While the Work Queue can handle a very large number of tasks,
 it runs most efficiently when the number of tasks is slightly
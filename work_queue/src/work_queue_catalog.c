@@ -8,6 +8,7 @@ See the file COPYING for details.
 
 #include "catalog_query.h"
 #include "jx.h"
+#include "jx_parse.h"
 #include "list.h"
 #include "debug.h"
 #include "stringtools.h"
@@ -57,13 +58,17 @@ struct list * work_queue_catalog_query( const char *catalog_host, int catalog_po
 	time_t stoptime = time(0) + 60;
 	struct catalog_query *q;
 
+	// Let the server discard records of other types.
+	struct jx *jexpr = jx_parse_string("type==\"wq_master\" || type==\"wq_manager\"");
+
 	if(catalog_port > 0) {
 		sprintf(hostport, "%s:%d", catalog_host, catalog_port);
-		q = catalog_query_create(hostport, 0, stoptime);
+		q = catalog_query_create(hostport, jexpr, stoptime);
 	} else {
-		q = catalog_query_create(catalog_host, 0, stoptime);
+		q = catalog_query_create(catalog_host, jexpr, stoptime);
 	}
 	if(!q) {
+		jx_delete(jexpr);
 		debug(D_NOTICE,"unable to contact catalog server at %s:%d\n", catalog_host, catalog_port);
 		return 0;
 	}